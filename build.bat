@@ -33,4 +33,23 @@ if ERRORLEVEL 1 (
     exit /b %ERRORLEVEL%
 )
 
+set "dependency_cache_exe=%~dp0scripts\bin\dependency_cache.exe"
+set "shader_library=%~dp0build\shaders\shaders.lib"
+set "assets=%~dp0build\assets.pak"
+set "assets_dependencies=%~dp0build\assets.deps"
+rem The packer source and the headers it includes decide the archive format
+set "packer_source=%~dp0scripts\src\pack_archive.cpp"
+"%dependency_cache_exe%" check "%assets_dependencies%" "" -o "%assets%" -I "%~dp0src\shared" "%shader_library%" "%packer_source%"
+if ERRORLEVEL 2 (
+    echo Unable to check asset dependencies.
+    exit /b 1
+) else if ERRORLEVEL 1 (
+    "%~dp0scripts\bin\pack_archive.exe" "%assets%" "shaders.lib=%shader_library%"
+    if ERRORLEVEL 1 (
+        echo Unable to pack assets %ERRORLEVEL%.
+        exit /b %ERRORLEVEL%
+    )
+    "%dependency_cache_exe%" update "%assets_dependencies%" "" -o "%assets%" -I "%~dp0src\shared" "%shader_library%" "%packer_source%"
+)
+
 endlocal
\ No newline at end of file
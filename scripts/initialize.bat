@@ -1,13 +1,45 @@
 @echo off
 
-set "modification_date_exe=%~dp0bin\modification_date.exe"
-set "modification_date_src=%~dp0src\modification_date.c"
+set "tools_flags=/EHsc /std:c++17 /O2 /D NOMINMAX"
+set "tools_include=%~dp0..\src\shared"
+set "dependency_cache_exe=%~dp0bin\dependency_cache.exe"
+set "dependency_cache_src=%~dp0src\dependency_cache.cpp"
+set "shader_library_exe=%~dp0bin\shader_library.exe"
+set "shader_library_src=%~dp0src\shader_library.cpp"
+set "pack_archive_exe=%~dp0bin\pack_archive.exe"
+set "pack_archive_src=%~dp0src\pack_archive.cpp"
 
 if not exist "%~dp0bin" (
     mkdir "%~dp0bin"
 )
 
-if not exist "%modification_date_exe%" (
-    cl /EHsc "/Fe%modification_date_exe%" "%modification_date_src%" /Fo"%~dp0modification_date.obj"
-    del "%~dp0modification_date.obj"
+rem Everything else is rebuilt when its sources change, this one only when missing
+if not exist "%dependency_cache_exe%" (
+    cl %tools_flags% /I"%tools_include%" "/Fe%dependency_cache_exe%" "%dependency_cache_src%" /Fo"%~dp0dependency_cache.obj"
+    del "%~dp0dependency_cache.obj"
 )
+
+call :BUILD_TOOL shader_library "%shader_library_exe%" "%shader_library_src%"
+if errorlevel 1 (
+    exit /b 1
+)
+call :BUILD_TOOL pack_archive "%pack_archive_exe%" "%pack_archive_src%"
+if errorlevel 1 (
+    exit /b 1
+)
+exit /b 0
+
+:BUILD_TOOL
+"%dependency_cache_exe%" check "%~dp0bin\%~1.deps" "%tools_flags%" -o "%~2" -I "%tools_include%" "%~3"
+if errorlevel 2 (
+    exit /b 1
+)
+if errorlevel 1 (
+    cl %tools_flags% /I"%tools_include%" "/Fe%~2" "%~3" /Fo"%~dp0%~1.obj"
+    if errorlevel 1 (
+        exit /b 1
+    )
+    del "%~dp0%~1.obj"
+    "%dependency_cache_exe%" update "%~dp0bin\%~1.deps" "%tools_flags%" -o "%~2" -I "%tools_include%" "%~3"
+)
+exit /b 0
@@ -0,0 +1,148 @@
+// Linux benchmark of open-to-first-byte latency, loose files versus the
+// same files packed into an Archive. Cold runs evict the page cache with
+// posix_fadvise before every round, warm runs read what is already cached.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/pack_archive.cpp -o pack_archive
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/archive_benchmark.cpp -o archive_benchmark
+//     ./pack_archive assets.pak a=loose/a.bin b=loose/b.bin ...
+//     ./archive_benchmark assets.pak 20 a=loose/a.bin b=loose/b.bin ...
+//
+// Usage: archive_benchmark archive_file rounds name=path ...
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Archive.h"
+
+struct LooseFile
+{
+    std::string name;
+    std::string path;
+};
+
+static void evict(const char* path)
+{
+    const int file = open(path, O_RDONLY);
+    if (file >= 0)
+    {
+        fdatasync(file);
+        posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+        close(file);
+    }
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Microseconds from open to the first byte of every file
+static double looseRound(const std::vector<LooseFile>& files, uint64_t* checksum)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (const LooseFile& loose : files)
+    {
+        const int file = open(loose.path.c_str(), O_RDONLY);
+        uint8_t byte = 0;
+        if (file < 0 || read(file, &byte, 1) != 1)
+        {
+            fprintf(stderr, "Unable to read %s\n", loose.path.c_str());
+            exit(1);
+        }
+        *checksum += byte;
+        close(file);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static double archiveRound(const char* path, const std::vector<LooseFile>& files, uint64_t* checksum)
+{
+    const auto start = std::chrono::steady_clock::now();
+    Archive archive;
+    if (!archive.Open(path))
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        exit(1);
+    }
+    std::vector<uint8_t> expanded;
+    for (const LooseFile& loose : files)
+    {
+        const uint32_t entry = archive.Find(loose.name.c_str());
+        if (entry == Archive::NOT_FOUND)
+        {
+            fprintf(stderr, "%s is not in %s\n", loose.name.c_str(), path);
+            exit(1);
+        }
+        if (archive.IsCompressed(entry))
+        {
+            expanded.resize(archive.Size(entry));
+            archive.Read(entry, expanded.data());
+            *checksum += expanded.empty() ? 0 : expanded[0];
+        } else {
+            const ArchiveSpan span = archive.Span(entry);
+            *checksum += span.size ? static_cast<const uint8_t*>(span.data)[0] : 0;
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s archive_file rounds name=path ...\n", argv[0]);
+        return 1;
+    }
+    const char* archivePath = argv[1];
+    const int rounds = std::max(1, atoi(argv[2]));
+    std::vector<LooseFile> files;
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t separator = argument.find('=');
+        if (separator == std::string::npos)
+        {
+            fprintf(stderr, "Expected name=path, got %s\n", argv[i]);
+            return 1;
+        }
+        files.push_back({ argument.substr(0, separator), argument.substr(separator + 1) });
+    }
+
+    uint64_t checksum = 0;
+    for (const bool cold : { true, false })
+    {
+        std::vector<double> loose;
+        std::vector<double> packed;
+        for (int round = 0; round < rounds; ++round)
+        {
+            if (cold)
+            {
+                for (const LooseFile& file : files)
+                {
+                    evict(file.path.c_str());
+                }
+                evict(archivePath);
+            }
+            loose.push_back(looseRound(files, &checksum));
+            if (cold)
+            {
+                evict(archivePath);
+            }
+            packed.push_back(archiveRound(archivePath, files, &checksum));
+        }
+        printf("%s, %zu files, median of %d rounds:\n", cold ? "Cold" : "Warm", files.size(), rounds);
+        printf("    loose files %10.1f us total %8.2f us per file\n", median(loose), median(loose) / files.size());
+        printf("    archive     %10.1f us total %8.2f us per file\n", median(packed), median(packed) / files.size());
+    }
+    printf("Checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
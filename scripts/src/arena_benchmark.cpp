@@ -0,0 +1,148 @@
+// Linux benchmark of per-tick scratch memory: every tick the JobSystem
+// workers make many small short lived allocations, once from the general
+// heap and once from WorkerArenas carved out of a tick Arena. Reports the
+// time per tick and, built with -DHEAP_ALLOCATION_CHECKS, what the
+// NO_HEAP_ALLOCATIONS scope around each tick saw on the calling thread.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared scripts/src/arena_benchmark.cpp -o arena_benchmark
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared -DHEAP_ALLOCATION_CHECKS scripts/src/arena_benchmark.cpp -o arena_benchmark_checked
+//     ./arena_benchmark 200 20000 1 2 4
+//
+// Usage: arena_benchmark ticks allocations_per_tick worker_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "Arena.h"
+#include "EventLoop.h"
+#include "HeapCheck.h"
+#include "Jobs.h"
+
+static constexpr uint32_t BATCH_SIZE = 256;
+static constexpr size_t TICK_ARENA_CAPACITY = 64 << 20;
+
+// Sizes of a typical scratch workload, mostly small with a few larger arrays
+static uint32_t allocationSize(uint32_t index)
+{
+    const uint32_t hash = index * 2654435761u;
+    return hash % 16 == 0 ? 1024 + hash % 4096 : 16 + hash % 240;
+}
+
+// Touches the memory so neither variant gets away with not using it
+static uint64_t use(uint8_t* memory, uint32_t size)
+{
+    memset(memory, static_cast<int>(size), size);
+    return memory[size - 1];
+}
+
+static uint64_t heapTick(JobSystem* jobs, uint32_t allocationCount, std::atomic<uint64_t>* checksum)
+{
+    const uint64_t start = EventLoop::Now();
+    NO_HEAP_ALLOCATIONS("heap tick");
+    jobs->ParallelFor(allocationCount, BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        uint64_t sum = 0;
+        std::vector<uint8_t*> live;
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            const uint32_t size = allocationSize(index);
+            live.push_back(new uint8_t[size]);
+            sum += use(live.back(), size);
+        }
+        for (uint8_t* memory : live)
+        {
+            delete[] memory;
+        }
+        checksum->fetch_add(sum, std::memory_order_relaxed);
+    });
+    return EventLoop::Now() - start;
+}
+
+static uint64_t arenaTick(JobSystem* jobs, Arena* tickArena, WorkerArenas* workerArenas, uint32_t allocationCount, std::atomic<uint64_t>* checksum)
+{
+    const uint64_t start = EventLoop::Now();
+    NO_HEAP_ALLOCATIONS("arena tick");
+    tickArena->Reset();
+    if (!workerArenas->Carve(tickArena, jobs->WorkerCount(), tickArena->Capacity() / jobs->WorkerCount() - Arena::CACHE_LINE))
+    {
+        fprintf(stderr, "Unable to carve the worker arenas\n");
+        exit(1);
+    }
+    jobs->ParallelFor(allocationCount, BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t workerIndex)
+    {
+        Arena& arena = (*workerArenas)[workerIndex];
+        // Freed together at the end of the batch, like the heap variant
+        ArenaScope scope(&arena);
+        uint64_t sum = 0;
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            const uint32_t size = allocationSize(index);
+            uint8_t* memory = arena.AllocateArray<uint8_t>(size);
+            if (!memory)
+            {
+                fprintf(stderr, "Worker arena %u is full\n", workerIndex);
+                exit(1);
+            }
+            sum += use(memory, size);
+        }
+        checksum->fetch_add(sum, std::memory_order_relaxed);
+    });
+    return EventLoop::Now() - start;
+}
+
+static double median(std::vector<uint64_t> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s ticks allocations_per_tick worker_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t tickCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    const uint32_t allocationCount = static_cast<uint32_t>(std::max(atoi(argv[2]), 1));
+    printf("%8s %14s %14s %10s %12s\n", "workers", "heap us/tick", "arena us/tick", "speedup", "arena peak");
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        const uint32_t workerCount = static_cast<uint32_t>(std::min(std::max(atoi(argv[argument]), 1), static_cast<int>(WorkerArenas::MAX_WORKERS)));
+        JobSystem jobs;
+        jobs.Initialize(workerCount);
+        Arena tickArena(TICK_ARENA_CAPACITY);
+        WorkerArenas workerArenas;
+        std::atomic<uint64_t> heapChecksum{0};
+        std::atomic<uint64_t> arenaChecksum{0};
+        std::vector<uint64_t> heapTimes;
+        std::vector<uint64_t> arenaTimes;
+        for (uint32_t tick = 0; tick < tickCount; ++tick)
+        {
+            heapTimes.push_back(heapTick(&jobs, allocationCount, &heapChecksum));
+            arenaTimes.push_back(arenaTick(&jobs, &tickArena, &workerArenas, allocationCount, &arenaChecksum));
+        }
+        if (heapChecksum != arenaChecksum)
+        {
+            fprintf(stderr, "The variants did different work\n");
+            return 1;
+        }
+        size_t peak = 0;
+        for (uint32_t worker = 0; worker < workerArenas.WorkerCount(); ++worker)
+        {
+            peak = std::max(peak, workerArenas[worker].PeakUsed());
+        }
+        printf("%8u %14.1f %14.1f %9.2fx %9zu KB\n",
+            workerCount,
+            median(heapTimes),
+            median(arenaTimes),
+            median(heapTimes) / std::max(median(arenaTimes), 0.001),
+            peak / 1024
+        );
+    }
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Linux benchmark of Broadphase. For every object count, boxes of mixed
+// sizes, a few of them many cells large, move through a cube at constant
+// density and every tick all of them are moved and the overlapping pairs
+// found, on all workers and on one. Reports nanoseconds per object, so near linear scaling shows as flat
+// columns. Up to BRUTE_FORCE_LIMIT objects the pairs, with all objects
+// active and with every third one, are checked against testing every
+// pair, whose time is reported next to them, and once more with a scratch
+// arena too small for them, so they come from the heap fallback. Pairs are
+// found with a scratch arena as large as the game's tick arena. Radius,
+// box and ray queries are checked against a linear scan at every count,
+// also after removing some of the objects.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared scripts/src/broadphase_benchmark.cpp -o broadphase_benchmark
+//     ./broadphase_benchmark 20 0 10000 100000 1000000
+//
+// Usage: broadphase_benchmark ticks worker_count object_count ...
+// A worker_count of 0 uses one per hardware thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "Arena.h"
+#include "Broadphase.h"
+#include "EventLoop.h"
+#include "Jobs.h"
+
+static constexpr float CELL_SIZE = 1.0f;
+// Objects per cubic unit
+static constexpr float DENSITY = 0.2f;
+static constexpr float MAX_HALF_EXTENT = 0.5f;
+// The first objects are the size of floors and walls
+static constexpr uint32_t LARGE_OBJECT_COUNT = 4;
+static constexpr float LARGE_HALF_EXTENT = 8.0f;
+static constexpr float MAX_SPEED = 0.2f;
+static constexpr uint32_t BRUTE_FORCE_LIMIT = 20000;
+// Like Game::TICK_ARENA_CAPACITY, and too small to hold any job's pairs
+static constexpr size_t SCRATCH_CAPACITY = 1 << 20;
+static constexpr size_t SMALL_SCRATCH_CAPACITY = 1024;
+static constexpr uint32_t QUERY_COUNT = 200;
+// Of the objects, before the second round of query checks
+static constexpr uint32_t REMOVED_PERCENT = 5;
+
+struct Objects
+{
+    std::vector<float> center[3];
+    std::vector<float> half[3];
+    std::vector<float> velocity[3];
+
+    uint32_t Count() const { return static_cast<uint32_t>(center[0].size()); }
+
+    bool Overlaps(uint32_t a, uint32_t b) const
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (fabsf(center[axis][a] - center[axis][b]) > half[axis][a] + half[axis][b])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static bool fail(uint32_t objectCount, const char* message)
+{
+    fprintf(stderr, "%u objects: %s\n", objectCount, message);
+    return false;
+}
+
+static bool samePairs(const std::vector<BroadphasePair>& left, const std::vector<BroadphasePair>& right)
+{
+    return left.size() == right.size() && std::equal(left.begin(), left.end(), right.begin(),
+        [](const BroadphasePair& a, const BroadphasePair& b) { return a.a == b.a && a.b == b.b; });
+}
+
+template<typename IsActive>
+static void bruteForcePairs(const Objects& objects, const IsActive& isActive, std::vector<BroadphasePair>* pairs)
+{
+    pairs->clear();
+    for (uint32_t a = 0; a < objects.Count(); ++a)
+    {
+        if (!isActive(a))
+        {
+            continue;
+        }
+        for (uint32_t b = 0; b < objects.Count(); ++b)
+        {
+            if (b != a && !(b < a && isActive(b)) && objects.Overlaps(a, b))
+            {
+                pairs->push_back({ a, b });
+            }
+        }
+    }
+}
+
+static void move(Objects* objects, float side)
+{
+    for (uint32_t object = 0; object < objects->Count(); ++object)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float& position = objects->center[axis][object];
+            float& velocity = objects->velocity[axis][object];
+            position += velocity;
+            if (position < 0.0f || position > side)
+            {
+                velocity = -velocity;
+                position = std::min(std::max(position, 0.0f), side);
+            }
+        }
+    }
+}
+
+static void remove(Objects* objects, Broadphase* broadphase, uint32_t object)
+{
+    broadphase->Remove(object);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (std::vector<float>* values : { &objects->center[axis], &objects->half[axis], &objects->velocity[axis] })
+        {
+            (*values)[object] = values->back();
+            values->pop_back();
+        }
+    }
+}
+
+// Returns the time of QUERY_COUNT queries of each kind in nanoseconds
+static bool checkQueries(const Objects& objects, const Broadphase& broadphase, float side, std::mt19937* random, uint64_t times[3])
+{
+    const uint32_t objectCount = objects.Count();
+    std::uniform_real_distribution<float> position(-1.0f, side + 1.0f);
+    std::uniform_real_distribution<float> size(0.0f, 3.0f);
+    std::vector<uint32_t> found;
+    std::vector<uint32_t> expected;
+    times[0] = times[1] = times[2] = 0;
+    for (uint32_t query = 0; query < QUERY_COUNT; ++query)
+    {
+        const float center[3] = { position(*random), position(*random), position(*random) };
+        const float radius = size(*random);
+        uint64_t start = EventLoop::Now();
+        broadphase.QueryRadius(center[0], center[1], center[2], radius, &found);
+        times[0] += EventLoop::Now() - start;
+        expected.clear();
+        for (uint32_t object = 0; object < objectCount; ++object)
+        {
+            float distanceSquared = 0.0f;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float outside = std::max(fabsf(center[axis] - objects.center[axis][object]) - objects.half[axis][object], 0.0f);
+                distanceSquared += outside * outside;
+            }
+            if (distanceSquared <= radius * radius)
+            {
+                expected.push_back(object);
+            }
+        }
+        if (found != expected)
+        {
+            return fail(objectCount, "a radius query differs from the linear scan");
+        }
+
+        const float half[3] = { size(*random), size(*random), size(*random) };
+        start = EventLoop::Now();
+        broadphase.QueryBox(center[0], center[1], center[2], half[0], half[1], half[2], &found);
+        times[1] += EventLoop::Now() - start;
+        expected.clear();
+        for (uint32_t object = 0; object < objectCount; ++object)
+        {
+            bool isOverlapping = true;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                isOverlapping = isOverlapping && fabsf(center[axis] - objects.center[axis][object]) <= half[axis] + objects.half[axis][object];
+            }
+            if (isOverlapping)
+            {
+                expected.push_back(object);
+            }
+        }
+        if (found != expected)
+        {
+            return fail(objectCount, "a box query differs from the linear scan");
+        }
+
+        // From outside the cube through it, some along an axis
+        float direction[3] = { position(*random) - center[0], position(*random) - center[1], position(*random) - center[2] };
+        if (query % 4 == 0)
+        {
+            direction[query / 4 % 3] = 0.0f;
+        }
+        const float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        for (float& component : direction)
+        {
+            component /= length;
+        }
+        const float maxDistance = query % 2 ? INFINITY : side * 0.5f;
+        RayHit hit;
+        start = EventLoop::Now();
+        broadphase.RayCast(center, direction, maxDistance, &hit);
+        times[2] += EventLoop::Now() - start;
+        RayHit closest = { Broadphase::NO_OBJECT, maxDistance };
+        for (uint32_t object = 0; object < objectCount; ++object)
+        {
+            const float objectCenter[3] = { objects.center[0][object], objects.center[1][object], objects.center[2][object] };
+            const float objectHalf[3] = { objects.half[0][object], objects.half[1][object], objects.half[2][object] };
+            const float distance = Broadphase_internal::rayBox(center, direction, objectCenter, objectHalf, closest.distance);
+            if (distance >= 0.0f && (distance < closest.distance || (distance == closest.distance && object < closest.object)))
+            {
+                closest = { object, distance };
+            }
+        }
+        if (hit.object != closest.object)
+        {
+            return fail(objectCount, "a ray cast differs from the linear scan");
+        }
+    }
+    return true;
+}
+
+static bool measure(uint32_t objectCount, uint32_t tickCount, JobSystem* jobs, JobSystem* singleWorker)
+{
+    std::mt19937 random(objectCount);
+    const float side = cbrtf(static_cast<float>(objectCount) / DENSITY);
+    std::uniform_real_distribution<float> position(0.0f, side);
+    std::uniform_real_distribution<float> half(0.05f, MAX_HALF_EXTENT);
+    std::uniform_real_distribution<float> largeHalf(2.0f * CELL_SIZE, LARGE_HALF_EXTENT);
+    std::uniform_real_distribution<float> velocity(-MAX_SPEED, MAX_SPEED);
+    Objects objects;
+    Broadphase broadphase;
+    broadphase.Reset(CELL_SIZE);
+    for (uint32_t object = 0; object < objectCount; ++object)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            objects.center[axis].push_back(position(random));
+            objects.half[axis].push_back(object < LARGE_OBJECT_COUNT ? largeHalf(random) : half(random));
+            objects.velocity[axis].push_back(velocity(random));
+        }
+        broadphase.Add(
+            objects.center[0][object], objects.center[1][object], objects.center[2][object],
+            objects.half[0][object], objects.half[1][object], objects.half[2][object]
+        );
+    }
+
+    Arena scratch(SCRATCH_CAPACITY);
+    std::vector<BroadphasePair> pairs;
+    std::vector<BroadphasePair> singlePairs;
+    uint64_t updateTime = 0;
+    uint64_t pairTime = 0;
+    uint64_t singlePairTime = 0;
+    for (uint32_t tick = 0; tick < tickCount; ++tick)
+    {
+        move(&objects, side);
+        uint64_t start = EventLoop::Now();
+        for (uint32_t object = 0; object < objectCount; ++object)
+        {
+            broadphase.Set(object,
+                objects.center[0][object], objects.center[1][object], objects.center[2][object],
+                objects.half[0][object], objects.half[1][object], objects.half[2][object]
+            );
+        }
+        updateTime += EventLoop::Now() - start;
+        start = EventLoop::Now();
+        broadphase.FindPairs(jobs, &scratch, &pairs);
+        pairTime += EventLoop::Now() - start;
+        start = EventLoop::Now();
+        broadphase.FindPairs(singleWorker, &scratch, &singlePairs);
+        singlePairTime += EventLoop::Now() - start;
+        if (!samePairs(pairs, singlePairs))
+        {
+            return fail(objectCount, "the pairs depend on the worker count");
+        }
+    }
+
+    double bruteForceMilliseconds = -1.0;
+    if (objectCount <= BRUTE_FORCE_LIMIT)
+    {
+        std::vector<BroadphasePair> expected;
+        const uint64_t start = EventLoop::Now();
+        bruteForcePairs(objects, [](uint32_t) { return true; }, &expected);
+        bruteForceMilliseconds = (EventLoop::Now() - start) / 1e6;
+        if (!samePairs(pairs, expected))
+        {
+            return fail(objectCount, "the pairs differ from testing every pair");
+        }
+        const auto everyThird = [](uint32_t object) { return object % 3 == 0; };
+        bruteForcePairs(objects, everyThird, &expected);
+        broadphase.FindPairs(jobs, &scratch, everyThird, &pairs);
+        if (!samePairs(pairs, expected))
+        {
+            return fail(objectCount, "the pairs of active objects differ from testing every pair");
+        }
+        Arena smallScratch(SMALL_SCRATCH_CAPACITY);
+        broadphase.FindPairs(jobs, &smallScratch, everyThird, &pairs);
+        if (!samePairs(pairs, expected))
+        {
+            return fail(objectCount, "the pairs that did not fit the scratch arena differ from testing every pair");
+        }
+    }
+
+    uint64_t queryTimes[3];
+    if (!checkQueries(objects, broadphase, side, &random, queryTimes))
+    {
+        return false;
+    }
+    for (uint32_t removal = 0; removal < objectCount * REMOVED_PERCENT / 100; ++removal)
+    {
+        remove(&objects, &broadphase, random() % objects.Count());
+    }
+    uint64_t unusedTimes[3];
+    if (!checkQueries(objects, broadphase, side, &random, unusedTimes))
+    {
+        return false;
+    }
+
+    const double perObjectTick = static_cast<double>(objectCount) * tickCount;
+    printf("%9u %10.1f %10.1f %10.1f %8.2f",
+        objectCount,
+        updateTime / perObjectTick,
+        pairTime / perObjectTick,
+        singlePairTime / perObjectTick,
+        static_cast<double>(pairs.size()) / objectCount
+    );
+    if (bruteForceMilliseconds >= 0.0)
+    {
+        printf(" %10.2f %10.2f", pairTime / 1e6 / tickCount, bruteForceMilliseconds);
+    } else {
+        printf(" %10.2f %10s", pairTime / 1e6 / tickCount, "-");
+    }
+    printf(" %9.2f %9.2f %9.2f\n", queryTimes[0] / 1e3 / QUERY_COUNT, queryTimes[1] / 1e3 / QUERY_COUNT, queryTimes[2] / 1e3 / QUERY_COUNT);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s ticks worker_count object_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t tickCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    JobSystem jobs;
+    jobs.Initialize(static_cast<uint32_t>(std::max(atoi(argv[2]), 0)));
+    JobSystem singleWorker;
+    singleWorker.Initialize(1);
+
+    printf("%u workers, %u ticks, ns per object and tick\n", jobs.WorkerCount(), tickCount);
+    printf("%9s %10s %10s %10s %8s %10s %10s %9s %9s %9s\n",
+        "objects", "update", "pairs", "1 worker", "pairs/obj", "pairs ms", "brute ms", "radius us", "box us", "ray us");
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), tickCount, &jobs, &singleWorker))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
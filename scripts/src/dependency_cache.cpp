@@ -0,0 +1,380 @@
+// Decides whether a build output is out of date from the content hashes of
+// everything it was built from, and records them after a build.
+//
+// Usage: dependency_cache check|update record_file key [-o output] [-I include_dir]... source...
+//
+// Sources are files or directories, a directory stands for every file
+// below it and for the list of those files. C, C++ and HLSL files are
+// scanned for #include "..." which are resolved next to the including
+// file first, then in the include directories, and followed recursively.
+// The key covers whatever else the output depends on, e.g. compiler flags.
+//
+// check exits with 0 when the output exists and nothing changed, 1 when
+// it has to be rebuilt and 2 on errors. Files are hashed only when their
+// size or modification time differ from the record, so a no-op check is
+// a stat per dependency. update scans and hashes everything, in parallel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Hash.h"
+#include "include_scanner.h"
+
+namespace fs = std::filesystem;
+
+struct Dependency
+{
+    std::string path;
+    bool        isDirectory;
+    uint64_t    hash;
+    uint64_t    size;
+    int64_t     modificationTime;
+};
+
+struct Arguments
+{
+    std::string           command;
+    std::string           recordPath;
+    std::string           key;
+    std::string           outputPath;
+    std::vector<fs::path> includeDirectories;
+    std::vector<fs::path> sources;
+};
+
+static std::string normalized(const fs::path& path)
+{
+    std::error_code error;
+    return fs::absolute(path, error).lexically_normal().generic_string();
+}
+
+static bool readFile(const std::string& path, std::string* data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    data->resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(&(*data)[0], data->size()));
+}
+
+static bool isScanned(const fs::path& path)
+{
+    static const char* const EXTENSIONS[] = { ".c", ".cpp", ".h", ".hpp", ".hlsl", ".hlsli" };
+    const std::string extension = path.extension().string();
+    for (const char* scanned : EXTENSIONS)
+    {
+        if (extension == scanned)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t directoryHash(const fs::path& directory, std::vector<std::string>* files)
+{
+    std::vector<std::string> listing;
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->is_regular_file(error))
+        {
+            listing.push_back(normalized(it->path()));
+        }
+    }
+    std::sort(listing.begin(), listing.end());
+    Hasher hasher;
+    for (const std::string& file : listing)
+    {
+        hasher.AddString(file.c_str()).AddU64(0);
+    }
+    if (files)
+    {
+        files->insert(files->end(), listing.begin(), listing.end());
+    }
+    return hasher.Finish();
+}
+
+static bool fileStatus(const std::string& path, uint64_t* size, int64_t* modificationTime)
+{
+    std::error_code error;
+    *size = fs::file_size(path, error);
+    if (error)
+    {
+        return false;
+    }
+    *modificationTime = static_cast<int64_t>(fs::last_write_time(path, error).time_since_epoch().count());
+    return !error;
+}
+
+template<typename Function>
+static void parallelFor(size_t count, const Function& function)
+{
+    std::atomic<size_t> next{0};
+    const size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), count);
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < threadCount; ++thread)
+    {
+        threads.emplace_back([&]
+        {
+            for (size_t index = next++; index < count; index = next++)
+            {
+                function(index);
+            }
+        });
+    }
+    for (size_t index = next++; index < count; index = next++)
+    {
+        function(index);
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Everything the record depends on besides the files
+static uint64_t keyHash(const Arguments& arguments)
+{
+    Hasher hasher;
+    hasher.AddString(arguments.key.c_str()).AddU64(0);
+    hasher.AddString(arguments.outputPath.c_str()).AddU64(0);
+    for (const fs::path& directory : arguments.includeDirectories)
+    {
+        hasher.AddString(normalized(directory).c_str()).AddU64(1);
+    }
+    for (const fs::path& source : arguments.sources)
+    {
+        hasher.AddString(normalized(source).c_str()).AddU64(2);
+    }
+    return hasher.Finish();
+}
+
+static bool loadRecord(const std::string& path, uint64_t* key, std::vector<Dependency>* dependencies)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string line;
+    if (!std::getline(file, line) || sscanf(line.c_str(), "key %llx", reinterpret_cast<unsigned long long*>(key)) != 1)
+    {
+        return false;
+    }
+    while (std::getline(file, line))
+    {
+        char type[8];
+        unsigned long long hash;
+        unsigned long long size;
+        long long modificationTime;
+        int pathStart = 0;
+        if (sscanf(line.c_str(), "%7s %llx %llu %lld %n", type, &hash, &size, &modificationTime, &pathStart) != 4 || !pathStart)
+        {
+            return false;
+        }
+        Dependency dependency;
+        dependency.path = line.substr(pathStart);
+        dependency.isDirectory = strcmp(type, "dir") == 0;
+        dependency.hash = hash;
+        dependency.size = size;
+        dependency.modificationTime = modificationTime;
+        dependencies->push_back(dependency);
+    }
+    return true;
+}
+
+static bool saveRecord(const std::string& path, uint64_t key, const std::vector<Dependency>& dependencies)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "key " << std::hex << key << std::dec << "\n";
+    for (const Dependency& dependency : dependencies)
+    {
+        file << (dependency.isDirectory ? "dir " : "file ")
+            << std::hex << dependency.hash << std::dec << " "
+            << dependency.size << " "
+            << dependency.modificationTime << " "
+            << dependency.path << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+static int check(const Arguments& arguments)
+{
+    uint64_t key = 0;
+    std::vector<Dependency> dependencies;
+    if (!loadRecord(arguments.recordPath, &key, &dependencies) || key != keyHash(arguments))
+    {
+        return 1;
+    }
+    if (!arguments.outputPath.empty() && !fs::exists(arguments.outputPath))
+    {
+        return 1;
+    }
+
+    std::vector<size_t> changed;
+    for (size_t index = 0; index < dependencies.size(); ++index)
+    {
+        Dependency& dependency = dependencies[index];
+        if (dependency.isDirectory)
+        {
+            if (directoryHash(dependency.path, nullptr) != dependency.hash)
+            {
+                return 1;
+            }
+            continue;
+        }
+        uint64_t size;
+        int64_t modificationTime;
+        if (!fileStatus(dependency.path, &size, &modificationTime) || size != dependency.size)
+        {
+            return 1;
+        }
+        if (modificationTime != dependency.modificationTime)
+        {
+            dependency.modificationTime = modificationTime;
+            changed.push_back(index);
+        }
+    }
+    if (changed.empty())
+    {
+        return 0;
+    }
+
+    // Touched files may still have the same content
+    std::atomic<bool> isOutOfDate{false};
+    parallelFor(changed.size(), [&](size_t index)
+    {
+        const Dependency& dependency = dependencies[changed[index]];
+        std::string data;
+        if (!readFile(dependency.path, &data) || HashBytes(data.data(), data.size()) != dependency.hash)
+        {
+            isOutOfDate = true;
+        }
+    });
+    if (isOutOfDate)
+    {
+        return 1;
+    }
+    // Remember the new times so the next check does not hash them again
+    saveRecord(arguments.recordPath, key, dependencies);
+    return 0;
+}
+
+static int update(const Arguments& arguments)
+{
+    std::vector<Dependency> dependencies;
+    std::vector<std::string> frontier;
+    for (const fs::path& source : arguments.sources)
+    {
+        if (fs::is_directory(source))
+        {
+            Dependency directory = {};
+            directory.path = normalized(source);
+            directory.isDirectory = true;
+            directory.hash = directoryHash(source, &frontier);
+            dependencies.push_back(directory);
+        } else {
+            frontier.push_back(normalized(source));
+        }
+    }
+
+    std::set<std::string> seen;
+    std::atomic<bool> hasFailed{false};
+    while (!frontier.empty())
+    {
+        std::vector<std::string> files;
+        for (const std::string& file : frontier)
+        {
+            if (seen.insert(file).second)
+            {
+                files.push_back(file);
+            }
+        }
+        std::vector<Dependency> scanned(files.size());
+        std::vector<std::vector<std::string>> includes(files.size());
+        parallelFor(files.size(), [&](size_t index)
+        {
+            Dependency& dependency = scanned[index];
+            dependency.path = files[index];
+            dependency.isDirectory = false;
+            std::string data;
+            if (!fileStatus(dependency.path, &dependency.size, &dependency.modificationTime) || !readFile(dependency.path, &data))
+            {
+                fprintf(stderr, "Unable to read %s\n", dependency.path.c_str());
+                hasFailed = true;
+                return;
+            }
+            dependency.hash = HashBytes(data.data(), data.size());
+            if (!isScanned(dependency.path))
+            {
+                return;
+            }
+            for (const std::string& include : QuotedIncludes(data))
+            {
+                const fs::path resolved = ResolveInclude(dependency.path, include, arguments.includeDirectories);
+                if (!resolved.empty())
+                {
+                    includes[index].push_back(normalized(resolved));
+                }
+            }
+        });
+        if (hasFailed)
+        {
+            return 2;
+        }
+        dependencies.insert(dependencies.end(), scanned.begin(), scanned.end());
+        frontier.clear();
+        for (const std::vector<std::string>& fileIncludes : includes)
+        {
+            frontier.insert(frontier.end(), fileIncludes.begin(), fileIncludes.end());
+        }
+    }
+
+    if (!saveRecord(arguments.recordPath, keyHash(arguments), dependencies))
+    {
+        fprintf(stderr, "Unable to write %s\n", arguments.recordPath.c_str());
+        return 2;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+    {
+        fprintf(stderr, "Usage: %s check|update record_file key [-o output] [-I include_dir]... source...\n", argv[0]);
+        return 2;
+    }
+    Arguments arguments;
+    arguments.command = argv[1];
+    arguments.recordPath = argv[2];
+    arguments.key = argv[3];
+    for (int i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            arguments.outputPath = argv[++i];
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            arguments.includeDirectories.push_back(argv[++i]);
+        } else {
+            arguments.sources.push_back(argv[i]);
+        }
+    }
+
+    if (arguments.command == "check")
+    {
+        return check(arguments);
+    } else if (arguments.command == "update") {
+        return update(arguments);
+    }
+    fprintf(stderr, "Unknown command %s\n", arguments.command.c_str());
+    return 2;
+}
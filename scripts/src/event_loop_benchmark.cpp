@@ -0,0 +1,163 @@
+// Linux benchmark of the EventLoop: runs a 60 Hz tick loop, once busy
+// spinning like the old main loop and once per spin budget given through
+// the EventLoop, with a second thread signaling an eventfd now and then
+// the way a fence completion would. Reports the CPU time the loop thread
+// used and how late ticks were.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared scripts/src/event_loop_benchmark.cpp -o event_loop_benchmark
+//     ./event_loop_benchmark 5 0 200 1000 2000
+//
+// Usage: event_loop_benchmark seconds spin_us ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+
+static constexpr uint64_t TICK_NANOSECONDS = 1000000000ull / 60;
+// Off the tick grid, so signals and deadlines do not coincide
+static constexpr uint64_t SIGNAL_NANOSECONDS = 7000000;
+
+struct Measurement
+{
+    double                cpuMilliseconds;
+    std::vector<uint64_t> lateness;
+    uint64_t              signals;
+};
+
+static double threadCpuMilliseconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static void clearSignal(int signal)
+{
+    uint64_t count;
+    (void)!read(signal, &count, sizeof(count));
+}
+
+// The old main loop, checks the clock and the source over and over
+static Measurement spin(uint64_t seconds, int signal)
+{
+    Measurement measurement = {};
+    const double cpuStart = threadCpuMilliseconds();
+    const uint64_t end = EventLoop::Now() + seconds * 1000000000ull;
+    uint64_t nextTick = EventLoop::Now() + TICK_NANOSECONDS;
+    for (uint64_t now = EventLoop::Now(); now < end; now = EventLoop::Now())
+    {
+        if (now >= nextTick)
+        {
+            measurement.lateness.push_back(now - nextTick);
+            nextTick += TICK_NANOSECONDS;
+        }
+        uint64_t count;
+        if (read(signal, &count, sizeof(count)) == sizeof(count))
+        {
+            ++measurement.signals;
+        }
+    }
+    measurement.cpuMilliseconds = threadCpuMilliseconds() - cpuStart;
+    return measurement;
+}
+
+static Measurement wait(uint64_t seconds, uint64_t spinNanoseconds, int signal)
+{
+    Measurement measurement = {};
+    EventLoop::Config config;
+    config.spinNanoseconds = spinNanoseconds;
+    EventLoop eventLoop;
+    if (!eventLoop.Initialize(config))
+    {
+        fprintf(stderr, "Unable to create the event loop\n");
+        exit(1);
+    }
+    const uint32_t signalSource = eventLoop.AddSource(signal);
+
+    const double cpuStart = threadCpuMilliseconds();
+    const uint64_t end = EventLoop::Now() + seconds * 1000000000ull;
+    uint64_t nextTick = EventLoop::Now() + TICK_NANOSECONDS;
+    while (nextTick < end)
+    {
+        const EventLoop::Result result = eventLoop.Wait(nextTick);
+        if (result.wake == EventLoop::Wake::Source && result.source == signalSource)
+        {
+            clearSignal(signal);
+            ++measurement.signals;
+            continue;
+        }
+        measurement.lateness.push_back(EventLoop::Now() - nextTick);
+        nextTick += TICK_NANOSECONDS;
+    }
+    measurement.cpuMilliseconds = threadCpuMilliseconds() - cpuStart;
+    return measurement;
+}
+
+static void report(const char* name, uint64_t seconds, Measurement measurement)
+{
+    std::vector<uint64_t>& lateness = measurement.lateness;
+    std::sort(lateness.begin(), lateness.end());
+    double sum = 0.0;
+    for (uint64_t value : lateness)
+    {
+        sum += static_cast<double>(value);
+    }
+    const size_t count = std::max<size_t>(lateness.size(), 1);
+    printf("%-12s cpu %6.2f%%  ticks %5zu  signals %5llu  late us: mean %7.1f  p99 %7.1f  max %7.1f\n",
+        name,
+        100.0 * measurement.cpuMilliseconds / (seconds * 1000.0),
+        lateness.size(),
+        static_cast<unsigned long long>(measurement.signals),
+        sum / count / 1000.0,
+        lateness.empty() ? 0.0 : lateness[std::min(lateness.size() - 1, lateness.size() * 99 / 100)] / 1000.0,
+        lateness.empty() ? 0.0 : lateness.back() / 1000.0
+    );
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s seconds spin_us ...\n", argv[0]);
+        return 1;
+    }
+    const uint64_t seconds = static_cast<uint64_t>(atoi(argv[1]));
+    const int signal = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signal < 0)
+    {
+        fprintf(stderr, "Unable to create an eventfd\n");
+        return 1;
+    }
+    std::atomic<bool> quit{false};
+    std::thread signaler([&]
+    {
+        while (!quit)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(SIGNAL_NANOSECONDS));
+            const uint64_t one = 1;
+            (void)!write(signal, &one, sizeof(one));
+        }
+    });
+
+    report("busy spin", seconds, spin(seconds, signal));
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "spin %d us", atoi(argv[argument]));
+        clearSignal(signal);
+        report(name, seconds, wait(seconds, static_cast<uint64_t>(atoi(argv[argument])) * 1000, signal));
+    }
+
+    quit = true;
+    signaler.join();
+    close(signal);
+    return 0;
+}
@@ -0,0 +1,242 @@
+// Linux stress test and benchmark of HandlePool. For every object count it
+// churns the pool with random creates and destroys against a plain model,
+// checking every live handle finds its object and every destroyed one is
+// rejected, and round trips the pool through a snapshot. Then it times
+// create, destroy and lookups, and a pass updating every object, once over
+// the pool's dense array and once through shared pointers allocated in
+// random order, the way refcounted resources end up.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/handle_pool_benchmark.cpp -o handle_pool_benchmark
+//     ./handle_pool_benchmark 1000000 1000 100000 1000000
+//
+// Usage: handle_pool_benchmark churn_operations object_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "EventLoop.h"
+#include "HandlePool.h"
+#include "Snapshot.h"
+
+// Sized like a small component, position and velocity
+struct Object
+{
+    float    position[3];
+    float    velocity[3];
+    uint32_t id;
+};
+
+static uint64_t key(Handle<Object> handle)
+{
+    return (static_cast<uint64_t>(handle.generation) << 32) | handle.index;
+}
+
+static bool fail(uint32_t objectCount, const char* message)
+{
+    fprintf(stderr, "%u objects: %s\n", objectCount, message);
+    return false;
+}
+
+static bool stress(uint32_t objectCount, uint32_t operationCount)
+{
+    std::mt19937 random(objectCount);
+    HandlePool<Object> pool;
+    // Live handles and the id each was created with
+    std::vector<Handle<Object>> live;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::vector<Handle<Object>> destroyed;
+    uint32_t nextId = 0;
+    for (uint32_t operation = 0; operation < operationCount; ++operation)
+    {
+        // Hovers around objectCount
+        const bool isCreate = live.empty() || (live.size() < objectCount ? random() % 3 != 0 : random() % 3 == 0);
+        if (isCreate)
+        {
+            const Handle<Object> handle = pool.Create(Object{ {}, {}, nextId });
+            if (ids.count(key(handle)))
+            {
+                return fail(objectCount, "a new handle equals a live one");
+            }
+            ids[key(handle)] = nextId++;
+            live.push_back(handle);
+        } else {
+            const size_t victim = random() % live.size();
+            const Handle<Object> handle = live[victim];
+            if (!pool.Destroy(handle) || pool.Destroy(handle))
+            {
+                return fail(objectCount, "destroy did not take exactly once");
+            }
+            ids.erase(key(handle));
+            live[victim] = live.back();
+            live.pop_back();
+            destroyed.push_back(handle);
+        }
+        if (operation % 1024 == 0 && !destroyed.empty())
+        {
+            const Handle<Object> stale = destroyed[random() % destroyed.size()];
+            if (pool.Get(stale) && !ids.count(key(stale)))
+            {
+                return fail(objectCount, "a destroyed handle still finds an object");
+            }
+        }
+    }
+    if (pool.Size() != live.size() || pool.Get(Handle<Object>()))
+    {
+        return fail(objectCount, "the pool does not hold what the model does");
+    }
+    for (const Handle<Object>& handle : live)
+    {
+        const Object* object = pool.Get(handle);
+        if (!object || object->id != ids[key(handle)])
+        {
+            return fail(objectCount, "a live handle does not find its object");
+        }
+    }
+    for (uint32_t index = 0; index < pool.Size(); ++index)
+    {
+        if (pool.Get(pool.HandleAt(index)) != pool.Data() + index)
+        {
+            return fail(objectCount, "dense index and handle disagree");
+        }
+    }
+
+    Snapshot snapshot;
+    pool.Save(&snapshot);
+    HandlePool<Object> restored;
+    SnapshotReader reader(snapshot);
+    if (!restored.Restore(&reader) || !reader.IsAtEnd())
+    {
+        return fail(objectCount, "the snapshot does not restore");
+    }
+    for (const Handle<Object>& handle : live)
+    {
+        if (!restored.Get(handle) || restored.Get(handle)->id != ids[key(handle)])
+        {
+            return fail(objectCount, "a handle does not survive the snapshot");
+        }
+    }
+    const Handle<Object> afterRestore = restored.Create(Object{ {}, {}, nextId });
+    if (ids.count(key(afterRestore)))
+    {
+        return fail(objectCount, "the restored pool reuses a live handle");
+    }
+    return true;
+}
+
+static void update(Object* object)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        object->position[axis] += object->velocity[axis] * (1.0f / 60.0f);
+    }
+}
+
+static bool measure(uint32_t objectCount, uint32_t operationCount)
+{
+    if (!stress(objectCount, operationCount))
+    {
+        return false;
+    }
+
+    std::mt19937 random(objectCount + 1);
+    HandlePool<Object> pool;
+    std::vector<Handle<Object>> handles;
+    handles.reserve(objectCount);
+
+    uint64_t start = EventLoop::Now();
+    for (uint32_t object = 0; object < objectCount; ++object)
+    {
+        handles.push_back(pool.Create(Object{ {}, { 1.0f, 2.0f, 3.0f }, object }));
+    }
+    const uint64_t createTime = EventLoop::Now() - start;
+
+    std::vector<Handle<Object>> shuffled = handles;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+    start = EventLoop::Now();
+    uint64_t idSum = 0;
+    for (const Handle<Object>& handle : shuffled)
+    {
+        idSum += pool.Get(handle)->id;
+    }
+    const uint64_t getTime = EventLoop::Now() - start;
+
+    start = EventLoop::Now();
+    for (uint32_t object = 0; object < pool.Size(); ++object)
+    {
+        update(pool.Data() + object);
+    }
+    const uint64_t denseTime = EventLoop::Now() - start;
+
+    // The same objects behind refcounted pointers, allocated interleaved
+    // with other allocations so they do not end up next to each other
+    std::vector<std::shared_ptr<Object>> pointers(objectCount);
+    std::vector<std::unique_ptr<uint8_t[]>> clutter(objectCount);
+    std::vector<uint32_t> order(objectCount);
+    for (uint32_t object = 0; object < objectCount; ++object)
+    {
+        order[object] = object;
+    }
+    std::shuffle(order.begin(), order.end(), random);
+    for (uint32_t object : order)
+    {
+        pointers[object] = std::make_shared<Object>(Object{ {}, { 1.0f, 2.0f, 3.0f }, object });
+        clutter[object].reset(new uint8_t[16 + random() % 256]);
+    }
+    start = EventLoop::Now();
+    for (const std::shared_ptr<Object>& pointer : pointers)
+    {
+        update(pointer.get());
+    }
+    const uint64_t pointerTime = EventLoop::Now() - start;
+
+    start = EventLoop::Now();
+    for (const Handle<Object>& handle : shuffled)
+    {
+        pool.Destroy(handle);
+    }
+    const uint64_t destroyTime = EventLoop::Now() - start;
+
+    float check = 0.0f;
+    for (const std::shared_ptr<Object>& pointer : pointers)
+    {
+        check += pointer->position[0];
+    }
+    if (pool.Size() || idSum != static_cast<uint64_t>(objectCount) * (objectCount - 1) / 2 || check <= 0.0f)
+    {
+        return fail(objectCount, "the timed passes did different work");
+    }
+    printf("%10u %10.1f %10.1f %10.1f %10.2f %10.2f %8.2fx\n",
+        objectCount,
+        static_cast<double>(createTime) / objectCount,
+        static_cast<double>(destroyTime) / objectCount,
+        static_cast<double>(getTime) / objectCount,
+        static_cast<double>(denseTime) / objectCount,
+        static_cast<double>(pointerTime) / objectCount,
+        static_cast<double>(pointerTime) / std::max<uint64_t>(denseTime, 1)
+    );
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s churn_operations object_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t operationCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    printf("%10s %10s %10s %10s %10s %10s %9s\n", "objects", "create ns", "destroy ns", "get ns", "dense ns", "shared ns", "speedup");
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), operationCount))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
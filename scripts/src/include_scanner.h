@@ -0,0 +1,73 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// #include "..." lookup shared by the build tools. Angle bracket includes are
+// system and SDK headers and never followed.
+
+// Quoted include names in source order
+std::vector<std::string> QuotedIncludes(const std::string& source);
+
+// Next to the including file first, then the include directories in
+// order. Returns an empty path when nothing matches, the compiler reports
+// those.
+std::filesystem::path ResolveInclude(
+    const std::filesystem::path& includingFile,
+    const std::string& include,
+    const std::vector<std::filesystem::path>& includeDirectories);
+
+std::vector<std::string> QuotedIncludes(const std::string& source)
+{
+    std::vector<std::string> includes;
+    size_t lineStart = 0;
+    while (lineStart < source.size())
+    {
+        size_t lineEnd = source.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+        {
+            lineEnd = source.size();
+        }
+        size_t position = source.find_first_not_of(" \t", lineStart);
+        if (position < lineEnd && source[position] == '#')
+        {
+            position = source.find_first_not_of(" \t", position + 1);
+            if (position < lineEnd && source.compare(position, 7, "include") == 0)
+            {
+                const size_t open = source.find_first_not_of(" \t", position + 7);
+                if (open < lineEnd && source[open] == '"')
+                {
+                    const size_t close = source.find('"', open + 1);
+                    if (close < lineEnd)
+                    {
+                        includes.push_back(source.substr(open + 1, close - open - 1));
+                    }
+                }
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+    return includes;
+}
+
+std::filesystem::path ResolveInclude(
+    const std::filesystem::path& includingFile,
+    const std::string& include,
+    const std::vector<std::filesystem::path>& includeDirectories)
+{
+    std::error_code error;
+    const std::filesystem::path sibling = includingFile.parent_path() / include;
+    if (std::filesystem::is_regular_file(sibling, error))
+    {
+        return sibling;
+    }
+    for (const std::filesystem::path& includeDirectory : includeDirectories)
+    {
+        if (std::filesystem::is_regular_file(includeDirectory / include, error))
+        {
+            return includeDirectory / include;
+        }
+    }
+    return std::filesystem::path();
+}
@@ -0,0 +1,244 @@
+// Replays an input stream through the InputQueue the way the game
+// receives it: a producer thread pushes every event when it is due, the
+// main thread runs 60 Hz ticks on an EventLoop and applies the events
+// older than each tick. Prints a digest of the input state after every
+// tick, equal for every replay of the same stream, and what pushing cost.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared scripts/src/input_replay.cpp -o input_replay
+//     ./input_replay -g 10 1 stream.txt
+//     ./input_replay stream.txt
+//
+// Usage: input_replay [-g seconds seed] stream_file
+//
+// A stream file has one event per line, "microseconds type code x y" with
+// type one of key_down, key_up, mouse_move, mouse_button_down,
+// mouse_button_up or mouse_wheel. -g writes a synthetic stream of a
+// 1000 Hz mouse, typing and scrolling to stream_file first.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Hash.h"
+#include "Input.h"
+
+static constexpr uint64_t TICK_NANOSECONDS = 1000000000ull / 60;
+
+static const char* const TYPE_NAMES[] = {
+    "key_down",
+    "key_up",
+    "mouse_move",
+    "mouse_button_down",
+    "mouse_button_up",
+    "mouse_wheel",
+};
+
+static std::vector<InputEvent> generate(uint32_t seconds, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<InputEvent> events;
+    int32_t x = 400;
+    int32_t y = 300;
+    uint32_t heldKey = 0;
+    for (uint64_t millisecond = 0; millisecond < seconds * 1000ull; ++millisecond)
+    {
+        const uint64_t time = millisecond * 1000000;
+        x = std::min(std::max(x + static_cast<int32_t>(random() % 9) - 4, 0), 799);
+        y = std::min(std::max(y + static_cast<int32_t>(random() % 9) - 4, 0), 599);
+        events.push_back({ time, InputEventType::MouseMove, 0, x, y });
+        if (random() % 80 == 0)
+        {
+            if (heldKey)
+            {
+                events.push_back({ time + 1000, InputEventType::KeyUp, heldKey, 0, 0 });
+                heldKey = 0;
+            } else {
+                heldKey = 'A' + random() % 26;
+                events.push_back({ time + 1000, InputEventType::KeyDown, heldKey, 0, 0 });
+            }
+        }
+        if (random() % 400 == 0)
+        {
+            const uint32_t button = random() % 3;
+            events.push_back({ time + 2000, InputEventType::MouseButtonDown, button, x, y });
+            events.push_back({ time + 2000 + (random() % 200) * 1000000, InputEventType::MouseButtonUp, button, x, y });
+        }
+        if (random() % 250 == 0)
+        {
+            events.push_back({ time + 3000, InputEventType::MouseWheel, 0, 0, random() % 2 ? 120 : -120 });
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& left, const InputEvent& right)
+    {
+        return left.time < right.time;
+    });
+    return events;
+}
+
+static bool writeStream(const char* path, const std::vector<InputEvent>& events)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+    for (const InputEvent& event : events)
+    {
+        fprintf(file, "%llu %s %u %d %d\n",
+            static_cast<unsigned long long>(event.time / 1000),
+            TYPE_NAMES[static_cast<uint32_t>(event.type)],
+            event.code,
+            event.x,
+            event.y
+        );
+    }
+    return fclose(file) == 0;
+}
+
+static bool readStream(const char* path, std::vector<InputEvent>* events)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    unsigned long long microseconds;
+    char type[32];
+    InputEvent event = {};
+    bool isValid = true;
+    while (isValid && fscanf(file, "%llu %31s %u %d %d", &microseconds, type, &event.code, &event.x, &event.y) == 5)
+    {
+        isValid = false;
+        for (uint32_t index = 0; index < sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]); ++index)
+        {
+            if (!strcmp(type, TYPE_NAMES[index]))
+            {
+                event.time = microseconds * 1000;
+                event.type = static_cast<InputEventType>(index);
+                events->push_back(event);
+                isValid = true;
+            }
+        }
+    }
+    isValid = isValid && feof(file);
+    fclose(file);
+    // The queue hands events over in order, the stream has to be too
+    return isValid && std::is_sorted(events->begin(), events->end(), [](const InputEvent& left, const InputEvent& right)
+    {
+        return left.time < right.time;
+    });
+}
+
+int main(int argc, char** argv)
+{
+    const bool isGenerating = argc == 5 && !strcmp(argv[1], "-g");
+    if (argc != 2 && !isGenerating)
+    {
+        fprintf(stderr, "Usage: %s [-g seconds seed] stream_file\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[argc - 1];
+    std::vector<InputEvent> events;
+    if (isGenerating)
+    {
+        events = generate(static_cast<uint32_t>(atoi(argv[2])), static_cast<uint32_t>(atoi(argv[3])));
+        if (!writeStream(path, events))
+        {
+            fprintf(stderr, "Unable to write %s\n", path);
+            return 1;
+        }
+    } else if (!readStream(path, &events)) {
+        fprintf(stderr, "Unable to read %s, or its events are out of order\n", path);
+        return 1;
+    }
+    if (events.empty())
+    {
+        fprintf(stderr, "%s has no events\n", path);
+        return 1;
+    }
+
+    EventLoop eventLoop;
+    EventLoop::Config config;
+    if (!eventLoop.Initialize(config))
+    {
+        fprintf(stderr, "Unable to create the event loop\n");
+        return 1;
+    }
+    // Heap allocated, it is too large for the stack
+    std::unique_ptr<InputQueue> queue(new InputQueue());
+    const uint64_t start = EventLoop::Now();
+    // Every event stamped before it has been pushed
+    std::atomic<uint64_t> pushedUntil{start};
+    uint64_t pushNanoseconds = 0;
+    uint64_t maxPushNanoseconds = 0;
+    uint64_t fullCount = 0;
+
+    // Stands in for the window procedure
+    std::thread producer([&]
+    {
+        for (InputEvent event : events)
+        {
+            event.time += start;
+            pushedUntil.store(event.time, std::memory_order_release);
+            const uint64_t now = EventLoop::Now();
+            if (event.time > now)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(event.time - now));
+            }
+            const uint64_t pushStart = EventLoop::Now();
+            while (!queue->Push(event))
+            {
+                ++fullCount;
+                std::this_thread::yield();
+            }
+            const uint64_t pushTime = EventLoop::Now() - pushStart;
+            pushNanoseconds += pushTime;
+            maxPushNanoseconds = std::max(maxPushNanoseconds, pushTime);
+        }
+        pushedUntil.store(UINT64_MAX, std::memory_order_release);
+    });
+
+    InputState state = {};
+    uint64_t digest = 0;
+    uint64_t tickCount = 0;
+    uint64_t appliedCount = 0;
+    uint64_t maxLateness = 0;
+    const uint64_t lastTick = start + events.back().time + TICK_NANOSECONDS;
+    for (uint64_t tickTime = start + TICK_NANOSECONDS; tickTime <= lastTick; tickTime += TICK_NANOSECONDS)
+    {
+        eventLoop.Wait(tickTime);
+        maxLateness = std::max(maxLateness, EventLoop::Now() - tickTime);
+        // A window procedure stamps events on arrival, the replay stamps
+        // them in advance and has to wait for the ones the producer has
+        // not pushed yet, or they would slip into a later tick
+        while (pushedUntil.load(std::memory_order_acquire) < tickTime)
+        {
+            std::this_thread::yield();
+        }
+        appliedCount += ApplyInput(queue.get(), tickTime, &state);
+        digest = Hasher().AddU64(digest).AddValue(state).Finish();
+        ++tickCount;
+    }
+    producer.join();
+
+    printf("%zu events, %llu applied over %llu ticks, tick late by at most %.1f us\n",
+        events.size(),
+        static_cast<unsigned long long>(appliedCount),
+        static_cast<unsigned long long>(tickCount),
+        maxLateness / 1000.0
+    );
+    printf("push: mean %.0f ns, max %.1f us, %llu retries on a full queue\n",
+        static_cast<double>(pushNanoseconds) / events.size(),
+        maxPushNanoseconds / 1000.0,
+        static_cast<unsigned long long>(fullCount)
+    );
+    printf("state digest %016llx\n", static_cast<unsigned long long>(digest));
+    return appliedCount == events.size() ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+// Linux benchmark of the MatrixBatch kernels: for every batch size, the
+// throughput of ComputeModelViewProjections and ComputeNormalMatrices in
+// matrices per millisecond with the kernels of every SIMD level up to the
+// widest the CPU supports, the best of the given number of repeats. Every
+// level is checked against a scalar computation in double precision.
+//
+// MatrixBatch.h includes DirectXMath, see scripts/src/replay_game.cpp for
+// where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/matrix_batch_benchmark.cpp -o matrix_batch_benchmark
+//     ./matrix_batch_benchmark 20 1000 100000 1000000
+//
+// Usage: matrix_batch_benchmark repeats matrix_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "MatrixBatch.h"
+
+// Relative to the largest element of the reference matrix
+static constexpr double TOLERANCE = 1e-4;
+
+struct Matrices
+{
+    std::vector<DirectX::XMFLOAT4X4> models;
+    DirectX::XMFLOAT4X4              view;
+    DirectX::XMFLOAT4X4              projection;
+    std::vector<DirectX::XMFLOAT4X4> expectedMVPs;
+    std::vector<DirectX::XMFLOAT4X4> expectedNormals;
+};
+
+// Scale, rotation about a random axis and translation, never singular
+static DirectX::XMFLOAT4X4 randomAffine(std::mt19937* random)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    float axis[3] = { unit(*random), unit(*random), unit(*random) + 2.0f };
+    const float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (float& component : axis)
+    {
+        component /= length;
+    }
+    const float angle = unit(*random) * 3.14159265f;
+    const float c = cosf(angle);
+    const float s = sinf(angle);
+    const float scale[3] = { 1.5f + unit(*random), 1.5f + unit(*random), 1.5f + unit(*random) };
+    const float rotation[3][3] = {
+        { c + axis[0] * axis[0] * (1 - c),           axis[0] * axis[1] * (1 - c) + axis[2] * s, axis[0] * axis[2] * (1 - c) - axis[1] * s },
+        { axis[1] * axis[0] * (1 - c) - axis[2] * s, c + axis[1] * axis[1] * (1 - c),           axis[1] * axis[2] * (1 - c) + axis[0] * s },
+        { axis[2] * axis[0] * (1 - c) + axis[1] * s, axis[2] * axis[1] * (1 - c) - axis[0] * s, c + axis[2] * axis[2] * (1 - c) },
+    };
+    DirectX::XMFLOAT4X4 result;
+    for (uint32_t row = 0; row < 3; ++row)
+    {
+        for (uint32_t column = 0; column < 3; ++column)
+        {
+            result.m[row][column] = scale[row] * rotation[row][column];
+        }
+        result.m[row][3] = 0.0f;
+    }
+    result.m[3][0] = unit(*random) * 100.0f;
+    result.m[3][1] = unit(*random) * 100.0f;
+    result.m[3][2] = unit(*random) * 100.0f;
+    result.m[3][3] = 1.0f;
+    return result;
+}
+
+static void multiply(const double a[4][4], const double b[4][4], double out[4][4])
+{
+    for (uint32_t row = 0; row < 4; ++row)
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            out[row][column] = 0.0;
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                out[row][column] += a[row][k] * b[k][column];
+            }
+        }
+    }
+}
+
+static void toDouble(const DirectX::XMFLOAT4X4& matrix, double out[4][4])
+{
+    for (uint32_t row = 0; row < 4; ++row)
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            out[row][column] = matrix.m[row][column];
+        }
+    }
+}
+
+static DirectX::XMFLOAT4X4 toFloat(const double matrix[4][4])
+{
+    DirectX::XMFLOAT4X4 result;
+    for (uint32_t row = 0; row < 4; ++row)
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            result.m[row][column] = static_cast<float>(matrix[row][column]);
+        }
+    }
+    return result;
+}
+
+static void fill(uint32_t count, Matrices* matrices)
+{
+    std::mt19937 random(count);
+    matrices->models.resize(count);
+    for (DirectX::XMFLOAT4X4& model : matrices->models)
+    {
+        model = randomAffine(&random);
+    }
+    matrices->view = randomAffine(&random);
+    matrices->projection = randomAffine(&random);
+    // Perspective divide by z, like XMMatrixPerspectiveFovLH
+    matrices->projection.m[2][3] = 1.0f;
+    matrices->projection.m[3][3] = 0.0f;
+
+    double view[4][4];
+    double projection[4][4];
+    double viewProjection[4][4];
+    toDouble(matrices->view, view);
+    toDouble(matrices->projection, projection);
+    multiply(view, projection, viewProjection);
+    matrices->expectedMVPs.resize(count);
+    matrices->expectedNormals.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        double model[4][4];
+        double modelViewProjection[4][4];
+        toDouble(matrices->models[i], model);
+        multiply(model, viewProjection, modelViewProjection);
+        matrices->expectedMVPs[i] = toFloat(modelViewProjection);
+
+        // Inverse transpose of the upper 3x3 from the cofactors
+        const double (*m)[4] = model;
+        double normal[4][4] = {};
+        for (uint32_t row = 0; row < 3; ++row)
+        {
+            for (uint32_t column = 0; column < 3; ++column)
+            {
+                const uint32_t r0 = (row + 1) % 3;
+                const uint32_t r1 = (row + 2) % 3;
+                const uint32_t c0 = (column + 1) % 3;
+                const uint32_t c1 = (column + 2) % 3;
+                normal[row][column] = m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+            }
+        }
+        const double determinant = m[0][0] * normal[0][0] + m[0][1] * normal[0][1] + m[0][2] * normal[0][2];
+        for (uint32_t row = 0; row < 3; ++row)
+        {
+            for (uint32_t column = 0; column < 3; ++column)
+            {
+                normal[row][column] /= determinant;
+            }
+        }
+        normal[3][3] = 1.0;
+        matrices->expectedNormals[i] = toFloat(normal);
+    }
+}
+
+static bool matches(const std::vector<DirectX::XMFLOAT4X4>& actual, const std::vector<DirectX::XMFLOAT4X4>& expected, const char* kernel, SimdLevel level)
+{
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        double largest = 0.0;
+        double difference = 0.0;
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                largest = std::max(largest, fabs(static_cast<double>(expected[i].m[row][column])));
+                difference = std::max(difference, fabs(static_cast<double>(actual[i].m[row][column]) - expected[i].m[row][column]));
+            }
+        }
+        if (!(difference <= TOLERANCE * largest))
+        {
+            fprintf(stderr, "%zu matrices: %s %s differs from the scalar result at %zu\n", expected.size(), SimdLevelName(level), kernel, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Kernel>
+static double matricesPerMillisecond(uint32_t repeatCount, uint32_t matrixCount, const Kernel& kernel)
+{
+    uint64_t best = UINT64_MAX;
+    for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+    {
+        const uint64_t start = EventLoop::Now();
+        kernel();
+        best = std::min(best, EventLoop::Now() - start);
+    }
+    return static_cast<double>(matrixCount) / std::max(best / 1e6, 1e-6);
+}
+
+static bool measure(uint32_t matrixCount, uint32_t repeatCount, SimdLevel widest)
+{
+    Matrices matrices;
+    fill(matrixCount, &matrices);
+    std::vector<DirectX::XMFLOAT4X4> modelViewProjections(matrixCount);
+    std::vector<DirectX::XMFLOAT4X4> normals(matrixCount);
+    for (uint32_t level = 0; level <= static_cast<uint32_t>(widest); ++level)
+    {
+        const SimdLevel simdLevel = static_cast<SimdLevel>(level);
+        SelectMatrixBatchKernels(simdLevel);
+        const double mvpRate = matricesPerMillisecond(repeatCount, matrixCount, [&]
+        {
+            ComputeModelViewProjections(matrices.models.data(), matrixCount, matrices.view, matrices.projection, modelViewProjections.data());
+        });
+        const double normalRate = matricesPerMillisecond(repeatCount, matrixCount, [&]
+        {
+            ComputeNormalMatrices(matrices.models.data(), matrixCount, normals.data());
+        });
+        if (!matches(modelViewProjections, matrices.expectedMVPs, "ComputeModelViewProjections", simdLevel) ||
+            !matches(normals, matrices.expectedNormals, "ComputeNormalMatrices", simdLevel))
+        {
+            return false;
+        }
+        printf("%10u %8s %14.0f %14.0f\n", matrixCount, SimdLevelName(simdLevel), mvpRate, normalRate);
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s repeats matrix_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t repeatCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    const SimdLevel widest = DetectSimdLevel();
+    printf("Up to %s kernels, best of %u\n", SimdLevelName(widest), repeatCount);
+    printf("%10s %8s %14s %14s\n", "matrices", "kernels", "MVPs/ms", "normals/ms");
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), repeatCount, widest))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+// Linux benchmark of OcclusionCuller. For every object count, random boxes
+// are scattered in front of a camera with a row of walls across its view,
+// frustum culled with CullBoxes like the game does, and then the walls are
+// rasterized and the objects in the frustum tested against the Hi-Z
+// pyramid. Reports the milliseconds of the occlusion pass, from BeginFrame
+// to the end of Cull, on all workers and on one, the best of the given
+// number of repeats, next to BUDGET_MILLISECONDS. Checks that no object in
+// front of every wall is culled, since nothing can hide those.
+//
+// Visibility.h includes DirectXMath through MatrixBatch.h, see
+// scripts/src/replay_game.cpp for where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/occlusion_benchmark.cpp -o occlusion_benchmark
+//     ./occlusion_benchmark 20 0 1000 10000 100000
+//
+// Usage: occlusion_benchmark repeats worker_count object_count ...
+// A worker_count of 0 uses one per hardware thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Jobs.h"
+#include "Occlusion.h"
+
+// What the game can spend on occlusion culling every frame
+static constexpr double BUDGET_MILLISECONDS = 1.0;
+static constexpr uint32_t WALL_COUNT = 16;
+// Walls stand between these distances from the camera, objects anywhere
+// from OBJECT_NEAR_Z to OBJECT_FAR_Z
+static constexpr float WALL_NEAR_Z = 15.0f;
+static constexpr float WALL_FAR_Z = 25.0f;
+static constexpr float OBJECT_NEAR_Z = 1.0f;
+static constexpr float OBJECT_FAR_Z = 150.0f;
+static constexpr float OBJECT_HALF_SIZE = 80.0f;
+
+// Unit cube corners and its triangles, the walls scale it
+static constexpr float CUBE_POSITIONS[8][3] = {
+    { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f },
+    { -1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f }, { -1.0f, 1.0f,  1.0f }, { 1.0f, 1.0f,  1.0f },
+};
+static constexpr uint32_t CUBE_INDEX_COUNT = 36;
+static constexpr uint16_t CUBE_INDICES[CUBE_INDEX_COUNT] = {
+    0, 2, 1, 1, 2, 3,   4, 5, 6, 5, 7, 6,   0, 4, 2, 2, 4, 6,
+    1, 3, 5, 3, 7, 5,   0, 1, 4, 1, 5, 4,   2, 6, 3, 3, 6, 7,
+};
+
+struct Wall
+{
+    float world[4][4];
+};
+
+// Camera at the origin looking down +z, row vector convention like
+// DirectXMath's XMMatrixPerspectiveFovLH
+static void perspective(float fovY, float aspect, float nearZ, float farZ, float m[4][4])
+{
+    const float yScale = 1.0f / tanf(fovY * 0.5f);
+    const float range = farZ / (farZ - nearZ);
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            m[row][column] = 0.0f;
+        }
+    }
+    m[0][0] = yScale / aspect;
+    m[1][1] = yScale;
+    m[2][2] = range;
+    m[2][3] = 1.0f;
+    m[3][2] = -range * nearZ;
+}
+
+static void occlude(OcclusionCuller* culler, JobSystem* jobs, const float viewProjection[4][4], const std::vector<Wall>& walls, const BoundsStore& bounds, VisibleSet* visible)
+{
+    culler->BeginFrame(viewProjection);
+    for (const Wall& wall : walls)
+    {
+        culler->AddOccluder(CUBE_POSITIONS, sizeof(CUBE_POSITIONS[0]), CUBE_INDICES, CUBE_INDEX_COUNT, wall.world);
+    }
+    culler->Cull(jobs, bounds, visible);
+}
+
+// Best of repeatCount, every repeat starts from the frustum culled set
+static double milliseconds(
+    uint32_t repeatCount, JobSystem* jobs, const float viewProjection[4][4],
+    const std::vector<Wall>& walls, const BoundsStore& bounds,
+    const VisibleSet& inFrustum, VisibleSet* visible)
+{
+    OcclusionCuller culler;
+    culler.Reserve(static_cast<uint32_t>(walls.size()) * CUBE_INDEX_COUNT / 3, bounds.Count());
+    uint64_t best = UINT64_MAX;
+    for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+    {
+        *visible = inFrustum;
+        const uint64_t start = EventLoop::Now();
+        occlude(&culler, jobs, viewProjection, walls, bounds, visible);
+        best = std::min(best, EventLoop::Now() - start);
+    }
+    return best / 1e6;
+}
+
+static bool check(const BoundsStore& bounds, const VisibleSet& inFrustum, const VisibleSet& visible)
+{
+    std::vector<uint8_t> isVisible(bounds.Count(), 0);
+    for (uint32_t i = 0; i < visible.count; ++i)
+    {
+        isVisible[visible.indices[i]] = 1;
+    }
+    for (uint32_t i = 0; i < inFrustum.count; ++i)
+    {
+        const uint32_t index = inFrustum.indices[i];
+        if (!isVisible[index] && bounds.centerZ[index] + bounds.extentZ[index] < WALL_NEAR_Z)
+        {
+            fprintf(stderr, "%u objects: object %u in front of every wall was culled\n", bounds.Count(), index);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool measure(uint32_t objectCount, uint32_t repeatCount, JobSystem* jobs, JobSystem* singleWorker)
+{
+    std::mt19937 random(objectCount);
+    std::uniform_real_distribution<float> across(-OBJECT_HALF_SIZE, OBJECT_HALF_SIZE);
+    std::uniform_real_distribution<float> depth(OBJECT_NEAR_Z, OBJECT_FAR_Z);
+    std::uniform_real_distribution<float> halfExtent(0.5f, 2.0f);
+    BoundsStore bounds;
+    for (uint32_t index = 0; index < objectCount; ++index)
+    {
+        bounds.Add(across(random), across(random), depth(random), halfExtent(random), halfExtent(random), halfExtent(random));
+    }
+
+    std::uniform_real_distribution<float> wallX(-25.0f, 25.0f);
+    std::uniform_real_distribution<float> wallY(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> wallZ(WALL_NEAR_Z + 0.25f, WALL_FAR_Z - 0.25f);
+    std::uniform_real_distribution<float> wallHalfWidth(2.0f, 6.0f);
+    std::uniform_real_distribution<float> wallHalfHeight(1.0f, 5.0f);
+    std::vector<Wall> walls(WALL_COUNT);
+    for (Wall& wall : walls)
+    {
+        // Scale then translate, the walls are 0.5 thick
+        const float halfWidth = wallHalfWidth(random);
+        const float halfHeight = wallHalfHeight(random);
+        const float center[3] = { wallX(random), wallY(random), wallZ(random) };
+        const float scale[3] = { halfWidth, halfHeight, 0.25f };
+        for (int row = 0; row < 4; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                if (row == 3)
+                {
+                    wall.world[row][column] = column < 3 ? center[column] : 1.0f;
+                } else {
+                    wall.world[row][column] = row == column ? scale[row] : 0.0f;
+                }
+            }
+        }
+    }
+
+    float viewProjection[4][4];
+    perspective(1.0f, 16.0f / 9.0f, 0.1f, OBJECT_FAR_Z, viewProjection);
+    FrustumPlanes planes;
+    planes.ExtractFrom(viewProjection);
+    VisibleSet inFrustum;
+    CullBoxes(planes, bounds, &inFrustum);
+
+    VisibleSet visible;
+    const double allWorkers = milliseconds(repeatCount, jobs, viewProjection, walls, bounds, inFrustum, &visible);
+    if (!check(bounds, inFrustum, visible))
+    {
+        return false;
+    }
+    const uint32_t visibleCount = visible.count;
+    const double oneWorker = milliseconds(repeatCount, singleWorker, viewProjection, walls, bounds, inFrustum, &visible);
+    if (!check(bounds, inFrustum, visible) || visible.count != visibleCount)
+    {
+        fprintf(stderr, "%u objects: one worker culled differently\n", objectCount);
+        return false;
+    }
+    printf("%10u %10u %10u %12.3f %12.3f %8s\n",
+        objectCount,
+        inFrustum.count,
+        inFrustum.count - visibleCount,
+        allWorkers,
+        oneWorker,
+        allWorkers <= BUDGET_MILLISECONDS ? "yes" : "no"
+    );
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s repeats worker_count object_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t repeatCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    JobSystem jobs;
+    jobs.Initialize(static_cast<uint32_t>(std::max(atoi(argv[2]), 0)));
+    JobSystem singleWorker;
+    singleWorker.Initialize(1);
+
+    printf("%u workers, %u walls, best of %u, budget %.1f ms\n", jobs.WorkerCount(), WALL_COUNT, repeatCount, BUDGET_MILLISECONDS);
+    printf("%10s %10s %10s %12s %12s %8s\n", "objects", "in frustum", "occluded", "ms", "ms 1 worker", "budget");
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), repeatCount, &jobs, &singleWorker))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Packs files into one Archive (see src/shared/Archive.h).
+//
+// Usage: pack_archive output_file [lz4:]name=path ...
+//
+// Entries prefixed with lz4: are stored compressed when that makes them
+// smaller, everything else is stored as is so the game can use it in place.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Archive.h"
+
+struct PackedEntry
+{
+    std::string          name;
+    Archive::Entry       entry;
+    std::vector<uint8_t> stored;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>* data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    data->resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(data->data()), data->size()));
+}
+
+static uint64_t alignUp(uint64_t value)
+{
+    return (value + Archive::ALIGNMENT - 1) / Archive::ALIGNMENT * Archive::ALIGNMENT;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s output_file [lz4:]name=path ...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<PackedEntry> packed;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        const bool compress = argument.compare(0, 4, "lz4:") == 0;
+        if (compress)
+        {
+            argument.erase(0, 4);
+        }
+        const size_t separator = argument.find('=');
+        if (separator == std::string::npos || separator == 0)
+        {
+            fprintf(stderr, "Expected name=path, got %s\n", argv[i]);
+            return 1;
+        }
+
+        PackedEntry current = {};
+        current.name = argument.substr(0, separator);
+        const std::string path = argument.substr(separator + 1);
+        std::vector<uint8_t> data;
+        if (!readFile(path, &data))
+        {
+            fprintf(stderr, "Unable to read %s\n", path.c_str());
+            return 1;
+        }
+        current.entry.nameHash = Archive::NameHash(current.name.c_str());
+        current.entry.contentHash = HashBytes(data.data(), data.size());
+        current.entry.size = data.size();
+        current.entry.compression = Archive::COMPRESSION_NONE;
+        if (compress)
+        {
+            Lz4Compress(data.data(), data.size(), &current.stored);
+            if (current.stored.size() < data.size())
+            {
+                current.entry.compression = Archive::COMPRESSION_LZ4;
+            }
+        }
+        if (current.entry.compression == Archive::COMPRESSION_NONE)
+        {
+            current.stored.swap(data);
+        }
+        current.entry.storedSize = current.stored.size();
+        current.entry.storedHash = HashBytes(current.stored.data(), current.stored.size());
+        packed.push_back(std::move(current));
+    }
+
+    std::sort(packed.begin(), packed.end(), [](const PackedEntry& left, const PackedEntry& right)
+    {
+        return left.entry.nameHash < right.entry.nameHash;
+    });
+    for (size_t i = 1; i < packed.size(); ++i)
+    {
+        if (packed[i - 1].entry.nameHash == packed[i].entry.nameHash)
+        {
+            fprintf(stderr, "Entries %s and %s have the same name hash\n", packed[i - 1].name.c_str(), packed[i].name.c_str());
+            return 1;
+        }
+    }
+
+    // Identical contents stored the same way share their data. Empty
+    // entries point at the start of the file, an offset past the last
+    // written byte would be outside of it.
+    uint64_t offset = alignUp(sizeof(Archive::Header) + packed.size() * sizeof(Archive::Entry));
+    std::vector<size_t> written;
+    for (size_t i = 0; i < packed.size(); ++i)
+    {
+        Archive::Entry& entry = packed[i].entry;
+        if (entry.storedSize == 0)
+        {
+            entry.offset = 0;
+            continue;
+        }
+        const auto same = std::find_if(written.begin(), written.end(), [&](size_t other)
+        {
+            return packed[other].entry.storedHash == entry.storedHash &&
+                packed[other].entry.compression == entry.compression &&
+                packed[other].stored == packed[i].stored;
+        });
+        if (same != written.end())
+        {
+            entry.offset = packed[*same].entry.offset;
+            continue;
+        }
+        entry.offset = offset;
+        offset = alignUp(offset + entry.storedSize);
+        written.push_back(i);
+    }
+
+    Archive::Header header = {};
+    header.magic = Archive::MAGIC;
+    header.version = Archive::VERSION;
+    header.entryCount = static_cast<uint32_t>(packed.size());
+
+    std::ofstream file(argv[1], std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const PackedEntry& current : packed)
+    {
+        file.write(reinterpret_cast<const char*>(&current.entry), sizeof(current.entry));
+    }
+    for (size_t i : written)
+    {
+        file.seekp(static_cast<std::streamoff>(packed[i].entry.offset));
+        file.write(reinterpret_cast<const char*>(packed[i].stored.data()), packed[i].stored.size());
+    }
+    if (!file)
+    {
+        fprintf(stderr, "Unable to write %s\n", argv[1]);
+        return 1;
+    }
+
+    uint64_t storedSize = 0;
+    for (size_t i : written)
+    {
+        storedSize += packed[i].entry.storedSize;
+    }
+    printf("Packed %zu entries, %llu bytes of data\n", packed.size(), static_cast<unsigned long long>(storedSize));
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Linux benchmark of ParticleSystem::Update: for every particle count, a
+// grid of fountains emits just enough to keep that many particles alive,
+// runs until the first particles die and is then updated for the given
+// number of ticks, writing every survivor as an instance the way a frame
+// does. Reports the milliseconds per update with the widest kernels on all
+// workers, with the SSE kernels and on one worker, and checks that all
+// three write the same instances.
+//
+// Particles.h includes DirectXMath through MatrixBatch.h, see
+// scripts/src/replay_game.cpp for where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/particle_benchmark.cpp -o particle_benchmark
+//     ./particle_benchmark 600 0 100000 1000000
+//
+// Usage: particle_benchmark ticks worker_count particle_count ...
+// A worker_count of 0 uses one per hardware thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Hash.h"
+#include "Jobs.h"
+#include "Particles.h"
+
+static constexpr float TICK_SECONDS = 1.0f / 60.0f;
+static constexpr float LIFETIME_SECONDS = 2.0f;
+static constexpr uint32_t EMITTER_SIDE = 8;
+
+struct Run
+{
+    double   milliseconds;
+    uint32_t particles;
+    uint64_t instanceHash;
+};
+
+static void addFountains(ParticleSystem* particles, uint32_t particleCount)
+{
+    // Slightly under the capacity, so nothing is dropped once running
+    const float particlesPerSecond = 0.98f * static_cast<float>(particleCount) / LIFETIME_SECONDS / (EMITTER_SIDE * EMITTER_SIDE);
+    for (uint32_t emitter = 0; emitter < EMITTER_SIDE * EMITTER_SIDE; ++emitter)
+    {
+        particles->AddEmitter({
+            { static_cast<float>(emitter % EMITTER_SIDE) * 4.0f, 0.0f, static_cast<float>(emitter / EMITTER_SIDE) * 4.0f },
+            { 0.0f, 8.0f, 0.0f },
+            1.5f,
+            particlesPerSecond,
+            LIFETIME_SECONDS,
+            0.1f,
+            0xFF3080FFu + emitter
+        });
+    }
+}
+
+static bool check(const ParticleInstance* instances, uint32_t count, uint32_t particleCount)
+{
+    for (uint32_t instance = 0; instance < count; ++instance)
+    {
+        if (!(instances[instance].size > 0.0f))
+        {
+            fprintf(stderr, "%u particles: a dead particle was written\n", particleCount);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run(uint32_t particleCount, uint32_t tickCount, JobSystem* jobs, SimdLevel level, Run* result)
+{
+    SelectParticleKernels(level);
+    ParticleSystem particles;
+    particles.Reset(particleCount, particleCount);
+    addFountains(&particles, particleCount);
+    std::vector<ParticleInstance> instances(particles.Capacity());
+    const uint32_t warmupTicks = static_cast<uint32_t>(LIFETIME_SECONDS / TICK_SECONDS) + 1;
+    for (uint32_t tick = 0; tick < warmupTicks; ++tick)
+    {
+        particles.Update(jobs, TICK_SECONDS, nullptr);
+    }
+
+    *result = {};
+    uint64_t updateNanoseconds = 0;
+    uint32_t count = 0;
+    for (uint32_t tick = 0; tick < tickCount; ++tick)
+    {
+        const uint64_t start = EventLoop::Now();
+        count = particles.Update(jobs, TICK_SECONDS, instances.data());
+        updateNanoseconds += EventLoop::Now() - start;
+    }
+    if (!check(instances.data(), count, particleCount))
+    {
+        return false;
+    }
+    result->milliseconds = static_cast<double>(updateNanoseconds) / 1e6 / tickCount;
+    result->particles = count;
+    result->instanceHash = HashBytes(instances.data(), count * sizeof(ParticleInstance));
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s ticks worker_count particle_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t tickCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    JobSystem jobs;
+    jobs.Initialize(static_cast<uint32_t>(std::max(atoi(argv[2]), 0)));
+    JobSystem singleWorker;
+    singleWorker.Initialize(1);
+    const SimdLevel level = DetectSimdLevel();
+
+    printf("%u workers, %s kernels, %u ticks\n", jobs.WorkerCount(), SimdLevelName(level), tickCount);
+    printf("%10s %10s %10s %10s %10s %12s\n", "capacity", "alive", "ms/tick", "SSE ms", "1 worker", "ns/particle");
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        const uint32_t particleCount = static_cast<uint32_t>(std::max(atoi(argv[argument]), 1));
+        Run widest;
+        Run sse;
+        Run single;
+        if (!run(particleCount, tickCount, &jobs, level, &widest) ||
+            !run(particleCount, tickCount, &jobs, SimdLevel::SSE, &sse) ||
+            !run(particleCount, tickCount, &singleWorker, level, &single))
+        {
+            return 1;
+        }
+        printf("%10u %10u %10.3f %10.3f %10.3f %12.2f\n",
+            particleCount,
+            widest.particles,
+            widest.milliseconds,
+            sse.milliseconds,
+            single.milliseconds,
+            widest.milliseconds * 1e6 / std::max(widest.particles, 1u)
+        );
+        if (widest.particles != sse.particles || widest.particles != single.particles ||
+            widest.instanceHash != sse.instanceHash || widest.instanceHash != single.instanceHash)
+        {
+            fprintf(stderr, "%u particles: the runs wrote different instances\n", particleCount);
+            return 1;
+        }
+    }
+    return 0;
+}
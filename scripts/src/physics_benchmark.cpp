@@ -0,0 +1,129 @@
+// Linux benchmark of PhysicsWorld::Step: for every body count, spheres are
+// dropped in loose piles onto the ground next to a few static ones and
+// stepped for the given number of ticks. Reports the throughput in bodies
+// per millisecond of step time with the widest kernels on all workers, with
+// the SSE kernels and on one worker, and checks that all three end in the
+// same state.
+//
+// Physics.h includes DirectXMath through MatrixBatch.h, see
+// scripts/src/replay_game.cpp for where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/physics_benchmark.cpp -o physics_benchmark
+//     ./physics_benchmark 600 0 10000 100000
+//
+// Usage: physics_benchmark ticks worker_count body_count ...
+// A worker_count of 0 uses one per hardware thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "Arena.h"
+#include "EventLoop.h"
+#include "Jobs.h"
+#include "Physics.h"
+
+static constexpr float TICK_SECONDS = 1.0f / 60.0f;
+// Like Game::TICK_ARENA_CAPACITY
+static constexpr size_t SCRATCH_CAPACITY = 1 << 20;
+static constexpr float BODY_RADIUS = 0.5f;
+// Of the bodies
+static constexpr uint32_t STATIC_PERCENT = 2;
+// Bodies per pile, dropped in a column
+static constexpr uint32_t PILE_SIZE = 16;
+
+struct Run
+{
+    double   bodiesPerMillisecond;
+    uint64_t stateHash;
+    uint32_t awakeBodies;
+    uint32_t contacts;
+    uint32_t islands;
+};
+
+static void buildScene(PhysicsWorld* world, uint32_t bodyCount)
+{
+    std::mt19937 random(bodyCount);
+    const uint32_t pileCount = std::max(bodyCount / PILE_SIZE, 1u);
+    const uint32_t side = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(pileCount))));
+    for (uint32_t body = 0; body < bodyCount; ++body)
+    {
+        const uint32_t pile = body % pileCount;
+        const uint32_t level = body / pileCount;
+        // Jittered so the piles topple instead of balancing
+        const float jitterX = static_cast<float>(random() % 100) / 400.0f;
+        const float jitterZ = static_cast<float>(random() % 100) / 400.0f;
+        const float x = static_cast<float>(pile % side) * 4.0f + jitterX;
+        const float z = static_cast<float>(pile / side) * 4.0f + jitterZ;
+        const bool isStatic = random() % 100 < STATIC_PERCENT && level == 0;
+        world->AddBody(x, BODY_RADIUS + static_cast<float>(level) * 2.5f * BODY_RADIUS, z, BODY_RADIUS, isStatic ? 0.0f : 1.0f);
+    }
+}
+
+static Run run(uint32_t bodyCount, uint32_t tickCount, JobSystem* jobs, SimdLevel level)
+{
+    SelectPhysicsKernels(level);
+    PhysicsWorld world;
+    buildScene(&world, bodyCount);
+    Arena scratch(SCRATCH_CAPACITY);
+    Run result = {};
+    uint64_t stepNanoseconds = 0;
+    for (uint32_t tick = 0; tick < tickCount; ++tick)
+    {
+        const uint64_t start = EventLoop::Now();
+        scratch.Reset();
+        world.Step(jobs, TICK_SECONDS, &scratch);
+        stepNanoseconds += EventLoop::Now() - start;
+    }
+    result.bodiesPerMillisecond = static_cast<double>(bodyCount) * tickCount / std::max(stepNanoseconds / 1e6, 1e-6);
+    result.stateHash = world.StateHash();
+    for (uint32_t body = 0; body < world.BodyCount(); ++body)
+    {
+        result.awakeBodies += world.IsAwake(body);
+    }
+    result.contacts = world.Stats().contacts;
+    result.islands = world.Stats().islands;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s ticks worker_count body_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t tickCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    JobSystem jobs;
+    jobs.Initialize(static_cast<uint32_t>(std::max(atoi(argv[2]), 0)));
+    JobSystem singleWorker;
+    singleWorker.Initialize(1);
+    const SimdLevel level = DetectSimdLevel();
+
+    printf("%u workers, %s kernels, %u ticks\n", jobs.WorkerCount(), SimdLevelName(level), tickCount);
+    printf("%9s %14s %14s %14s %8s %9s %8s\n", "bodies", "bodies/ms", "SSE bodies/ms", "1 worker", "awake", "contacts", "islands");
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        const uint32_t bodyCount = static_cast<uint32_t>(std::max(atoi(argv[argument]), 1));
+        const Run widest = run(bodyCount, tickCount, &jobs, level);
+        const Run sse = run(bodyCount, tickCount, &jobs, SimdLevel::SSE);
+        const Run single = run(bodyCount, tickCount, &singleWorker, level);
+        printf("%9u %14.0f %14.0f %14.0f %8u %9u %8u\n",
+            bodyCount,
+            widest.bodiesPerMillisecond,
+            sse.bodiesPerMillisecond,
+            single.bodiesPerMillisecond,
+            widest.awakeBodies,
+            widest.contacts,
+            widest.islands
+        );
+        if (widest.stateHash != sse.stateHash || widest.stateHash != single.stateHash)
+        {
+            fprintf(stderr, "%u bodies: the runs ended in different states\n", bodyCount);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Linux check of the PipelineCache file format: saves a cache, loads it
+// back and compares keys and payload, then damages copies of the file in
+// every way Load must reject (other device, truncated, extended, lying key
+// count or payload size, corrupt payload, unsorted keys) and checks that
+// each is treated as a miss. Also checks that saving leaves no temporary
+// file behind, and that a save that cannot replace the cache fails cleanly.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/pipeline_cache_check.cpp -o pipeline_cache_check
+//     ./pipeline_cache_check [directory]
+//
+// Files are written to the directory, /tmp by default. Prints every
+// failure and exits with 1 when there is one.
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "PipelineCache.h"
+
+static constexpr uint64_t DEVICE_HASH = 0x0123456789ABCDEFull;
+
+static std::vector<uint8_t> readFile(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+static bool expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s\n", what);
+    }
+    return condition;
+}
+
+template<typename Damage>
+static bool expectRejected(const std::filesystem::path& directory, const std::vector<uint8_t>& saved, const char* name, const Damage& damage)
+{
+    std::vector<uint8_t> bytes = saved;
+    damage(&bytes);
+    const std::filesystem::path path = directory / "pipeline_cache_check_damaged.cache";
+    writeFile(path, bytes);
+    PipelineCache cache;
+    const bool isLoaded = cache.Load(path.string().c_str(), DEVICE_HASH);
+    std::filesystem::remove(path);
+    if (isLoaded || cache.KeyCount() != 0 || !cache.Payload().empty())
+    {
+        fprintf(stderr, "%s: loaded instead of treated as a miss\n", name);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const std::filesystem::path directory = argc > 1 ? argv[1] : "/tmp";
+    const std::filesystem::path path = directory / "pipeline_cache_check.cache";
+    const std::string pathString = path.string();
+    std::filesystem::remove(path);
+
+    std::vector<uint8_t> payload(1000);
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    const uint64_t keys[] = { 42, 7, 0xFFFFFFFFFFFFFFFFull, 1000, 7 };
+
+    bool isCorrect = true;
+    {
+        PipelineCache cache;
+        isCorrect = expect(!cache.Load(pathString.c_str(), DEVICE_HASH), "a missing file loaded") && isCorrect;
+        for (const uint64_t key : keys)
+        {
+            cache.Insert(key);
+        }
+        isCorrect = expect(cache.IsDirty() && cache.KeyCount() == 4, "inserting keys did not make four distinct dirty ones") && isCorrect;
+        isCorrect = expect(cache.Save(pathString.c_str(), payload.data(), payload.size()), "saving failed") && isCorrect;
+        isCorrect = expect(!cache.IsDirty(), "still dirty after saving") && isCorrect;
+        isCorrect = expect(!std::filesystem::exists(pathString + ".tmp"), "saving left the temporary file behind") && isCorrect;
+    }
+    const std::vector<uint8_t> saved = readFile(path);
+    isCorrect = expect(saved.size() == sizeof(PipelineCache::Header) + 4 * sizeof(uint64_t) + payload.size(), "the file has the wrong size") && isCorrect;
+    {
+        PipelineCache cache;
+        isCorrect = expect(cache.Load(pathString.c_str(), DEVICE_HASH), "loading the saved file failed") && isCorrect;
+        for (const uint64_t key : keys)
+        {
+            isCorrect = expect(cache.Contains(key), "a saved key is missing") && isCorrect;
+        }
+        isCorrect = expect(!cache.Contains(8), "a key that was never saved is there") && isCorrect;
+        isCorrect = expect(cache.KeyCount() == 4 && !cache.IsDirty(), "loaded keys are wrong or dirty") && isCorrect;
+        isCorrect = expect(cache.Payload() == payload, "the loaded payload differs") && isCorrect;
+
+        // Loaded keys are not written again, a new one is
+        cache.Insert(7);
+        isCorrect = expect(!cache.IsDirty(), "inserting a loaded key made the cache dirty") && isCorrect;
+        cache.Insert(8);
+        isCorrect = expect(cache.IsDirty(), "inserting a new key did not make the cache dirty") && isCorrect;
+    }
+    {
+        PipelineCache cache;
+        isCorrect = expect(!cache.Load(pathString.c_str(), DEVICE_HASH + 1), "a file of another device loaded") && isCorrect;
+    }
+
+    const size_t keyCountOffset = offsetof(PipelineCache::Header, keyCount);
+    const size_t payloadSizeOffset = offsetof(PipelineCache::Header, payloadSize);
+    const size_t keysOffset = sizeof(PipelineCache::Header);
+    isCorrect = expectRejected(directory, saved, "empty file", [](std::vector<uint8_t>* bytes) { bytes->clear(); }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "header only", [&](std::vector<uint8_t>* bytes) { bytes->resize(keysOffset); }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "truncated payload", [](std::vector<uint8_t>* bytes) { bytes->pop_back(); }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "trailing bytes", [](std::vector<uint8_t>* bytes) { bytes->push_back(0); }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "huge key count", [&](std::vector<uint8_t>* bytes)
+    {
+        const uint32_t keyCount = UINT32_MAX;
+        memcpy(bytes->data() + keyCountOffset, &keyCount, sizeof(keyCount));
+    }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "key count one too large", [&](std::vector<uint8_t>* bytes)
+    {
+        const uint32_t keyCount = 5;
+        memcpy(bytes->data() + keyCountOffset, &keyCount, sizeof(keyCount));
+    }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "huge payload size", [&](std::vector<uint8_t>* bytes)
+    {
+        const uint64_t payloadSize = UINT64_MAX - 8;
+        memcpy(bytes->data() + payloadSizeOffset, &payloadSize, sizeof(payloadSize));
+    }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "corrupt payload", [](std::vector<uint8_t>* bytes) { bytes->back() ^= 1; }) && isCorrect;
+    isCorrect = expectRejected(directory, saved, "unsorted keys", [&](std::vector<uint8_t>* bytes)
+    {
+        std::swap_ranges(bytes->begin() + keysOffset, bytes->begin() + keysOffset + sizeof(uint64_t), bytes->begin() + keysOffset + sizeof(uint64_t));
+    }) && isCorrect;
+
+    // A directory in the way of the rename, the save fails and cleans up
+    const std::filesystem::path blockedPath = directory / "pipeline_cache_check_blocked.cache";
+    std::filesystem::create_directories(blockedPath / "child");
+    {
+        PipelineCache cache;
+        cache.Insert(1);
+        isCorrect = expect(!cache.Save(blockedPath.string().c_str(), payload.data(), payload.size()), "saving over a directory succeeded") && isCorrect;
+        isCorrect = expect(cache.IsDirty(), "a failed save cleared the dirty flag") && isCorrect;
+        isCorrect = expect(!std::filesystem::exists(blockedPath.string() + ".tmp"), "a failed save left the temporary file behind") && isCorrect;
+    }
+    std::filesystem::remove_all(blockedPath);
+    std::filesystem::remove(path);
+
+    if (!isCorrect)
+    {
+        return 1;
+    }
+    printf("PipelineCache: round trip and rejected files as expected\n");
+    return 0;
+}
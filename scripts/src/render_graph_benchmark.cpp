@@ -0,0 +1,133 @@
+// Linux benchmark of RenderGraph::Compile: for every pass count, a frame
+// graph where every pass writes a transient texture of its own and reads
+// the output of the pass before it plus up to EXTRA_READS_PER_PASS of the
+// last READ_WINDOW outputs. Every DEAD_PASS_INTERVAL-th output is never
+// read, so those passes are culled, and the last pass writes the back
+// buffer. Reports the microseconds per compile, the best of the given
+// number of repeats, next to the passes culled, the barriers and how much
+// memory aliasing saves: the size of all allocated transient textures
+// against the size of the heap they share.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/render_graph_benchmark.cpp -o render_graph_benchmark
+//     ./render_graph_benchmark 20 10 100 1000 10000
+//
+// Usage: render_graph_benchmark repeats pass_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "RenderGraph.h"
+
+static constexpr uint64_t MB = 1 << 20;
+static constexpr uint64_t PLACEMENT_ALIGNMENT = 64 * 1024;
+static constexpr uint32_t EXTRA_READS_PER_PASS = 2;
+static constexpr uint32_t READ_WINDOW = 8;
+static constexpr uint32_t DEAD_PASS_INTERVAL = 10;
+
+static void build(uint32_t passCount, RenderGraph* graph)
+{
+    std::mt19937 random(passCount);
+    // Render targets from a quarter to full 1080p RGBA16F
+    const uint64_t sizes[] = { 4 * MB, 8 * MB, 16 * MB };
+    graph->Reset();
+    const RenderGraph::Resource backBuffer = graph->ImportTexture("back buffer", ResourceState::Present, ResourceState::Present);
+    // Outputs of the passes that some later pass may read
+    std::vector<RenderGraph::Resource> readable;
+    for (uint32_t index = 0; index + 1 < passCount; ++index)
+    {
+        const uint32_t pass = graph->AddPass("pass", [] {});
+        if (!readable.empty())
+        {
+            graph->Read(pass, readable.back(), ResourceState::PixelShaderResource);
+        }
+        const uint32_t extraReadCount = std::min<uint32_t>(random() % (EXTRA_READS_PER_PASS + 1), static_cast<uint32_t>(readable.size()));
+        for (uint32_t read = 0; read < extraReadCount; ++read)
+        {
+            const uint32_t window = std::min<uint32_t>(READ_WINDOW, static_cast<uint32_t>(readable.size()));
+            const RenderGraph::Resource input = readable[readable.size() - 1 - random() % window];
+            graph->Read(pass, input, ResourceState::PixelShaderResource);
+        }
+        const uint64_t size = sizes[random() % 3];
+        const RenderGraph::Resource output = graph->CreateTexture("target", { 1920, 1080, 0, size, PLACEMENT_ALIGNMENT });
+        graph->Write(pass, output, random() % 4 ? ResourceState::RenderTarget : ResourceState::UnorderedAccess);
+        if ((index + 1) % DEAD_PASS_INTERVAL)
+        {
+            readable.push_back(output);
+        }
+    }
+    const uint32_t present = graph->AddPass("present", [] {});
+    if (!readable.empty())
+    {
+        graph->Read(present, readable.back(), ResourceState::PixelShaderResource);
+    }
+    graph->Write(present, backBuffer, ResourceState::RenderTarget);
+}
+
+static bool measure(uint32_t passCount, uint32_t repeatCount)
+{
+    RenderGraph graph;
+    build(passCount, &graph);
+    uint64_t best = UINT64_MAX;
+    for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+    {
+        const uint64_t start = EventLoop::Now();
+        graph.Compile();
+        best = std::min(best, EventLoop::Now() - start);
+    }
+
+    uint32_t culledPasses = 0;
+    for (uint32_t pass = 0; pass < graph.PassCount(); ++pass)
+    {
+        culledPasses += graph.IsPassCulled(pass) ? 1 : 0;
+    }
+    uint64_t allocatedBytes = 0;
+    for (RenderGraph::Resource resource = 0; resource < graph.ResourceCount(); ++resource)
+    {
+        if (!graph.IsImported(resource) && graph.IsAllocated(resource))
+        {
+            allocatedBytes += graph.Desc(resource).sizeInBytes;
+        }
+    }
+    const uint64_t heapBytes = graph.TransientHeapSize();
+    if (heapBytes > allocatedBytes)
+    {
+        fprintf(stderr, "%u passes: the heap of %llu bytes is larger than its %llu bytes of textures\n",
+            passCount, static_cast<unsigned long long>(heapBytes), static_cast<unsigned long long>(allocatedBytes));
+        return false;
+    }
+    printf("%10u %10u %8u %12.1f %10u %12.0f %10.0f %8.1f%%\n",
+        passCount,
+        graph.ResourceCount(),
+        culledPasses,
+        best / 1e3,
+        graph.BarrierCount(),
+        static_cast<double>(allocatedBytes) / MB,
+        static_cast<double>(heapBytes) / MB,
+        allocatedBytes ? 100.0 * static_cast<double>(allocatedBytes - heapBytes) / static_cast<double>(allocatedBytes) : 0.0
+    );
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s repeats pass_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t repeatCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    printf("Best of %u, up to %u extra reads of the last %u outputs per pass\n", repeatCount, EXTRA_READS_PER_PASS, READ_WINDOW);
+    printf("%10s %10s %8s %12s %10s %12s %10s %9s\n", "passes", "resources", "culled", "us/compile", "barriers", "textures MB", "heap MB", "saved");
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), repeatCount))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+// Linux check of RenderGraph::Compile: builds small frame graphs, executes
+// them twice while recording every pass and barrier, and compares the
+// recording with the expected one. Covers culling of passes whose output
+// nobody reads, first fit placement of transient textures with aliasing
+// of disjoint lifetimes, and the transition, aliasing and UAV barriers
+// issued before every pass and at the end of the frame.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/render_graph_check.cpp -o render_graph_check
+//     ./render_graph_check
+//
+// Prints every mismatch and exits with 1 when there is one.
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "RenderGraph.h"
+
+static constexpr uint64_t MB = 1 << 20;
+static constexpr uint64_t PLACEMENT_ALIGNMENT = 64 * 1024;
+
+static const char* stateName(ResourceState state)
+{
+    switch (state)
+    {
+    case ResourceState::Common: return "Common";
+    case ResourceState::RenderTarget: return "RenderTarget";
+    case ResourceState::DepthWrite: return "DepthWrite";
+    case ResourceState::DepthRead: return "DepthRead";
+    case ResourceState::PixelShaderResource: return "PixelShaderResource";
+    case ResourceState::NonPixelShaderResource: return "NonPixelShaderResource";
+    case ResourceState::UnorderedAccess: return "UnorderedAccess";
+    case ResourceState::CopySource: return "CopySource";
+    case ResourceState::CopyDest: return "CopyDest";
+    case ResourceState::Present: return "Present";
+    }
+    return "combined";
+}
+
+static std::string describe(const RenderGraph& graph, const RenderGraph::Barrier& barrier)
+{
+    std::string result;
+    switch (barrier.type)
+    {
+    case RenderGraph::BarrierType::Transition:
+        result = std::string("transition ") + graph.ResourceName(barrier.resource) + " " + stateName(barrier.before) + " -> " + stateName(barrier.after);
+        break;
+    case RenderGraph::BarrierType::Aliasing:
+        result = std::string("aliasing ") + graph.ResourceName(barrier.resource) + " after " +
+            (barrier.previousResource == RenderGraph::NONE ? "several" : graph.ResourceName(barrier.previousResource));
+        break;
+    case RenderGraph::BarrierType::UnorderedAccess:
+        result = std::string("uav ") + graph.ResourceName(barrier.resource);
+        break;
+    }
+    return result;
+}
+
+static uint32_t addPass(RenderGraph* graph, std::vector<std::string>* recording, const char* name, bool hasSideEffects = false)
+{
+    return graph->AddPass(name, [recording, name] { recording->push_back(std::string("pass ") + name); }, hasSideEffects);
+}
+
+static RenderGraph::TextureDesc texture(uint64_t sizeInBytes)
+{
+    return { 1920, 1080, 0, sizeInBytes, PLACEMENT_ALIGNMENT };
+}
+
+static bool expect(bool condition, const char* graphName, const std::string& what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s: %s\n", graphName, what.c_str());
+    }
+    return condition;
+}
+
+static bool expectRecording(
+    const RenderGraph& graph, std::vector<std::string>* recording,
+    const std::vector<std::string>& expected, const char* graphName)
+{
+    bool isMatching = true;
+    // Twice, a compiled graph returns every texture to its initial state
+    for (uint32_t frame = 0; frame < 2; ++frame)
+    {
+        recording->clear();
+        graph.Execute([&](const RenderGraph::Barrier* barriers, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                recording->push_back(describe(graph, barriers[i]));
+            }
+        });
+        for (size_t line = 0; line < std::max(recording->size(), expected.size()); ++line)
+        {
+            const std::string actual = line < recording->size() ? (*recording)[line] : "(nothing)";
+            const std::string wanted = line < expected.size() ? expected[line] : "(nothing)";
+            isMatching = expect(actual == wanted, graphName,
+                "frame " + std::to_string(frame) + " line " + std::to_string(line) + ": got '" + actual + "', expected '" + wanted + "'") && isMatching;
+        }
+    }
+    return isMatching;
+}
+
+// Deferred frame: a shadow map, a G-buffer, lighting into an HDR target,
+// bloom and tone mapping into the back buffer, plus a debug branch nobody
+// reads and a profiling pass with side effects only
+static bool checkDeferredFrame()
+{
+    const char* name = "deferred frame";
+    RenderGraph graph;
+    std::vector<std::string> recording;
+    const RenderGraph::Resource backBuffer = graph.ImportTexture("back buffer", ResourceState::Present, ResourceState::Present);
+    const RenderGraph::Resource shadowMap = graph.CreateTexture("shadow map", texture(4 * MB));
+    const RenderGraph::Resource debug = graph.CreateTexture("debug", texture(8 * MB));
+    const RenderGraph::Resource debugBlur = graph.CreateTexture("debug blur", texture(8 * MB));
+    const RenderGraph::Resource albedo = graph.CreateTexture("albedo", texture(8 * MB));
+    const RenderGraph::Resource depth = graph.CreateTexture("depth", texture(4 * MB));
+    const RenderGraph::Resource hdr = graph.CreateTexture("hdr", texture(8 * MB));
+    const RenderGraph::Resource bloom = graph.CreateTexture("bloom", texture(8 * MB));
+
+    const uint32_t shadowPass = addPass(&graph, &recording, "shadow");
+    graph.Write(shadowPass, shadowMap, ResourceState::DepthWrite);
+    const uint32_t debugPass = addPass(&graph, &recording, "debug");
+    graph.Write(debugPass, debug, ResourceState::RenderTarget);
+    const uint32_t debugBlurPass = addPass(&graph, &recording, "debug blur");
+    graph.Read(debugBlurPass, debug, ResourceState::PixelShaderResource);
+    graph.Write(debugBlurPass, debugBlur, ResourceState::RenderTarget);
+    const uint32_t gBufferPass = addPass(&graph, &recording, "g-buffer");
+    graph.Write(gBufferPass, albedo, ResourceState::RenderTarget);
+    graph.Write(gBufferPass, depth, ResourceState::DepthWrite);
+    const uint32_t lightingPass = addPass(&graph, &recording, "lighting");
+    graph.Read(lightingPass, shadowMap, ResourceState::PixelShaderResource);
+    graph.Read(lightingPass, albedo, ResourceState::PixelShaderResource);
+    graph.Read(lightingPass, depth, ResourceState::DepthRead);
+    graph.Write(lightingPass, hdr, ResourceState::RenderTarget);
+    const uint32_t bloomPass = addPass(&graph, &recording, "bloom");
+    graph.Read(bloomPass, hdr, ResourceState::PixelShaderResource);
+    graph.Write(bloomPass, bloom, ResourceState::RenderTarget);
+    const uint32_t toneMapPass = addPass(&graph, &recording, "tone map");
+    graph.Read(toneMapPass, hdr, ResourceState::PixelShaderResource);
+    graph.Read(toneMapPass, bloom, ResourceState::PixelShaderResource);
+    graph.Write(toneMapPass, backBuffer, ResourceState::RenderTarget);
+    const uint32_t profilePass = addPass(&graph, &recording, "profile", true);
+    graph.Compile();
+
+    bool isCorrect = true;
+    // The debug blur is never read and takes the debug pass with it
+    const bool expectedCulling[] = { false, true, true, false, false, false, false, false };
+    for (uint32_t pass = 0; pass < graph.PassCount(); ++pass)
+    {
+        isCorrect = expect(graph.IsPassCulled(pass) == expectedCulling[pass], name,
+            std::string(graph.PassName(pass)) + (expectedCulling[pass] ? " is not culled" : " is culled")) && isCorrect;
+    }
+    isCorrect = expect(!graph.IsAllocated(debug) && !graph.IsAllocated(debugBlur), name, "textures of culled passes got memory") && isCorrect;
+    (void)profilePass;
+
+    // Shadow map, albedo and depth are alive together from the g-buffer to
+    // lighting and hdr until tone mapping, bloom starts after the first
+    // three are done and reuses the memory of the shadow map and albedo
+    const struct { RenderGraph::Resource resource; uint64_t offset; } expectedOffsets[] = {
+        { shadowMap, 0 },
+        { albedo,    4 * MB },
+        { depth,     12 * MB },
+        { hdr,       16 * MB },
+        { bloom,     0 },
+    };
+    for (const auto& expected : expectedOffsets)
+    {
+        isCorrect = expect(graph.IsAllocated(expected.resource) && graph.HeapOffset(expected.resource) == expected.offset, name,
+            std::string(graph.ResourceName(expected.resource)) + " placed at " + std::to_string(graph.HeapOffset(expected.resource)) +
+            ", expected " + std::to_string(expected.offset)) && isCorrect;
+    }
+    isCorrect = expect(graph.TransientHeapSize() == 24 * MB, name, "transient heap of " + std::to_string(graph.TransientHeapSize()) + " bytes") && isCorrect;
+
+    return expectRecording(graph, &recording, {
+        "aliasing shadow map after bloom",
+        "pass shadow",
+        "aliasing albedo after bloom",
+        "pass g-buffer",
+        "transition shadow map DepthWrite -> PixelShaderResource",
+        "transition albedo RenderTarget -> PixelShaderResource",
+        "transition depth DepthWrite -> DepthRead",
+        "pass lighting",
+        "transition hdr RenderTarget -> PixelShaderResource",
+        "aliasing bloom after several",
+        "pass bloom",
+        "transition back buffer Present -> RenderTarget",
+        "transition bloom RenderTarget -> PixelShaderResource",
+        "pass tone map",
+        "pass profile",
+        "transition back buffer RenderTarget -> Present",
+        "transition shadow map PixelShaderResource -> DepthWrite",
+        "transition albedo PixelShaderResource -> RenderTarget",
+        "transition depth DepthRead -> DepthWrite",
+        "transition hdr PixelShaderResource -> RenderTarget",
+        "transition bloom PixelShaderResource -> RenderTarget",
+    }, name) && isCorrect;
+}
+
+// Two compute passes writing the same texture as UAV, then a draw reading it
+static bool checkComputeChain()
+{
+    const char* name = "compute chain";
+    RenderGraph graph;
+    std::vector<std::string> recording;
+    const RenderGraph::Resource backBuffer = graph.ImportTexture("back buffer", ResourceState::Present, ResourceState::Present);
+    const RenderGraph::Resource particles = graph.CreateTexture("particles", texture(2 * MB));
+
+    const uint32_t simulatePass = addPass(&graph, &recording, "simulate");
+    graph.Write(simulatePass, particles, ResourceState::UnorderedAccess);
+    const uint32_t integratePass = addPass(&graph, &recording, "integrate");
+    graph.Read(integratePass, particles, ResourceState::UnorderedAccess);
+    graph.Write(integratePass, particles, ResourceState::UnorderedAccess);
+    const uint32_t drawPass = addPass(&graph, &recording, "draw");
+    graph.Read(drawPass, particles, ResourceState::NonPixelShaderResource);
+    graph.Write(drawPass, backBuffer, ResourceState::RenderTarget);
+    graph.Compile();
+
+    bool isCorrect = true;
+    for (uint32_t pass = 0; pass < graph.PassCount(); ++pass)
+    {
+        isCorrect = expect(!graph.IsPassCulled(pass), name, std::string(graph.PassName(pass)) + " is culled") && isCorrect;
+    }
+    isCorrect = expect(graph.HeapOffset(particles) == 0 && graph.TransientHeapSize() == 2 * MB, name, "particles not alone in the heap") && isCorrect;
+    isCorrect = expect(graph.InitialState(particles) == ResourceState::UnorderedAccess, name, "particles do not start as UAV") && isCorrect;
+
+    return expectRecording(graph, &recording, {
+        "pass simulate",
+        "uav particles",
+        "pass integrate",
+        "transition back buffer Present -> RenderTarget",
+        "transition particles UnorderedAccess -> NonPixelShaderResource",
+        "pass draw",
+        "transition back buffer RenderTarget -> Present",
+        "transition particles NonPixelShaderResource -> UnorderedAccess",
+    }, name) && isCorrect;
+}
+
+int main()
+{
+    const bool isDeferredFrameCorrect = checkDeferredFrame();
+    const bool isComputeChainCorrect = checkComputeChain();
+    if (!isDeferredFrameCorrect || !isComputeChainCorrect)
+    {
+        return 1;
+    }
+    printf("RenderGraph: culling, placement and barriers as expected\n");
+    return 0;
+}
@@ -0,0 +1,203 @@
+// Replays a log recorded with "game.exe -record file" through Game without
+// a window, a GPU or a clock: the same ProcessTicks calls with the same
+// input, back to back. Checks the state hash after every call against the
+// recorded one and reports how fast the simulation ran, so a log doubles
+// as a reproducible benchmark.
+//
+// Game.h includes DirectXMath, on Linux take its headers from
+// https://github.com/microsoft/DirectXMath and the sal.h stub of
+// https://github.com/microsoft/DirectX-Headers.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/replay_game.cpp -o replay_game
+//     ./replay_game -g 60 1 game.rply
+//     ./replay_game game.rply 10
+//
+// Usage: replay_game [-g seconds seed] log_file [repeats]
+//
+// -g records a log of a synthetic session to log_file first, ticks
+// grouped into calls of one to three the way a main loop catching up
+// would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Game.h"
+#include "Replay.h"
+
+static bool record(const char* path, uint32_t seconds, uint32_t seed)
+{
+    ReplayWriter recorder;
+    // Heap allocated, it is too large for the stack
+    std::unique_ptr<Game> game(new Game());
+    game->seed = seed;
+    if (!recorder.Open(path, game->seed, Game::TICK_NANOSECONDS))
+    {
+        return false;
+    }
+    game->recorder = &recorder;
+
+    std::mt19937 random(seed);
+    int32_t x = 400;
+    int32_t y = 300;
+    uint64_t time = 0;
+    const uint64_t end = seconds * 1000000000ull;
+    for (uint64_t nextTick = Game::TICK_NANOSECONDS; nextTick <= end; )
+    {
+        const uint64_t numberOfTicks = 1 + random() % 3;
+        for (const uint64_t callEnd = nextTick + (numberOfTicks - 1) * Game::TICK_NANOSECONDS; time < callEnd; time += 1000000)
+        {
+            x = std::min(std::max(x + static_cast<int32_t>(random() % 9) - 4, 0), 799);
+            y = std::min(std::max(y + static_cast<int32_t>(random() % 9) - 4, 0), 599);
+            game->input.Push({ time, InputEventType::MouseMove, 0, x, y });
+            if (random() % 80 == 0)
+            {
+                const uint32_t key = 'A' + random() % 26;
+                const InputEventType type = game->inputState.IsKeyDown(key) ? InputEventType::KeyUp : InputEventType::KeyDown;
+                game->input.Push({ time, type, key, 0, 0 });
+            }
+            if (random() % 250 == 0)
+            {
+                game->input.Push({ time, InputEventType::MouseWheel, 0, 0, random() % 2 ? 120 : -120 });
+            }
+        }
+        game->ProcessTicks(numberOfTicks, nextTick);
+        nextTick += numberOfTicks * Game::TICK_NANOSECONDS;
+    }
+    game->recorder = nullptr;
+    return recorder.Close();
+}
+
+struct Replayed
+{
+    uint64_t calls;
+    uint64_t ticks;
+    uint64_t events;
+    uint64_t nanoseconds;
+    // Call index of the first hash that differs, or UINT64_MAX
+    uint64_t firstMismatch;
+    uint64_t stateHash;
+};
+
+static bool replay(const char* path, Replayed* replayed)
+{
+    ReplayReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "Unable to read %s, or it is not a replay log\n", path);
+        return false;
+    }
+    if (reader.TickNanoseconds() != Game::TICK_NANOSECONDS)
+    {
+        fprintf(stderr, "%s was recorded with %llu ns ticks, the game runs %llu ns ones\n",
+            path,
+            static_cast<unsigned long long>(reader.TickNanoseconds()),
+            static_cast<unsigned long long>(Game::TICK_NANOSECONDS)
+        );
+        return false;
+    }
+
+    // Read up front, so the timing only covers the simulation
+    struct Call
+    {
+        ReplayLog::Call                call;
+        std::vector<ReplayLog::Event> events;
+    };
+    std::vector<Call> calls;
+    for (Call call; reader.Next(&call.call, &call.events); )
+    {
+        if (call.events.size() > INPUT_QUEUE_CAPACITY)
+        {
+            fprintf(stderr, "Call %zu has %zu events, more than the input queue holds\n", calls.size(), call.events.size());
+            return false;
+        }
+        calls.push_back(std::move(call));
+    }
+    if (reader.IsTruncated())
+    {
+        fprintf(stderr, "%s is truncated, replaying %zu complete calls\n", path, calls.size());
+    }
+
+    *replayed = {};
+    replayed->firstMismatch = UINT64_MAX;
+    std::unique_ptr<Game> game(new Game());
+    game->seed = reader.Seed();
+    // Any start works, ticks only compare input times against each other
+    uint64_t nextTick = Game::TICK_NANOSECONDS;
+    const uint64_t start = EventLoop::Now();
+    for (const Call& call : calls)
+    {
+        for (const ReplayLog::Event& event : call.events)
+        {
+            game->input.Push(ReplayReader::ToInputEvent(event, nextTick, Game::TICK_NANOSECONDS));
+        }
+        game->ProcessTicks(call.call.numberOfTicks, nextTick);
+        nextTick += call.call.numberOfTicks * Game::TICK_NANOSECONDS;
+        if (replayed->firstMismatch == UINT64_MAX && game->StateHash() != call.call.stateHash)
+        {
+            replayed->firstMismatch = replayed->calls;
+        }
+        ++replayed->calls;
+        replayed->ticks += call.call.numberOfTicks;
+        replayed->events += call.events.size();
+    }
+    replayed->nanoseconds = EventLoop::Now() - start;
+    replayed->stateHash = game->StateHash();
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const bool isRecording = argc >= 5 && !strcmp(argv[1], "-g");
+    const int pathArgument = isRecording ? 4 : 1;
+    if (argc < pathArgument + 1 || argc > pathArgument + 2)
+    {
+        fprintf(stderr, "Usage: %s [-g seconds seed] log_file [repeats]\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[pathArgument];
+    const int repeats = argc > pathArgument + 1 ? std::max(atoi(argv[pathArgument + 1]), 1) : 1;
+    if (isRecording && !record(path, static_cast<uint32_t>(atoi(argv[2])), static_cast<uint32_t>(atoi(argv[3]))))
+    {
+        fprintf(stderr, "Unable to record %s\n", path);
+        return 1;
+    }
+
+    uint64_t bestNanoseconds = UINT64_MAX;
+    Replayed replayed = {};
+    for (int repeat = 0; repeat < repeats; ++repeat)
+    {
+        if (!replay(path, &replayed))
+        {
+            return 1;
+        }
+        if (replayed.firstMismatch != UINT64_MAX)
+        {
+            fprintf(stderr, "State diverged from the recording at call %llu of %llu\n",
+                static_cast<unsigned long long>(replayed.firstMismatch),
+                static_cast<unsigned long long>(replayed.calls)
+            );
+            return 1;
+        }
+        bestNanoseconds = std::min(bestNanoseconds, std::max<uint64_t>(replayed.nanoseconds, 1));
+    }
+
+    printf("%llu calls, %llu ticks (%.1f s of game time), %llu events\n",
+        static_cast<unsigned long long>(replayed.calls),
+        static_cast<unsigned long long>(replayed.ticks),
+        replayed.ticks * Game::TICK_NANOSECONDS / 1e9,
+        static_cast<unsigned long long>(replayed.events)
+    );
+    printf("best of %d: %.2f ms, %.0f ticks/s\n",
+        repeats,
+        bestNanoseconds / 1e6,
+        replayed.ticks * 1e9 / bestNanoseconds
+    );
+    printf("state hash %016llx, matches the recording\n", static_cast<unsigned long long>(replayed.stateHash));
+    return 0;
+}
@@ -0,0 +1,219 @@
+// Linux check of ResourceStateTracker: records a command stream in which
+// every draw flushes the queued barriers first, the way the renderer does,
+// and compares it line by line with the expected stream. Covers merging of
+// queued transitions, transitions that cancel out, combined read states,
+// per subresource tracking, and transitions ordered around aliasing and
+// UAV barriers.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared scripts/src/resource_state_tracker_check.cpp -o resource_state_tracker_check
+//     ./resource_state_tracker_check
+//
+// Prints every mismatch and exits with 1 when there is one.
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ResourceStateTracker.h"
+
+// Stand-ins for ID3D12Resource*, only compared by address
+struct FakeResource
+{
+    const char* name;
+};
+
+static std::string stateName(ResourceState state)
+{
+    static const struct { ResourceState state; const char* name; } names[] = {
+        { ResourceState::RenderTarget,           "RenderTarget" },
+        { ResourceState::DepthWrite,             "DepthWrite" },
+        { ResourceState::DepthRead,              "DepthRead" },
+        { ResourceState::PixelShaderResource,    "PixelShaderResource" },
+        { ResourceState::NonPixelShaderResource, "NonPixelShaderResource" },
+        { ResourceState::UnorderedAccess,        "UnorderedAccess" },
+        { ResourceState::CopySource,             "CopySource" },
+        { ResourceState::CopyDest,               "CopyDest" },
+        { ResourceState::Present,                "Present" },
+    };
+    std::string result;
+    for (const auto& entry : names)
+    {
+        if ((state & entry.state) == entry.state)
+        {
+            result += (result.empty() ? "" : "|") + std::string(entry.name);
+        }
+    }
+    return result.empty() ? "Common" : result;
+}
+
+class CommandStream final
+{
+public:
+    explicit CommandStream(ResourceStateTracker* tracker) : m_tracker(tracker) {}
+
+    void Draw(const char* name)
+    {
+        m_tracker->Flush([this](const ResourceStateTracker::Barrier* barriers, uint32_t count)
+        {
+            m_lines.push_back("barriers " + std::to_string(count));
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_lines.push_back(describe(barriers[i]));
+            }
+        });
+        m_lines.push_back(std::string("draw ") + name);
+    }
+
+    const std::vector<std::string>& Lines() const { return m_lines; }
+
+private:
+    ResourceStateTracker*    m_tracker;
+    std::vector<std::string> m_lines;
+
+    static std::string describe(const ResourceStateTracker::Barrier& barrier)
+    {
+        const char* name = static_cast<FakeResource*>(barrier.resource)->name;
+        switch (barrier.type)
+        {
+        case ResourceStateTracker::BarrierType::Transition:
+            return std::string("  transition ") + name +
+                (barrier.subresource == ResourceStateTracker::ALL_SUBRESOURCES ? "" : " #" + std::to_string(barrier.subresource)) +
+                " " + stateName(barrier.before) + " -> " + stateName(barrier.after);
+        case ResourceStateTracker::BarrierType::Aliasing:
+            return std::string("  aliasing ") + name + " after " +
+                (barrier.previousResource ? static_cast<FakeResource*>(barrier.previousResource)->name : "anything");
+        case ResourceStateTracker::BarrierType::UnorderedAccess:
+            return std::string("  uav ") + name;
+        }
+        return "  unknown barrier";
+    }
+};
+
+int main()
+{
+    FakeResource backBuffer = { "back buffer" };
+    FakeResource shadowMap = { "shadow map" };
+    FakeResource gBuffer = { "g-buffer" };
+    FakeResource mips = { "mips" };
+    FakeResource bloom = { "bloom" };
+    FakeResource particles = { "particles" };
+    FakeResource upload = { "upload" };
+
+    ResourceStateTracker tracker;
+    CommandStream stream(&tracker);
+    tracker.Register(&backBuffer, 1, ResourceState::Present);
+    tracker.Register(&shadowMap, 1, ResourceState::DepthWrite);
+    tracker.Register(&mips, 3, ResourceState::CopyDest);
+    tracker.Register(&particles, 1, ResourceState::UnorderedAccess);
+
+    // Queued transitions of one resource become one barrier
+    tracker.Transition(&backBuffer, ResourceState::CopyDest);
+    tracker.Transition(&backBuffer, ResourceState::RenderTarget);
+    // Going there and back again needs nothing
+    tracker.Transition(&shadowMap, ResourceState::PixelShaderResource);
+    tracker.Transition(&shadowMap, ResourceState::DepthWrite);
+    stream.Draw("shadows");
+
+    // Reads that follow each other share one combined state, and a read of
+    // a state already included is dropped
+    tracker.Transition(&shadowMap, ResourceState::PixelShaderResource);
+    stream.Draw("lighting");
+    tracker.Transition(&shadowMap, ResourceState::NonPixelShaderResource);
+    tracker.Transition(&shadowMap, ResourceState::PixelShaderResource);
+    stream.Draw("fog");
+
+    // Per mip while the mips disagree, one barrier for all once they agree
+    tracker.Transition(&mips, ResourceState::PixelShaderResource, 0);
+    stream.Draw("downsample 1");
+    tracker.Transition(&mips, ResourceState::PixelShaderResource, 1);
+    stream.Draw("downsample 2");
+    tracker.Transition(&mips, ResourceState::PixelShaderResource);
+    stream.Draw("sample mips");
+    tracker.Transition(&mips, ResourceState::CopyDest);
+    stream.Draw("upload mips");
+
+    // A transition queued before an aliasing barrier is not merged with one
+    // queued after it, the aliased memory changes owner in between
+    tracker.Transition(&gBuffer, ResourceState::RenderTarget);
+    tracker.Aliasing(&gBuffer, &bloom);
+    tracker.Transition(&bloom, ResourceState::RenderTarget);
+    tracker.Transition(&gBuffer, ResourceState::PixelShaderResource);
+    stream.Draw("bloom");
+
+    // Writes separated by a UAV barrier, then a read after it
+    stream.Draw("simulate");
+    tracker.UnorderedAccess(&particles);
+    tracker.Transition(&particles, ResourceState::NonPixelShaderResource);
+    stream.Draw("draw particles");
+
+    // Unregistered resources start in Common, nothing queued flushes nothing
+    tracker.Transition(&upload, ResourceState::CopySource);
+    tracker.Transition(&backBuffer, ResourceState::Present);
+    stream.Draw("copy and present");
+    stream.Draw("idle");
+
+    const std::vector<std::string> expected = {
+        "barriers 1",
+        "  transition back buffer Present -> RenderTarget",
+        "draw shadows",
+        "barriers 1",
+        "  transition shadow map DepthWrite -> PixelShaderResource",
+        "draw lighting",
+        "barriers 1",
+        "  transition shadow map PixelShaderResource -> PixelShaderResource|NonPixelShaderResource",
+        "draw fog",
+        "barriers 1",
+        "  transition mips #0 CopyDest -> PixelShaderResource",
+        "draw downsample 1",
+        "barriers 1",
+        "  transition mips #1 CopyDest -> PixelShaderResource",
+        "draw downsample 2",
+        "barriers 1",
+        "  transition mips #2 CopyDest -> PixelShaderResource",
+        "draw sample mips",
+        "barriers 1",
+        "  transition mips PixelShaderResource -> CopyDest",
+        "draw upload mips",
+        "barriers 4",
+        "  transition g-buffer Common -> RenderTarget",
+        "  aliasing bloom after g-buffer",
+        "  transition bloom Common -> RenderTarget",
+        "  transition g-buffer RenderTarget -> PixelShaderResource",
+        "draw bloom",
+        "draw simulate",
+        "barriers 2",
+        "  uav particles",
+        "  transition particles UnorderedAccess -> NonPixelShaderResource",
+        "draw draw particles",
+        "barriers 2",
+        "  transition upload Common -> CopySource",
+        "  transition back buffer RenderTarget -> Present",
+        "draw copy and present",
+        "draw idle",
+    };
+
+    bool isMatching = true;
+    const std::vector<std::string>& lines = stream.Lines();
+    for (size_t line = 0; line < std::max(lines.size(), expected.size()); ++line)
+    {
+        const std::string actual = line < lines.size() ? lines[line] : "(nothing)";
+        const std::string wanted = line < expected.size() ? expected[line] : "(nothing)";
+        if (actual != wanted)
+        {
+            fprintf(stderr, "line %zu: got '%s', expected '%s'\n", line, actual.c_str(), wanted.c_str());
+            isMatching = false;
+        }
+    }
+    if (tracker.State(&mips, 1) != ResourceState::CopyDest || tracker.State(&shadowMap) != (ResourceState::PixelShaderResource | ResourceState::NonPixelShaderResource))
+    {
+        fprintf(stderr, "tracked states do not match the recorded barriers\n");
+        isMatching = false;
+    }
+    if (!isMatching)
+    {
+        return 1;
+    }
+    printf("ResourceStateTracker: %zu lines of command stream as expected\n", lines.size());
+    return 0;
+}
@@ -0,0 +1,222 @@
+// Linux benchmark of SceneGraph::UpdateWorldMatrices: for every scene size,
+// the milliseconds of an update with a few, a hundredth and all of the
+// nodes dirty, and of inserting a few children under random parents
+// together with the update after them. Reports how many nodes every update
+// recomputed, and checks all world matrices against ones computed node by
+// node from the local transforms after every update. The graph is built
+// once more with the SSE kernels, which have to give the same bits as the
+// widest ones the CPU supports since the game hashes world matrices.
+//
+// SceneGraph.h includes DirectXMath, see scripts/src/replay_game.cpp for
+// where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/scene_graph_benchmark.cpp -o scene_graph_benchmark
+//     ./scene_graph_benchmark 20 10000 100000 1000000
+//
+// Usage: scene_graph_benchmark rounds node_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "SceneGraph.h"
+
+static constexpr uint32_t FEW_DIRTY_NODES = 10;
+static constexpr uint32_t INSERTED_NODES = 10;
+
+// The local transforms by node id, parents always have smaller ids
+struct Reference
+{
+    std::vector<uint32_t>          parents;
+    std::vector<DirectX::XMFLOAT3> positions;
+};
+
+struct Update
+{
+    double   milliseconds;
+    uint32_t updatedNodes;
+};
+
+static DirectX::XMFLOAT3 randomPosition(std::mt19937* random)
+{
+    return DirectX::XMFLOAT3(static_cast<float>((*random)() % 100), static_cast<float>((*random)() % 10), static_cast<float>((*random)() % 100));
+}
+
+static void addNode(SceneGraph* graph, Reference* reference, uint32_t parent, const DirectX::XMFLOAT3& position)
+{
+    graph->AddNode(parent, position, DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f));
+    reference->parents.push_back(parent);
+    reference->positions.push_back(position);
+}
+
+static void setPosition(SceneGraph* graph, Reference* reference, uint32_t node, const DirectX::XMFLOAT3& position)
+{
+    graph->SetLocalTransform(node, position, DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f));
+    reference->positions[node] = position;
+}
+
+static bool check(const SceneGraph& graph, const Reference& reference, const char* update)
+{
+    using namespace DirectX;
+
+    const uint32_t nodeCount = static_cast<uint32_t>(reference.parents.size());
+    std::vector<XMFLOAT4X4> worlds(nodeCount);
+    for (uint32_t node = 0; node < nodeCount; ++node)
+    {
+        XMMATRIX world = XMMatrixAffineTransformation(
+            XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f),
+            XMVectorZero(),
+            XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f),
+            XMLoadFloat3(&reference.positions[node])
+        );
+        if (reference.parents[node] != SceneGraph::NO_PARENT)
+        {
+            world = XMMatrixMultiply(world, XMLoadFloat4x4(&worlds[reference.parents[node]]));
+        }
+        XMStoreFloat4x4(&worlds[node], world);
+
+        const XMFLOAT4X4& actual = graph.WorldMatrices()[graph.SlotOf(node)];
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                if (fabsf(actual.m[row][column] - worlds[node].m[row][column]) > 1e-3f * std::max(1.0f, fabsf(worlds[node].m[row][column])))
+                {
+                    fprintf(stderr, "%u nodes, %s: node %u has the wrong world matrix\n", nodeCount, update, node);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static Update update(SceneGraph* graph)
+{
+    const uint64_t start = EventLoop::Now();
+    graph->UpdateWorldMatrices();
+    return { static_cast<double>(EventLoop::Now() - start) / 1e6, graph->LastUpdatedNodeCount() };
+}
+
+static void addMedian(std::vector<Update>* updates, Update* result)
+{
+    std::sort(updates->begin(), updates->end(), [](const Update& a, const Update& b) { return a.milliseconds < b.milliseconds; });
+    *result = (*updates)[updates->size() / 2];
+}
+
+static bool sameBitsWithSSE(const SceneGraph& graph, const Reference& reference, SimdLevel widest)
+{
+    SelectMatrixBatchKernels(SimdLevel::SSE);
+    SceneGraph sse;
+    for (uint32_t node = 0; node < reference.parents.size(); ++node)
+    {
+        sse.AddNode(reference.parents[node], reference.positions[node], DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f));
+    }
+    sse.UpdateWorldMatrices();
+    SelectMatrixBatchKernels(widest);
+    if (memcmp(sse.WorldMatrices(), graph.WorldMatrices(), graph.NodeCount() * sizeof(DirectX::XMFLOAT4X4)))
+    {
+        fprintf(stderr, "%u nodes: the %s kernels give other world matrices than SSE\n", graph.NodeCount(), SimdLevelName(widest));
+        return false;
+    }
+    return true;
+}
+
+static bool measure(uint32_t nodeCount, uint32_t rounds, SimdLevel widest)
+{
+    std::mt19937 random(nodeCount);
+    SceneGraph graph;
+    Reference reference;
+    for (uint32_t node = 0; node < nodeCount; ++node)
+    {
+        // Shallow and wide like a level, a tenth of the nodes are roots
+        addNode(&graph, &reference, node % 10 == 0 ? SceneGraph::NO_PARENT : random() % node, randomPosition(&random));
+    }
+    const Update build = update(&graph);
+    if (!check(graph, reference, "build") || !sameBitsWithSSE(graph, reference, widest))
+    {
+        return false;
+    }
+
+    const uint32_t dirtyCounts[] = { FEW_DIRTY_NODES, std::max(nodeCount / 100, 1u), nodeCount };
+    Update dirtyUpdates[3];
+    for (uint32_t kind = 0; kind < 3; ++kind)
+    {
+        std::vector<Update> updates;
+        for (uint32_t round = 0; round < rounds; ++round)
+        {
+            for (uint32_t dirty = 0; dirty < dirtyCounts[kind]; ++dirty)
+            {
+                const uint32_t node = dirtyCounts[kind] == nodeCount ? dirty : random() % nodeCount;
+                setPosition(&graph, &reference, node, randomPosition(&random));
+            }
+            updates.push_back(update(&graph));
+        }
+        addMedian(&updates, &dirtyUpdates[kind]);
+        if (!check(graph, reference, "dirty nodes"))
+        {
+            return false;
+        }
+    }
+
+    std::vector<Update> insertions;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        // Timed together with the update, which is where a rebuild would go
+        const uint64_t start = EventLoop::Now();
+        for (uint32_t inserted = 0; inserted < INSERTED_NODES; ++inserted)
+        {
+            const uint32_t parent = random() % static_cast<uint32_t>(reference.parents.size());
+            addNode(&graph, &reference, parent, randomPosition(&random));
+        }
+        Update insertion = update(&graph);
+        insertion.milliseconds = static_cast<double>(EventLoop::Now() - start) / 1e6;
+        insertions.push_back(insertion);
+    }
+    Update insertion;
+    addMedian(&insertions, &insertion);
+    if (!check(graph, reference, "insertions"))
+    {
+        return false;
+    }
+
+    printf("%10u %10.3f %10.3f %8u %10.3f %8u %10.3f %10.3f %8u\n",
+        nodeCount,
+        build.milliseconds,
+        dirtyUpdates[0].milliseconds,
+        dirtyUpdates[0].updatedNodes,
+        dirtyUpdates[1].milliseconds,
+        dirtyUpdates[1].updatedNodes,
+        dirtyUpdates[2].milliseconds,
+        insertion.milliseconds,
+        insertion.updatedNodes
+    );
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s rounds node_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t rounds = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    const SimdLevel widest = DetectSimdLevel();
+    SelectMatrixBatchKernels(widest);
+    printf("%s kernels, median of %u rounds, %u dirty nodes, %u nodes inserted per round\n", SimdLevelName(widest), rounds, FEW_DIRTY_NODES, INSERTED_NODES);
+    printf("%10s %10s %10s %8s %10s %8s %10s %10s %8s\n", "nodes", "build ms", "few ms", "updated", "1% ms", "updated", "all ms", "insert ms", "updated");
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), rounds, widest))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Compiles every permutation declared in ShaderPermutations.h with dxc, as
+// many at once as there are cores, and packs them into one ShaderLibrary.
+//
+// Usage: shader_library source_dir build_dir configuration
+//
+// Every .hlsl and .hlsli file in source_dir is scanned for quoted
+// includes. Programs whose source or entry point is missing fail the
+// build, files no program uses are reported. Compiled permutations are
+// cached in build_dir/cache under a hash of the program source, all it
+// includes, the dxc version and the flags, so only permutations whose
+// inputs changed are compiled again. Works with the Linux dxc as well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShaderLibrary.h"
+#include "include_scanner.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace fs = std::filesystem;
+
+struct SourceFile
+{
+    std::string              content;
+    uint64_t                 hash;
+    std::vector<std::string> includes;
+};
+
+struct Compilation
+{
+    fs::path    cachePath;
+    std::string command;
+    bool        isCached;
+    int         result;
+    double      milliseconds;
+};
+
+static bool readFile(const fs::path& path, std::string* data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    data->resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(&(*data)[0], data->size()));
+}
+
+// Sources by path relative to source_dir, with generic separators
+static bool discoverSources(const fs::path& sourceDir, std::map<std::string, SourceFile>* sources)
+{
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(sourceDir, error), end; !error && it != end; it.increment(error))
+    {
+        const std::string extension = it->path().extension().string();
+        if (!it->is_regular_file() || (extension != ".hlsl" && extension != ".hlsli"))
+        {
+            continue;
+        }
+        SourceFile source;
+        if (!readFile(it->path(), &source.content))
+        {
+            fprintf(stderr, "Unable to read %s\n", it->path().string().c_str());
+            return false;
+        }
+        source.hash = HashBytes(source.content.data(), source.content.size());
+        for (const std::string& include : QuotedIncludes(source.content))
+        {
+            const fs::path resolved = ResolveInclude(it->path(), include, { sourceDir });
+            if (!resolved.empty())
+            {
+                source.includes.push_back(resolved.lexically_relative(sourceDir).generic_string());
+            }
+        }
+        (*sources)[it->path().lexically_relative(sourceDir).generic_string()] = std::move(source);
+    }
+    return !error;
+}
+
+// A function named entryPoint, not just the word somewhere in a comment
+static bool hasEntryPoint(const std::string& content, const char* entryPoint)
+{
+    const size_t length = strlen(entryPoint);
+    for (size_t position = content.find(entryPoint); position != std::string::npos; position = content.find(entryPoint, position + 1))
+    {
+        const bool startsWord = position == 0 || !(isalnum(static_cast<unsigned char>(content[position - 1])) || content[position - 1] == '_');
+        const size_t next = content.find_first_not_of(" \t\r\n", position + length);
+        if (startsWord && next != std::string::npos && content[next] == '(')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hash of a program source and everything it includes, marks them as used
+static uint64_t programHash(
+    const std::map<std::string, SourceFile>& sources,
+    const std::string& path,
+    std::set<std::string>* used)
+{
+    std::set<std::string> visited;
+    std::vector<std::string> stack = { path };
+    while (!stack.empty())
+    {
+        const std::string current = stack.back();
+        stack.pop_back();
+        const auto source = sources.find(current);
+        if (source == sources.end() || !visited.insert(current).second)
+        {
+            continue;
+        }
+        stack.insert(stack.end(), source->second.includes.begin(), source->second.includes.end());
+    }
+    // Sorted by path, so the order includes are found in does not matter
+    Hasher hasher;
+    for (const std::string& file : visited)
+    {
+        hasher.AddString(file.c_str()).AddU64(sources.at(file).hash);
+        used->insert(file);
+    }
+    return hasher.Finish();
+}
+
+static uint64_t compilerVersionHash()
+{
+    FILE* pipe = popen("dxc --version 2>&1", "r");
+    if (!pipe)
+    {
+        return 0;
+    }
+    std::string output;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), pipe))
+    {
+        output += buffer;
+    }
+    pclose(pipe);
+    return HashBytes(output.data(), output.size());
+}
+
+// Everything but the paths, those do not change the bytecode
+static std::string compileFlags(const ShaderPermutation& permutation, bool withDebugInfo)
+{
+    const ShaderProgramDesc& program = SHADER_PROGRAMS[static_cast<uint32_t>(permutation.program)];
+    std::string flags = "-nologo";
+    flags += std::string(" -T ") + program.profile;
+    flags += std::string(" -E ") + program.entryPoint;
+    for (uint32_t feature = 0; feature < SHADER_FEATURE_COUNT; ++feature)
+    {
+        flags += std::string(" -D ") + SHADER_FEATURE_DEFINES[feature] + ((permutation.features >> feature) & 1 ? "=1" : "=0");
+    }
+    if (withDebugInfo)
+    {
+        flags += " -Zi";
+    }
+    return flags;
+}
+
+static bool writeLibrary(const fs::path& path, const std::vector<Compilation>& compilations)
+{
+    std::vector<ShaderLibrary::Entry> entries(SHADER_PERMUTATION_COUNT);
+    std::vector<std::string> blobs(SHADER_PERMUTATION_COUNT);
+    uint64_t offset = sizeof(ShaderLibrary::Header) + entries.size() * sizeof(ShaderLibrary::Entry);
+    for (uint32_t index = 0; index < SHADER_PERMUTATION_COUNT; ++index)
+    {
+        if (!readFile(compilations[index].cachePath, &blobs[index]))
+        {
+            fprintf(stderr, "Unable to read %s\n", compilations[index].cachePath.string().c_str());
+            return false;
+        }
+        const ShaderPermutation permutation = ShaderPermutationAt(index);
+        offset = (offset + ShaderLibrary::ALIGNMENT - 1) / ShaderLibrary::ALIGNMENT * ShaderLibrary::ALIGNMENT;
+        entries[index].key = ShaderLibrary::Key(SHADER_PROGRAMS[static_cast<uint32_t>(permutation.program)].name, permutation.features);
+        entries[index].offset = offset;
+        entries[index].size = blobs[index].size();
+        offset += blobs[index].size();
+    }
+
+    ShaderLibrary::Header header = {};
+    header.magic = ShaderLibrary::MAGIC;
+    header.version = ShaderLibrary::VERSION;
+    header.entryCount = SHADER_PERMUTATION_COUNT;
+
+    std::vector<char> library(static_cast<size_t>(offset), 0);
+    memcpy(library.data(), &header, sizeof(header));
+    for (uint32_t index = 0; index < SHADER_PERMUTATION_COUNT; ++index)
+    {
+        memcpy(library.data() + entries[index].offset, blobs[index].data(), blobs[index].size());
+    }
+    std::sort(entries.begin(), entries.end(), [](const ShaderLibrary::Entry& left, const ShaderLibrary::Entry& right)
+    {
+        return left.key < right.key;
+    });
+    memcpy(library.data() + sizeof(header), entries.data(), entries.size() * sizeof(ShaderLibrary::Entry));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(library.data(), library.size());
+    return static_cast<bool>(file);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s source_dir build_dir configuration\n", argv[0]);
+        return 1;
+    }
+    const fs::path sourceDir = argv[1];
+    const fs::path buildDir = argv[2];
+    const bool withDebugInfo = std::string(argv[3]) != "release";
+    const auto start = std::chrono::steady_clock::now();
+
+    std::map<std::string, SourceFile> sources;
+    if (!discoverSources(sourceDir, &sources))
+    {
+        return 1;
+    }
+    std::set<std::string> used;
+    uint64_t programHashes[SHADER_PROGRAM_COUNT];
+    bool hasFailed = false;
+    for (uint32_t program = 0; program < SHADER_PROGRAM_COUNT; ++program)
+    {
+        const ShaderProgramDesc& desc = SHADER_PROGRAMS[program];
+        const auto source = sources.find(desc.source);
+        if (source == sources.end())
+        {
+            fprintf(stderr, "%s: %s not found in %s\n", desc.name, desc.source, sourceDir.string().c_str());
+            hasFailed = true;
+            continue;
+        }
+        if (!hasEntryPoint(source->second.content, desc.entryPoint))
+        {
+            fprintf(stderr, "%s: entry point %s not found in %s\n", desc.name, desc.entryPoint, desc.source);
+            hasFailed = true;
+        }
+        programHashes[program] = programHash(sources, desc.source, &used);
+    }
+    if (hasFailed)
+    {
+        return 1;
+    }
+    for (const auto& source : sources)
+    {
+        if (!used.count(source.first))
+        {
+            printf("Warning: %s is not used by any program in ShaderPermutations.h\n", source.first.c_str());
+        }
+    }
+
+    const fs::path cacheDir = buildDir / "cache";
+    fs::create_directories(cacheDir);
+    const uint64_t versionHash = compilerVersionHash();
+    std::vector<Compilation> compilations(SHADER_PERMUTATION_COUNT);
+    std::vector<uint32_t> pending;
+    for (uint32_t index = 0; index < SHADER_PERMUTATION_COUNT; ++index)
+    {
+        const ShaderPermutation permutation = ShaderPermutationAt(index);
+        const ShaderProgramDesc& program = SHADER_PROGRAMS[static_cast<uint32_t>(permutation.program)];
+        const std::string flags = compileFlags(permutation, withDebugInfo);
+        const uint64_t key = Hasher()
+            .AddU64(programHashes[static_cast<uint32_t>(permutation.program)])
+            .AddU64(versionHash)
+            .AddString(flags.c_str())
+            .Finish();
+        char name[96];
+        snprintf(name, sizeof(name), "%s_%02x_%016llx.cso", program.name, permutation.features, static_cast<unsigned long long>(key));
+
+        Compilation& compilation = compilations[index];
+        compilation.cachePath = cacheDir / name;
+        compilation.isCached = fs::exists(compilation.cachePath);
+        compilation.result = 0;
+        compilation.milliseconds = 0.0;
+        if (compilation.isCached)
+        {
+            continue;
+        }
+        // Written next to the cache entry and renamed once complete, an
+        // interrupted build never leaves a broken entry behind
+        fs::path temporaryPath = compilation.cachePath;
+        temporaryPath.replace_extension(".tmp");
+        compilation.command = "dxc " + flags;
+        if (withDebugInfo)
+        {
+            fs::path pdbPath = compilation.cachePath;
+            pdbPath.replace_extension(".pdb");
+            compilation.command += " -Fd \"" + pdbPath.string() + "\"";
+        }
+        compilation.command += " -Fo \"" + temporaryPath.string() + "\"";
+        compilation.command += " \"" + (sourceDir / program.source).string() + "\"";
+        pending.push_back(index);
+    }
+
+    std::atomic<size_t> next{0};
+    const size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), pending.size()));
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < threadCount && !pending.empty(); ++thread)
+    {
+        threads.emplace_back([&]
+        {
+            for (size_t job = next++; job < pending.size(); job = next++)
+            {
+                Compilation& compilation = compilations[pending[job]];
+                const auto compileStart = std::chrono::steady_clock::now();
+                compilation.result = system(compilation.command.c_str());
+                compilation.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+                if (!compilation.result)
+                {
+                    fs::path temporaryPath = compilation.cachePath;
+                    temporaryPath.replace_extension(".tmp");
+                    std::error_code error;
+                    fs::rename(temporaryPath, compilation.cachePath, error);
+                    compilation.result = error ? 1 : 0;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (uint32_t index = 0; index < SHADER_PERMUTATION_COUNT; ++index)
+    {
+        const Compilation& compilation = compilations[index];
+        const ShaderPermutation permutation = ShaderPermutationAt(index);
+        const char* name = SHADER_PROGRAMS[static_cast<uint32_t>(permutation.program)].name;
+        if (compilation.isCached)
+        {
+            printf("    %-16s %02x   cached\n", name, permutation.features);
+        } else if (compilation.result) {
+            printf("    %-16s %02x   FAILED %s\n", name, permutation.features, compilation.command.c_str());
+            hasFailed = true;
+        } else {
+            printf("    %-16s %02x %8.1f ms\n", name, permutation.features, compilation.milliseconds);
+        }
+    }
+    if (hasFailed || !writeLibrary(buildDir / "shaders.lib", compilations))
+    {
+        return 1;
+    }
+    printf("Packed %u shader permutations, %zu compiled on %zu threads in %.1f ms\n",
+        SHADER_PERMUTATION_COUNT,
+        pending.size(),
+        threadCount,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+    );
+    return 0;
+}
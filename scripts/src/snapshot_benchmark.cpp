@@ -0,0 +1,179 @@
+// Linux benchmark of Game snapshots: for every scene size, the cost of
+// saving and restoring the whole state and of encoding and decoding the
+// delta between the snapshots of consecutive ticks, with a few percent of
+// the nodes moving. Every round also rolls back a few ticks, simulates
+// them again and checks that the state comes out byte for byte the same.
+//
+// Game.h includes DirectXMath, see scripts/src/replay_game.cpp for where
+// to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/snapshot_benchmark.cpp -o snapshot_benchmark
+//     ./snapshot_benchmark 20 1000 10000 100000 1000000
+//
+// Usage: snapshot_benchmark rounds node_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Game.h"
+#include "Snapshot.h"
+
+// Of the nodes, per tick
+static constexpr uint32_t MOVING_PERCENT = 2;
+static constexpr uint32_t ROLLBACK_TICKS = 4;
+
+struct Timings
+{
+    std::vector<uint64_t> save;
+    std::vector<uint64_t> restore;
+    std::vector<uint64_t> encode;
+    std::vector<uint64_t> decode;
+    uint64_t              deltaBytes;
+};
+
+static uint64_t median(std::vector<uint64_t> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0 : values[values.size() / 2];
+}
+
+static void buildScene(Game* game, uint32_t nodeCount, std::mt19937* random)
+{
+    for (uint32_t node = 0; node < nodeCount; ++node)
+    {
+        // Shallow and wide like a level, a tenth of the nodes are roots
+        const uint32_t parent = node % 10 == 0 ? SceneGraph::NO_PARENT : (*random)() % node;
+        game->sceneGraph.AddNode(
+            parent,
+            DirectX::XMFLOAT3(static_cast<float>((*random)() % 100), 0.0f, static_cast<float>((*random)() % 100)),
+            DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f),
+            DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f)
+        );
+    }
+    game->ProcessTicks(1, Game::TICK_NANOSECONDS);
+}
+
+// A tick of a few moving nodes, the same for the same tick index
+static void tick(Game* game, uint64_t index)
+{
+    std::mt19937 random(static_cast<uint32_t>(index));
+    const uint32_t nodeCount = game->sceneGraph.NodeCount();
+    for (uint32_t moved = 0; moved < std::max(nodeCount * MOVING_PERCENT / 100, 1u); ++moved)
+    {
+        const float offset = static_cast<float>(random() % 1000) / 100.0f;
+        game->sceneGraph.SetLocalTransform(
+            random() % nodeCount,
+            DirectX::XMFLOAT3(offset, 1.0f, offset),
+            DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f),
+            DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f)
+        );
+    }
+    game->ProcessTicks(1, (index + 2) * Game::TICK_NANOSECONDS);
+}
+
+static bool measure(uint32_t nodeCount, uint32_t rounds)
+{
+    std::mt19937 random(nodeCount);
+    // Heap allocated, it is too large for the stack
+    std::unique_ptr<Game> game(new Game());
+    buildScene(game.get(), nodeCount, &random);
+
+    Timings timings = {};
+    Snapshot previous;
+    Snapshot current;
+    Snapshot decoded;
+    Snapshot rolledBack;
+    std::vector<uint8_t> encoded;
+    game->SaveSnapshot(&previous);
+    uint64_t tickIndex = 0;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        tick(game.get(), tickIndex++);
+
+        uint64_t start = EventLoop::Now();
+        game->SaveSnapshot(&current);
+        timings.save.push_back(EventLoop::Now() - start);
+
+        encoded.clear();
+        start = EventLoop::Now();
+        EncodeSnapshotDelta(previous, current, &encoded);
+        timings.encode.push_back(EventLoop::Now() - start);
+        timings.deltaBytes += encoded.size();
+
+        start = EventLoop::Now();
+        const bool isDecoded = DecodeSnapshotDelta(previous, encoded.data(), encoded.size(), &decoded);
+        timings.decode.push_back(EventLoop::Now() - start);
+        if (!isDecoded || !decoded.IsEqual(current))
+        {
+            fprintf(stderr, "%u nodes: the delta of round %u does not decode to its snapshot\n", nodeCount, round);
+            return false;
+        }
+
+        // Rollback: run ahead, go back to the snapshot and run the same
+        // ticks again
+        const uint64_t rollbackTick = tickIndex;
+        for (uint32_t ahead = 0; ahead < ROLLBACK_TICKS; ++ahead)
+        {
+            tick(game.get(), tickIndex++);
+        }
+        game->SaveSnapshot(&rolledBack);
+        start = EventLoop::Now();
+        const bool isRestored = game->RestoreSnapshot(current);
+        timings.restore.push_back(EventLoop::Now() - start);
+        tickIndex = rollbackTick;
+        for (uint32_t ahead = 0; ahead < ROLLBACK_TICKS; ++ahead)
+        {
+            tick(game.get(), tickIndex++);
+        }
+        game->SaveSnapshot(&decoded);
+        if (!isRestored || !decoded.IsEqual(rolledBack))
+        {
+            fprintf(stderr, "%u nodes: resimulating after the rollback of round %u diverged\n", nodeCount, round);
+            return false;
+        }
+        game->SaveSnapshot(&previous);
+    }
+
+    const double megabytes = current.Size() / 1e6;
+    const uint64_t save = std::max<uint64_t>(median(timings.save), 1);
+    const uint64_t restore = std::max<uint64_t>(median(timings.restore), 1);
+    printf("%9u %10.2f %10.1f %8.2f %10.1f %8.2f %10.1f %7.2f%% %10.1f %10.1f\n",
+        nodeCount,
+        megabytes,
+        save / 1000.0,
+        megabytes * 1e6 / save,
+        restore / 1000.0,
+        megabytes * 1e6 / restore,
+        timings.deltaBytes / 1e3 / rounds,
+        100.0 * timings.deltaBytes / rounds / current.Size(),
+        median(timings.encode) / 1000.0,
+        median(timings.decode) / 1000.0
+    );
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s rounds node_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t rounds = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    printf("%9s %10s %10s %8s %10s %8s %10s %8s %10s %10s\n",
+        "nodes", "state MB", "save us", "GB/s", "restore us", "GB/s", "delta KB", "of state", "encode us", "decode us"
+    );
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(atoi(argv[argument])), rounds))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
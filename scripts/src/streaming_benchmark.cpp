@@ -0,0 +1,96 @@
+// Linux benchmark of the StreamingLoader: streams every entry of an
+// archive with a cold page cache and reports throughput and queue depth
+// for every queue depth given.
+//
+//     g++ -std=c++17 -O2 -pthread -Isrc/shared scripts/src/streaming_benchmark.cpp -o streaming_benchmark
+//     ./streaming_benchmark assets.pak 64 1 4 16 64
+//
+// Usage: streaming_benchmark archive_file budget_mb queue_depth ...
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "Streaming.h"
+
+static void evict(const char* path)
+{
+    const int file = open(path, O_RDONLY);
+    if (file >= 0)
+    {
+        posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+        close(file);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s archive_file budget_mb queue_depth ...\n", argv[0]);
+        return 1;
+    }
+    const char* archivePath = argv[1];
+    Archive archive;
+    if (!archive.Open(archivePath))
+    {
+        fprintf(stderr, "Unable to open %s\n", archivePath);
+        return 1;
+    }
+    uint64_t storedBytes = 0;
+    uint64_t expandedBytes = 0;
+    for (uint32_t entry = 0; entry < archive.EntryCount(); ++entry)
+    {
+        storedBytes += archive.Span(entry).size;
+        expandedBytes += archive.Size(entry);
+    }
+    printf("%u entries, %.1f MB stored, %.1f MB expanded\n",
+        archive.EntryCount(), storedBytes / 1048576.0, expandedBytes / 1048576.0);
+
+    for (int argument = 3; argument < argc; ++argument)
+    {
+        StreamingLoader::Config config;
+        config.memoryBudget = static_cast<size_t>(atoi(argv[2])) * 1024 * 1024;
+        config.queueDepth = static_cast<uint32_t>(atoi(argv[argument]));
+        evict(archivePath);
+
+        StreamingLoader loader;
+        const auto start = std::chrono::steady_clock::now();
+        if (!loader.Initialize(archivePath, &archive, config))
+        {
+            fprintf(stderr, "Unable to stream %s\n", archivePath);
+            return 1;
+        }
+        for (uint32_t entry = 0; entry < archive.EntryCount(); ++entry)
+        {
+            loader.Request(entry);
+        }
+        uint64_t checksum = 0;
+        uint32_t failed = 0;
+        while (loader.Outstanding())
+        {
+            loader.Wait();
+            loader.Poll([&](const StreamingLoader::Result& result)
+            {
+                failed += result.failed;
+                checksum += result.size ? static_cast<const uint8_t*>(result.data)[result.size - 1] : 0;
+            });
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const StreamingLoader::Stats stats = loader.GetStats();
+        printf("queue depth %3u: %8.1f MB/s read %8.1f MB/s expanded, depth avg %5.1f max %3u, %llu reads, peak %.1f MB, %u failed, checksum %llu\n",
+            config.queueDepth,
+            stats.bytesRead / 1048576.0 / seconds,
+            expandedBytes / 1048576.0 / seconds,
+            stats.averageQueueDepth,
+            stats.maxQueueDepth,
+            static_cast<unsigned long long>(stats.readCount),
+            stats.peakMemory / 1048576.0,
+            failed,
+            static_cast<unsigned long long>(checksum)
+        );
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Linux benchmark of CullSpheres and CullBoxes: for every bounds count,
+// random boxes are scattered around a camera and culled against its
+// frustum. Reports the throughput in bounds per millisecond with the
+// kernels of every SIMD level up to the widest the CPU supports, the best
+// of the given number of repeats, and checks every level against a scalar
+// cull in double precision. Bounds within rounding distance of a plane may
+// go either way.
+//
+// Visibility.h includes DirectXMath through MatrixBatch.h, see
+// scripts/src/replay_game.cpp for where to take its headers from on Linux.
+//
+//     g++ -std=c++17 -O2 -Isrc/shared -IDirectXMath/Inc -IDirectX-Headers/include/wsl/stubs scripts/src/visibility_benchmark.cpp -o visibility_benchmark
+//     ./visibility_benchmark 20 10000 1000000
+//
+// Usage: visibility_benchmark repeats bounds_count ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Visibility.h"
+
+static constexpr float WORLD_HALF_SIZE = 500.0f;
+// Of the distance to a plane, below which the kernels may disagree with
+// the reference
+static constexpr double TOLERANCE = 1e-3;
+
+// Camera at the origin looking down +z, row vector convention like
+// DirectXMath's XMMatrixPerspectiveFovLH
+static void perspective(float fovY, float aspect, float nearZ, float farZ, float m[4][4])
+{
+    const float yScale = 1.0f / tanf(fovY * 0.5f);
+    const float range = farZ / (farZ - nearZ);
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            m[row][column] = 0.0f;
+        }
+    }
+    m[0][0] = yScale / aspect;
+    m[1][1] = yScale;
+    m[2][2] = range;
+    m[2][3] = 1.0f;
+    m[3][2] = -range * nearZ;
+}
+
+// 1 inside, 0 outside, -1 too close to a plane to tell
+static int reference(const FrustumPlanes& planes, const BoundsStore& bounds, uint32_t index, bool isBox)
+{
+    int result = 1;
+    for (uint32_t p = 0; p < FrustumPlanes::PLANE_COUNT; ++p)
+    {
+        double distance =
+            static_cast<double>(planes.a[p]) * bounds.centerX[index] +
+            static_cast<double>(planes.b[p]) * bounds.centerY[index] +
+            static_cast<double>(planes.c[p]) * bounds.centerZ[index] +
+            planes.d[p];
+        if (isBox)
+        {
+            distance +=
+                fabs(static_cast<double>(planes.a[p])) * bounds.extentX[index] +
+                fabs(static_cast<double>(planes.b[p])) * bounds.extentY[index] +
+                fabs(static_cast<double>(planes.c[p])) * bounds.extentZ[index];
+        } else {
+            distance += bounds.radius[index];
+        }
+        if (distance < -TOLERANCE)
+        {
+            return 0;
+        }
+        if (distance < TOLERANCE)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static bool check(const FrustumPlanes& planes, const BoundsStore& bounds, const VisibleSet& visible, bool isBox)
+{
+    std::vector<uint8_t> isVisible(bounds.Count(), 0);
+    for (uint32_t i = 0; i < visible.count; ++i)
+    {
+        if (visible.indices[i] >= bounds.Count() || (i && visible.indices[i] <= visible.indices[i - 1]))
+        {
+            fprintf(stderr, "%u bounds: %s culling reported padding or out of order indices\n", bounds.Count(), isBox ? "box" : "sphere");
+            return false;
+        }
+        isVisible[visible.indices[i]] = 1;
+    }
+    for (uint32_t index = 0; index < bounds.Count(); ++index)
+    {
+        const int expected = reference(planes, bounds, index, isBox);
+        if (expected >= 0 && expected != isVisible[index])
+        {
+            fprintf(stderr, "%u bounds: %s culling disagrees with the reference at %u\n", bounds.Count(), isBox ? "box" : "sphere", index);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Cull>
+static double boundsPerMillisecond(uint32_t repeatCount, uint32_t boundsCount, const Cull& cull)
+{
+    uint64_t best = UINT64_MAX;
+    for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+    {
+        const uint64_t start = EventLoop::Now();
+        cull();
+        best = std::min(best, EventLoop::Now() - start);
+    }
+    return static_cast<double>(boundsCount) / std::max(best / 1e6, 1e-6);
+}
+
+static bool measure(uint32_t boundsCount, uint32_t repeatCount, SimdLevel widest)
+{
+    std::mt19937 random(boundsCount);
+    std::uniform_real_distribution<float> position(-WORLD_HALF_SIZE, WORLD_HALF_SIZE);
+    std::uniform_real_distribution<float> halfExtent(0.5f, 2.0f);
+    BoundsStore bounds;
+    for (uint32_t index = 0; index < boundsCount; ++index)
+    {
+        bounds.Add(position(random), position(random), position(random), halfExtent(random), halfExtent(random), halfExtent(random));
+    }
+    float viewProjection[4][4];
+    perspective(1.0f, 16.0f / 9.0f, 0.1f, WORLD_HALF_SIZE, viewProjection);
+    FrustumPlanes planes;
+    planes.ExtractFrom(viewProjection);
+
+    for (uint32_t level = 0; level <= static_cast<uint32_t>(widest); ++level)
+    {
+        const SimdLevel simdLevel = static_cast<SimdLevel>(level);
+        SelectVisibilityKernels(simdLevel);
+        VisibleSet spheres;
+        VisibleSet boxes;
+        const double sphereRate = boundsPerMillisecond(repeatCount, boundsCount, [&] { CullSpheres(planes, bounds, &spheres); });
+        const double boxRate = boundsPerMillisecond(repeatCount, boundsCount, [&] { CullBoxes(planes, bounds, &boxes); });
+        if (!check(planes, bounds, spheres, false) || !check(planes, bounds, boxes, true))
+        {
+            fprintf(stderr, "with the %s kernels\n", SimdLevelName(simdLevel));
+            return false;
+        }
+        printf("%10u %8s %14.0f %14.0f %10u %10u\n", boundsCount, SimdLevelName(simdLevel), sphereRate, boxRate, spheres.count, boxes.count);
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s repeats bounds_count ...\n", argv[0]);
+        return 1;
+    }
+    const uint32_t repeatCount = static_cast<uint32_t>(std::max(atoi(argv[1]), 1));
+    const SimdLevel widest = DetectSimdLevel();
+    printf("Up to %s kernels, best of %u\n", SimdLevelName(widest), repeatCount);
+    printf("%10s %8s %14s %14s %10s %10s\n", "bounds", "kernels", "spheres/ms", "boxes/ms", "spheres in", "boxes in");
+    for (int argument = 2; argument < argc; ++argument)
+    {
+        if (!measure(static_cast<uint32_t>(std::max(atoi(argv[argument]), 1)), repeatCount, widest))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+// Permutations are declared in src/shared/ShaderPermutations.h
+struct ViewProjection
+{
+    matrix VP;
+};
+
+ConstantBuffer<ViewProjection> ViewProjectionCB: register(b0);
+
+// Per instance, laid out like ParticleInstance in src/shared/Particles.h
+struct ParticleInstance
+{
+    float3 Position: POSITION;
+    float Size: SIZE;
+    float4 Color: COLOR;
+};
+
+struct VertexShaderOutput
+{
+    float4 Color: COLOR;
+    float4 Position: SV_Position;
+};
+
+// 4 vertices per instance drawn as a triangle strip, no vertex buffer.
+// Corners go up before right, so both triangles wind clockwise.
+VertexShaderOutput main(ParticleInstance IN, uint vertexId: SV_VertexID)
+{
+    VertexShaderOutput OUT;
+    const float2 corner = float2(vertexId >> 1, vertexId & 1) - 0.5f;
+    OUT.Position = mul(ViewProjectionCB.VP, float4(IN.Position, 1.0f));
+    // The first two rows are the camera right and up axes scaled by the
+    // projection, offsetting in clip space keeps the quad facing the camera
+    OUT.Position.x += corner.x * IN.Size * length(ViewProjectionCB.VP[0].xyz);
+    OUT.Position.y += corner.y * IN.Size * length(ViewProjectionCB.VP[1].xyz);
+    OUT.Color = IN.Color;
+    return OUT;
+}
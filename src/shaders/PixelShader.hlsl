@@ -1,3 +1,4 @@
+// Permutations are declared in src/shared/ShaderPermutations.h
 struct PixelShaderInput
 {
     float4 Color: COLOR;
@@ -5,5 +6,9 @@ struct PixelShaderInput
 
 float4 main( PixelShaderInput IN): SV_TARGET
 {
+#if DEBUG_COLOR
+    return lerp(IN.Color, float4(1.0f, 0.0f, 1.0f, 1.0f), 0.5f);
+#else
     return IN.Color;
+#endif
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+// Permutations are declared in src/shared/ShaderPermutations.h
 struct ModelViewProjection
 {
     matrix MVP;
@@ -8,7 +9,16 @@ ConstantBuffer<ModelViewProjection> ModelViewProjectionCB: register(b0);
 struct VertexPosColor
 {
     float3 Position: POSITION;
+#if !VERTEX_POSITION_ONLY
     float3 Color: COLOR;
+#endif
+#if INSTANCING
+    // Rows of the instance world matrix, MVP then holds view projection
+    float4 World0: WORLD0;
+    float4 World1: WORLD1;
+    float4 World2: WORLD2;
+    float4 World3: WORLD3;
+#endif
 };
 
 struct VertexShaderOutput
@@ -20,8 +30,17 @@ struct VertexShaderOutput
 VertexShaderOutput main(VertexPosColor IN)
 {
     VertexShaderOutput OUT;
-    OUT.Position = mul(ModelViewProjectionCB.MVP, float4(IN.Position, 1.0f));
+    float4 position = float4(IN.Position, 1.0f);
+#if INSTANCING
+    // The rows of an XMFLOAT4X4 world matrix, which transforms row vectors
+    position = mul(position, float4x4(IN.World0, IN.World1, IN.World2, IN.World3));
+#endif
+    OUT.Position = mul(ModelViewProjectionCB.MVP, position);
+#if VERTEX_POSITION_ONLY
+    OUT.Color = float4(normalize(IN.Position) * 0.5f + 0.5f, 1.0f);
+#else
     OUT.Color = float4(IN.Color, 1.0f);
+#endif
 
     return OUT;
 }
\ No newline at end of file
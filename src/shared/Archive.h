@@ -0,0 +1,312 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Hash.h"
+#include "Lz4.h"
+
+// Read only view of a whole file, mapped once and released on destruction
+class MappedFile final
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
+
+    bool Open(const char* path);
+    void Close();
+    // Starts reading a range in the background ahead of touching it
+    void Prefetch(size_t offset, size_t size) const;
+
+    const uint8_t* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+};
+
+struct ArchiveSpan
+{
+    const void* data;
+    size_t      size;
+};
+
+// Assets packed into one file that is memory mapped at startup:
+//
+//     Header
+//     Entry entries[entryCount]    sorted by name hash
+//     entry data, every entry 64KB aligned
+//
+// The alignment matches the mapping granularity and D3D12 placement
+// alignment, so uncompressed entries can be handed out in place with
+// Span() and never copied on the CPU. LZ4 compressed entries are expanded
+// by Read() directly into the destination, e.g. a mapped upload buffer.
+// Content hashes are of the uncompressed data, the packer stores
+// identical contents once. Stored hashes are of the bytes in the file,
+// which is what Read() checks, it never reads back its destination.
+class Archive final
+{
+public:
+    static constexpr uint32_t MAGIC = 0x4B434150; // "PACK"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t ALIGNMENT = 64 * 1024;
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    enum Compression : uint32_t
+    {
+        COMPRESSION_NONE = 0,
+        COMPRESSION_LZ4  = 1,
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+    };
+
+    struct Entry
+    {
+        uint64_t nameHash;
+        uint64_t contentHash;
+        uint64_t storedHash;
+        uint64_t offset;
+        uint64_t storedSize;
+        uint64_t size;
+        uint32_t compression;
+        uint32_t reserved;
+    };
+
+    static uint64_t NameHash(const char* name) { return Hasher().AddString(name).Finish(); }
+
+    // Fails when the file is missing, of another version or an entry
+    // points outside of it
+    bool Open(const char* path);
+    void Close();
+
+    uint32_t EntryCount() const { return m_entryCount; }
+    uint32_t Find(const char* name) const;
+
+    // Uncompressed size, the number of bytes Read() writes
+    size_t Size(uint32_t entry) const { return static_cast<size_t>(m_entries[entry].size); }
+    uint64_t ContentHash(uint32_t entry) const { return m_entries[entry].contentHash; }
+    bool IsCompressed(uint32_t entry) const { return m_entries[entry].compression != COMPRESSION_NONE; }
+    // Where the stored bytes start in the file, for readers not going
+    // through the mapping
+    uint64_t Offset(uint32_t entry) const { return m_entries[entry].offset; }
+
+    // Bytes as stored in the mapping, valid until Close()
+    ArchiveSpan Span(uint32_t entry) const;
+    // Fails when the stored bytes do not match their hash or do not expand
+    // to Size() bytes. Only writes to destination, which may be write
+    // combined memory.
+    bool Read(uint32_t entry, void* destination) const;
+    void Prefetch(uint32_t entry) const;
+
+private:
+    MappedFile   m_file;
+    const Entry* m_entries = nullptr;
+    uint32_t     m_entryCount = 0;
+};
+
+#pragma region MappedFile
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+    // The view keeps the mapping alive
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+    return m_data != nullptr;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>(m_data + offset), size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    const int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    void* data = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    // Entries are looked up one by one, reading around every fault would
+    // pull in neighbours nobody asked for. Prefetch() covers whole entries.
+    madvise(data, static_cast<size_t>(status.st_size), MADV_RANDOM);
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    // madvise needs a page aligned start, entries are aligned but the
+    // table of contents is not
+    const size_t pageOffset = offset % static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    madvise(const_cast<uint8_t*>(m_data + offset - pageOffset), size + pageOffset, MADV_WILLNEED);
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region Archive
+
+bool Archive::Open(const char* path)
+{
+    Close();
+    if (!m_file.Open(path) || m_file.Size() < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+    const Header* header = reinterpret_cast<const Header*>(m_file.Data());
+    if (header->magic != MAGIC ||
+        header->version != VERSION ||
+        (m_file.Size() - sizeof(Header)) / sizeof(Entry) < header->entryCount)
+    {
+        Close();
+        return false;
+    }
+    const Entry* entries = reinterpret_cast<const Entry*>(m_file.Data() + sizeof(Header));
+    for (uint32_t i = 0; i < header->entryCount; ++i)
+    {
+        const Entry& entry = entries[i];
+        if (entry.offset > m_file.Size() ||
+            entry.storedSize > m_file.Size() - entry.offset ||
+            entry.compression > COMPRESSION_LZ4 ||
+            (entry.compression == COMPRESSION_NONE && entry.storedSize != entry.size) ||
+            (i > 0 && entries[i - 1].nameHash >= entry.nameHash))
+        {
+            Close();
+            return false;
+        }
+    }
+    m_entries = entries;
+    m_entryCount = header->entryCount;
+    return true;
+}
+
+void Archive::Close()
+{
+    m_file.Close();
+    m_entries = nullptr;
+    m_entryCount = 0;
+}
+
+uint32_t Archive::Find(const char* name) const
+{
+    const uint64_t nameHash = NameHash(name);
+    const Entry* end = m_entries + m_entryCount;
+    const Entry* entry = std::lower_bound(m_entries, end, nameHash, [](const Entry& left, uint64_t right)
+    {
+        return left.nameHash < right;
+    });
+    if (entry == end || entry->nameHash != nameHash)
+    {
+        return NOT_FOUND;
+    }
+    return static_cast<uint32_t>(entry - m_entries);
+}
+
+ArchiveSpan Archive::Span(uint32_t entry) const
+{
+    return { m_file.Data() + m_entries[entry].offset, static_cast<size_t>(m_entries[entry].storedSize) };
+}
+
+bool Archive::Read(uint32_t entry, void* destination) const
+{
+    // The whole entry is needed, read it in one go instead of page by page
+    Prefetch(entry);
+    const ArchiveSpan stored = Span(entry);
+    if (HashBytes(stored.data, stored.size) != m_entries[entry].storedHash)
+    {
+        return false;
+    }
+    if (m_entries[entry].compression == COMPRESSION_LZ4)
+    {
+        return Lz4Decompress(stored.data, stored.size, destination, Size(entry));
+    }
+    if (stored.size)
+    {
+        memcpy(destination, stored.data, stored.size);
+    }
+    return true;
+}
+
+void Archive::Prefetch(uint32_t entry) const
+{
+    m_file.Prefetch(static_cast<size_t>(m_entries[entry].offset), static_cast<size_t>(m_entries[entry].storedSize));
+}
+
+#pragma endregion
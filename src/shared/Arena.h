@@ -0,0 +1,233 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+// Linear allocator: allocating bumps an offset into one block reserved up
+// front and everything is freed at once by Reset or by rewinding to a
+// Mark. The block is reused after a reset, so work that only allocates
+// from arenas does not touch the general heap once they exist.
+class Arena final
+{
+public:
+    static constexpr size_t CACHE_LINE = 64;
+
+    // Reserves the block right away, charged to tag as arena memory. An
+    // empty arena can still Borrow.
+    explicit Arena(size_t capacity = 0, MemoryTag tag = MemoryTag::Untagged);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { release(); }
+
+    // Allocates from memory owned by someone else, which outlives the arena
+    void Borrow(void* memory, size_t capacity);
+
+    // Null when the arena is full. alignment is a power of two.
+    void* Allocate(size_t size, size_t alignment = alignof(max_align_t));
+    // Uninitialized, nothing allocated from an arena is ever destroyed
+    template<typename T>
+    T* AllocateArray(size_t count);
+    void Reset() { m_used = 0; }
+    size_t Mark() const { return m_used; }
+    void Rewind(size_t mark) { m_used = mark; }
+
+    size_t Used() const { return m_used; }
+    size_t Capacity() const { return m_capacity; }
+    size_t Available() const { return m_capacity - m_used; }
+    size_t PeakUsed() const { return m_peakUsed; }
+    // Allocations that did not fit, since construction
+    uint32_t FailedCount() const { return m_failedCount; }
+
+private:
+    uint8_t* m_memory = nullptr;
+    size_t   m_capacity = 0;
+    size_t   m_used = 0;
+    size_t   m_peakUsed = 0;
+    uint32_t m_failedCount = 0;
+    bool     m_isOwned = false;
+
+    void release();
+};
+
+// Rewinds the arena to where it was when the scope opened
+class ArenaScope final
+{
+public:
+    explicit ArenaScope(Arena* arena) : m_arena(arena), m_mark(arena->Mark()) {}
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+    ~ArenaScope() { m_arena->Rewind(m_mark); }
+
+private:
+    Arena* m_arena;
+    size_t m_mark;
+};
+
+// One arena per frame in flight, indexed like the swap chain's back
+// buffers. What a frame allocates stays valid until its index comes around
+// again and BeginFrame resets it, which happens once the GPU is done with
+// that back buffer, so the frame's command lists may point into it.
+template<uint32_t FRAME_COUNT>
+class FrameArenas final
+{
+public:
+    explicit FrameArenas(size_t capacityPerFrame, MemoryTag tag = MemoryTag::Untagged);
+
+    Arena& BeginFrame(uint32_t frameIndex);
+    Arena& Current() { return m_arenas[m_frameIndex]; }
+
+private:
+    Arena    m_block;
+    Arena    m_arenas[FRAME_COUNT];
+    uint32_t m_frameIndex = 0;
+};
+
+// Sub-arenas for the workers of a JobSystem::ParallelFor, indexed by
+// workerIndex so every thread allocates from its own without locking.
+// Carved out of a parent arena, each starting on its own cache line, and
+// valid until the parent is reset or rewound past them.
+class WorkerArenas final
+{
+public:
+    static constexpr uint32_t MAX_WORKERS = 64;
+
+    // False when the parent has no room left, the sub-arenas are then empty
+    bool Carve(Arena* parent, uint32_t workerCount, size_t capacityPerWorker);
+    Arena& operator[](uint32_t workerIndex) { return m_arenas[workerIndex]; }
+    uint32_t WorkerCount() const { return m_workerCount; }
+
+private:
+    Arena    m_arenas[MAX_WORKERS];
+    uint32_t m_workerCount = 0;
+};
+
+// count values from the arena, or from fallback, resized and kept for its
+// capacity, when the arena is full
+template<typename T>
+T* AllocateScratch(Arena* arena, std::vector<T>* fallback, size_t count);
+
+#pragma region Arena
+
+Arena::Arena(size_t capacity, MemoryTag tag)
+{
+    if (capacity)
+    {
+        MemoryTagScope scope(tag, MemorySource::Arena);
+        m_memory = static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(CACHE_LINE)));
+        m_capacity = capacity;
+        m_isOwned = true;
+    }
+}
+
+void Arena::release()
+{
+    if (m_isOwned)
+    {
+        ::operator delete(m_memory, std::align_val_t(CACHE_LINE));
+    }
+    m_memory = nullptr;
+    m_capacity = 0;
+    m_used = 0;
+    m_isOwned = false;
+}
+
+void Arena::Borrow(void* memory, size_t capacity)
+{
+    release();
+    m_memory = static_cast<uint8_t*>(memory);
+    m_capacity = memory ? capacity : 0;
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+    // Aligns the address, borrowed memory may start anywhere
+    const uintptr_t base = reinterpret_cast<uintptr_t>(m_memory);
+    const size_t offset = ((base + m_used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base;
+    if (offset > m_capacity || size > m_capacity - offset)
+    {
+        ++m_failedCount;
+        return nullptr;
+    }
+    m_used = offset + size;
+    m_peakUsed = m_used > m_peakUsed ? m_used : m_peakUsed;
+    return m_memory + offset;
+}
+
+template<typename T>
+T* Arena::AllocateArray(size_t count)
+{
+    static_assert(std::is_trivially_destructible<T>::value, "Arena memory is released without destructors");
+    if (count > SIZE_MAX / sizeof(T))
+    {
+        ++m_failedCount;
+        return nullptr;
+    }
+    return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+}
+
+template<typename T>
+T* AllocateScratch(Arena* arena, std::vector<T>* fallback, size_t count)
+{
+    T* values = arena->AllocateArray<T>(count);
+    if (!values)
+    {
+        fallback->resize(count);
+        values = fallback->data();
+    }
+    return values;
+}
+
+#pragma endregion
+
+#pragma region FrameArenas
+
+template<uint32_t FRAME_COUNT>
+FrameArenas<FRAME_COUNT>::FrameArenas(size_t capacityPerFrame, MemoryTag tag)
+    : m_block(((capacityPerFrame + Arena::CACHE_LINE - 1) & ~(Arena::CACHE_LINE - 1)) * FRAME_COUNT, tag)
+{
+    const size_t capacity = m_block.Capacity() / FRAME_COUNT;
+    for (Arena& arena : m_arenas)
+    {
+        arena.Borrow(m_block.Allocate(capacity, Arena::CACHE_LINE), capacity);
+    }
+}
+
+template<uint32_t FRAME_COUNT>
+Arena& FrameArenas<FRAME_COUNT>::BeginFrame(uint32_t frameIndex)
+{
+    m_frameIndex = frameIndex;
+    m_arenas[frameIndex].Reset();
+    return m_arenas[frameIndex];
+}
+
+#pragma endregion
+
+#pragma region WorkerArenas
+
+bool WorkerArenas::Carve(Arena* parent, uint32_t workerCount, size_t capacityPerWorker)
+{
+    m_workerCount = workerCount < MAX_WORKERS ? workerCount : MAX_WORKERS;
+    const size_t capacity = (capacityPerWorker + Arena::CACHE_LINE - 1) & ~(Arena::CACHE_LINE - 1);
+    bool isCarved = true;
+    for (uint32_t worker = 0; worker < m_workerCount; ++worker)
+    {
+        void* memory = isCarved ? parent->Allocate(capacity, Arena::CACHE_LINE) : nullptr;
+        isCarved = memory != nullptr;
+        m_arenas[worker].Borrow(memory, capacity);
+    }
+    if (!isCarved)
+    {
+        for (uint32_t worker = 0; worker < m_workerCount; ++worker)
+        {
+            m_arenas[worker].Borrow(nullptr, 0);
+        }
+    }
+    return isCarved;
+}
+
+#pragma endregion
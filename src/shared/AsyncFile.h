@@ -0,0 +1,388 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Read only file with a queue of asynchronous reads: io_uring on Linux,
+// overlapped reads on an I/O completion port on Windows. The file is
+// opened unbuffered when the file system allows it, so offsets, sizes and
+// destinations have to be READ_ALIGNMENT aligned. Where io_uring is not
+// available reads fall back to blocking ones issued by Wait().
+//
+// Not thread safe, one thread queues reads and waits for them.
+class AsyncFile final
+{
+public:
+    static constexpr size_t READ_ALIGNMENT = 4096;
+
+    AsyncFile() = default;
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    ~AsyncFile() { Close(); }
+
+    bool Open(const char* path, uint32_t queueDepth);
+    void Close();
+
+    // At most queueDepth reads may be in flight
+    void Read(uint64_t offset, void* destination, uint32_t size, uint64_t userData);
+    // Submits queued reads and blocks until at least one of them finishes.
+    // function(userData, result) gets the bytes read or a negative error.
+    // Returns false when waiting failed, reads that had already finished
+    // are still handed to function.
+    template<typename Function>
+    bool Wait(const Function& function);
+
+    uint32_t InFlight() const { return m_inFlight; }
+
+private:
+    struct Completion
+    {
+        uint64_t userData;
+        int64_t  result;
+    };
+
+    uint32_t                m_queueDepth = 0;
+    uint32_t                m_inFlight = 0;
+    std::vector<Completion> m_ready;
+
+#ifdef _WIN32
+    struct Slot
+    {
+        OVERLAPPED overlapped;
+        uint64_t   userData;
+    };
+
+    HANDLE                m_file = INVALID_HANDLE_VALUE;
+    HANDLE                m_port = NULL;
+    std::vector<Slot>     m_slots;
+    std::vector<uint32_t> m_freeSlots;
+#else
+    struct Ring
+    {
+        void*           memory = MAP_FAILED;
+        size_t          size = 0;
+        const uint32_t* head = nullptr;
+        const uint32_t* tail = nullptr;
+        uint32_t*       headOrTail = nullptr;
+        uint32_t        mask = 0;
+    };
+
+    int                 m_file = -1;
+    int                 m_ring = -1;
+    Ring                m_submissions;
+    Ring                m_completions;
+    uint32_t*           m_submissionArray = nullptr;
+    io_uring_sqe*       m_sqes = nullptr;
+    size_t              m_sqesSize = 0;
+    const io_uring_cqe* m_cqes = nullptr;
+    uint32_t            m_toSubmit = 0;
+
+    void reapCompletions();
+#endif
+};
+
+#ifdef _WIN32
+
+bool AsyncFile::Open(const char* path, uint32_t queueDepth)
+{
+    Close();
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_port = CreateIoCompletionPort(m_file, NULL, 0, 1);
+    if (!m_port)
+    {
+        Close();
+        return false;
+    }
+    m_queueDepth = queueDepth;
+    m_slots.resize(queueDepth);
+    for (uint32_t slot = queueDepth; slot > 0; --slot)
+    {
+        m_freeSlots.push_back(slot - 1);
+    }
+    return true;
+}
+
+void AsyncFile::Close()
+{
+    // Outstanding reads still write into their slots, finish them first.
+    // When the port fails closing the file cancels whatever is left.
+    while (m_inFlight)
+    {
+        if (!Wait([](uint64_t, int64_t) {}))
+        {
+            break;
+        }
+    }
+    if (m_port)
+    {
+        CloseHandle(m_port);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+    }
+    m_port = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_ready.clear();
+    m_inFlight = 0;
+    m_queueDepth = 0;
+}
+
+void AsyncFile::Read(uint64_t offset, void* destination, uint32_t size, uint64_t userData)
+{
+    const uint32_t index = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    Slot& slot = m_slots[index];
+    memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+    slot.overlapped.Offset = static_cast<DWORD>(offset);
+    slot.overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    slot.userData = userData;
+    ++m_inFlight;
+    // Completion packets are queued even when the read finishes right away
+    if (!ReadFile(m_file, destination, size, NULL, &slot.overlapped) && GetLastError() != ERROR_IO_PENDING)
+    {
+        m_ready.push_back({ userData, -static_cast<int64_t>(GetLastError()) });
+        m_freeSlots.push_back(index);
+    }
+}
+
+template<typename Function>
+bool AsyncFile::Wait(const Function& function)
+{
+    bool isWaited = true;
+    if (m_ready.empty() && m_inFlight)
+    {
+        OVERLAPPED_ENTRY entries[64];
+        ULONG count = 0;
+        isWaited = GetQueuedCompletionStatusEx(m_port, entries, _countof(entries), &count, INFINITE, FALSE) != FALSE;
+        if (isWaited)
+        {
+            for (ULONG i = 0; i < count; ++i)
+            {
+                Slot* slot = CONTAINING_RECORD(entries[i].lpOverlapped, Slot, overlapped);
+                DWORD bytes = 0;
+                int64_t result;
+                if (GetOverlappedResult(m_file, &slot->overlapped, &bytes, FALSE))
+                {
+                    result = bytes;
+                } else {
+                    result = GetLastError() == ERROR_HANDLE_EOF ? 0 : -static_cast<int64_t>(GetLastError());
+                }
+                m_ready.push_back({ slot->userData, result });
+                m_freeSlots.push_back(static_cast<uint32_t>(slot - m_slots.data()));
+            }
+        }
+    }
+    std::vector<Completion> ready;
+    ready.swap(m_ready);
+    m_inFlight -= static_cast<uint32_t>(ready.size());
+    for (const Completion& completion : ready)
+    {
+        function(completion.userData, completion.result);
+    }
+    return isWaited;
+}
+
+#else
+
+bool AsyncFile::Open(const char* path, uint32_t queueDepth)
+{
+    Close();
+    m_file = open(path, O_RDONLY | O_DIRECT);
+    if (m_file < 0)
+    {
+        // tmpfs and friends refuse direct I/O
+        m_file = open(path, O_RDONLY);
+    }
+    if (m_file < 0)
+    {
+        return false;
+    }
+    m_queueDepth = queueDepth;
+
+    io_uring_params params = {};
+    m_ring = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+    if (m_ring < 0)
+    {
+        return true;
+    }
+    m_submissions.size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_completions.size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_submissions.size = std::max(m_submissions.size, m_completions.size);
+    }
+    m_submissions.memory = mmap(nullptr, m_submissions.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_completions.memory = m_submissions.memory;
+        m_completions.size = 0;
+    } else {
+        m_completions.memory = mmap(nullptr, m_completions.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+    }
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+    if (m_submissions.memory == MAP_FAILED || m_completions.memory == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        if (sqes != MAP_FAILED)
+        {
+            munmap(sqes, m_sqesSize);
+        }
+        Close();
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    uint8_t* submissions = static_cast<uint8_t*>(m_submissions.memory);
+    m_submissions.head = reinterpret_cast<const uint32_t*>(submissions + params.sq_off.head);
+    m_submissions.headOrTail = reinterpret_cast<uint32_t*>(submissions + params.sq_off.tail);
+    m_submissions.tail = m_submissions.headOrTail;
+    m_submissions.mask = *reinterpret_cast<const uint32_t*>(submissions + params.sq_off.ring_mask);
+    m_submissionArray = reinterpret_cast<uint32_t*>(submissions + params.sq_off.array);
+
+    uint8_t* completions = static_cast<uint8_t*>(m_completions.memory);
+    m_completions.headOrTail = reinterpret_cast<uint32_t*>(completions + params.cq_off.head);
+    m_completions.head = m_completions.headOrTail;
+    m_completions.tail = reinterpret_cast<const uint32_t*>(completions + params.cq_off.tail);
+    m_completions.mask = *reinterpret_cast<const uint32_t*>(completions + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<const io_uring_cqe*>(completions + params.cq_off.cqes);
+    return true;
+}
+
+void AsyncFile::Close()
+{
+    // Outstanding reads still write into caller memory, finish them first.
+    // When the ring fails closing it cancels whatever is left.
+    while (m_inFlight)
+    {
+        if (!Wait([](uint64_t, int64_t) {}))
+        {
+            break;
+        }
+    }
+    if (m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_completions.memory != MAP_FAILED && m_completions.size)
+    {
+        munmap(m_completions.memory, m_completions.size);
+    }
+    if (m_submissions.memory != MAP_FAILED)
+    {
+        munmap(m_submissions.memory, m_submissions.size);
+    }
+    if (m_ring >= 0)
+    {
+        close(m_ring);
+    }
+    if (m_file >= 0)
+    {
+        close(m_file);
+    }
+    m_submissions = Ring();
+    m_completions = Ring();
+    m_submissionArray = nullptr;
+    m_sqes = nullptr;
+    m_cqes = nullptr;
+    m_ring = -1;
+    m_file = -1;
+    m_toSubmit = 0;
+    m_ready.clear();
+    m_inFlight = 0;
+    m_queueDepth = 0;
+}
+
+void AsyncFile::Read(uint64_t offset, void* destination, uint32_t size, uint64_t userData)
+{
+    ++m_inFlight;
+    if (m_ring < 0)
+    {
+        const ssize_t result = pread(m_file, destination, size, static_cast<off_t>(offset));
+        m_ready.push_back({ userData, result < 0 ? -static_cast<int64_t>(errno) : static_cast<int64_t>(result) });
+        return;
+    }
+    // Only this thread moves the tail, the kernel only reads it
+    const uint32_t tail = *m_submissions.tail;
+    const uint32_t index = tail & m_submissions.mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_file;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(destination);
+    sqe->len = size;
+    sqe->user_data = userData;
+    m_submissionArray[index] = index;
+    __atomic_store_n(m_submissions.headOrTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_toSubmit;
+}
+
+void AsyncFile::reapCompletions()
+{
+    uint32_t head = *m_completions.head;
+    const uint32_t tail = __atomic_load_n(m_completions.tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe& cqe = m_cqes[head & m_completions.mask];
+        m_ready.push_back({ cqe.user_data, cqe.res });
+    }
+    __atomic_store_n(m_completions.headOrTail, head, __ATOMIC_RELEASE);
+}
+
+template<typename Function>
+bool AsyncFile::Wait(const Function& function)
+{
+    bool isWaited = true;
+    if (m_ring >= 0)
+    {
+        reapCompletions();
+        while (m_toSubmit || (m_ready.empty() && m_inFlight))
+        {
+            const bool waitForOne = m_ready.empty() && m_inFlight;
+            const long submitted = syscall(__NR_io_uring_enter, m_ring, m_toSubmit, waitForOne ? 1 : 0,
+                waitForOne ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                isWaited = false;
+                break;
+            }
+            if (submitted > 0)
+            {
+                m_toSubmit -= static_cast<uint32_t>(submitted);
+            }
+            reapCompletions();
+        }
+    }
+    std::vector<Completion> ready;
+    ready.swap(m_ready);
+    m_inFlight -= static_cast<uint32_t>(ready.size());
+    for (const Completion& completion : ready)
+    {
+        function(completion.userData, completion.result);
+    }
+    return isWaited;
+}
+
+#endif
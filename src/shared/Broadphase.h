@@ -0,0 +1,848 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Arena.h"
+#include "Jobs.h"
+
+// Two objects whose boxes overlap, a is the one that found the other.
+struct BroadphasePair
+{
+    uint32_t a;
+    uint32_t b;
+};
+
+struct RayHit
+{
+    uint32_t object;
+    float    distance;
+};
+
+// Loose uniform grid over axis aligned boxes (center + half extents, like
+// BoundsStore). Every object lives in the one cell holding its center, so
+// moving it is a write of its bounds until the center crosses into another
+// cell, then only the old and the new cell are touched. Searches widen the
+// cells they look at by the largest half extent instead, except FindPairs,
+// which tests objects larger than a cell against everything directly so a
+// few of them do not widen the search of all the others. Only occupied
+// cells exist, in a hash table, so the world has no bounds and empty space
+// costs nothing.
+//
+// Objects are numbered densely from 0 like BoundsStore, removing one moves
+// the last object into its place. Results never depend on the order
+// objects were added or moved in, only on their bounds: pairs and query
+// results come out sorted by object.
+class Broadphase final
+{
+public:
+    static constexpr uint32_t NO_OBJECT = 0xFFFFFFFF;
+
+    // Removes all objects. Cells work best at about the size of the typical
+    // object, bigger ones only make searches look at more cells.
+    void Reset(float cellSize);
+    uint32_t Add(float x, float y, float z, float halfX, float halfY, float halfZ);
+    void Set(uint32_t object, float x, float y, float z, float halfX, float halfY, float halfZ);
+    // The last object takes over the index
+    void Remove(uint32_t object);
+    uint32_t Count() const { return static_cast<uint32_t>(m_entries.size()); }
+
+    // Every overlapping pair with at least one object for which
+    // isActive(object) holds, found by an active object: a is active and
+    // when both are a < b. Sorted by a, then b. Active objects are split
+    // between the workers, jobs may be null to run on the calling thread.
+    // The workers collect their pairs in arenas carved out of scratch, which
+    // is rewound before returning. Jobs that do not fit run again on the
+    // calling thread, straight into pairs.
+    template<typename IsActive>
+    void FindPairs(JobSystem* jobs, Arena* scratch, const IsActive& isActive, std::vector<BroadphasePair>* pairs);
+    // All objects are active
+    void FindPairs(JobSystem* jobs, Arena* scratch, std::vector<BroadphasePair>* pairs);
+
+    // Objects overlapping the box or the sphere, sorted
+    void QueryBox(float x, float y, float z, float halfX, float halfY, float halfZ, std::vector<uint32_t>* objects) const;
+    void QueryRadius(float x, float y, float z, float radius, std::vector<uint32_t>* objects) const;
+    // Closest object hit within maxDistance along the unit direction, an
+    // object around the origin is hit at 0. Walks the cells along the ray
+    // and stops at the first cell past the closest hit.
+    bool RayCast(const float origin[3], const float direction[3], float maxDistance, RayHit* hit) const;
+
+private:
+    static constexpr uint32_t NO_CELL = 0xFFFFFFFF;
+    // Objects a pair job walks
+    static constexpr uint32_t PAIR_JOB_OBJECTS = 1024;
+
+    // 32 bytes, searches touch every candidate once, so everything they
+    // read is kept in one place rather than in SoA arrays
+    struct Entry
+    {
+        float    center[3];
+        float    half[3];
+        // Next object of the same cell
+        uint32_t next;
+        // Slot of the cell in m_table
+        uint32_t cell;
+    };
+
+    // Cells live in the hash table itself, a lookup is one probe and
+    // holds the first object
+    struct Slot
+    {
+        int32_t  coordinate[3];
+        // NO_OBJECT for a free slot, cells go away with their last object
+        uint32_t head;
+    };
+
+    std::vector<Entry>    m_entries;
+    // Open addressing, at most half full
+    std::vector<Slot>     m_table;
+    uint32_t              m_cellCount = 0;
+    // One bit per hash, four per slot, set for the hashes of all cells. Most
+    // cells searches look at do not exist and are turned away by these
+    // without probing the table. Removed cells leave their bits set until
+    // as many were removed as there are cells.
+    std::vector<uint64_t> m_hashBits;
+    uint32_t              m_removedCells = 0;
+    float                 m_cellSize = 1.0f;
+    float                 m_inverseCellSize = 1.0f;
+    // At least the largest half extent, grows with Add and Set and is
+    // recomputed by FindPairs
+    float                 m_maxHalfExtent = 0.0f;
+    // Of all cells since Reset
+    int32_t               m_minCell[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+    int32_t               m_maxCell[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+    // Pairs of a pair job in its worker's arena, count is NO_OBJECT when
+    // they did not fit
+    struct JobPairs
+    {
+        const BroadphasePair* pairs;
+        uint32_t              count;
+    };
+
+    // Per pair job, kept for the capacity
+    std::vector<JobPairs> m_jobPairs;
+    // Of the last FindPairs, sorted
+    std::vector<uint32_t> m_largeObjects;
+
+    int32_t cellCoordinate(float position) const;
+    // Larger than a cell, FindPairs tests these against every object
+    bool isLarge(const Entry& entry) const { return std::max({ entry.half[0], entry.half[1], entry.half[2] }) > m_cellSize; }
+    bool mayExist(uint32_t hash) const;
+    // Slot of the cell or NO_CELL
+    uint32_t findCell(uint32_t hash, const int32_t coordinate[3]) const;
+    void link(uint32_t object);
+    void unlink(uint32_t object);
+    void growTable();
+    // Points the objects of the cell at its slot
+    void setCellOfObjects(uint32_t slot);
+    void setHashBit(uint32_t hash);
+    // function(head) with the first object of every cell in [low, high]
+    template<typename Function>
+    void forEachCell(const int32_t low[3], const int32_t high[3], const Function& function) const;
+    // function(object) for every object of the cells in [low, high]
+    template<typename Function>
+    void forEachInCells(const int32_t low[3], const int32_t high[3], const Function& function) const;
+};
+
+namespace Broadphase_internal
+{
+    uint32_t hashCell(int32_t x, int32_t y, int32_t z)
+    {
+        // Mixed so the low bits, which pick the slot, depend on all of them
+        uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u ^ static_cast<uint32_t>(z) * 83492791u;
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        return hash ^ (hash >> 13);
+    }
+
+    uint32_t lowestBit(uint64_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return index;
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+    }
+
+    bool overlaps(const float centerA[3], const float halfA[3], const float centerB[3], const float halfB[3])
+    {
+        return
+            fabsf(centerA[0] - centerB[0]) <= halfA[0] + halfB[0] &&
+            fabsf(centerA[1] - centerB[1]) <= halfA[1] + halfB[1] &&
+            fabsf(centerA[2] - centerB[2]) <= halfA[2] + halfB[2];
+    }
+
+    // Distance along the ray to where it enters the box, negative when it
+    // misses or the box lies behind
+    float rayBox(const float origin[3], const float direction[3], const float center[3], const float half[3], float maxDistance)
+    {
+        float enter = 0.0f;
+        float exit = maxDistance;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float low = center[axis] - half[axis] - origin[axis];
+            const float high = center[axis] + half[axis] - origin[axis];
+            if (direction[axis] == 0.0f)
+            {
+                if (low > 0.0f || high < 0.0f)
+                {
+                    return -1.0f;
+                }
+                continue;
+            }
+            const float inverse = 1.0f / direction[axis];
+            enter = std::max(enter, std::min(low * inverse, high * inverse));
+            exit = std::min(exit, std::max(low * inverse, high * inverse));
+            if (enter > exit)
+            {
+                return -1.0f;
+            }
+        }
+        return enter;
+    }
+}
+
+#pragma region Objects
+
+void Broadphase::Reset(float cellSize)
+{
+    m_entries.clear();
+    m_table.clear();
+    m_cellCount = 0;
+    m_hashBits.clear();
+    m_removedCells = 0;
+    m_cellSize = std::max(cellSize, 1e-3f);
+    m_inverseCellSize = 1.0f / m_cellSize;
+    m_maxHalfExtent = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        m_minCell[axis] = INT32_MAX;
+        m_maxCell[axis] = INT32_MIN;
+    }
+}
+
+uint32_t Broadphase::Add(float x, float y, float z, float halfX, float halfY, float halfZ)
+{
+    const uint32_t object = Count();
+    m_entries.push_back({ { x, y, z }, { halfX, halfY, halfZ }, NO_OBJECT, NO_CELL });
+    m_maxHalfExtent = std::max({ m_maxHalfExtent, halfX, halfY, halfZ });
+    link(object);
+    return object;
+}
+
+void Broadphase::Set(uint32_t object, float x, float y, float z, float halfX, float halfY, float halfZ)
+{
+    Entry& entry = m_entries[object];
+    entry.center[0] = x;
+    entry.center[1] = y;
+    entry.center[2] = z;
+    entry.half[0] = halfX;
+    entry.half[1] = halfY;
+    entry.half[2] = halfZ;
+    m_maxHalfExtent = std::max({ m_maxHalfExtent, halfX, halfY, halfZ });
+    const int32_t* cell = m_table[entry.cell].coordinate;
+    if (cell[0] == cellCoordinate(x) && cell[1] == cellCoordinate(y) && cell[2] == cellCoordinate(z))
+    {
+        return;
+    }
+    unlink(object);
+    link(object);
+}
+
+void Broadphase::Remove(uint32_t object)
+{
+    unlink(object);
+    const uint32_t last = Count() - 1;
+    if (object != last)
+    {
+        // Whoever points at the last object points at its new index
+        uint32_t* reference = &m_table[m_entries[last].cell].head;
+        while (*reference != last)
+        {
+            reference = &m_entries[*reference].next;
+        }
+        *reference = object;
+        m_entries[object] = m_entries[last];
+    }
+    m_entries.pop_back();
+}
+
+int32_t Broadphase::cellCoordinate(float position) const
+{
+    // Clamped so far away objects share the outermost cells instead of
+    // overflowing
+    const float scaled = std::min(std::max(position * m_inverseCellSize, -1e9f), 1e9f);
+    // floorf without the library call
+    const int32_t truncated = static_cast<int32_t>(scaled);
+    return truncated - (scaled < static_cast<float>(truncated));
+}
+
+bool Broadphase::mayExist(uint32_t hash) const
+{
+    const uint32_t bit = hash & (static_cast<uint32_t>(m_hashBits.size()) * 64 - 1);
+    return m_hashBits[bit / 64] >> (bit % 64) & 1;
+}
+
+uint32_t Broadphase::findCell(uint32_t hash, const int32_t coordinate[3]) const
+{
+    const uint32_t mask = static_cast<uint32_t>(m_table.size()) - 1;
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        const Slot& entry = m_table[slot];
+        if (entry.head == NO_OBJECT)
+        {
+            return NO_CELL;
+        }
+        if (entry.coordinate[0] == coordinate[0] && entry.coordinate[1] == coordinate[1] && entry.coordinate[2] == coordinate[2])
+        {
+            return slot;
+        }
+    }
+}
+
+void Broadphase::link(uint32_t object)
+{
+    Entry& entry = m_entries[object];
+    const int32_t coordinate[3] = { cellCoordinate(entry.center[0]), cellCoordinate(entry.center[1]), cellCoordinate(entry.center[2]) };
+    const uint32_t hash = Broadphase_internal::hashCell(coordinate[0], coordinate[1], coordinate[2]);
+    const uint32_t found = m_table.empty() ? NO_CELL : findCell(hash, coordinate);
+    if (found != NO_CELL)
+    {
+        entry.cell = found;
+        entry.next = m_table[found].head;
+        m_table[found].head = object;
+        return;
+    }
+
+    // A new cell
+    if (m_table.size() < 2 * (m_cellCount + 1))
+    {
+        growTable();
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        m_minCell[axis] = std::min(m_minCell[axis], coordinate[axis]);
+        m_maxCell[axis] = std::max(m_maxCell[axis], coordinate[axis]);
+    }
+    const uint32_t mask = static_cast<uint32_t>(m_table.size()) - 1;
+    uint32_t slot = hash & mask;
+    while (m_table[slot].head != NO_OBJECT)
+    {
+        slot = (slot + 1) & mask;
+    }
+    m_table[slot] = { { coordinate[0], coordinate[1], coordinate[2] }, object };
+    setHashBit(hash);
+    ++m_cellCount;
+    entry.cell = slot;
+    entry.next = NO_OBJECT;
+}
+
+void Broadphase::unlink(uint32_t object)
+{
+    using Broadphase_internal::hashCell;
+
+    uint32_t hole = m_entries[object].cell;
+    uint32_t* reference = &m_table[hole].head;
+    while (*reference != object)
+    {
+        reference = &m_entries[*reference].next;
+    }
+    *reference = m_entries[object].next;
+    if (m_table[hole].head != NO_OBJECT)
+    {
+        return;
+    }
+
+    // The cell is empty. Later slots of its run move into the hole when it
+    // lies between them and their home slot, so probing never stops early.
+    const uint32_t mask = static_cast<uint32_t>(m_table.size()) - 1;
+    for (uint32_t slot = (hole + 1) & mask; m_table[slot].head != NO_OBJECT; slot = (slot + 1) & mask)
+    {
+        const int32_t* coordinate = m_table[slot].coordinate;
+        const uint32_t home = hashCell(coordinate[0], coordinate[1], coordinate[2]) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            m_table[hole] = m_table[slot];
+            setCellOfObjects(hole);
+            hole = slot;
+        }
+    }
+    m_table[hole].head = NO_OBJECT;
+    --m_cellCount;
+
+    if (++m_removedCells > m_cellCount)
+    {
+        std::fill(m_hashBits.begin(), m_hashBits.end(), 0);
+        m_removedCells = 0;
+        for (const Slot& entry : m_table)
+        {
+            if (entry.head != NO_OBJECT)
+            {
+                setHashBit(hashCell(entry.coordinate[0], entry.coordinate[1], entry.coordinate[2]));
+            }
+        }
+    }
+}
+
+void Broadphase::growTable()
+{
+    std::vector<Slot> slots(std::max<size_t>(m_table.size() * 2, 64), Slot{ {}, NO_OBJECT });
+    slots.swap(m_table);
+    m_hashBits.assign(m_table.size() * 4 / 64, 0);
+    m_removedCells = 0;
+    const uint32_t mask = static_cast<uint32_t>(m_table.size()) - 1;
+    for (const Slot& entry : slots)
+    {
+        if (entry.head == NO_OBJECT)
+        {
+            continue;
+        }
+        const uint32_t hash = Broadphase_internal::hashCell(entry.coordinate[0], entry.coordinate[1], entry.coordinate[2]);
+        uint32_t slot = hash & mask;
+        while (m_table[slot].head != NO_OBJECT)
+        {
+            slot = (slot + 1) & mask;
+        }
+        m_table[slot] = entry;
+        setHashBit(hash);
+        setCellOfObjects(slot);
+    }
+}
+
+void Broadphase::setCellOfObjects(uint32_t slot)
+{
+    for (uint32_t object = m_table[slot].head; object != NO_OBJECT; object = m_entries[object].next)
+    {
+        m_entries[object].cell = slot;
+    }
+}
+
+void Broadphase::setHashBit(uint32_t hash)
+{
+    const uint32_t bit = hash & (static_cast<uint32_t>(m_hashBits.size()) * 64 - 1);
+    m_hashBits[bit / 64] |= 1ull << (bit % 64);
+}
+
+#pragma endregion
+
+#pragma region Searches
+
+template<typename IsActive>
+void Broadphase::FindPairs(JobSystem* jobs, Arena* scratch, const IsActive& isActive, std::vector<BroadphasePair>* pairs)
+{
+    using namespace Broadphase_internal;
+
+    pairs->clear();
+    const uint32_t jobCount = (Count() + PAIR_JOB_OBJECTS - 1) / PAIR_JOB_OBJECTS;
+    m_jobPairs.resize(jobCount);
+    // Small objects are searched for in the cells around each object, the
+    // few large ones are tested directly
+    m_largeObjects.clear();
+    float maxSmallHalfExtent = 0.0f;
+    m_maxHalfExtent = 0.0f;
+    for (uint32_t object = 0; object < Count(); ++object)
+    {
+        const Entry& entry = m_entries[object];
+        const float halfExtent = std::max({ entry.half[0], entry.half[1], entry.half[2] });
+        m_maxHalfExtent = std::max(m_maxHalfExtent, halfExtent);
+        if (isLarge(entry))
+        {
+            m_largeObjects.push_back(object);
+        } else {
+            maxSmallHalfExtent = std::max(maxSmallHalfExtent, halfExtent);
+        }
+    }
+
+    // Writes the pairs of the job's objects to out, which has room for
+    // capacity of them. Returns how many or NO_OBJECT when they do not fit.
+    const auto findJobPairs = [&](uint32_t job, BroadphasePair* out, uint32_t capacity)
+    {
+        uint32_t count = 0;
+        bool isFull = false;
+        const uint32_t end = std::min((job + 1) * PAIR_JOB_OBJECTS, Count());
+        for (uint32_t a = job * PAIR_JOB_OBJECTS; a < end; ++a)
+        {
+            if (!isActive(a))
+            {
+                continue;
+            }
+            const Entry& entry = m_entries[a];
+            const uint32_t first = count;
+            const auto test = [&](uint32_t b)
+            {
+                // Pairs of active objects are found from the lower index
+                if (b == a || (b < a && isActive(b)))
+                {
+                    return;
+                }
+                if (overlaps(entry.center, entry.half, m_entries[b].center, m_entries[b].half))
+                {
+                    if (count == capacity)
+                    {
+                        isFull = true;
+                    } else {
+                        out[count++] = { a, b };
+                    }
+                }
+            };
+            // Centers of overlapping boxes are at most both half extents
+            // apart, a large object's search falls back to going through
+            // the table
+            int32_t low[3];
+            int32_t high[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis] = cellCoordinate(entry.center[axis] - entry.half[axis] - maxSmallHalfExtent);
+                high[axis] = cellCoordinate(entry.center[axis] + entry.half[axis] + maxSmallHalfExtent);
+            }
+            forEachInCells(low, high, [&](uint32_t b)
+            {
+                if (!isLarge(m_entries[b]))
+                {
+                    test(b);
+                }
+            });
+            for (uint32_t b : m_largeObjects)
+            {
+                test(b);
+            }
+            if (isFull)
+            {
+                return NO_OBJECT;
+            }
+            std::sort(out + first, out + count, [](const BroadphasePair& left, const BroadphasePair& right)
+            {
+                return left.b < right.b;
+            });
+        }
+        return count;
+    };
+
+    // A job takes all that is left of its worker's arena and gives back
+    // what it did not fill, so the jobs of a worker lie back to back
+    ArenaScope scope(scratch);
+    WorkerArenas workerArenas;
+    const uint32_t workerCount = jobs ? jobs->WorkerCount() : 1;
+    const size_t workerCapacity = scratch->Available() > Arena::CACHE_LINE
+        ? ((scratch->Available() - Arena::CACHE_LINE) / workerCount) & ~(Arena::CACHE_LINE - 1)
+        : 0;
+    const bool isCarved = workerCount <= WorkerArenas::MAX_WORKERS && workerCapacity && workerArenas.Carve(scratch, workerCount, workerCapacity);
+    const auto runJob = [&](uint32_t job, uint32_t workerIndex)
+    {
+        JobPairs& jobPairs = m_jobPairs[job];
+        jobPairs.count = NO_OBJECT;
+        if (!isCarved)
+        {
+            return;
+        }
+        Arena& arena = workerArenas[workerIndex];
+        const uint32_t capacity = static_cast<uint32_t>(std::min<size_t>(arena.Available() / sizeof(BroadphasePair), NO_OBJECT - 1));
+        BroadphasePair* out = arena.AllocateArray<BroadphasePair>(capacity);
+        jobPairs.pairs = out;
+        jobPairs.count = findJobPairs(job, out, capacity);
+        const uint32_t unused = jobPairs.count == NO_OBJECT ? capacity : capacity - jobPairs.count;
+        arena.Rewind(arena.Used() - unused * sizeof(BroadphasePair));
+    };
+    if (jobs)
+    {
+        jobs->ParallelFor(jobCount, 1, [&](uint32_t begin, uint32_t end, uint32_t workerIndex)
+        {
+            for (uint32_t job = begin; job < end; ++job)
+            {
+                runJob(job, workerIndex);
+            }
+        });
+    } else {
+        for (uint32_t job = 0; job < jobCount; ++job)
+        {
+            runJob(job, 0);
+        }
+    }
+
+    size_t pairCount = 0;
+    for (uint32_t job = 0; job < jobCount; ++job)
+    {
+        pairCount += m_jobPairs[job].count != NO_OBJECT ? m_jobPairs[job].count : 0;
+    }
+    pairs->reserve(pairCount);
+    for (uint32_t job = 0; job < jobCount; ++job)
+    {
+        const JobPairs& jobPairs = m_jobPairs[job];
+        if (jobPairs.count != NO_OBJECT)
+        {
+            pairs->insert(pairs->end(), jobPairs.pairs, jobPairs.pairs + jobPairs.count);
+            continue;
+        }
+        // Its worker's arena ran full, found again into room at the end of
+        // pairs, doubled until they fit
+        const size_t first = pairs->size();
+        uint32_t capacity = static_cast<uint32_t>(std::max<size_t>(pairs->capacity() - first, PAIR_JOB_OBJECTS));
+        uint32_t count = NO_OBJECT;
+        while (count == NO_OBJECT)
+        {
+            pairs->resize(first + capacity);
+            count = findJobPairs(job, pairs->data() + first, capacity);
+            capacity *= 2;
+        }
+        pairs->resize(first + count);
+    }
+}
+
+void Broadphase::FindPairs(JobSystem* jobs, Arena* scratch, std::vector<BroadphasePair>* pairs)
+{
+    FindPairs(jobs, scratch, [](uint32_t) { return true; }, pairs);
+}
+
+template<typename Function>
+void Broadphase::forEachCell(const int32_t low[3], const int32_t high[3], const Function& function) const
+{
+    using namespace Broadphase_internal;
+
+    if (m_table.empty())
+    {
+        return;
+    }
+    // Most cells around anything are empty and a branch on each would
+    // mostly mispredict. Instead up to 64 hashes at a time are tested
+    // against m_hashBits into a mask and only the cells whose bits are set
+    // are looked up, all of their slots fetched before the first is probed
+    // and all first objects before the first is handed out, so the cache
+    // misses overlap.
+    uint32_t hashes[64];
+    int32_t coordinates[64][3];
+    uint32_t heads[64];
+    uint64_t candidates = 0;
+    uint32_t count = 0;
+    const uint32_t mask = static_cast<uint32_t>(m_table.size()) - 1;
+    const auto lookUp = [&]()
+    {
+        for (uint64_t bits = candidates; bits; bits &= bits - 1)
+        {
+            _mm_prefetch(reinterpret_cast<const char*>(&m_table[hashes[lowestBit(bits)] & mask]), _MM_HINT_T0);
+        }
+        uint32_t headCount = 0;
+        for (uint64_t bits = candidates; bits; bits &= bits - 1)
+        {
+            const uint32_t index = lowestBit(bits);
+            const uint32_t cell = findCell(hashes[index], coordinates[index]);
+            if (cell != NO_CELL)
+            {
+                heads[headCount++] = m_table[cell].head;
+                _mm_prefetch(reinterpret_cast<const char*>(&m_entries[m_table[cell].head]), _MM_HINT_T0);
+            }
+        }
+        for (uint32_t head = 0; head < headCount; ++head)
+        {
+            function(heads[head]);
+        }
+        candidates = 0;
+        count = 0;
+    };
+    for (int32_t x = low[0]; x <= high[0]; ++x)
+    {
+        for (int32_t y = low[1]; y <= high[1]; ++y)
+        {
+            for (int32_t z = low[2]; z <= high[2]; ++z)
+            {
+                const uint32_t hash = hashCell(x, y, z);
+                hashes[count] = hash;
+                coordinates[count][0] = x;
+                coordinates[count][1] = y;
+                coordinates[count][2] = z;
+                candidates |= static_cast<uint64_t>(mayExist(hash)) << count;
+                if (++count == 64)
+                {
+                    lookUp();
+                }
+            }
+        }
+    }
+    lookUp();
+}
+
+template<typename Function>
+void Broadphase::forEachInCells(const int32_t low[3], const int32_t high[3], const Function& function) const
+{
+    // Past as many cells as there are slots, going through those is cheaper
+    double volume = 1.0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        volume *= static_cast<double>(high[axis]) - low[axis] + 1.0;
+    }
+    if (volume > static_cast<double>(m_table.size()))
+    {
+        for (const Slot& cell : m_table)
+        {
+            const int32_t* coordinate = cell.coordinate;
+            if (cell.head == NO_OBJECT ||
+                coordinate[0] < low[0] || coordinate[0] > high[0] ||
+                coordinate[1] < low[1] || coordinate[1] > high[1] ||
+                coordinate[2] < low[2] || coordinate[2] > high[2])
+            {
+                continue;
+            }
+            for (uint32_t object = cell.head; object != NO_OBJECT; object = m_entries[object].next)
+            {
+                function(object);
+            }
+        }
+        return;
+    }
+    forEachCell(low, high, [&](uint32_t head)
+    {
+        for (uint32_t object = head; object != NO_OBJECT; object = m_entries[object].next)
+        {
+            function(object);
+        }
+    });
+}
+
+void Broadphase::QueryBox(float x, float y, float z, float halfX, float halfY, float halfZ, std::vector<uint32_t>* objects) const
+{
+    objects->clear();
+    if (m_entries.empty())
+    {
+        return;
+    }
+    const float center[3] = { x, y, z };
+    const float half[3] = { halfX, halfY, halfZ };
+    int32_t low[3];
+    int32_t high[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        low[axis] = cellCoordinate(center[axis] - half[axis] - m_maxHalfExtent);
+        high[axis] = cellCoordinate(center[axis] + half[axis] + m_maxHalfExtent);
+    }
+    forEachInCells(low, high, [&](uint32_t object)
+    {
+        if (Broadphase_internal::overlaps(center, half, m_entries[object].center, m_entries[object].half))
+        {
+            objects->push_back(object);
+        }
+    });
+    std::sort(objects->begin(), objects->end());
+}
+
+void Broadphase::QueryRadius(float x, float y, float z, float radius, std::vector<uint32_t>* objects) const
+{
+    objects->clear();
+    if (m_entries.empty())
+    {
+        return;
+    }
+    const float center[3] = { x, y, z };
+    int32_t low[3];
+    int32_t high[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        low[axis] = cellCoordinate(center[axis] - radius - m_maxHalfExtent);
+        high[axis] = cellCoordinate(center[axis] + radius + m_maxHalfExtent);
+    }
+    forEachInCells(low, high, [&](uint32_t object)
+    {
+        // From the center to the closest point of the box
+        const Entry& entry = m_entries[object];
+        float distanceSquared = 0.0f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float outside = std::max(fabsf(center[axis] - entry.center[axis]) - entry.half[axis], 0.0f);
+            distanceSquared += outside * outside;
+        }
+        if (distanceSquared <= radius * radius)
+        {
+            objects->push_back(object);
+        }
+    });
+    std::sort(objects->begin(), objects->end());
+}
+
+bool Broadphase::RayCast(const float origin[3], const float direction[3], float maxDistance, RayHit* hit) const
+{
+    using namespace Broadphase_internal;
+
+    hit->object = NO_OBJECT;
+    hit->distance = maxDistance;
+    if (m_entries.empty())
+    {
+        return false;
+    }
+    // A point of a box is at most this many cells from the box's cell
+    const int32_t reach = static_cast<int32_t>(ceilf(m_maxHalfExtent * m_inverseCellSize));
+
+    // Only the part of the ray through cells that can reach an object
+    const float worldCenter[3] = {
+        (static_cast<float>(m_minCell[0]) + static_cast<float>(m_maxCell[0]) + 1.0f) * 0.5f * m_cellSize,
+        (static_cast<float>(m_minCell[1]) + static_cast<float>(m_maxCell[1]) + 1.0f) * 0.5f * m_cellSize,
+        (static_cast<float>(m_minCell[2]) + static_cast<float>(m_maxCell[2]) + 1.0f) * 0.5f * m_cellSize
+    };
+    const float worldHalf[3] = {
+        (static_cast<float>(m_maxCell[0] - m_minCell[0]) + 1.0f + 2.0f * reach) * 0.5f * m_cellSize,
+        (static_cast<float>(m_maxCell[1] - m_minCell[1]) + 1.0f + 2.0f * reach) * 0.5f * m_cellSize,
+        (static_cast<float>(m_maxCell[2] - m_minCell[2]) + 1.0f + 2.0f * reach) * 0.5f * m_cellSize
+    };
+    const float start = rayBox(origin, direction, worldCenter, worldHalf, maxDistance);
+    if (start < 0.0f)
+    {
+        return false;
+    }
+
+    // Cell by cell along the ray
+    int32_t cell[3];
+    int32_t step[3];
+    float nextBoundary[3];
+    float boundaryDistance[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        cell[axis] = cellCoordinate(origin[axis] + direction[axis] * start);
+        step[axis] = direction[axis] > 0.0f ? 1 : -1;
+        if (direction[axis] == 0.0f)
+        {
+            nextBoundary[axis] = INFINITY;
+            boundaryDistance[axis] = INFINITY;
+            continue;
+        }
+        const float boundary = static_cast<float>(cell[axis] + (step[axis] > 0 ? 1 : 0)) * m_cellSize;
+        nextBoundary[axis] = std::max((boundary - origin[axis]) / direction[axis], start);
+        boundaryDistance[axis] = m_cellSize / fabsf(direction[axis]);
+    }
+    for (;;)
+    {
+        const int32_t low[3] = { cell[0] - reach, cell[1] - reach, cell[2] - reach };
+        const int32_t high[3] = { cell[0] + reach, cell[1] + reach, cell[2] + reach };
+        forEachInCells(low, high, [&](uint32_t object)
+        {
+            const float distance = rayBox(origin, direction, m_entries[object].center, m_entries[object].half, hit->distance);
+            // Ties go to the lower index, the order cells list objects in
+            // does not matter
+            if (distance >= 0.0f && (distance < hit->distance || (distance == hit->distance && object < hit->object)))
+            {
+                hit->object = object;
+                hit->distance = distance;
+            }
+        });
+        const int axis = nextBoundary[0] < nextBoundary[1]
+            ? (nextBoundary[0] < nextBoundary[2] ? 0 : 2)
+            : (nextBoundary[1] < nextBoundary[2] ? 1 : 2);
+        // Whatever is left is entered past the next boundary
+        if (nextBoundary[axis] > hit->distance || nextBoundary[axis] > maxDistance ||
+            cell[axis] + step[axis] < m_minCell[axis] - reach || cell[axis] + step[axis] > m_maxCell[axis] + reach)
+        {
+            break;
+        }
+        cell[axis] += step[axis];
+        nextBoundary[axis] += boundaryDistance[axis];
+    }
+    return hit->object != NO_OBJECT;
+}
+
+#pragma endregion
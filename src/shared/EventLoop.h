@@ -0,0 +1,301 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Blocks the calling thread until a registered source is signaled, a
+// window message arrives (Windows only) or a deadline passes:
+// MsgWaitForMultipleObjectsEx and a high resolution waitable timer on
+// Windows, epoll and a timerfd on Linux.
+//
+// OS timers wake up late by up to a scheduler quantum, so the timer goes
+// off Config::spinNanoseconds before the deadline and the rest of the wait
+// yields while polling the sources. That bounds how late deadlines are met
+// at the cost of the CPU spent spinning, 0 never spins.
+class EventLoop final
+{
+public:
+#ifdef _WIN32
+    // Waitable object, e.g. an event set on fence completion
+    typedef HANDLE Source;
+#else
+    // Descriptor that turns readable when signaled, e.g. an eventfd
+    typedef int Source;
+#endif
+    static constexpr uint64_t NO_DEADLINE = UINT64_MAX;
+#ifdef _WIN32
+    // MsgWaitForMultipleObjectsEx limit, one handle is the timer
+    static constexpr uint32_t MAX_SOURCES = MAXIMUM_WAIT_OBJECTS - 2;
+#else
+    static constexpr uint32_t MAX_SOURCES = 62;
+#endif
+
+    enum class Wake
+    {
+        Deadline,
+        Source,
+        Messages,
+    };
+
+    struct Result
+    {
+        Wake     wake;
+        // Index returned by AddSource when wake is Source
+        uint32_t source;
+    };
+
+    struct Config
+    {
+        uint64_t spinNanoseconds = 1000000;
+    };
+
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    ~EventLoop() { Shutdown(); }
+
+    bool Initialize(const Config& config);
+    void Shutdown();
+
+    // After Initialize, at most MAX_SOURCES. Returns the index reported in
+    // Result::source, sources stay registered until Shutdown.
+    uint32_t AddSource(Source source);
+    // deadline in Now() nanoseconds or NO_DEADLINE
+    Result Wait(uint64_t deadline);
+
+    // Monotonic nanoseconds
+    static uint64_t Now();
+
+private:
+    Config              m_config;
+    std::vector<Source> m_sources;
+#ifdef _WIN32
+    HANDLE              m_timer = NULL;
+    // Sources followed by the timer
+    std::vector<HANDLE> m_handles;
+#else
+    int                 m_epoll = -1;
+    int                 m_timer = -1;
+#endif
+
+    void armTimer(uint64_t timerDeadline, uint64_t now);
+    // Blocking until a source, a message or the timer wakes it up, or just
+    // polling. False when nothing but the timer was signaled.
+    bool waitForSources(bool isBlocking, Result* result);
+};
+
+uint32_t EventLoop::AddSource(Source source)
+{
+#ifdef _WIN32
+    m_handles.insert(m_handles.end() - 1, source);
+#else
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = static_cast<uint32_t>(m_sources.size());
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, source, &event);
+#endif
+    m_sources.push_back(source);
+    return static_cast<uint32_t>(m_sources.size() - 1);
+}
+
+EventLoop::Result EventLoop::Wait(uint64_t deadline)
+{
+    Result result = { Wake::Deadline, 0 };
+    for (;;)
+    {
+        const uint64_t now = Now();
+        if (deadline != NO_DEADLINE && now >= deadline)
+        {
+            return { Wake::Deadline, 0 };
+        }
+        const uint64_t timerDeadline = deadline == NO_DEADLINE
+            ? NO_DEADLINE
+            : deadline - std::min(deadline, m_config.spinNanoseconds);
+        if (timerDeadline > now)
+        {
+            armTimer(timerDeadline, now);
+            if (waitForSources(true, &result))
+            {
+                return result;
+            }
+        } else if (waitForSources(false, &result)) {
+            return result;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+#ifdef _WIN32
+
+bool EventLoop::Initialize(const Config& config)
+{
+    Shutdown();
+    m_config = config;
+    m_timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!m_timer)
+    {
+        // Before Windows 10 1803, waits round to the timer resolution
+        m_timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    }
+    if (!m_timer)
+    {
+        return false;
+    }
+    m_handles.push_back(m_timer);
+    return true;
+}
+
+void EventLoop::Shutdown()
+{
+    if (m_timer)
+    {
+        CloseHandle(m_timer);
+    }
+    m_timer = NULL;
+    m_handles.clear();
+    m_sources.clear();
+}
+
+uint64_t EventLoop::Now()
+{
+    static const LONGLONG frequency = []
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        return value.QuadPart;
+    }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>(counter.QuadPart / frequency) * 1000000000ull +
+        static_cast<uint64_t>(counter.QuadPart % frequency) * 1000000000ull / static_cast<uint64_t>(frequency);
+}
+
+void EventLoop::armTimer(uint64_t timerDeadline, uint64_t now)
+{
+    if (timerDeadline == NO_DEADLINE)
+    {
+        CancelWaitableTimer(m_timer);
+        return;
+    }
+    // Relative, in 100 ns units
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -static_cast<LONGLONG>((timerDeadline - now + 99) / 100);
+    SetWaitableTimer(m_timer, &dueTime, 0, NULL, NULL, FALSE);
+}
+
+bool EventLoop::waitForSources(bool isBlocking, Result* result)
+{
+    const DWORD handleCount = static_cast<DWORD>(m_handles.size());
+    const DWORD signaled = MsgWaitForMultipleObjectsEx(
+        handleCount,
+        m_handles.data(),
+        isBlocking ? INFINITE : 0,
+        QS_ALLINPUT,
+        MWMO_INPUTAVAILABLE
+    );
+    if (signaled < WAIT_OBJECT_0 + handleCount - 1)
+    {
+        *result = { Wake::Source, signaled - WAIT_OBJECT_0 };
+        return true;
+    }
+    if (signaled == WAIT_OBJECT_0 + handleCount)
+    {
+        *result = { Wake::Messages, 0 };
+        return true;
+    }
+    return false;
+}
+
+#else
+
+bool EventLoop::Initialize(const Config& config)
+{
+    Shutdown();
+    m_config = config;
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_epoll < 0 || m_timer < 0)
+    {
+        Shutdown();
+        return false;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = MAX_SOURCES;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &event) < 0)
+    {
+        Shutdown();
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::Shutdown()
+{
+    if (m_timer >= 0)
+    {
+        close(m_timer);
+    }
+    if (m_epoll >= 0)
+    {
+        close(m_epoll);
+    }
+    m_timer = -1;
+    m_epoll = -1;
+    m_sources.clear();
+}
+
+uint64_t EventLoop::Now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+}
+
+void EventLoop::armTimer(uint64_t timerDeadline, uint64_t now)
+{
+    (void)now;
+    // Absolute, so time spent getting here does not delay it
+    itimerspec timer = {};
+    if (timerDeadline != NO_DEADLINE)
+    {
+        timer.it_value.tv_sec = static_cast<time_t>(timerDeadline / 1000000000ull);
+        timer.it_value.tv_nsec = static_cast<long>(timerDeadline % 1000000000ull);
+    }
+    timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+bool EventLoop::waitForSources(bool isBlocking, Result* result)
+{
+    epoll_event events[4];
+    const int count = epoll_wait(m_epoll, events, 4, isBlocking ? -1 : 0);
+    bool isSignaled = false;
+    for (int i = 0; i < count; ++i)
+    {
+        if (events[i].data.u32 == MAX_SOURCES)
+        {
+            // Also left over from earlier waits, clear it
+            uint64_t expirations;
+            (void)!read(m_timer, &expirations, sizeof(expirations));
+        } else if (!isSignaled) {
+            *result = { Wake::Source, events[i].data.u32 };
+            isSignaled = true;
+        }
+    }
+    return isSignaled;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files written, created, renamed or deleted in one directory,
+// subdirectories are not watched: inotify on Linux, ReadDirectoryChangesW
+// on Windows.
+//
+// Not thread safe, one thread waits for changes.
+class FileWatcher final
+{
+public:
+    FileWatcher() = default;
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    ~FileWatcher() { Close(); }
+
+    bool Open(const char* directory);
+    void Close();
+
+    // Blocks for at most timeoutMilliseconds until something changes, then
+    // calls onChanged(name) for every change with the name relative to the
+    // directory. name is null when changes were lost, anything may have
+    // changed then. Returns false once the directory cannot be watched.
+    template<typename Function>
+    bool Wait(uint32_t timeoutMilliseconds, const Function& onChanged);
+
+private:
+#ifdef _WIN32
+    HANDLE     m_directory = INVALID_HANDLE_VALUE;
+    OVERLAPPED m_overlapped = {};
+    DWORD      m_buffer[16 * 1024];
+    bool       m_isPending = false;
+
+    bool queueRead();
+#else
+    int        m_inotify = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+bool FileWatcher::Open(const char* directory)
+{
+    Close();
+    m_directory = CreateFileA(directory, FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (m_directory == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!m_overlapped.hEvent || !queueRead())
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void FileWatcher::Close()
+{
+    if (m_isPending)
+    {
+        DWORD transferred;
+        CancelIoEx(m_directory, &m_overlapped);
+        GetOverlappedResult(m_directory, &m_overlapped, &transferred, TRUE);
+        m_isPending = false;
+    }
+    if (m_overlapped.hEvent)
+    {
+        CloseHandle(m_overlapped.hEvent);
+    }
+    if (m_directory != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_directory);
+    }
+    m_overlapped = {};
+    m_directory = INVALID_HANDLE_VALUE;
+}
+
+template<typename Function>
+bool FileWatcher::Wait(uint32_t timeoutMilliseconds, const Function& onChanged)
+{
+    if (!m_isPending)
+    {
+        return false;
+    }
+    if (WaitForSingleObject(m_overlapped.hEvent, timeoutMilliseconds) != WAIT_OBJECT_0)
+    {
+        return true;
+    }
+    DWORD transferred = 0;
+    m_isPending = false;
+    if (!GetOverlappedResult(m_directory, &m_overlapped, &transferred, FALSE))
+    {
+        return false;
+    }
+    if (!transferred)
+    {
+        // The buffer overflowed, the system dropped the list
+        onChanged(static_cast<const char*>(nullptr));
+    }
+    const uint8_t* records = reinterpret_cast<const uint8_t*>(m_buffer);
+    DWORD offset = 0;
+    while (transferred)
+    {
+        const FILE_NOTIFY_INFORMATION* information = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(records + offset);
+        const int nameLength = static_cast<int>(information->FileNameLength / sizeof(WCHAR));
+        std::string name(WideCharToMultiByte(CP_UTF8, 0, information->FileName, nameLength, NULL, 0, NULL, NULL), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, information->FileName, nameLength, &name[0], static_cast<int>(name.size()), NULL, NULL);
+        onChanged(name.c_str());
+        if (!information->NextEntryOffset)
+        {
+            break;
+        }
+        offset += information->NextEntryOffset;
+    }
+    return queueRead();
+}
+
+bool FileWatcher::queueRead()
+{
+    ResetEvent(m_overlapped.hEvent);
+    m_isPending = ReadDirectoryChangesW(
+        m_directory,
+        m_buffer,
+        sizeof(m_buffer),
+        FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+        NULL,
+        &m_overlapped,
+        NULL
+    ) != FALSE;
+    return m_isPending;
+}
+
+#else
+
+bool FileWatcher::Open(const char* directory)
+{
+    Close();
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+    {
+        return false;
+    }
+    if (inotify_add_watch(m_inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR) < 0)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void FileWatcher::Close()
+{
+    if (m_inotify >= 0)
+    {
+        close(m_inotify);
+    }
+    m_inotify = -1;
+}
+
+template<typename Function>
+bool FileWatcher::Wait(uint32_t timeoutMilliseconds, const Function& onChanged)
+{
+    if (m_inotify < 0)
+    {
+        return false;
+    }
+    pollfd descriptor = { m_inotify, POLLIN, 0 };
+    if (poll(&descriptor, 1, static_cast<int>(timeoutMilliseconds)) <= 0)
+    {
+        return true;
+    }
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    for (;;)
+    {
+        const ssize_t size = read(m_inotify, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            return size < 0 && (errno == EAGAIN || errno == EINTR);
+        }
+        for (ssize_t offset = 0; offset < size; )
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->mask & IN_IGNORED)
+            {
+                // The directory itself went away
+                Close();
+                return false;
+            }
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                onChanged(static_cast<const char*>(nullptr));
+            } else if (event->len) {
+                onChanged(static_cast<const char*>(event->name));
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+#endif
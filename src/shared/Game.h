@@ -2,17 +2,123 @@
 
 #include <stdint.h>
 #include "diagnostics.h"
+#include "Arena.h"
+#include "HandlePool.h"
+#include "Hash.h"
+#include "HeapCheck.h"
+#include "Input.h"
+#include "Jobs.h"
+#include "MemoryTracker.h"
+#include "Physics.h"
+#include "Replay.h"
+#include "SceneGraph.h"
+#include "Snapshot.h"
+
+// Made by the renderer, the simulation only holds handles to them
+struct Mesh;
+
+// Something in the world, placed by its scene graph node
+struct Entity
+{
+    uint32_t     node;
+    Handle<Mesh> mesh;
+};
 
 struct Game
 {
-    void ProcessTicks(uint64_t numberOfTicks);
+    static constexpr uint64_t TICK_NANOSECONDS = 1000000000ull / 60;
+    static constexpr float TICK_SECONDS = 1.0f / 60.0f;
+    static constexpr size_t TICK_ARENA_CAPACITY = 1 << 20;
+
+    SceneGraph sceneGraph;
+    HandlePool<Entity> entities;
+    PhysicsWorld physics;
+    // Pushed to by the platform layer only
+    InputQueue input;
+    InputState inputState = {};
+    // Everything random in the simulation derives from it
+    uint64_t seed = 0;
+    // Runs the physics on its workers when set, on the calling thread
+    // otherwise, with the same results
+    JobSystem* jobs = nullptr;
+    // Logs every ProcessTicks call when set
+    ReplayWriter* recorder = nullptr;
+    // Scratch memory of the running tick, reset before every tick. The
+    // physics step allocates from it and falls back to the heap only for
+    // what does not fit.
+    Arena tickArena{TICK_ARENA_CAPACITY, MemoryTag::Simulation};
+
+    // firstTickTime is when the first tick was due, in EventLoop::Now()
+    // time, the others follow TICK_NANOSECONDS apart
+    void ProcessTicks(uint64_t numberOfTicks, uint64_t firstTickTime);
+    // Of everything the ticks decide, equal after equal ticks and input
+    uint64_t StateHash() const;
+
+    // Everything the ticks decide, not the input still queued. Restoring
+    // and running the same ticks and input again gives the same state, for
+    // rollback, save states and comparing runs byte by byte. After a failed
+    // restore the state is unusable until a good one is restored.
+    void SaveSnapshot(Snapshot* snapshot) const;
+    bool RestoreSnapshot(const Snapshot& snapshot);
 };
 
-void Game::ProcessTicks(uint64_t numberOfTicks)
+void Game::ProcessTicks(uint64_t numberOfTicks, uint64_t firstTickTime)
 {
     if (!numberOfTicks)
     {
         return;
     }
+    NO_HEAP_ALLOCATIONS("Game::ProcessTicks");
+    MEMORY_TAG(Simulation);
+    for (uint64_t tick = 0; tick < numberOfTicks; ++tick)
+    {
+        tickArena.Reset();
+        if (recorder)
+        {
+            ApplyInput(&input, firstTickTime + tick * TICK_NANOSECONDS, &inputState, [&](const InputEvent& event)
+            {
+                recorder->RecordInput(static_cast<uint32_t>(tick), event);
+            });
+        } else {
+            ApplyInput(&input, firstTickTime + tick * TICK_NANOSECONDS, &inputState);
+        }
+        physics.Step(jobs, TICK_SECONDS, &tickArena);
+    }
     // LOG("TODO Game::ProcessTicks %llu\n", numberOfTicks);
+    sceneGraph.UpdateWorldMatrices();
+    if (recorder)
+    {
+        recorder->RecordCall(static_cast<uint32_t>(numberOfTicks), StateHash());
+    }
+}
+
+uint64_t Game::StateHash() const
+{
+    return Hasher(seed)
+        .AddValue(inputState)
+        .AddBytes(sceneGraph.WorldMatrices(), sceneGraph.NodeCount() * sizeof(DirectX::XMFLOAT4X4))
+        .AddBytes(entities.Data(), entities.Size() * sizeof(Entity))
+        .AddU64(physics.StateHash())
+        .Finish();
+}
+
+void Game::SaveSnapshot(Snapshot* snapshot) const
+{
+    snapshot->Clear();
+    snapshot->Write(seed);
+    snapshot->Write(inputState);
+    sceneGraph.Save(snapshot);
+    entities.Save(snapshot);
+    physics.Save(snapshot);
+}
+
+bool Game::RestoreSnapshot(const Snapshot& snapshot)
+{
+    SnapshotReader reader(snapshot);
+    return reader.Read(&seed) &&
+        reader.Read(&inputState) &&
+        sceneGraph.Restore(&reader) &&
+        entities.Restore(&reader) &&
+        physics.Restore(&reader) &&
+        reader.IsAtEnd();
 }
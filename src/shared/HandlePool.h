@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "Snapshot.h"
+
+// Typed reference to an object of a HandlePool<T>. A handle stays valid
+// while its object lives and is told apart from any later object of the
+// same slot by the generation. The default handle is never valid.
+template<typename T>
+struct Handle
+{
+    uint32_t index = 0;
+    // Odd while the slot is in use
+    uint32_t generation = 0;
+
+    bool IsNull() const { return generation == 0; }
+    bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Objects addressed by generational handles. The objects themselves are
+// kept dense and unordered, destroying one moves the last into its place,
+// so loops over all of them run over Data() without holes or indirection.
+// Handles go through a slot holding the object's dense index and the
+// generation, which changes whenever an object is created in or destroyed
+// from the slot, so handles to destroyed objects are detected instead of
+// reaching whatever lives there now. Create and Destroy are O(1), reusing
+// freed slots first.
+//
+// Pointers into the pool are only good until the next Create or Destroy.
+template<typename T>
+class HandlePool final
+{
+public:
+    void Reserve(uint32_t capacity);
+    void Clear();
+
+    template<typename... Arguments>
+    Handle<T> Create(Arguments&&... arguments);
+    // False for a stale or null handle
+    bool Destroy(Handle<T> handle);
+
+    bool IsValid(Handle<T> handle) const;
+    // Null for a stale or null handle
+    T* Get(Handle<T> handle);
+    const T* Get(Handle<T> handle) const;
+
+    // All objects, Size() of them, in no particular order
+    T* Data() { return m_objects.data(); }
+    const T* Data() const { return m_objects.data(); }
+    uint32_t Size() const { return static_cast<uint32_t>(m_objects.size()); }
+    // Of the object at index in Data()
+    Handle<T> HandleAt(uint32_t index) const;
+
+    // Only for pointer free objects, like the rest of a snapshot
+    void Save(Snapshot* snapshot) const;
+    bool Restore(SnapshotReader* reader);
+
+private:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        // Of the object while in use, of the next free slot otherwise
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    std::vector<T>        m_objects;
+    std::vector<uint32_t> m_slotOfObject;
+    std::vector<Slot>     m_slots;
+    uint32_t              m_freeSlot = NO_SLOT;
+};
+
+#pragma region HandlePool
+
+template<typename T>
+void HandlePool<T>::Reserve(uint32_t capacity)
+{
+    m_objects.reserve(capacity);
+    m_slotOfObject.reserve(capacity);
+    m_slots.reserve(capacity);
+}
+
+template<typename T>
+void HandlePool<T>::Clear()
+{
+    // Through Destroy, generations move on and old handles stay stale
+    while (Size())
+    {
+        Destroy(HandleAt(Size() - 1));
+    }
+}
+
+template<typename T>
+template<typename... Arguments>
+Handle<T> HandlePool<T>::Create(Arguments&&... arguments)
+{
+    uint32_t slotIndex = m_freeSlot;
+    if (slotIndex == NO_SLOT)
+    {
+        slotIndex = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back({ 0, 0 });
+    } else {
+        m_freeSlot = m_slots[slotIndex].index;
+    }
+    Slot& slot = m_slots[slotIndex];
+    slot.index = static_cast<uint32_t>(m_objects.size());
+    ++slot.generation;
+    m_objects.push_back(T{ std::forward<Arguments>(arguments)... });
+    m_slotOfObject.push_back(slotIndex);
+    return { slotIndex, slot.generation };
+}
+
+template<typename T>
+bool HandlePool<T>::Destroy(Handle<T> handle)
+{
+    if (!IsValid(handle))
+    {
+        return false;
+    }
+    Slot& slot = m_slots[handle.index];
+    const uint32_t last = Size() - 1;
+    if (slot.index != last)
+    {
+        m_objects[slot.index] = std::move(m_objects[last]);
+        m_slotOfObject[slot.index] = m_slotOfObject[last];
+        m_slots[m_slotOfObject[last]].index = slot.index;
+    }
+    m_objects.pop_back();
+    m_slotOfObject.pop_back();
+    ++slot.generation;
+    slot.index = m_freeSlot;
+    m_freeSlot = handle.index;
+    return true;
+}
+
+template<typename T>
+bool HandlePool<T>::IsValid(Handle<T> handle) const
+{
+    // Free slots have even generations, which no handle carries
+    return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation && (handle.generation & 1);
+}
+
+template<typename T>
+T* HandlePool<T>::Get(Handle<T> handle)
+{
+    return IsValid(handle) ? &m_objects[m_slots[handle.index].index] : nullptr;
+}
+
+template<typename T>
+const T* HandlePool<T>::Get(Handle<T> handle) const
+{
+    return IsValid(handle) ? &m_objects[m_slots[handle.index].index] : nullptr;
+}
+
+template<typename T>
+Handle<T> HandlePool<T>::HandleAt(uint32_t index) const
+{
+    const uint32_t slotIndex = m_slotOfObject[index];
+    return { slotIndex, m_slots[slotIndex].generation };
+}
+
+template<typename T>
+void HandlePool<T>::Save(Snapshot* snapshot) const
+{
+    snapshot->WriteArray(m_objects);
+    snapshot->WriteArray(m_slotOfObject);
+    snapshot->WriteArray(m_slots);
+    snapshot->Write(m_freeSlot);
+}
+
+template<typename T>
+bool HandlePool<T>::Restore(SnapshotReader* reader)
+{
+    const bool isRead =
+        reader->ReadArray(&m_objects) &&
+        reader->ReadArray(&m_slotOfObject) &&
+        reader->ReadArray(&m_slots) &&
+        reader->Read(&m_freeSlot);
+    if (!isRead || m_slotOfObject.size() != m_objects.size() || (m_freeSlot != NO_SLOT && m_freeSlot >= m_slots.size()))
+    {
+        return false;
+    }
+    // Handles index with these, they have to agree
+    for (uint32_t object = 0; object < Size(); ++object)
+    {
+        const uint32_t slotIndex = m_slotOfObject[object];
+        if (slotIndex >= m_slots.size() || m_slots[slotIndex].index != object || !(m_slots[slotIndex].generation & 1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#pragma endregion
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Non cryptographic 64 bit hashing for cache keys. Results only depend on
+// the bytes, so they are stable between runs and machines of the same
+// endianness and may be stored on disk.
+namespace Hash_internal
+{
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+
+    constexpr uint64_t rotateLeft(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    constexpr uint64_t mix(uint64_t hash, uint64_t value)
+    {
+        return rotateLeft(hash ^ (rotateLeft(value * PRIME_2, 31) * PRIME_1), 27) * PRIME_1 + PRIME_3;
+    }
+
+    constexpr uint64_t finalize(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= PRIME_2;
+        hash ^= hash >> 29;
+        hash *= PRIME_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+// Incremental hash, feeding the same bytes in different chunks gives
+// different results, so feed values field by field in a fixed order.
+class Hasher final
+{
+public:
+    explicit constexpr Hasher(uint64_t seed = 0) : m_hash(seed + Hash_internal::PRIME_3) {}
+
+    constexpr Hasher& AddU64(uint64_t value)
+    {
+        m_hash = Hash_internal::mix(m_hash, value);
+        return *this;
+    }
+    Hasher& AddBytes(const void* data, size_t size);
+    Hasher& AddString(const char* string) { return AddBytes(string, string ? strlen(string) : 0); }
+    template<typename T>
+    Hasher& AddValue(const T& value) { return AddBytes(&value, sizeof(value)); }
+
+    constexpr uint64_t Finish() const { return Hash_internal::finalize(m_hash); }
+
+private:
+    uint64_t m_hash;
+};
+
+Hasher& Hasher::AddBytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    AddU64(size);
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        AddU64(word);
+    }
+    if (size)
+    {
+        uint64_t tail = 0;
+        memcpy(&tail, bytes, size);
+        AddU64(tail);
+    }
+    return *this;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    return Hasher(seed).AddBytes(data, size).Finish();
+}
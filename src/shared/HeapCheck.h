@@ -0,0 +1,232 @@
+#pragma once
+
+// Replacement of the global operator new, installed when either of these is
+// defined:
+//
+// HEAP_ALLOCATION_CHECKS, a debug check that hot paths stay off the general
+// heap. It counts what is allocated while a NO_HEAP_ALLOCATIONS scope is
+// open on the calling thread and the scope reports it when it closes.
+// Without the define the scope compiles to nothing.
+//
+// MEMORY_TRACKING, charges every allocation to the MemoryTracker tag and
+// source of the allocating thread. A small header in front of the
+// allocation keeps them and the size for the delete.
+//
+// Plain malloc is not seen.
+#if defined(HEAP_ALLOCATION_CHECKS) || defined(MEMORY_TRACKING)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "diagnostics.h"
+#include "MemoryTracker.h"
+
+namespace HeapCheck_internal
+{
+#ifdef HEAP_ALLOCATION_CHECKS
+    thread_local const char* g_scope = nullptr;
+    thread_local uint64_t g_count = 0;
+    thread_local uint64_t g_bytes = 0;
+#endif
+
+#ifdef MEMORY_TRACKING
+    // Right in front of the pointer operator new returns
+    struct Header
+    {
+        uint64_t     size;
+        // Back to the start of the underlying allocation
+        uint32_t     offset;
+        MemoryTag    tag;
+        MemorySource source;
+    };
+    constexpr size_t HEADER_SPACE = 16;
+    static_assert(sizeof(Header) <= HEADER_SPACE, "The header has to fit in front of every allocation");
+#endif
+
+    void* allocateRaw(size_t size, size_t alignment)
+    {
+#ifdef _WIN32
+        return _aligned_malloc(size, alignment);
+#else
+        // aligned_alloc wants a multiple of the alignment
+        return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+    }
+
+    void freeRaw(void* memory)
+    {
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        // GCC sees free inlined into operator delete and takes the pair for
+        // a mismatch
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+        free(memory);
+#pragma GCC diagnostic pop
+#endif
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+#ifdef HEAP_ALLOCATION_CHECKS
+        if (g_scope)
+        {
+            ++g_count;
+            g_bytes += size;
+        }
+#endif
+        size = size ? size : 1;
+#ifdef MEMORY_TRACKING
+        // A whole alignment in front keeps the returned pointer aligned
+        const size_t offset = alignment > HEADER_SPACE ? alignment : HEADER_SPACE;
+        uint8_t* memory = static_cast<uint8_t*>(allocateRaw(offset + size, alignment));
+        if (!memory)
+        {
+            return nullptr;
+        }
+        const Header header = {
+            size,
+            static_cast<uint32_t>(offset),
+            MemoryTagScope::CurrentTag(),
+            MemoryTagScope::CurrentSource()
+        };
+        memcpy(memory + offset - HEADER_SPACE, &header, sizeof(header));
+        TrackAllocation(header.tag, header.source, size);
+        return memory + offset;
+#else
+        return allocateRaw(size, alignment);
+#endif
+    }
+
+    void deallocate(void* memory)
+    {
+#ifdef MEMORY_TRACKING
+        if (!memory)
+        {
+            return;
+        }
+        Header header;
+        memcpy(&header, static_cast<uint8_t*>(memory) - HEADER_SPACE, sizeof(header));
+        TrackFree(header.tag, header.source, header.size);
+        freeRaw(static_cast<uint8_t*>(memory) - header.offset);
+#else
+        freeRaw(memory);
+#endif
+    }
+}
+
+#ifdef HEAP_ALLOCATION_CHECKS
+
+#define NO_HEAP_ALLOCATIONS(name) HeapAllocationScope noHeapAllocationScope(name)
+
+class HeapAllocationScope final
+{
+public:
+    explicit HeapAllocationScope(const char* name);
+    HeapAllocationScope(const HeapAllocationScope&) = delete;
+    HeapAllocationScope& operator=(const HeapAllocationScope&) = delete;
+    ~HeapAllocationScope();
+
+    // Allocations of this thread inside any scope, since it started
+    static uint64_t Count() { return HeapCheck_internal::g_count; }
+
+private:
+    const char* m_outerScope;
+    uint64_t    m_count;
+    uint64_t    m_bytes;
+};
+
+HeapAllocationScope::HeapAllocationScope(const char* name)
+    : m_outerScope(HeapCheck_internal::g_scope)
+    , m_count(HeapCheck_internal::g_count)
+    , m_bytes(HeapCheck_internal::g_bytes)
+{
+    HeapCheck_internal::g_scope = name;
+}
+
+HeapAllocationScope::~HeapAllocationScope()
+{
+    using namespace HeapCheck_internal;
+
+    const char* name = g_scope;
+    // Closed first, reporting may allocate
+    g_scope = m_outerScope;
+    if (g_count != m_count)
+    {
+        const unsigned long long count = g_count - m_count;
+        const unsigned long long bytes = g_bytes - m_bytes;
+#ifdef WIN_32_BUILD
+        LOG("%s made %llu heap allocations, %llu bytes\n", name, count, bytes);
+#else
+        fprintf(stderr, "%s made %llu heap allocations, %llu bytes\n", name, count, bytes);
+#endif
+    }
+}
+
+#else
+
+#define NO_HEAP_ALLOCATIONS(name)
+
+#endif
+
+void* operator new(size_t size)
+{
+    void* memory = HeapCheck_internal::allocate(size, alignof(max_align_t));
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* memory = HeapCheck_internal::allocate(size, static_cast<size_t>(alignment));
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return HeapCheck_internal::allocate(size, alignof(max_align_t));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return HeapCheck_internal::allocate(size, alignof(max_align_t));
+}
+
+void operator delete(void* memory) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete[](void* memory) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete(void* memory, size_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete[](void* memory, size_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { HeapCheck_internal::deallocate(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { HeapCheck_internal::deallocate(memory); }
+
+#else
+
+#define NO_HEAP_ALLOCATIONS(name)
+
+#endif
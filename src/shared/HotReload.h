@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "FileWatcher.h"
+
+// Rebuilds something on a background thread whenever matching files in a
+// directory change. Changes are collected until the directory has been
+// quiet for DEBOUNCE_MILLISECONDS, editors save in several steps. The
+// rebuilt Result waits in the reloader until the owner takes it at a point
+// where swapping it in is safe, a newer one replaces one not taken yet.
+template<typename Result>
+class HotReload final
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr uint32_t DEBOUNCE_MILLISECONDS = 50;
+    // How long stopping may take while nothing changes
+    static constexpr uint32_t IDLE_MILLISECONDS = 100;
+
+    HotReload() = default;
+    HotReload(const HotReload&) = delete;
+    HotReload& operator=(const HotReload&) = delete;
+    ~HotReload() { Stop(); }
+
+    // Only files ending with one of extensions trigger rebuilds. rebuild
+    // runs on the reload thread and returns false when there is nothing to
+    // swap in, because it failed or nothing that matters changed.
+    bool Start(const char* directory, std::vector<std::string> extensions, std::function<bool(Result*)> rebuild);
+    void Stop();
+
+    // Moves out the latest rebuilt result and when the first change it
+    // includes was seen, false when there is none
+    bool Take(Result* result, Clock::time_point* changedAt);
+
+private:
+    FileWatcher                  m_watcher;
+    std::vector<std::string>     m_extensions;
+    std::function<bool(Result*)> m_rebuild;
+    std::thread                  m_thread;
+    std::atomic<bool>            m_quit{false};
+
+    std::mutex                   m_mutex;
+    Result                       m_result;
+    Clock::time_point            m_changedAt;
+    bool                         m_hasResult = false;
+
+    bool isWatched(const char* name) const;
+    void reloadMain();
+};
+
+template<typename Result>
+bool HotReload<Result>::Start(const char* directory, std::vector<std::string> extensions, std::function<bool(Result*)> rebuild)
+{
+    Stop();
+    if (!m_watcher.Open(directory))
+    {
+        return false;
+    }
+    m_extensions = std::move(extensions);
+    m_rebuild = std::move(rebuild);
+    m_quit = false;
+    m_thread = std::thread(&HotReload::reloadMain, this);
+    return true;
+}
+
+template<typename Result>
+void HotReload<Result>::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_quit = true;
+        m_thread.join();
+    }
+    m_watcher.Close();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_result = Result();
+    m_hasResult = false;
+}
+
+template<typename Result>
+bool HotReload<Result>::Take(Result* result, Clock::time_point* changedAt)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_hasResult)
+    {
+        return false;
+    }
+    *result = std::move(m_result);
+    *changedAt = m_changedAt;
+    m_result = Result();
+    m_hasResult = false;
+    return true;
+}
+
+template<typename Result>
+bool HotReload<Result>::isWatched(const char* name) const
+{
+    if (!name)
+    {
+        return true;
+    }
+    const size_t length = strlen(name);
+    for (const std::string& extension : m_extensions)
+    {
+        if (length >= extension.size() && extension.compare(0, std::string::npos, name + length - extension.size()) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename Result>
+void HotReload<Result>::reloadMain()
+{
+    bool hasChanges = false;
+    Clock::time_point firstChange;
+    Clock::time_point lastChange;
+    while (!m_quit)
+    {
+        bool hasChanged = false;
+        const bool isWatching = m_watcher.Wait(hasChanges ? DEBOUNCE_MILLISECONDS : IDLE_MILLISECONDS, [&](const char* name)
+        {
+            hasChanged = hasChanged || isWatched(name);
+        });
+        if (!isWatching)
+        {
+            return;
+        }
+        const Clock::time_point now = Clock::now();
+        if (hasChanged)
+        {
+            firstChange = hasChanges ? firstChange : now;
+            lastChange = now;
+            hasChanges = true;
+            continue;
+        }
+        if (!hasChanges || now - lastChange < std::chrono::milliseconds(DEBOUNCE_MILLISECONDS))
+        {
+            continue;
+        }
+        // Changes made while rebuilding wait in the watcher for the next round
+        hasChanges = false;
+        Result result;
+        if (m_rebuild(&result))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_result = std::move(result);
+            m_changedAt = firstChange;
+            m_hasResult = true;
+        }
+    }
+}
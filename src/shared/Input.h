@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "SpscQueue.h"
+
+// Raw keyboard and mouse events on their way from the platform layer to
+// the simulation. The platform layer stamps each event with the
+// EventLoop::Now() clock when it arrives and pushes it into the InputQueue,
+// the simulation applies the events older than each tick before running
+// it. Which tick sees an event depends only on the timestamps, so a
+// recorded or synthetic stream splits the same way every time.
+
+enum class InputEventType : uint8_t
+{
+    KeyDown,
+    KeyUp,
+    // x, y in client area pixels
+    MouseMove,
+    MouseButtonDown,
+    MouseButtonUp,
+    // y in wheel notches scaled by 120, like WM_MOUSEWHEEL
+    MouseWheel,
+};
+
+enum MouseButton : uint32_t
+{
+    MOUSE_BUTTON_LEFT   = 0,
+    MOUSE_BUTTON_RIGHT  = 1,
+    MOUSE_BUTTON_MIDDLE = 2,
+};
+
+struct InputEvent
+{
+    uint64_t       time;
+    InputEventType type;
+    // Virtual key code or MouseButton
+    uint32_t       code;
+    int32_t        x;
+    int32_t        y;
+};
+
+// Over 4 s of a 1000 Hz mouse, the simulation is stalled before it fills
+static constexpr uint32_t INPUT_QUEUE_CAPACITY = 4096;
+typedef SpscQueue<InputEvent, INPUT_QUEUE_CAPACITY> InputQueue;
+
+struct InputState
+{
+    static constexpr uint32_t KEY_COUNT = 256;
+
+    uint64_t keys[KEY_COUNT / 64];
+    uint32_t mouseButtons;
+    int32_t  mouseX;
+    int32_t  mouseY;
+    // Scrolled during the last tick
+    int32_t  wheel;
+
+    bool IsKeyDown(uint32_t key) const { return key < KEY_COUNT && (keys[key / 64] >> (key % 64)) & 1; }
+    bool IsMouseButtonDown(uint32_t button) const { return (mouseButtons >> button) & 1; }
+    void Apply(const InputEvent& event);
+};
+
+// Applies queued events stamped before tickTime, later ones wait for the
+// next tick, and passes each to onApplied(event). Returns how many were
+// applied.
+template<typename Function>
+uint32_t ApplyInput(InputQueue* queue, uint64_t tickTime, InputState* state, const Function& onApplied);
+uint32_t ApplyInput(InputQueue* queue, uint64_t tickTime, InputState* state);
+
+void InputState::Apply(const InputEvent& event)
+{
+    switch (event.type)
+    {
+    case InputEventType::KeyDown:
+        if (event.code < KEY_COUNT)
+        {
+            keys[event.code / 64] |= 1ull << (event.code % 64);
+        }
+        break;
+    case InputEventType::KeyUp:
+        if (event.code < KEY_COUNT)
+        {
+            keys[event.code / 64] &= ~(1ull << (event.code % 64));
+        }
+        break;
+    case InputEventType::MouseMove:
+        mouseX = event.x;
+        mouseY = event.y;
+        break;
+    case InputEventType::MouseButtonDown:
+        mouseButtons |= 1u << (event.code & 31);
+        mouseX = event.x;
+        mouseY = event.y;
+        break;
+    case InputEventType::MouseButtonUp:
+        mouseButtons &= ~(1u << (event.code & 31));
+        mouseX = event.x;
+        mouseY = event.y;
+        break;
+    case InputEventType::MouseWheel:
+        wheel += event.y;
+        break;
+    }
+}
+
+template<typename Function>
+uint32_t ApplyInput(InputQueue* queue, uint64_t tickTime, InputState* state, const Function& onApplied)
+{
+    state->wheel = 0;
+    uint32_t count = 0;
+    for (const InputEvent* event = queue->Peek(); event && event->time < tickTime; event = queue->Peek())
+    {
+        state->Apply(*event);
+        onApplied(*event);
+        queue->Pop();
+        ++count;
+    }
+    return count;
+}
+
+uint32_t ApplyInput(InputQueue* queue, uint64_t tickTime, InputState* state)
+{
+    return ApplyInput(queue, tickTime, state, [](const InputEvent&) {});
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads that split index ranges between themselves.
+// Only the thread that called Initialize may dispatch work and it takes
+// part in every ParallelFor as worker 0, so a pool with no extra threads
+// simply runs the work inline.
+class JobSystem final
+{
+public:
+    // workerCount includes the calling thread, 0 picks one per hardware thread
+    void Initialize(uint32_t workerCount = 0);
+    void Shutdown();
+    uint32_t WorkerCount() const { return static_cast<uint32_t>(m_threads.size()) + 1; }
+
+    // function(begin, end, workerIndex) is called for consecutive ranges of
+    // at most batchSize items until [0, count) is covered.
+    template<typename Function>
+    void ParallelFor(uint32_t count, uint32_t batchSize, const Function& function);
+
+    ~JobSystem() { Shutdown(); }
+
+private:
+    typedef void (*RangeFunction)(const void* context, uint32_t begin, uint32_t end, uint32_t workerIndex);
+
+    std::vector<std::thread>          m_threads;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_workAvailable;
+    std::condition_variable           m_workDone;
+    uint64_t                          m_generation = 0;
+    uint32_t                          m_busyWorkers = 0;
+    bool                              m_quit = false;
+
+    RangeFunction                     m_function = nullptr;
+    const void*                       m_context = nullptr;
+    uint32_t                          m_count = 0;
+    uint32_t                          m_batchSize = 1;
+    std::atomic<uint32_t>             m_next{0};
+
+    void dispatch(RangeFunction function, const void* context, uint32_t count, uint32_t batchSize);
+    void runBatches(uint32_t workerIndex);
+    void workerMain(uint32_t workerIndex);
+};
+
+void JobSystem::Initialize(uint32_t workerCount)
+{
+    if (!workerCount)
+    {
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    m_quit = false;
+    m_threads.reserve(workerCount - 1);
+    for (uint32_t workerIndex = 1; workerIndex < workerCount; ++workerIndex)
+    {
+        m_threads.emplace_back(&JobSystem::workerMain, this, workerIndex);
+    }
+}
+
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_workAvailable.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+template<typename Function>
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const Function& function)
+{
+    if (!count)
+    {
+        return;
+    }
+    RangeFunction trampoline = [](const void* context, uint32_t begin, uint32_t end, uint32_t workerIndex)
+    {
+        (*static_cast<const Function*>(context))(begin, end, workerIndex);
+    };
+    if (m_threads.empty() || count <= batchSize)
+    {
+        trampoline(&function, 0, count, 0);
+        return;
+    }
+    dispatch(trampoline, &function, count, batchSize);
+}
+
+void JobSystem::dispatch(RangeFunction function, const void* context, uint32_t count, uint32_t batchSize)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = function;
+        m_context = context;
+        m_count = count;
+        m_batchSize = std::max(batchSize, 1u);
+        m_next.store(0, std::memory_order_relaxed);
+        m_busyWorkers = static_cast<uint32_t>(m_threads.size());
+        ++m_generation;
+    }
+    m_workAvailable.notify_all();
+
+    runBatches(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workDone.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_function = nullptr;
+    m_context = nullptr;
+}
+
+void JobSystem::runBatches(uint32_t workerIndex)
+{
+    for (;;)
+    {
+        const uint32_t begin = m_next.fetch_add(m_batchSize, std::memory_order_relaxed);
+        if (begin >= m_count)
+        {
+            return;
+        }
+        m_function(m_context, begin, std::min(begin + m_batchSize, m_count), workerIndex);
+    }
+}
+
+void JobSystem::workerMain(uint32_t workerIndex)
+{
+    uint64_t seenGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [&] { return m_quit || m_generation != seenGeneration; });
+            if (m_quit)
+            {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+
+        runBatches(workerIndex);
+
+        bool isLast;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            isLast = --m_busyWorkers == 0;
+        }
+        if (isLast)
+        {
+            m_workDone.notify_one();
+        }
+    }
+}
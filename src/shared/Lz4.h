@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// LZ4 block format (no frame header, sizes are stored by the caller).
+// Decompression is what the game needs at load time, compression is a
+// simple greedy matcher used by the offline tools.
+namespace Lz4_internal
+{
+    constexpr size_t MIN_MATCH = 4;
+    // The format requires the last 5 bytes to be literals and the last
+    // match to start at least 12 bytes before the end of the block
+    constexpr size_t LAST_LITERALS = 5;
+    constexpr size_t MATCH_SAFE_DISTANCE = 12;
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr uint32_t HASH_BITS = 14;
+
+    uint32_t read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void writeLength(std::vector<uint8_t>* output, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            output->push_back(255);
+        }
+        output->push_back(static_cast<uint8_t>(length));
+    }
+
+    void writeSequence(
+        std::vector<uint8_t>* output,
+        const uint8_t* literals,
+        size_t literalLength,
+        size_t offset,
+        size_t matchLength)
+    {
+        const size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+        const uint8_t token = static_cast<uint8_t>(
+            ((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)
+        );
+        output->push_back(token);
+        if (literalLength >= 15)
+        {
+            writeLength(output, literalLength - 15);
+        }
+        output->insert(output->end(), literals, literals + literalLength);
+        if (matchLength)
+        {
+            output->push_back(static_cast<uint8_t>(offset));
+            output->push_back(static_cast<uint8_t>(offset >> 8));
+            if (matchCode >= 15)
+            {
+                writeLength(output, matchCode - 15);
+            }
+        }
+    }
+
+    // Returns false when the length runs past the end of the input
+    bool readLength(const uint8_t** input, const uint8_t* inputEnd, size_t* length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (*input == inputEnd)
+            {
+                return false;
+            }
+            byte = *(*input)++;
+            *length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+// Appends the compressed block to output
+void Lz4Compress(const void* data, size_t size, std::vector<uint8_t>* output);
+
+// Decompresses exactly outputSize bytes, rejects malformed or truncated
+// input instead of reading or writing out of bounds
+bool Lz4Decompress(const void* data, size_t size, void* output, size_t outputSize);
+
+void Lz4Compress(const void* data, size_t size, std::vector<uint8_t>* output)
+{
+    using namespace Lz4_internal;
+
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    const uint8_t* literals = input;
+    const uint8_t* const inputEnd = input + size;
+    if (size > MATCH_SAFE_DISTANCE)
+    {
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+        const uint8_t* const matchLimit = inputEnd - MATCH_SAFE_DISTANCE;
+        const uint8_t* current = input;
+        while (current < matchLimit)
+        {
+            const uint32_t sequence = read32(current);
+            const uint32_t slot = hash(sequence);
+            const uint32_t candidate = table[slot];
+            table[slot] = static_cast<uint32_t>(current - input);
+            if (candidate == UINT32_MAX ||
+                static_cast<size_t>(current - input) - candidate > MAX_OFFSET ||
+                read32(input + candidate) != sequence)
+            {
+                ++current;
+                continue;
+            }
+
+            const uint8_t* match = input + candidate;
+            const uint8_t* matchEnd = current + MIN_MATCH;
+            const uint8_t* const lengthLimit = inputEnd - LAST_LITERALS;
+            while (matchEnd < lengthLimit && *matchEnd == match[matchEnd - current])
+            {
+                ++matchEnd;
+            }
+            writeSequence(output, literals, current - literals, current - match, matchEnd - current);
+            current = matchEnd;
+            literals = current;
+        }
+    }
+    writeSequence(output, literals, inputEnd - literals, 0, 0);
+}
+
+bool Lz4Decompress(const void* data, size_t size, void* output, size_t outputSize)
+{
+    using namespace Lz4_internal;
+
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    const uint8_t* const inputEnd = input + size;
+    uint8_t* destination = static_cast<uint8_t*>(output);
+    uint8_t* const destinationEnd = destination + outputSize;
+    while (input < inputEnd)
+    {
+        const uint8_t token = *input++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(&input, inputEnd, &literalLength))
+        {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inputEnd - input) ||
+            literalLength > static_cast<size_t>(destinationEnd - destination))
+        {
+            return false;
+        }
+        memcpy(destination, input, literalLength);
+        destination += literalLength;
+        input += literalLength;
+        if (input == inputEnd)
+        {
+            break;
+        }
+
+        if (inputEnd - input < 2)
+        {
+            return false;
+        }
+        const size_t offset = input[0] | (input[1] << 8);
+        input += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(&input, inputEnd, &matchLength))
+        {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 ||
+            offset > static_cast<size_t>(destination - static_cast<uint8_t*>(output)) ||
+            matchLength > static_cast<size_t>(destinationEnd - destination))
+        {
+            return false;
+        }
+        // Overlapping matches repeat the last offset bytes, copy forward
+        const uint8_t* match = destination - offset;
+        for (size_t i = 0; i < matchLength; ++i)
+        {
+            destination[i] = match[i];
+        }
+        destination += matchLength;
+    }
+    return destination == destinationEnd;
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <immintrin.h>
+#include <DirectXMath.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles any intrinsic regardless of /arch
+#define MATRIX_BATCH_TARGET(features)
+#else
+#include <cpuid.h>
+#define MATRIX_BATCH_TARGET(features) __attribute__((target(features)))
+#endif
+
+// Batched matrix kernels for per object transforms. All matrices follow
+// the DirectXMath row vector convention, so an object's MVP is
+// model * view * projection. The implementation is picked at runtime from
+// the widest instruction set the CPU and OS support.
+enum class SimdLevel : uint32_t
+{
+    SSE = 0,
+    AVX2,
+    AVX512,
+};
+
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(SimdLevel level);
+void SelectMatrixBatchKernels(SimdLevel level);
+
+// out[i] = a[i] * b, out may be a. Without fused multiply-adds, so every
+// level gives the same bits and the simulation can use it.
+void MultiplyMatrices(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+// out[i] = models[i] * view * projection
+void ComputeModelViewProjections(
+    const DirectX::XMFLOAT4X4* models, uint32_t count,
+    const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+    DirectX::XMFLOAT4X4* out
+);
+// out[i] = inverse transpose of the upper 3x3 of matrices[i], for normals
+void ComputeNormalMatrices(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out);
+
+namespace MatrixBatch_internal
+{
+    typedef void (*MultiplyKernel)(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+    typedef void (*InverseTransposeKernel)(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out);
+
+    void multiplySSE(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+    void multiplyAVX2(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+    void multiplyAVX512(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+    void multiplyExactAVX(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out);
+    void inverseTransposeSSE(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out);
+    void inverseTransposeAVX2(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out);
+
+    static MultiplyKernel g_multiply = multiplySSE;
+    static MultiplyKernel g_multiplyExact = multiplySSE;
+    static InverseTransposeKernel g_inverseTranspose = inverseTransposeSSE;
+
+    __m128 cross(__m128 u, __m128 v);
+    MATRIX_BATCH_TARGET("avx2,fma") __m256 cross(__m256 u, __m256 v);
+    MATRIX_BATCH_TARGET("avx2,fma") __m256 loadRowPair(const DirectX::XMFLOAT4X4* matrices, uint32_t row);
+
+    void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4]);
+    uint64_t xgetbv();
+}
+
+#pragma region Detection
+
+void MatrixBatch_internal::cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        registers[i] = static_cast<uint32_t>(values[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+uint64_t MatrixBatch_internal::xgetbv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+}
+
+SimdLevel DetectSimdLevel()
+{
+    uint32_t registers[4];
+    MatrixBatch_internal::cpuid(0, 0, registers);
+    const uint32_t maxLeaf = registers[0];
+    if (maxLeaf < 7)
+    {
+        return SimdLevel::SSE;
+    }
+
+    MatrixBatch_internal::cpuid(1, 0, registers);
+    const bool hasOsxsave = (registers[2] >> 27) & 1;
+    const bool hasAvx = (registers[2] >> 28) & 1;
+    const bool hasFma = (registers[2] >> 12) & 1;
+    if (!hasOsxsave || !hasAvx || !hasFma)
+    {
+        return SimdLevel::SSE;
+    }
+    // The OS has to save the wider registers on context switches
+    const uint64_t enabledStates = MatrixBatch_internal::xgetbv();
+    if ((enabledStates & 0x6) != 0x6)
+    {
+        return SimdLevel::SSE;
+    }
+
+    MatrixBatch_internal::cpuid(7, 0, registers);
+    const bool hasAvx2 = (registers[1] >> 5) & 1;
+    const bool hasAvx512f = (registers[1] >> 16) & 1;
+    if (!hasAvx2)
+    {
+        return SimdLevel::SSE;
+    }
+    if (hasAvx512f && (enabledStates & 0xE0) == 0xE0)
+    {
+        return SimdLevel::AVX512;
+    }
+    return SimdLevel::AVX2;
+}
+
+const char* SimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX512: return "AVX-512";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "SSE";
+    }
+}
+
+void SelectMatrixBatchKernels(SimdLevel level)
+{
+    using namespace MatrixBatch_internal;
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+        g_multiply = multiplyAVX512;
+        // Only AVX has no fused multiply-add the compiler could contract into
+        g_multiplyExact = multiplyExactAVX;
+        // 3x3 inverses gain nothing from a second 256 bit half
+        g_inverseTranspose = inverseTransposeAVX2;
+        break;
+    case SimdLevel::AVX2:
+        g_multiply = multiplyAVX2;
+        g_multiplyExact = multiplyExactAVX;
+        g_inverseTranspose = inverseTransposeAVX2;
+        break;
+    default:
+        g_multiply = multiplySSE;
+        g_multiplyExact = multiplySSE;
+        g_inverseTranspose = inverseTransposeSSE;
+        break;
+    }
+}
+
+#pragma endregion
+
+#pragma region Public functions
+
+void MultiplyMatrices(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out)
+{
+    MatrixBatch_internal::g_multiplyExact(a, count, b, out);
+}
+
+void ComputeModelViewProjections(
+    const DirectX::XMFLOAT4X4* models, uint32_t count,
+    const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+    DirectX::XMFLOAT4X4* out)
+{
+    DirectX::XMFLOAT4X4 viewProjection;
+    MatrixBatch_internal::multiplySSE(&view, 1, projection, &viewProjection);
+    MatrixBatch_internal::g_multiply(models, count, viewProjection, out);
+}
+
+void ComputeNormalMatrices(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out)
+{
+    MatrixBatch_internal::g_inverseTranspose(matrices, count, out);
+}
+
+#pragma endregion
+
+#pragma region Kernels
+
+void MatrixBatch_internal::multiplySSE(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out)
+{
+    const __m128 b0 = _mm_loadu_ps(b.m[0]);
+    const __m128 b1 = _mm_loadu_ps(b.m[1]);
+    const __m128 b2 = _mm_loadu_ps(b.m[2]);
+    const __m128 b3 = _mm_loadu_ps(b.m[3]);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            const __m128 r = _mm_loadu_ps(a[i].m[row]);
+            __m128 result = _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+            _mm_storeu_ps(out[i].m[row], result);
+        }
+    }
+}
+
+MATRIX_BATCH_TARGET("avx2,fma")
+void MatrixBatch_internal::multiplyAVX2(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out)
+{
+    // Two rows per register, every row of b repeated in both halves
+    const __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[0]));
+    const __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[1]));
+    const __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[2]));
+    const __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[3]));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (uint32_t row = 0; row < 4; row += 2)
+        {
+            const __m256 r = _mm256_loadu_ps(a[i].m[row]);
+            __m256 result = _mm256_mul_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1, result);
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2, result);
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3, result);
+            _mm256_storeu_ps(out[i].m[row], result);
+        }
+    }
+}
+
+MATRIX_BATCH_TARGET("avx")
+void MatrixBatch_internal::multiplyExactAVX(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out)
+{
+    // multiplyAVX2 without the fused multiply-adds, rounding like multiplySSE
+    const __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[0]));
+    const __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[1]));
+    const __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[2]));
+    const __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[3]));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (uint32_t row = 0; row < 4; row += 2)
+        {
+            const __m256 r = _mm256_loadu_ps(a[i].m[row]);
+            __m256 result = _mm256_mul_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+            _mm256_storeu_ps(out[i].m[row], result);
+        }
+    }
+}
+
+MATRIX_BATCH_TARGET("avx512f")
+void MatrixBatch_internal::multiplyAVX512(const DirectX::XMFLOAT4X4* a, uint32_t count, const DirectX::XMFLOAT4X4& b, DirectX::XMFLOAT4X4* out)
+{
+    // A whole matrix per register, every row of b repeated in all quarters
+    const __m512 b0 = _mm512_broadcast_f32x4(_mm_loadu_ps(b.m[0]));
+    const __m512 b1 = _mm512_broadcast_f32x4(_mm_loadu_ps(b.m[1]));
+    const __m512 b2 = _mm512_broadcast_f32x4(_mm_loadu_ps(b.m[2]));
+    const __m512 b3 = _mm512_broadcast_f32x4(_mm_loadu_ps(b.m[3]));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const __m512 r = _mm512_loadu_ps(a[i].m[0]);
+        __m512 result = _mm512_mul_ps(_mm512_permute_ps(r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        result = _mm512_fmadd_ps(_mm512_permute_ps(r, _MM_SHUFFLE(1, 1, 1, 1)), b1, result);
+        result = _mm512_fmadd_ps(_mm512_permute_ps(r, _MM_SHUFFLE(2, 2, 2, 2)), b2, result);
+        result = _mm512_fmadd_ps(_mm512_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)), b3, result);
+        _mm512_storeu_ps(out[i].m[0], result);
+    }
+}
+
+// For rows a, b, c the inverse transpose has rows (b x c, c x a, a x b) / det.
+// The w lanes of the inputs are masked out so the outputs have w = 0.
+
+__m128 MatrixBatch_internal::cross(__m128 u, __m128 v)
+{
+    return _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))),
+        _mm_mul_ps(_mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)))
+    );
+}
+
+MATRIX_BATCH_TARGET("avx2,fma")
+__m256 MatrixBatch_internal::cross(__m256 u, __m256 v)
+{
+    return _mm256_fmsub_ps(
+        _mm256_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1)), _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2)),
+        _mm256_mul_ps(_mm256_shuffle_ps(u, u, _MM_SHUFFLE(3, 1, 0, 2)), _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)))
+    );
+}
+
+MATRIX_BATCH_TARGET("avx2,fma")
+__m256 MatrixBatch_internal::loadRowPair(const DirectX::XMFLOAT4X4* matrices, uint32_t row)
+{
+    // Row of the first matrix in the low half, of the second in the high half
+    return _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(matrices[0].m[row])),
+        _mm_loadu_ps(matrices[1].m[row]),
+        1
+    );
+}
+
+void MatrixBatch_internal::inverseTransposeSSE(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out)
+{
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 lastRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const __m128 a = _mm_and_ps(_mm_loadu_ps(matrices[i].m[0]), xyzMask);
+        const __m128 b = _mm_and_ps(_mm_loadu_ps(matrices[i].m[1]), xyzMask);
+        const __m128 c = _mm_and_ps(_mm_loadu_ps(matrices[i].m[2]), xyzMask);
+        const __m128 bc = cross(b, c);
+        const __m128 ca = cross(c, a);
+        const __m128 ab = cross(a, b);
+        __m128 det = _mm_mul_ps(a, bc);
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+        const __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        _mm_storeu_ps(out[i].m[0], _mm_mul_ps(bc, inverseDet));
+        _mm_storeu_ps(out[i].m[1], _mm_mul_ps(ca, inverseDet));
+        _mm_storeu_ps(out[i].m[2], _mm_mul_ps(ab, inverseDet));
+        _mm_storeu_ps(out[i].m[3], lastRow);
+    }
+}
+
+MATRIX_BATCH_TARGET("avx2,fma")
+void MatrixBatch_internal::inverseTransposeAVX2(const DirectX::XMFLOAT4X4* matrices, uint32_t count, DirectX::XMFLOAT4X4* out)
+{
+    // Two matrices per iteration, one in each 128 bit half
+    const __m256 xyzMask = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+    const __m128 lastRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m256 a = _mm256_and_ps(loadRowPair(matrices + i, 0), xyzMask);
+        const __m256 b = _mm256_and_ps(loadRowPair(matrices + i, 1), xyzMask);
+        const __m256 c = _mm256_and_ps(loadRowPair(matrices + i, 2), xyzMask);
+        const __m256 bc = cross(b, c);
+        const __m256 ca = cross(c, a);
+        const __m256 ab = cross(a, b);
+        __m256 det = _mm256_mul_ps(a, bc);
+        det = _mm256_add_ps(det, _mm256_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+        det = _mm256_add_ps(det, _mm256_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+        const __m256 inverseDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+        const __m256 row0 = _mm256_mul_ps(bc, inverseDet);
+        const __m256 row1 = _mm256_mul_ps(ca, inverseDet);
+        const __m256 row2 = _mm256_mul_ps(ab, inverseDet);
+        _mm_storeu_ps(out[i].m[0], _mm256_castps256_ps128(row0));
+        _mm_storeu_ps(out[i].m[1], _mm256_castps256_ps128(row1));
+        _mm_storeu_ps(out[i].m[2], _mm256_castps256_ps128(row2));
+        _mm_storeu_ps(out[i].m[3], lastRow);
+        _mm_storeu_ps(out[i + 1].m[0], _mm256_extractf128_ps(row0, 1));
+        _mm_storeu_ps(out[i + 1].m[1], _mm256_extractf128_ps(row1, 1));
+        _mm_storeu_ps(out[i + 1].m[2], _mm256_extractf128_ps(row2, 1));
+        _mm_storeu_ps(out[i + 1].m[3], lastRow);
+    }
+    if (i < count)
+    {
+        inverseTransposeSSE(matrices + i, count - i, out + i);
+    }
+}
+
+#pragma endregion
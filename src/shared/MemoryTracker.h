@@ -0,0 +1,256 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+// Memory accounting by subsystem. Everything allocated is charged to a
+// tag and a source. The operator new HeapCheck.h installs when
+// MEMORY_TRACKING is defined charges heap allocations to the innermost
+// MemoryTagScope of the allocating thread, arenas open one for their block
+// so it counts as arena memory, and the renderer tracks GPU resources where
+// it creates them. Counters are relaxed atomics, cheap enough to leave on
+// while profiling.
+
+enum class MemoryTag : uint8_t
+{
+    Untagged,
+    Simulation,
+    Renderer,
+    Logger,
+    COUNT
+};
+
+enum class MemorySource : uint8_t
+{
+    Heap,
+    Arena,
+    Gpu,
+    COUNT
+};
+
+struct MemoryStats
+{
+    uint64_t current;
+    uint64_t peak;
+    // Live allocations
+    uint64_t count;
+};
+
+#define MEMORY_TAG(tag) MemoryTagScope memoryTagScope(MemoryTag::tag)
+
+// bytes in total of count allocations
+void TrackAllocation(MemoryTag tag, MemorySource source, uint64_t bytes, uint64_t count = 1);
+void TrackFree(MemoryTag tag, MemorySource source, uint64_t bytes, uint64_t count = 1);
+MemoryStats GetMemoryStats(MemoryTag tag, MemorySource source);
+// Over all sources, 0 for none
+void SetMemoryBudget(MemoryTag tag, uint64_t bytes);
+const char* MemoryTagName(MemoryTag tag);
+
+// Calls print(line) with a warning for every tag that went over its
+// budget since the last call, and with a table of all counters once every
+// MEMORY_REPORT_NANOSECONDS of now, in EventLoop::Now() time
+template<typename Print>
+void ReportMemory(uint64_t now, const Print& print);
+template<typename Print>
+void DumpMemoryStats(const Print& print);
+
+class MemoryTagScope final
+{
+public:
+    explicit MemoryTagScope(MemoryTag tag, MemorySource source = MemorySource::Heap);
+    MemoryTagScope(const MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+    ~MemoryTagScope();
+
+    static MemoryTag CurrentTag();
+    static MemorySource CurrentSource();
+
+private:
+    MemoryTag    m_outerTag;
+    MemorySource m_outerSource;
+};
+
+static constexpr uint64_t MEMORY_REPORT_NANOSECONDS = 10000000000ull;
+
+namespace MemoryTracker_internal
+{
+    constexpr uint32_t TAG_COUNT = static_cast<uint32_t>(MemoryTag::COUNT);
+    constexpr uint32_t SOURCE_COUNT = static_cast<uint32_t>(MemorySource::COUNT);
+
+    // A cache line each, threads allocating under different tags do not
+    // contend
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> current{0};
+        std::atomic<uint64_t> peak{0};
+        std::atomic<uint64_t> count{0};
+    };
+
+    Counters g_counters[TAG_COUNT][SOURCE_COUNT];
+    std::atomic<uint64_t> g_budgets[TAG_COUNT];
+    std::atomic<bool> g_isOverBudget[TAG_COUNT];
+    uint64_t g_nextReport = 0;
+    thread_local MemoryTag g_tag = MemoryTag::Untagged;
+    thread_local MemorySource g_source = MemorySource::Heap;
+
+    const char* const TAG_NAMES[TAG_COUNT] = { "untagged", "simulation", "renderer", "logger" };
+    const char* const SOURCE_NAMES[SOURCE_COUNT] = { "heap", "arena", "gpu" };
+
+    uint64_t tagTotal(uint32_t tag)
+    {
+        uint64_t total = 0;
+        for (const Counters& counters : g_counters[tag])
+        {
+            total += counters.current.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+}
+
+#pragma region Tracking
+
+void TrackAllocation(MemoryTag tag, MemorySource source, uint64_t bytes, uint64_t count)
+{
+    using namespace MemoryTracker_internal;
+
+    const uint32_t tagIndex = static_cast<uint32_t>(tag);
+    Counters& counters = g_counters[tagIndex][static_cast<uint32_t>(source)];
+    const uint64_t current = counters.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    counters.count.fetch_add(count, std::memory_order_relaxed);
+    uint64_t peak = counters.peak.load(std::memory_order_relaxed);
+    while (current > peak && !counters.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+    {
+    }
+    const uint64_t budget = g_budgets[tagIndex].load(std::memory_order_relaxed);
+    if (budget && tagTotal(tagIndex) > budget)
+    {
+        g_isOverBudget[tagIndex].store(true, std::memory_order_relaxed);
+    }
+}
+
+void TrackFree(MemoryTag tag, MemorySource source, uint64_t bytes, uint64_t count)
+{
+    using namespace MemoryTracker_internal;
+
+    Counters& counters = g_counters[static_cast<uint32_t>(tag)][static_cast<uint32_t>(source)];
+    counters.current.fetch_sub(bytes, std::memory_order_relaxed);
+    counters.count.fetch_sub(count, std::memory_order_relaxed);
+}
+
+MemoryStats GetMemoryStats(MemoryTag tag, MemorySource source)
+{
+    const MemoryTracker_internal::Counters& counters =
+        MemoryTracker_internal::g_counters[static_cast<uint32_t>(tag)][static_cast<uint32_t>(source)];
+    return {
+        counters.current.load(std::memory_order_relaxed),
+        counters.peak.load(std::memory_order_relaxed),
+        counters.count.load(std::memory_order_relaxed)
+    };
+}
+
+void SetMemoryBudget(MemoryTag tag, uint64_t bytes)
+{
+    using namespace MemoryTracker_internal;
+
+    const uint32_t tagIndex = static_cast<uint32_t>(tag);
+    g_budgets[tagIndex].store(bytes, std::memory_order_relaxed);
+    if (bytes && tagTotal(tagIndex) > bytes)
+    {
+        g_isOverBudget[tagIndex].store(true, std::memory_order_relaxed);
+    }
+}
+
+const char* MemoryTagName(MemoryTag tag)
+{
+    return tag < MemoryTag::COUNT ? MemoryTracker_internal::TAG_NAMES[static_cast<uint32_t>(tag)] : "?";
+}
+
+#pragma endregion
+
+#pragma region Reporting
+
+template<typename Print>
+void ReportMemory(uint64_t now, const Print& print)
+{
+    using namespace MemoryTracker_internal;
+
+    char line[160];
+    for (uint32_t tag = 0; tag < TAG_COUNT; ++tag)
+    {
+        if (g_isOverBudget[tag].exchange(false, std::memory_order_relaxed))
+        {
+            snprintf(line, sizeof(line), "Memory of %s over budget: %llu KB of %llu KB\n",
+                TAG_NAMES[tag],
+                static_cast<unsigned long long>(tagTotal(tag) / 1024),
+                static_cast<unsigned long long>(g_budgets[tag].load(std::memory_order_relaxed) / 1024)
+            );
+            print(line);
+        }
+    }
+    if (now >= g_nextReport)
+    {
+        g_nextReport = now + MEMORY_REPORT_NANOSECONDS;
+        DumpMemoryStats(print);
+    }
+}
+
+template<typename Print>
+void DumpMemoryStats(const Print& print)
+{
+    using namespace MemoryTracker_internal;
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-11s %-6s %12s %12s %10s %12s\n", "memory", "source", "current KB", "peak KB", "count", "budget KB");
+    print(line);
+    for (uint32_t tag = 0; tag < TAG_COUNT; ++tag)
+    {
+        for (uint32_t source = 0; source < SOURCE_COUNT; ++source)
+        {
+            const MemoryStats stats = GetMemoryStats(static_cast<MemoryTag>(tag), static_cast<MemorySource>(source));
+            if (!stats.peak)
+            {
+                continue;
+            }
+            snprintf(line, sizeof(line), "%-11s %-6s %12llu %12llu %10llu %12llu\n",
+                TAG_NAMES[tag],
+                SOURCE_NAMES[source],
+                static_cast<unsigned long long>(stats.current / 1024),
+                static_cast<unsigned long long>(stats.peak / 1024),
+                static_cast<unsigned long long>(stats.count),
+                static_cast<unsigned long long>(g_budgets[tag].load(std::memory_order_relaxed) / 1024)
+            );
+            print(line);
+        }
+    }
+}
+
+#pragma endregion
+
+#pragma region MemoryTagScope
+
+MemoryTagScope::MemoryTagScope(MemoryTag tag, MemorySource source)
+    : m_outerTag(MemoryTracker_internal::g_tag)
+    , m_outerSource(MemoryTracker_internal::g_source)
+{
+    MemoryTracker_internal::g_tag = tag;
+    MemoryTracker_internal::g_source = source;
+}
+
+MemoryTagScope::~MemoryTagScope()
+{
+    MemoryTracker_internal::g_tag = m_outerTag;
+    MemoryTracker_internal::g_source = m_outerSource;
+}
+
+MemoryTag MemoryTagScope::CurrentTag()
+{
+    return MemoryTracker_internal::g_tag;
+}
+
+MemorySource MemoryTagScope::CurrentSource()
+{
+    return MemoryTracker_internal::g_source;
+}
+
+#pragma endregion
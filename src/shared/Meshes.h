@@ -0,0 +1,376 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// Procedural primitives. Every generator is constexpr, so small meshes are
+// baked into the executable as std::arrays with MakeXxx<...>(), while large
+// tessellations are generated at runtime into vectors with GenerateXxx().
+//
+// Triangles are clockwise when seen from outside, matching the default
+// D3D12 rasterizer state, and vertices are colored by their direction from
+// the mesh center.
+struct MeshVertex
+{
+    float position[3];
+    float color[3];
+};
+
+template<size_t VertexCount, size_t IndexCount>
+struct StaticMesh
+{
+    static_assert(VertexCount <= 65536, "Static meshes use 16 bit indices");
+
+    std::array<MeshVertex, VertexCount> vertices;
+    std::array<uint16_t, IndexCount> indices;
+};
+
+struct RuntimeMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct MeshSize
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+};
+
+namespace Meshes_internal
+{
+    constexpr double PI = 3.14159265358979323846;
+
+    constexpr double sine(double x)
+    {
+        while (x > PI)
+        {
+            x -= 2.0 * PI;
+        }
+        while (x < -PI)
+        {
+            x += 2.0 * PI;
+        }
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 12; ++n)
+        {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double cosine(double x)
+    {
+        return sine(x + PI * 0.5);
+    }
+
+    template<typename Index>
+    struct MeshWriter
+    {
+        MeshVertex* vertices;
+        Index* indices;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+
+        constexpr uint32_t Vertex(double x, double y, double z, double directionX, double directionY, double directionZ)
+        {
+            MeshVertex& vertex = vertices[vertexCount];
+            vertex.position[0] = static_cast<float>(x);
+            vertex.position[1] = static_cast<float>(y);
+            vertex.position[2] = static_cast<float>(z);
+            vertex.color[0] = static_cast<float>(directionX * 0.5 + 0.5);
+            vertex.color[1] = static_cast<float>(directionY * 0.5 + 0.5);
+            vertex.color[2] = static_cast<float>(directionZ * 0.5 + 0.5);
+            return vertexCount++;
+        }
+
+        constexpr void Triangle(uint32_t a, uint32_t b, uint32_t c)
+        {
+            indices[indexCount++] = static_cast<Index>(a);
+            indices[indexCount++] = static_cast<Index>(b);
+            indices[indexCount++] = static_cast<Index>(c);
+        }
+
+        // Corners as seen from outside
+        constexpr void Quad(uint32_t bottomLeft, uint32_t topLeft, uint32_t topRight, uint32_t bottomRight)
+        {
+            Triangle(bottomLeft, topLeft, topRight);
+            Triangle(bottomLeft, topRight, bottomRight);
+        }
+
+        // (columns + 1) x (rows + 1) vertices laid out row by row, bottom row first
+        constexpr void GridQuads(uint32_t firstVertex, uint32_t columns, uint32_t rows)
+        {
+            for (uint32_t row = 0; row < rows; ++row)
+            {
+                for (uint32_t column = 0; column < columns; ++column)
+                {
+                    const uint32_t bottom = firstVertex + row * (columns + 1) + column;
+                    const uint32_t top = bottom + columns + 1;
+                    Quad(bottom, top, top + 1, bottom + 1);
+                }
+            }
+        }
+    };
+}
+
+#pragma region Sizes
+
+constexpr MeshSize BoxSize(uint32_t segments)
+{
+    return { 6 * (segments + 1) * (segments + 1), 6 * segments * segments * 6 };
+}
+
+constexpr MeshSize GridSize(uint32_t columns, uint32_t rows)
+{
+    return { (columns + 1) * (rows + 1), columns * rows * 6 };
+}
+
+constexpr MeshSize SphereSize(uint32_t slices, uint32_t stacks)
+{
+    return { (slices + 1) * (stacks + 1), slices * stacks * 6 };
+}
+
+constexpr MeshSize CylinderSize(uint32_t slices, uint32_t stacks)
+{
+    return { (slices + 1) * (stacks + 1) + 2 * (slices + 2), slices * stacks * 6 + 2 * slices * 3 };
+}
+
+constexpr MeshSize TorusSize(uint32_t ringSegments, uint32_t tubeSegments)
+{
+    return { (ringSegments + 1) * (tubeSegments + 1), ringSegments * tubeSegments * 6 };
+}
+
+#pragma endregion
+
+#pragma region Generators
+
+// Axis aligned box centered at the origin, every face split into segments x segments quads
+template<typename Index>
+constexpr void GenerateBox(uint32_t segments, float halfExtent, MeshVertex* vertices, Index* indices)
+{
+    // Outward normal, then right and up directions as seen from outside
+    constexpr int faces[6][9] = {
+        {  1,  0,  0,   0,  0,  1,   0,  1,  0 },
+        { -1,  0,  0,   0,  0, -1,   0,  1,  0 },
+        {  0,  1,  0,   1,  0,  0,   0,  0,  1 },
+        {  0, -1,  0,   1,  0,  0,   0,  0, -1 },
+        {  0,  0,  1,  -1,  0,  0,   0,  1,  0 },
+        {  0,  0, -1,   1,  0,  0,   0,  1,  0 },
+    };
+    Meshes_internal::MeshWriter<Index> writer = { vertices, indices, 0, 0 };
+    for (const auto& face : faces)
+    {
+        const uint32_t firstVertex = writer.vertexCount;
+        for (uint32_t row = 0; row <= segments; ++row)
+        {
+            const double v = 2.0 * row / segments - 1.0;
+            for (uint32_t column = 0; column <= segments; ++column)
+            {
+                const double u = 2.0 * column / segments - 1.0;
+                const double x = face[0] + u * face[3] + v * face[6];
+                const double y = face[1] + u * face[4] + v * face[7];
+                const double z = face[2] + u * face[5] + v * face[8];
+                writer.Vertex(x * halfExtent, y * halfExtent, z * halfExtent, x, y, z);
+            }
+        }
+        writer.GridQuads(firstVertex, segments, segments);
+    }
+}
+
+// Plane y = 0 facing up, spanning [-halfExtent, halfExtent] on x and z
+template<typename Index>
+constexpr void GenerateGrid(uint32_t columns, uint32_t rows, float halfExtent, MeshVertex* vertices, Index* indices)
+{
+    Meshes_internal::MeshWriter<Index> writer = { vertices, indices, 0, 0 };
+    for (uint32_t row = 0; row <= rows; ++row)
+    {
+        const double z = 2.0 * row / rows - 1.0;
+        for (uint32_t column = 0; column <= columns; ++column)
+        {
+            const double x = 2.0 * column / columns - 1.0;
+            writer.Vertex(x * halfExtent, 0.0, z * halfExtent, x, 1.0, z);
+        }
+    }
+    writer.GridQuads(0, columns, rows);
+}
+
+// UV sphere, stacks go from the south to the north pole
+template<typename Index>
+constexpr void GenerateSphere(uint32_t slices, uint32_t stacks, float radius, MeshVertex* vertices, Index* indices)
+{
+    using namespace Meshes_internal;
+    MeshWriter<Index> writer = { vertices, indices, 0, 0 };
+    for (uint32_t stack = 0; stack <= stacks; ++stack)
+    {
+        const double polar = PI * (1.0 - static_cast<double>(stack) / stacks);
+        for (uint32_t slice = 0; slice <= slices; ++slice)
+        {
+            const double azimuth = 2.0 * PI * slice / slices;
+            const double x = cosine(azimuth) * sine(polar);
+            const double y = cosine(polar);
+            const double z = sine(azimuth) * sine(polar);
+            writer.Vertex(x * radius, y * radius, z * radius, x, y, z);
+        }
+    }
+    writer.GridQuads(0, slices, stacks);
+}
+
+// Capped cylinder around the y axis, from y = -halfHeight to y = halfHeight
+template<typename Index>
+constexpr void GenerateCylinder(uint32_t slices, uint32_t stacks, float radius, float halfHeight, MeshVertex* vertices, Index* indices)
+{
+    using namespace Meshes_internal;
+    MeshWriter<Index> writer = { vertices, indices, 0, 0 };
+    for (uint32_t stack = 0; stack <= stacks; ++stack)
+    {
+        const double y = 2.0 * stack / stacks - 1.0;
+        for (uint32_t slice = 0; slice <= slices; ++slice)
+        {
+            const double azimuth = 2.0 * PI * slice / slices;
+            const double x = cosine(azimuth);
+            const double z = sine(azimuth);
+            writer.Vertex(x * radius, y * halfHeight, z * radius, x, y, z);
+        }
+    }
+    writer.GridQuads(0, slices, stacks);
+
+    for (int side = -1; side <= 1; side += 2)
+    {
+        const uint32_t center = writer.Vertex(0.0, side * halfHeight, 0.0, 0.0, side, 0.0);
+        for (uint32_t slice = 0; slice <= slices; ++slice)
+        {
+            const double azimuth = 2.0 * PI * slice / slices;
+            const double x = cosine(azimuth);
+            const double z = sine(azimuth);
+            writer.Vertex(x * radius, side * halfHeight, z * radius, x, side, z);
+        }
+        for (uint32_t slice = 0; slice < slices; ++slice)
+        {
+            // Increasing azimuth turns counterclockwise when seen from above
+            if (side > 0)
+            {
+                writer.Triangle(center, center + slice + 2, center + slice + 1);
+            } else {
+                writer.Triangle(center, center + slice + 1, center + slice + 2);
+            }
+        }
+    }
+}
+
+// Torus around the y axis
+template<typename Index>
+constexpr void GenerateTorus(uint32_t ringSegments, uint32_t tubeSegments, float ringRadius, float tubeRadius, MeshVertex* vertices, Index* indices)
+{
+    using namespace Meshes_internal;
+    MeshWriter<Index> writer = { vertices, indices, 0, 0 };
+    for (uint32_t tube = 0; tube <= tubeSegments; ++tube)
+    {
+        const double tubeAngle = 2.0 * PI * tube / tubeSegments;
+        const double distance = ringRadius + tubeRadius * cosine(tubeAngle);
+        for (uint32_t ring = 0; ring <= ringSegments; ++ring)
+        {
+            const double ringAngle = 2.0 * PI * ring / ringSegments;
+            writer.Vertex(
+                distance * cosine(ringAngle), tubeRadius * sine(tubeAngle), distance * sine(ringAngle),
+                cosine(tubeAngle) * cosine(ringAngle), sine(tubeAngle), cosine(tubeAngle) * sine(ringAngle)
+            );
+        }
+    }
+    writer.GridQuads(0, ringSegments, tubeSegments);
+}
+
+#pragma endregion
+
+#pragma region Compile time meshes
+
+template<uint32_t Segments>
+constexpr auto MakeBox(float halfExtent)
+{
+    constexpr MeshSize size = BoxSize(Segments);
+    StaticMesh<size.vertexCount, size.indexCount> mesh = {};
+    GenerateBox(Segments, halfExtent, mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+template<uint32_t Columns, uint32_t Rows>
+constexpr auto MakeGrid(float halfExtent)
+{
+    constexpr MeshSize size = GridSize(Columns, Rows);
+    StaticMesh<size.vertexCount, size.indexCount> mesh = {};
+    GenerateGrid(Columns, Rows, halfExtent, mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+template<uint32_t Slices, uint32_t Stacks>
+constexpr auto MakeSphere(float radius)
+{
+    constexpr MeshSize size = SphereSize(Slices, Stacks);
+    StaticMesh<size.vertexCount, size.indexCount> mesh = {};
+    GenerateSphere(Slices, Stacks, radius, mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+template<uint32_t Slices, uint32_t Stacks>
+constexpr auto MakeCylinder(float radius, float halfHeight)
+{
+    constexpr MeshSize size = CylinderSize(Slices, Stacks);
+    StaticMesh<size.vertexCount, size.indexCount> mesh = {};
+    GenerateCylinder(Slices, Stacks, radius, halfHeight, mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+template<uint32_t RingSegments, uint32_t TubeSegments>
+constexpr auto MakeTorus(float ringRadius, float tubeRadius)
+{
+    constexpr MeshSize size = TorusSize(RingSegments, TubeSegments);
+    StaticMesh<size.vertexCount, size.indexCount> mesh = {};
+    GenerateTorus(RingSegments, TubeSegments, ringRadius, tubeRadius, mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+#pragma endregion
+
+#pragma region Runtime meshes
+
+void ResizeMesh(RuntimeMesh* mesh, MeshSize size)
+{
+    mesh->vertices.resize(size.vertexCount);
+    mesh->indices.resize(size.indexCount);
+}
+
+void GenerateBox(uint32_t segments, float halfExtent, RuntimeMesh* mesh)
+{
+    ResizeMesh(mesh, BoxSize(segments));
+    GenerateBox(segments, halfExtent, mesh->vertices.data(), mesh->indices.data());
+}
+
+void GenerateGrid(uint32_t columns, uint32_t rows, float halfExtent, RuntimeMesh* mesh)
+{
+    ResizeMesh(mesh, GridSize(columns, rows));
+    GenerateGrid(columns, rows, halfExtent, mesh->vertices.data(), mesh->indices.data());
+}
+
+void GenerateSphere(uint32_t slices, uint32_t stacks, float radius, RuntimeMesh* mesh)
+{
+    ResizeMesh(mesh, SphereSize(slices, stacks));
+    GenerateSphere(slices, stacks, radius, mesh->vertices.data(), mesh->indices.data());
+}
+
+void GenerateCylinder(uint32_t slices, uint32_t stacks, float radius, float halfHeight, RuntimeMesh* mesh)
+{
+    ResizeMesh(mesh, CylinderSize(slices, stacks));
+    GenerateCylinder(slices, stacks, radius, halfHeight, mesh->vertices.data(), mesh->indices.data());
+}
+
+void GenerateTorus(uint32_t ringSegments, uint32_t tubeSegments, float ringRadius, float tubeRadius, RuntimeMesh* mesh)
+{
+    ResizeMesh(mesh, TorusSize(ringSegments, tubeSegments));
+    GenerateTorus(ringSegments, tubeSegments, ringRadius, tubeRadius, mesh->vertices.data(), mesh->indices.data());
+}
+
+#pragma endregion
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "Jobs.h"
+#include "Visibility.h"
+
+// Counters of the last OcclusionCuller::Cull call.
+struct OcclusionStats
+{
+    uint32_t occluderTriangles;
+    uint32_t rejectedTriangles;   // crossing the near plane, not rasterized
+    uint32_t testedObjects;
+    uint32_t culledObjects;
+};
+
+// Software occlusion culling against a low resolution CPU depth buffer.
+//
+// Occluders are transformed to screen space on AddOccluder and rasterized
+// in horizontal bands on the job threads. The depth buffer is then reduced
+// into a Hi-Z pyramid keeping the farthest depth of every texel, and an
+// object is culled when the nearest point of its screen space bounds lies
+// behind every Hi-Z texel it covers. Depth follows D3D: 0 near, 1 far.
+class OcclusionCuller final
+{
+public:
+    static constexpr uint32_t WIDTH = 256;
+    static constexpr uint32_t HEIGHT = 128;
+    static constexpr uint32_t BAND_HEIGHT = 8;
+    static constexpr uint32_t MIP_COUNT = 7;
+
+    // Grows the buffers up front so that frames with up to triangleCount
+    // occluder triangles and objectCount tested objects do not allocate
+    void Reserve(uint32_t triangleCount, uint32_t objectCount);
+    void BeginFrame(const float viewProjection[4][4]);
+    // positions are float3 at the start of every stride bytes in object space
+    void AddOccluder(
+        const void* positions, uint32_t stride,
+        const uint16_t* indices, uint32_t indexCount,
+        const float world[4][4]
+    );
+    // Rasterizes occluders, then removes occluded objects from visible
+    void Cull(JobSystem* jobs, const BoundsStore& bounds, VisibleSet* visible);
+
+    const OcclusionStats& Stats() const { return m_stats; }
+    const float* DepthBuffer() const { return m_mips[0].data(); }
+
+private:
+    struct ScreenTriangle
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        uint32_t minY;
+        uint32_t maxY;
+    };
+
+    float                         m_viewProjection[4][4];
+    std::vector<ScreenTriangle>   m_triangles;
+    std::vector<float>            m_mips[MIP_COUNT];
+    std::vector<uint8_t>          m_visibleFlags;
+    OcclusionStats                m_stats;
+
+    void rasterizeBand(uint32_t band);
+    void buildHiZ();
+    bool isOccluded(const BoundsStore& bounds, uint32_t index) const;
+};
+
+namespace Occlusion_internal
+{
+    void transform(const float point[3], const float m[4][4], float out[4]);
+    void multiply(const float a[4][4], const float b[4][4], float out[4][4]);
+}
+
+#pragma region Setup
+
+void OcclusionCuller::Reserve(uint32_t triangleCount, uint32_t objectCount)
+{
+    m_triangles.reserve(triangleCount);
+    m_visibleFlags.resize(std::max<size_t>(m_visibleFlags.size(), objectCount));
+    for (uint32_t level = 0; level < MIP_COUNT; ++level)
+    {
+        m_mips[level].resize(static_cast<size_t>(WIDTH >> level) * (HEIGHT >> level));
+    }
+}
+
+void OcclusionCuller::BeginFrame(const float viewProjection[4][4])
+{
+    memcpy(m_viewProjection, viewProjection, sizeof(m_viewProjection));
+    m_triangles.clear();
+    m_stats = {};
+    for (uint32_t level = 0; level < MIP_COUNT; ++level)
+    {
+        m_mips[level].assign(static_cast<size_t>(WIDTH >> level) * (HEIGHT >> level), 1.0f);
+    }
+}
+
+void OcclusionCuller::AddOccluder(
+    const void* positions, uint32_t stride,
+    const uint16_t* indices, uint32_t indexCount,
+    const float world[4][4])
+{
+    float worldViewProjection[4][4];
+    Occlusion_internal::multiply(world, m_viewProjection, worldViewProjection);
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(positions);
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        ScreenTriangle triangle;
+        bool behindNearPlane = false;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            float clip[4];
+            Occlusion_internal::transform(
+                reinterpret_cast<const float*>(bytes + static_cast<size_t>(indices[i + corner]) * stride),
+                worldViewProjection,
+                clip
+            );
+            // Clipping would only make the occluder smaller, dropping it is conservative
+            if (clip[3] <= 1e-5f || clip[2] < 0.0f)
+            {
+                behindNearPlane = true;
+                break;
+            }
+            const float inverseW = 1.0f / clip[3];
+            triangle.x[corner] = (clip[0] * inverseW * 0.5f + 0.5f) * WIDTH;
+            triangle.y[corner] = (0.5f - clip[1] * inverseW * 0.5f) * HEIGHT;
+            triangle.z[corner] = clip[2] * inverseW;
+        }
+        ++m_stats.occluderTriangles;
+        if (behindNearPlane)
+        {
+            ++m_stats.rejectedTriangles;
+            continue;
+        }
+        const float minY = std::min({ triangle.y[0], triangle.y[1], triangle.y[2] });
+        const float maxY = std::max({ triangle.y[0], triangle.y[1], triangle.y[2] });
+        if (maxY < 0.0f || minY >= static_cast<float>(HEIGHT))
+        {
+            continue;
+        }
+        triangle.minY = static_cast<uint32_t>(std::max(minY, 0.0f));
+        triangle.maxY = std::min(static_cast<uint32_t>(maxY), HEIGHT - 1);
+        m_triangles.push_back(triangle);
+    }
+}
+
+#pragma endregion
+
+#pragma region Culling
+
+void OcclusionCuller::Cull(JobSystem* jobs, const BoundsStore& bounds, VisibleSet* visible)
+{
+    jobs->ParallelFor(HEIGHT / BAND_HEIGHT, 1, [this](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t band = begin; band < end; ++band)
+        {
+            rasterizeBand(band);
+        }
+    });
+    buildHiZ();
+
+    m_visibleFlags.resize(std::max<size_t>(m_visibleFlags.size(), visible->count));
+    jobs->ParallelFor(visible->count, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            m_visibleFlags[i] = isOccluded(bounds, visible->indices[i]) ? 0 : 1;
+        }
+    });
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < visible->count; ++i)
+    {
+        visible->indices[visibleCount] = visible->indices[i];
+        visibleCount += m_visibleFlags[i];
+    }
+    m_stats.testedObjects = visible->count;
+    m_stats.culledObjects = visible->count - visibleCount;
+    visible->count = visibleCount;
+}
+
+void OcclusionCuller::rasterizeBand(uint32_t band)
+{
+    const uint32_t bandMinY = band * BAND_HEIGHT;
+    const uint32_t bandMaxY = bandMinY + BAND_HEIGHT - 1;
+    float* depth = m_mips[0].data();
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (const ScreenTriangle& t : m_triangles)
+    {
+        if (t.maxY < bandMinY || t.minY > bandMaxY)
+        {
+            continue;
+        }
+        // Edge functions and depth as planes over the screen, evaluated at pixel centers
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+        if (fabsf(area) < 1e-6f)
+        {
+            continue;
+        }
+        const float sign = area > 0.0f ? 1.0f : -1.0f;
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (uint32_t e = 0; e < 3; ++e)
+        {
+            const uint32_t from = (e + 1) % 3;
+            const uint32_t to = (e + 2) % 3;
+            edgeA[e] = sign * (t.y[from] - t.y[to]);
+            edgeB[e] = sign * (t.x[to] - t.x[from]);
+            edgeC[e] = sign * (t.x[from] * t.y[to] - t.x[to] * t.y[from]);
+        }
+        const float inverseArea = 1.0f / (sign * area);
+        const float depthA = (edgeA[0] * t.z[0] + edgeA[1] * t.z[1] + edgeA[2] * t.z[2]) * inverseArea;
+        const float depthB = (edgeB[0] * t.z[0] + edgeB[1] * t.z[1] + edgeB[2] * t.z[2]) * inverseArea;
+        const float depthC = (edgeC[0] * t.z[0] + edgeC[1] * t.z[1] + edgeC[2] * t.z[2]) * inverseArea;
+
+        const float minX = std::min({ t.x[0], t.x[1], t.x[2] });
+        const float maxX = std::max({ t.x[0], t.x[1], t.x[2] });
+        if (maxX < 0.0f || minX >= static_cast<float>(WIDTH))
+        {
+            continue;
+        }
+        const uint32_t startX = static_cast<uint32_t>(std::max(minX, 0.0f)) & ~3u;
+        const uint32_t endX = std::min(static_cast<uint32_t>(maxX), WIDTH - 1);
+        const uint32_t startY = std::max(t.minY, bandMinY);
+        const uint32_t endY = std::min(t.maxY, bandMaxY);
+
+        for (uint32_t y = startY; y <= endY; ++y)
+        {
+            const float centerY = static_cast<float>(y) + 0.5f;
+            float* row = depth + static_cast<size_t>(y) * WIDTH;
+            for (uint32_t x = startX; x <= endX; x += 4)
+            {
+                const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                const __m128 py = _mm_set1_ps(centerY);
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (uint32_t e = 0; e < 3; ++e)
+                {
+                    const __m128 value = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(edgeA[e])), _mm_mul_ps(py, _mm_set1_ps(edgeB[e]))),
+                        _mm_set1_ps(edgeC[e])
+                    );
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_setzero_ps()));
+                }
+                const __m128 z = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(depthA)), _mm_mul_ps(py, _mm_set1_ps(depthB))),
+                    _mm_set1_ps(depthC)
+                );
+                const __m128 previous = _mm_loadu_ps(row + x);
+                _mm_storeu_ps(row + x, _mm_or_ps(
+                    _mm_and_ps(inside, _mm_min_ps(previous, z)),
+                    _mm_andnot_ps(inside, previous)
+                ));
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildHiZ()
+{
+    for (uint32_t level = 1; level < MIP_COUNT; ++level)
+    {
+        const uint32_t width = WIDTH >> level;
+        const uint32_t height = HEIGHT >> level;
+        const float* source = m_mips[level - 1].data();
+        float* destination = m_mips[level].data();
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const float* top = source + static_cast<size_t>(2 * y) * (2 * width);
+            const float* bottom = top + 2 * width;
+            float* row = destination + static_cast<size_t>(y) * width;
+            uint32_t x = 0;
+            for (; x + 2 <= width; x += 2)
+            {
+                // Four source texels give two destination texels
+                const __m128 vertical = _mm_max_ps(_mm_loadu_ps(top + 2 * x), _mm_loadu_ps(bottom + 2 * x));
+                const __m128 horizontal = _mm_max_ps(vertical, _mm_shuffle_ps(vertical, vertical, _MM_SHUFFLE(2, 3, 0, 1)));
+                row[x] = _mm_cvtss_f32(horizontal);
+                row[x + 1] = _mm_cvtss_f32(_mm_shuffle_ps(horizontal, horizontal, _MM_SHUFFLE(2, 2, 2, 2)));
+            }
+            for (; x < width; ++x)
+            {
+                row[x] = std::max({ top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1] });
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(const BoundsStore& bounds, uint32_t index) const
+{
+    // Corners are the clip space center plus or minus the clip space extents
+    const __m128 row0 = _mm_loadu_ps(m_viewProjection[0]);
+    const __m128 row1 = _mm_loadu_ps(m_viewProjection[1]);
+    const __m128 row2 = _mm_loadu_ps(m_viewProjection[2]);
+    const __m128 row3 = _mm_loadu_ps(m_viewProjection[3]);
+    const __m128 center = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(bounds.centerX[index]), row0),
+        _mm_mul_ps(_mm_set1_ps(bounds.centerY[index]), row1)), _mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(bounds.centerZ[index]), row2),
+        row3
+    ));
+    const __m128 extentX = _mm_mul_ps(_mm_set1_ps(bounds.extentX[index]), row0);
+    const __m128 extentY = _mm_mul_ps(_mm_set1_ps(bounds.extentY[index]), row1);
+    const __m128 extentZ = _mm_mul_ps(_mm_set1_ps(bounds.extentZ[index]), row2);
+
+    __m128 minimum = _mm_set1_ps(1.0f);
+    __m128 maximum = _mm_set1_ps(-1.0f);
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        __m128 clip = center;
+        clip = (corner & 1) ? _mm_add_ps(clip, extentX) : _mm_sub_ps(clip, extentX);
+        clip = (corner & 2) ? _mm_add_ps(clip, extentY) : _mm_sub_ps(clip, extentY);
+        clip = (corner & 4) ? _mm_add_ps(clip, extentZ) : _mm_sub_ps(clip, extentZ);
+        const __m128 w = _mm_shuffle_ps(clip, clip, _MM_SHUFFLE(3, 3, 3, 3));
+        if (_mm_cvtss_f32(w) <= 1e-5f)
+        {
+            return false;
+        }
+        const __m128 ndc = _mm_div_ps(clip, w);
+        minimum = _mm_min_ps(minimum, ndc);
+        maximum = _mm_max_ps(maximum, ndc);
+    }
+    float ndcMin[4];
+    float ndcMax[4];
+    _mm_storeu_ps(ndcMin, minimum);
+    _mm_storeu_ps(ndcMax, maximum);
+    float minX = (ndcMin[0] * 0.5f + 0.5f) * WIDTH;
+    float maxX = (ndcMax[0] * 0.5f + 0.5f) * WIDTH;
+    float minY = (0.5f - ndcMax[1] * 0.5f) * HEIGHT;
+    float maxY = (0.5f - ndcMin[1] * 0.5f) * HEIGHT;
+    const float minZ = ndcMin[2];
+
+    minX = std::max(minX, 0.0f);
+    minY = std::max(minY, 0.0f);
+    maxX = std::min(maxX, static_cast<float>(WIDTH - 1));
+    maxY = std::min(maxY, static_cast<float>(HEIGHT - 1));
+    if (minX > maxX || minY > maxY)
+    {
+        // Outside of the screen, frustum culling decides about those
+        return false;
+    }
+
+    // Pick the level where the rectangle spans at most 2x2 texels
+    const float size = std::max(maxX - minX, maxY - minY);
+    uint32_t level = 0;
+    while (level + 1 < MIP_COUNT && static_cast<float>(1u << level) < size * 0.5f)
+    {
+        ++level;
+    }
+    const uint32_t width = WIDTH >> level;
+    const uint32_t x0 = static_cast<uint32_t>(minX) >> level;
+    const uint32_t x1 = static_cast<uint32_t>(maxX) >> level;
+    const uint32_t y0 = static_cast<uint32_t>(minY) >> level;
+    const uint32_t y1 = static_cast<uint32_t>(maxY) >> level;
+    const float* mip = m_mips[level].data();
+    for (uint32_t y = y0; y <= y1; ++y)
+    {
+        for (uint32_t x = x0; x <= x1; ++x)
+        {
+            if (minZ <= mip[static_cast<size_t>(y) * width + x])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#pragma endregion
+
+void Occlusion_internal::transform(const float p[3], const float m[4][4], float out[4])
+{
+    for (uint32_t column = 0; column < 4; ++column)
+    {
+        out[column] = p[0] * m[0][column] + p[1] * m[1][column] + p[2] * m[2][column] + m[3][column];
+    }
+}
+
+void Occlusion_internal::multiply(const float a[4][4], const float b[4][4], float out[4][4])
+{
+    for (uint32_t row = 0; row < 4; ++row)
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            out[row][column] =
+                a[row][0] * b[0][column] + a[row][1] * b[1][column] +
+                a[row][2] * b[2][column] + a[row][3] * b[3][column];
+        }
+    }
+}
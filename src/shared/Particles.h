@@ -0,0 +1,539 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "Jobs.h"
+#include "MatrixBatch.h"
+
+#ifdef _MSC_VER
+#define PARTICLES_TARGET(features)
+#else
+#define PARTICLES_TARGET(features) __attribute__((target(features)))
+#endif
+
+// One particle as the particle vertex shader reads it, per instance.
+struct ParticleInstance
+{
+    float    position[3];
+    // Edge of the camera facing quad, shrinks to 0 over the lifetime
+    float    size;
+    // RGBA8
+    uint32_t color;
+};
+
+// Spawns particles at a steady rate, moved and changed freely between
+// updates.
+struct ParticleEmitter
+{
+    float    position[3];
+    float    velocity[3];
+    // Random velocity added on every axis, up to this much either way
+    float    spread;
+    float    particlesPerSecond;
+    float    lifetime;
+    float    size;
+    // RGBA8
+    uint32_t color;
+};
+
+// Cosmetic particles falling under gravity with drag until their lifetime
+// runs out. Particles are kept in SoA arrays split into blocks of
+// BLOCK_SIZE. Every block is updated by one job with SSE/AVX2 kernels,
+// which also compact its survivors to the front of the block without
+// branching and write them as instances.
+//
+// Updates are deterministic: the same emitters, seeds and steps give the
+// same particles in the same order on any number of workers and with any
+// kernels.
+class ParticleSystem final
+{
+public:
+    static constexpr uint32_t BATCH_SIZE = 8;
+    static constexpr uint32_t BLOCK_SIZE = 4096;
+    static constexpr float GRAVITY = -9.81f;
+    // Of the velocity lost per second
+    static constexpr float DRAG = 0.5f;
+
+    // Drops all particles and emitters, capacity is rounded up to blocks
+    void Reset(uint32_t capacity, uint64_t seed);
+    uint32_t AddEmitter(const ParticleEmitter& emitter);
+    ParticleEmitter& Emitter(uint32_t emitter) { return m_emitters[emitter]; }
+    uint32_t EmitterCount() const { return static_cast<uint32_t>(m_emitters.size()); }
+    // Alive after the last update
+    uint32_t Count() const { return m_count; }
+    uint32_t Capacity() const { return static_cast<uint32_t>(m_life.size()); }
+
+    // Emits for the elapsed seconds, then moves all particles and drops
+    // the ones that ran out of life. When instances is set, it receives
+    // every survivor and has to hold Capacity() of them. Allocates
+    // nothing, jobs may be null to run on the calling thread only.
+    // Returns Count().
+    uint32_t Update(JobSystem* jobs, float seconds, ParticleInstance* instances);
+
+private:
+    // Emission beyond the capacity is dropped
+    void emit(float seconds);
+    uint32_t nextRandom();
+
+    std::vector<float>    m_positionX;
+    std::vector<float>    m_positionY;
+    std::vector<float>    m_positionZ;
+    std::vector<float>    m_velocityX;
+    std::vector<float>    m_velocityY;
+    std::vector<float>    m_velocityZ;
+    // Seconds left
+    std::vector<float>    m_life;
+    std::vector<float>    m_inverseLifetime;
+    std::vector<float>    m_size;
+    std::vector<uint32_t> m_color;
+    // Particles are [0, count) of every block
+    std::vector<uint32_t> m_blockCounts;
+    // Scratch of an update, where the survivors of a block start in the
+    // instances
+    std::vector<uint32_t> m_blockOffsets;
+    uint32_t              m_count = 0;
+    // First block that may have room, emission fills blocks in turn
+    uint32_t              m_emitBlock = 0;
+
+    std::vector<ParticleEmitter> m_emitters;
+    // Fraction of a particle each emitter still owes
+    std::vector<float>    m_emitCarry;
+    uint64_t              m_random = 0;
+};
+
+void SelectParticleKernels(SimdLevel level);
+
+namespace Particles_internal
+{
+    // One block, every array starts at its first particle
+    struct ParticleArrays
+    {
+        float*    positionX;
+        float*    positionY;
+        float*    positionZ;
+        float*    velocityX;
+        float*    velocityY;
+        float*    velocityZ;
+        float*    life;
+        float*    inverseLifetime;
+        float*    size;
+        uint32_t* color;
+    };
+
+    // Over particles [0, count) of a block, reading up to count rounded
+    // up to BATCH_SIZE. Both count the same survivors: lanes before count
+    // with life - seconds > 0. Kernels use no FMA, every level rounds the
+    // same.
+    typedef uint32_t (*CountKernel)(const float* life, uint32_t count, float seconds);
+    // Returns the survivors, moved to the front of the block in order
+    typedef uint32_t (*UpdateKernel)(const ParticleArrays& particles, uint32_t count, float seconds);
+
+    uint32_t countSurvivorsSSE(const float* life, uint32_t count, float seconds);
+    uint32_t countSurvivorsAVX2(const float* life, uint32_t count, float seconds);
+    uint32_t updateSSE(const ParticleArrays& particles, uint32_t count, float seconds);
+    uint32_t updateAVX2(const ParticleArrays& particles, uint32_t count, float seconds);
+    // Writes exactly count instances, never past them, so blocks are
+    // written side by side from different jobs
+    void writeInstances(const ParticleArrays& particles, uint32_t count, ParticleInstance* instances);
+    void writeInstance(const ParticleArrays& particles, uint32_t particle, ParticleInstance* instance);
+
+    static CountKernel g_countSurvivors = countSurvivorsSSE;
+    static UpdateKernel g_update = updateSSE;
+
+    template<typename Function>
+    void parallelFor(JobSystem* jobs, uint32_t count, uint32_t batchSize, const Function& function)
+    {
+        if (jobs)
+        {
+            jobs->ParallelFor(count, batchSize, function);
+        } else if (count) {
+            function(0, count, 0);
+        }
+    }
+
+    // Velocity kept over a step of the given length
+    float keptVelocity(float seconds)
+    {
+        return std::max(1.0f - ParticleSystem::DRAG * seconds, 0.0f);
+    }
+}
+
+#pragma region Emitters
+
+void ParticleSystem::Reset(uint32_t capacity, uint64_t seed)
+{
+    const uint32_t blockCount = (capacity + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const size_t paddedCount = static_cast<size_t>(blockCount) * BLOCK_SIZE;
+    for (std::vector<float>* values : {
+        &m_positionX, &m_positionY, &m_positionZ, &m_velocityX, &m_velocityY, &m_velocityZ,
+        &m_life, &m_inverseLifetime, &m_size })
+    {
+        values->assign(paddedCount, 0.0f);
+    }
+    m_color.assign(paddedCount, 0);
+    m_blockCounts.assign(blockCount, 0);
+    m_blockOffsets.assign(blockCount, 0);
+    m_count = 0;
+    m_emitBlock = 0;
+    m_emitters.clear();
+    m_emitCarry.clear();
+    // Never 0, which xorshift would keep
+    m_random = seed | 1;
+}
+
+uint32_t ParticleSystem::AddEmitter(const ParticleEmitter& emitter)
+{
+    m_emitters.push_back(emitter);
+    m_emitCarry.push_back(0.0f);
+    return static_cast<uint32_t>(m_emitters.size() - 1);
+}
+
+uint32_t ParticleSystem::nextRandom()
+{
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 7;
+    m_random ^= m_random << 17;
+    return static_cast<uint32_t>(m_random >> 32);
+}
+
+void ParticleSystem::emit(float seconds)
+{
+    const uint32_t blockCount = static_cast<uint32_t>(m_blockCounts.size());
+    for (size_t index = 0; index < m_emitters.size(); ++index)
+    {
+        const ParticleEmitter& emitter = m_emitters[index];
+        const float owed = m_emitCarry[index] + std::max(emitter.particlesPerSecond, 0.0f) * seconds;
+        uint32_t remaining = static_cast<uint32_t>(owed);
+        m_emitCarry[index] = owed - static_cast<float>(remaining);
+        if (!remaining || emitter.lifetime <= 0.0f)
+        {
+            continue;
+        }
+        const float inverseLifetime = 1.0f / emitter.lifetime;
+        // Every block is visited once at most, full ones drop the rest
+        for (uint32_t visited = 0; remaining && visited < blockCount; ++visited)
+        {
+            const uint32_t block = m_emitBlock;
+            const uint32_t count = m_blockCounts[block];
+            const uint32_t emitted = std::min(remaining, BLOCK_SIZE - count);
+            const size_t first = static_cast<size_t>(block) * BLOCK_SIZE + count;
+            for (size_t particle = first; particle < first + emitted; ++particle)
+            {
+                float velocity[3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    // In [-1, 1)
+                    const float random = static_cast<float>(nextRandom() >> 8) * (2.0f / 16777216.0f) - 1.0f;
+                    velocity[axis] = emitter.velocity[axis] + random * emitter.spread;
+                }
+                m_positionX[particle] = emitter.position[0];
+                m_positionY[particle] = emitter.position[1];
+                m_positionZ[particle] = emitter.position[2];
+                m_velocityX[particle] = velocity[0];
+                m_velocityY[particle] = velocity[1];
+                m_velocityZ[particle] = velocity[2];
+                m_life[particle] = emitter.lifetime;
+                m_inverseLifetime[particle] = inverseLifetime;
+                m_size[particle] = emitter.size;
+                m_color[particle] = emitter.color;
+            }
+            m_blockCounts[block] = count + emitted;
+            remaining -= emitted;
+            if (remaining)
+            {
+                m_emitBlock = block + 1 == blockCount ? 0 : block + 1;
+            }
+        }
+    }
+}
+
+#pragma endregion
+
+#pragma region Update
+
+uint32_t ParticleSystem::Update(JobSystem* jobs, float seconds, ParticleInstance* instances)
+{
+    using namespace Particles_internal;
+    emit(seconds);
+
+    const uint32_t blockCount = static_cast<uint32_t>(m_blockCounts.size());
+    if (instances)
+    {
+        // Survivors are counted up front, so every block knows where its
+        // instances go before any of them is updated
+        parallelFor(jobs, blockCount, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t block = begin; block < end; ++block)
+            {
+                m_blockOffsets[block] = g_countSurvivors(&m_life[static_cast<size_t>(block) * BLOCK_SIZE], m_blockCounts[block], seconds);
+            }
+        });
+        uint32_t offset = 0;
+        for (uint32_t& blockOffset : m_blockOffsets)
+        {
+            const uint32_t survivors = blockOffset;
+            blockOffset = offset;
+            offset += survivors;
+        }
+    }
+
+    parallelFor(jobs, blockCount, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t block = begin; block < end; ++block)
+        {
+            if (!m_blockCounts[block])
+            {
+                continue;
+            }
+            const size_t first = static_cast<size_t>(block) * BLOCK_SIZE;
+            const ParticleArrays particles = {
+                &m_positionX[first], &m_positionY[first], &m_positionZ[first],
+                &m_velocityX[first], &m_velocityY[first], &m_velocityZ[first],
+                &m_life[first], &m_inverseLifetime[first], &m_size[first], &m_color[first]
+            };
+            m_blockCounts[block] = g_update(particles, m_blockCounts[block], seconds);
+            if (instances)
+            {
+                writeInstances(particles, m_blockCounts[block], instances + m_blockOffsets[block]);
+            }
+        }
+    });
+
+    m_count = 0;
+    for (uint32_t count : m_blockCounts)
+    {
+        m_count += count;
+    }
+    return m_count;
+}
+
+#pragma endregion
+
+#pragma region Kernels
+
+namespace Particles_internal
+{
+    // For every 8 bit survivor mask, the lane numbers of set bits packed
+    // into bytes, so a batch is compacted with a single permute per array.
+    struct CompactionTable
+    {
+        uint64_t lanes[256];
+
+        constexpr CompactionTable() : lanes()
+        {
+            for (uint32_t mask = 0; mask < 256; ++mask)
+            {
+                uint64_t packed = 0;
+                uint32_t count = 0;
+                for (uint32_t lane = 0; lane < 8; ++lane)
+                {
+                    if (mask & (1u << lane))
+                    {
+                        packed |= static_cast<uint64_t>(lane) << (8 * count++);
+                    }
+                }
+                lanes[mask] = packed;
+            }
+        }
+    };
+    static constexpr CompactionTable g_compactionTable;
+}
+
+void SelectParticleKernels(SimdLevel level)
+{
+    using namespace Particles_internal;
+    if (level == SimdLevel::AVX2 || level == SimdLevel::AVX512)
+    {
+        g_countSurvivors = countSurvivorsAVX2;
+        g_update = updateAVX2;
+    } else {
+        g_countSurvivors = countSurvivorsSSE;
+        g_update = updateSSE;
+    }
+}
+
+uint32_t Particles_internal::countSurvivorsSSE(const float* life, uint32_t count, float seconds)
+{
+    const __m128 step = _mm_set1_ps(seconds);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    // Alive lanes subtract their all ones mask, adding 1
+    __m128i survivors = _mm_setzero_si128();
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        const __m128i isInBlock = _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(count - i)), laneIndex);
+        const __m128 isAlive = _mm_cmpgt_ps(_mm_sub_ps(_mm_loadu_ps(life + i), step), zero);
+        survivors = _mm_sub_epi32(survivors, _mm_and_si128(_mm_castps_si128(isAlive), isInBlock));
+    }
+    survivors = _mm_add_epi32(survivors, _mm_shuffle_epi32(survivors, _MM_SHUFFLE(1, 0, 3, 2)));
+    survivors = _mm_add_epi32(survivors, _mm_shuffle_epi32(survivors, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(survivors));
+}
+
+PARTICLES_TARGET("avx2")
+uint32_t Particles_internal::countSurvivorsAVX2(const float* life, uint32_t count, float seconds)
+{
+    const __m256 step = _mm256_set1_ps(seconds);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i survivors = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < count; i += 8)
+    {
+        const __m256i isInBlock = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - i)), laneIndex);
+        const __m256 isAlive = _mm256_cmp_ps(_mm256_sub_ps(_mm256_loadu_ps(life + i), step), zero, _CMP_GT_OQ);
+        survivors = _mm256_sub_epi32(survivors, _mm256_and_si256(_mm256_castps_si256(isAlive), isInBlock));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(survivors), _mm256_extracti128_si256(survivors, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+
+uint32_t Particles_internal::updateSSE(const ParticleArrays& particles, uint32_t count, float seconds)
+{
+    const __m128 step = _mm_set1_ps(seconds);
+    const __m128 gravity = _mm_set1_ps(ParticleSystem::GRAVITY * seconds);
+    const __m128 damping = _mm_set1_ps(keptVelocity(seconds));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    // Lanes of a batch go through memory to be compacted one by one
+    alignas(16) float lanes[9][4];
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        const __m128 velocityX = _mm_mul_ps(_mm_loadu_ps(particles.velocityX + i), damping);
+        const __m128 velocityY = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(particles.velocityY + i), damping), gravity);
+        const __m128 velocityZ = _mm_mul_ps(_mm_loadu_ps(particles.velocityZ + i), damping);
+        const __m128 life = _mm_sub_ps(_mm_loadu_ps(particles.life + i), step);
+        _mm_store_ps(lanes[0], _mm_add_ps(_mm_loadu_ps(particles.positionX + i), _mm_mul_ps(velocityX, step)));
+        _mm_store_ps(lanes[1], _mm_add_ps(_mm_loadu_ps(particles.positionY + i), _mm_mul_ps(velocityY, step)));
+        _mm_store_ps(lanes[2], _mm_add_ps(_mm_loadu_ps(particles.positionZ + i), _mm_mul_ps(velocityZ, step)));
+        _mm_store_ps(lanes[3], velocityX);
+        _mm_store_ps(lanes[4], velocityY);
+        _mm_store_ps(lanes[5], velocityZ);
+        _mm_store_ps(lanes[6], life);
+        _mm_store_ps(lanes[7], _mm_loadu_ps(particles.inverseLifetime + i));
+        _mm_store_ps(lanes[8], _mm_loadu_ps(particles.size + i));
+        uint32_t colors[4];
+        memcpy(colors, particles.color + i, sizeof(colors));
+
+        const __m128i isInBlock = _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(count - i)), laneIndex);
+        const int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(life, zero), _mm_castsi128_ps(isInBlock)));
+        // Every lane is written, only survivors advance. Writes trail the
+        // reads, so the block is compacted in place.
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            particles.positionX[written] = lanes[0][lane];
+            particles.positionY[written] = lanes[1][lane];
+            particles.positionZ[written] = lanes[2][lane];
+            particles.velocityX[written] = lanes[3][lane];
+            particles.velocityY[written] = lanes[4][lane];
+            particles.velocityZ[written] = lanes[5][lane];
+            particles.life[written] = lanes[6][lane];
+            particles.inverseLifetime[written] = lanes[7][lane];
+            particles.size[written] = lanes[8][lane];
+            particles.color[written] = colors[lane];
+            written += (mask >> lane) & 1;
+        }
+    }
+    return written;
+}
+
+PARTICLES_TARGET("avx2,popcnt")
+uint32_t Particles_internal::updateAVX2(const ParticleArrays& particles, uint32_t count, float seconds)
+{
+    const __m256 step = _mm256_set1_ps(seconds);
+    const __m256 gravity = _mm256_set1_ps(ParticleSystem::GRAVITY * seconds);
+    const __m256 damping = _mm256_set1_ps(keptVelocity(seconds));
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i += 8)
+    {
+        const __m256 velocityX = _mm256_mul_ps(_mm256_loadu_ps(particles.velocityX + i), damping);
+        const __m256 velocityY = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(particles.velocityY + i), damping), gravity);
+        const __m256 velocityZ = _mm256_mul_ps(_mm256_loadu_ps(particles.velocityZ + i), damping);
+        const __m256 life = _mm256_sub_ps(_mm256_loadu_ps(particles.life + i), step);
+        const __m256 positionX = _mm256_add_ps(_mm256_loadu_ps(particles.positionX + i), _mm256_mul_ps(velocityX, step));
+        const __m256 positionY = _mm256_add_ps(_mm256_loadu_ps(particles.positionY + i), _mm256_mul_ps(velocityY, step));
+        const __m256 positionZ = _mm256_add_ps(_mm256_loadu_ps(particles.positionZ + i), _mm256_mul_ps(velocityZ, step));
+        const __m256 inverseLifetime = _mm256_loadu_ps(particles.inverseLifetime + i);
+        const __m256 size = _mm256_loadu_ps(particles.size + i);
+        const __m256i color = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(particles.color + i));
+
+        const __m256i isInBlock = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - i)), laneIndex);
+        const __m256 isAlive = _mm256_and_ps(_mm256_cmp_ps(life, zero, _CMP_GT_OQ), _mm256_castsi256_ps(isInBlock));
+        const int mask = _mm256_movemask_ps(isAlive);
+        // Survivors packed to the low lanes and all 8 stored, only the
+        // survivors advance. Writes trail the reads, so the block is
+        // compacted in place and never written past its end.
+        const __m256i lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(static_cast<long long>(g_compactionTable.lanes[mask])));
+        _mm256_storeu_ps(particles.positionX + written, _mm256_permutevar8x32_ps(positionX, lanes));
+        _mm256_storeu_ps(particles.positionY + written, _mm256_permutevar8x32_ps(positionY, lanes));
+        _mm256_storeu_ps(particles.positionZ + written, _mm256_permutevar8x32_ps(positionZ, lanes));
+        _mm256_storeu_ps(particles.velocityX + written, _mm256_permutevar8x32_ps(velocityX, lanes));
+        _mm256_storeu_ps(particles.velocityY + written, _mm256_permutevar8x32_ps(velocityY, lanes));
+        _mm256_storeu_ps(particles.velocityZ + written, _mm256_permutevar8x32_ps(velocityZ, lanes));
+        _mm256_storeu_ps(particles.life + written, _mm256_permutevar8x32_ps(life, lanes));
+        _mm256_storeu_ps(particles.inverseLifetime + written, _mm256_permutevar8x32_ps(inverseLifetime, lanes));
+        _mm256_storeu_ps(particles.size + written, _mm256_permutevar8x32_ps(size, lanes));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(particles.color + written), _mm256_permutevar8x32_epi32(color, lanes));
+        written += static_cast<uint32_t>(_mm_popcnt_u32(static_cast<unsigned int>(mask)));
+    }
+    return written;
+}
+
+void Particles_internal::writeInstances(const ParticleArrays& particles, uint32_t count, ParticleInstance* instances)
+{
+    // Groups of 4 instances are 5 aligned vectors, streamed past the
+    // caches so writing them does not read them first. Suits write
+    // combined upload memory as well.
+    uint32_t i = 0;
+    for (; i < count && reinterpret_cast<uintptr_t>(instances + i) % 16; ++i)
+    {
+        writeInstance(particles, i, instances + i);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 first = _mm_loadu_ps(particles.positionX + i);
+        __m128 second = _mm_loadu_ps(particles.positionY + i);
+        __m128 third = _mm_loadu_ps(particles.positionZ + i);
+        __m128 fourth = _mm_mul_ps(
+            _mm_loadu_ps(particles.size + i),
+            _mm_mul_ps(_mm_loadu_ps(particles.life + i), _mm_loadu_ps(particles.inverseLifetime + i))
+        );
+        const __m128 color = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(particles.color + i)));
+        // Into position and size of one instance each, then the colors
+        // are slotted in between
+        _MM_TRANSPOSE4_PS(first, second, third, fourth);
+        float* out = instances[i].position;
+        _mm_stream_ps(out, first);
+        _mm_stream_ps(out + 4, _mm_move_ss(_mm_shuffle_ps(second, second, _MM_SHUFFLE(2, 1, 0, 3)), color));
+        _mm_stream_ps(out + 8, _mm_shuffle_ps(_mm_shuffle_ps(second, color, _MM_SHUFFLE(1, 1, 3, 3)), third, _MM_SHUFFLE(1, 0, 2, 0)));
+        _mm_stream_ps(out + 12, _mm_shuffle_ps(third, _mm_shuffle_ps(color, fourth, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 3, 2)));
+        _mm_stream_ps(out + 16, _mm_shuffle_ps(fourth, _mm_shuffle_ps(fourth, color, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 1)));
+    }
+    for (; i < count; ++i)
+    {
+        writeInstance(particles, i, instances + i);
+    }
+    // Streamed stores are ordered before whatever tells the reader
+    _mm_sfence();
+}
+
+void Particles_internal::writeInstance(const ParticleArrays& particles, uint32_t particle, ParticleInstance* instance)
+{
+    instance->position[0] = particles.positionX[particle];
+    instance->position[1] = particles.positionY[particle];
+    instance->position[2] = particles.positionZ[particle];
+    instance->size = particles.size[particle] * (particles.life[particle] * particles.inverseLifetime[particle]);
+    instance->color = particles.color[particle];
+}
+
+#pragma endregion
@@ -0,0 +1,733 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "Arena.h"
+#include "Broadphase.h"
+#include "Hash.h"
+#include "Jobs.h"
+#include "MatrixBatch.h"
+#include "Snapshot.h"
+
+#ifdef _MSC_VER
+#define PHYSICS_TARGET(features)
+#else
+#define PHYSICS_TARGET(features) __attribute__((target(features)))
+#endif
+
+// Counters of the last PhysicsWorld::Step call.
+struct PhysicsStats
+{
+    uint32_t contacts;
+    uint32_t islands;
+    uint32_t sleptBodies;
+};
+
+// Rigid spheres without rotation, falling onto a ground plane at y = 0 and
+// onto each other. Body state is kept in SoA arrays padded to BATCH_SIZE,
+// so the integration kernels run whole SSE/AVX batches and split them
+// between the job threads. Contacts are found through a Broadphase kept up
+// to date with the moving bodies, grouped into
+// islands of bodies touching each other and the islands solved in
+// parallel with sequential impulses. Islands that stay slow for
+// SLEEP_SECONDS go to sleep and cost nothing until something awake touches
+// them.
+//
+// Steps are deterministic: the results only depend on the state and the
+// step length, not on the number of workers or the instruction set, so a
+// snapshot replays to the same bytes on any machine of the same build.
+class PhysicsWorld final
+{
+public:
+    static constexpr uint32_t BATCH_SIZE = 8;
+    static constexpr float GRAVITY = -9.81f;
+    static constexpr uint32_t SOLVER_ITERATIONS = 8;
+    static constexpr float FRICTION = 0.5f;
+    // Of the penetration pushed out per step, and how much is left so
+    // resting contacts persist
+    static constexpr float BAUMGARTE = 0.2f;
+    static constexpr float PENETRATION_SLOP = 0.005f;
+    static constexpr float SLEEP_SPEED = 0.05f;
+    static constexpr float SLEEP_SECONDS = 0.5f;
+
+    // inverseMass 0 makes the body static
+    uint32_t AddBody(float x, float y, float z, float radius, float inverseMass);
+    // Wakes the body up
+    void SetVelocity(uint32_t body, float x, float y, float z);
+    void GetPosition(uint32_t body, float position[3]) const;
+    bool IsAwake(uint32_t body) const { return m_motion[body] != 0.0f; }
+    uint32_t BodyCount() const { return m_count; }
+
+    // One fixed step, jobs may be null to run on the calling thread only.
+    // The step's scratch comes from scratch, and from the heap only what
+    // does not fit, valid until scratch is reset.
+    void Step(JobSystem* jobs, float seconds, Arena* scratch);
+    const PhysicsStats& Stats() const { return m_stats; }
+    // Bounds of the bodies as of the end of the last step, objects are
+    // bodies, for radius, box and ray queries
+    const Broadphase& Bodies() const { return m_broadphase; }
+
+    uint64_t StateHash() const;
+    void Save(Snapshot* snapshot) const;
+    bool Restore(SnapshotReader* reader);
+
+private:
+    static constexpr uint32_t NO_BODY = 0xFFFFFFFF;
+    static constexpr uint32_t NO_ISLAND = 0xFFFFFFFF;
+    // Marks bodies in contacts until their island is numbered
+    static constexpr uint32_t PENDING_ISLAND = 0xFFFFFFFE;
+    // Batches of BATCH_SIZE bodies per job
+    static constexpr uint32_t INTEGRATION_JOB_BATCHES = 256;
+    static constexpr uint32_t ISLANDS_PER_JOB = 16;
+
+    struct Contact
+    {
+        uint32_t a;
+        // NO_BODY for the ground and static bodies, which never move, so
+        // the solver neither reads nor writes anything of theirs
+        uint32_t b;
+        // From b to a
+        float    normal[3];
+        float    depth;
+        float    tangent[3];
+        float    mass;
+        float    bias;
+        float    normalImpulse;
+        float    tangentImpulse;
+    };
+
+    // Simulation state, all padded
+    std::vector<float>    m_positionX;
+    std::vector<float>    m_positionY;
+    std::vector<float>    m_positionZ;
+    std::vector<float>    m_velocityX;
+    std::vector<float>    m_velocityY;
+    std::vector<float>    m_velocityZ;
+    std::vector<float>    m_inverseMass;
+    std::vector<float>    m_radius;
+    // 1 for awake dynamic bodies, 0 for static and sleeping ones and the
+    // padding, scales all motion in the kernels
+    std::vector<float>    m_motion;
+    // How long the body has been slower than SLEEP_SPEED
+    std::vector<float>    m_stillSeconds;
+    uint32_t              m_count = 0;
+    float                 m_maxRadius = 0.0f;
+
+    // Per body, kept between steps and only reset where a step touched them
+    std::vector<uint32_t> m_parents;
+    std::vector<uint32_t> m_islandOfBody;
+    // Scratch of a step, allocated from the arena passed to Step
+    Contact*              m_contacts = nullptr;
+    uint32_t              m_contactCount = 0;
+    uint32_t*             m_touchedBodies = nullptr;
+    uint32_t              m_touchedBodyCount = 0;
+    uint32_t*             m_islandContactStarts = nullptr;
+    uint32_t*             m_islandContacts = nullptr;
+    uint32_t*             m_islandBodyStarts = nullptr;
+    uint32_t*             m_islandBodies = nullptr;
+    // Where the scratch goes when the arena is full, kept for the capacity
+    std::vector<BroadphasePair> m_pairs;
+    std::vector<Contact>  m_contactsFallback;
+    std::vector<uint32_t> m_touchedBodiesFallback;
+    std::vector<uint32_t> m_islandContactStartsFallback;
+    std::vector<uint32_t> m_islandContactsFallback;
+    std::vector<uint32_t> m_islandBodyStartsFallback;
+    std::vector<uint32_t> m_islandBodiesFallback;
+    PhysicsStats          m_stats = {};
+    // Derived from the positions, rebuilt on Restore
+    Broadphase            m_broadphase;
+
+    void resizeScratch();
+    void rebuildBroadphase();
+    void findContacts(JobSystem* jobs, Arena* scratch);
+    void buildIslands(Arena* scratch);
+    void solveIsland(uint32_t island, float seconds);
+    bool sleepIsland(uint32_t island);
+    uint32_t findRoot(uint32_t body);
+};
+
+void SelectPhysicsKernels(SimdLevel level);
+
+namespace Physics_internal
+{
+    struct BodyArrays
+    {
+        float*       positionX;
+        float*       positionY;
+        float*       positionZ;
+        float*       velocityX;
+        float*       velocityY;
+        float*       velocityZ;
+        const float* motion;
+        float*       stillSeconds;
+    };
+
+    // Over bodies [begin, end), both multiples of BATCH_SIZE. Kernels use
+    // no FMA, every level rounds the same.
+    typedef void (*IntegrateKernel)(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds);
+
+    void integrateVelocitiesSSE(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds);
+    void integrateVelocitiesAVX(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds);
+    void integratePositionsSSE(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds);
+    void integratePositionsAVX(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds);
+
+    static IntegrateKernel g_integrateVelocities = integrateVelocitiesSSE;
+    static IntegrateKernel g_integratePositions = integratePositionsSSE;
+
+    template<typename Function>
+    void parallelFor(JobSystem* jobs, uint32_t count, uint32_t batchSize, const Function& function)
+    {
+        if (jobs)
+        {
+            jobs->ParallelFor(count, batchSize, function);
+        } else if (count) {
+            function(0, count, 0);
+        }
+    }
+}
+
+#pragma region Bodies
+
+uint32_t PhysicsWorld::AddBody(float x, float y, float z, float radius, float inverseMass)
+{
+    if (m_count == m_positionX.size())
+    {
+        const size_t paddedCount = m_positionX.size() + BATCH_SIZE;
+        for (std::vector<float>* values : {
+            &m_positionX, &m_positionY, &m_positionZ, &m_velocityX, &m_velocityY, &m_velocityZ,
+            &m_inverseMass, &m_radius, &m_motion, &m_stillSeconds })
+        {
+            values->resize(paddedCount, 0.0f);
+        }
+        resizeScratch();
+    }
+    if (!m_count)
+    {
+        m_broadphase.Reset(2.0f * radius);
+    }
+    const uint32_t body = m_count++;
+    m_broadphase.Add(x, y, z, radius, radius, radius);
+    m_positionX[body] = x;
+    m_positionY[body] = y;
+    m_positionZ[body] = z;
+    m_inverseMass[body] = inverseMass;
+    m_radius[body] = radius;
+    m_motion[body] = inverseMass > 0.0f ? 1.0f : 0.0f;
+    m_maxRadius = std::max(m_maxRadius, radius);
+    return body;
+}
+
+void PhysicsWorld::SetVelocity(uint32_t body, float x, float y, float z)
+{
+    if (m_inverseMass[body] > 0.0f)
+    {
+        m_velocityX[body] = x;
+        m_velocityY[body] = y;
+        m_velocityZ[body] = z;
+        m_motion[body] = 1.0f;
+        m_stillSeconds[body] = 0.0f;
+    }
+}
+
+void PhysicsWorld::GetPosition(uint32_t body, float position[3]) const
+{
+    position[0] = m_positionX[body];
+    position[1] = m_positionY[body];
+    position[2] = m_positionZ[body];
+}
+
+void PhysicsWorld::resizeScratch()
+{
+    const size_t oldCount = m_parents.size();
+    m_parents.resize(m_positionX.size());
+    for (size_t body = oldCount; body < m_parents.size(); ++body)
+    {
+        m_parents[body] = static_cast<uint32_t>(body);
+    }
+    m_islandOfBody.resize(m_positionX.size(), NO_ISLAND);
+}
+
+uint64_t PhysicsWorld::StateHash() const
+{
+    const size_t size = m_count * sizeof(float);
+    return Hasher()
+        .AddBytes(m_positionX.data(), size)
+        .AddBytes(m_positionY.data(), size)
+        .AddBytes(m_positionZ.data(), size)
+        .AddBytes(m_velocityX.data(), size)
+        .AddBytes(m_velocityY.data(), size)
+        .AddBytes(m_velocityZ.data(), size)
+        .AddBytes(m_motion.data(), size)
+        .Finish();
+}
+
+void PhysicsWorld::Save(Snapshot* snapshot) const
+{
+    snapshot->WriteArray(m_positionX);
+    snapshot->WriteArray(m_positionY);
+    snapshot->WriteArray(m_positionZ);
+    snapshot->WriteArray(m_velocityX);
+    snapshot->WriteArray(m_velocityY);
+    snapshot->WriteArray(m_velocityZ);
+    snapshot->WriteArray(m_inverseMass);
+    snapshot->WriteArray(m_radius);
+    snapshot->WriteArray(m_motion);
+    snapshot->WriteArray(m_stillSeconds);
+    snapshot->Write(m_count);
+    snapshot->Write(m_maxRadius);
+}
+
+bool PhysicsWorld::Restore(SnapshotReader* reader)
+{
+    const bool isRead =
+        reader->ReadArray(&m_positionX) &&
+        reader->ReadArray(&m_positionY) &&
+        reader->ReadArray(&m_positionZ) &&
+        reader->ReadArray(&m_velocityX) &&
+        reader->ReadArray(&m_velocityY) &&
+        reader->ReadArray(&m_velocityZ) &&
+        reader->ReadArray(&m_inverseMass) &&
+        reader->ReadArray(&m_radius) &&
+        reader->ReadArray(&m_motion) &&
+        reader->ReadArray(&m_stillSeconds) &&
+        reader->Read(&m_count) &&
+        reader->Read(&m_maxRadius);
+    const size_t paddedCount = m_positionX.size();
+    if (!isRead ||
+        paddedCount % BATCH_SIZE != 0 ||
+        m_count > paddedCount ||
+        m_positionY.size() != paddedCount ||
+        m_positionZ.size() != paddedCount ||
+        m_velocityX.size() != paddedCount ||
+        m_velocityY.size() != paddedCount ||
+        m_velocityZ.size() != paddedCount ||
+        m_inverseMass.size() != paddedCount ||
+        m_radius.size() != paddedCount ||
+        m_motion.size() != paddedCount ||
+        m_stillSeconds.size() != paddedCount)
+    {
+        return false;
+    }
+    resizeScratch();
+    rebuildBroadphase();
+    return true;
+}
+
+void PhysicsWorld::rebuildBroadphase()
+{
+    m_broadphase.Reset(2.0f * m_maxRadius);
+    for (uint32_t body = 0; body < m_count; ++body)
+    {
+        m_broadphase.Add(m_positionX[body], m_positionY[body], m_positionZ[body], m_radius[body], m_radius[body], m_radius[body]);
+    }
+}
+
+#pragma endregion
+
+#pragma region Step
+
+void PhysicsWorld::Step(JobSystem* jobs, float seconds, Arena* scratch)
+{
+    using namespace Physics_internal;
+
+    m_stats = {};
+    const BodyArrays bodies = {
+        m_positionX.data(), m_positionY.data(), m_positionZ.data(),
+        m_velocityX.data(), m_velocityY.data(), m_velocityZ.data(),
+        m_motion.data(), m_stillSeconds.data()
+    };
+    const uint32_t batchCount = static_cast<uint32_t>(m_positionX.size()) / BATCH_SIZE;
+    parallelFor(jobs, batchCount, INTEGRATION_JOB_BATCHES, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        g_integrateVelocities(bodies, begin * BATCH_SIZE, end * BATCH_SIZE, seconds);
+    });
+
+    findContacts(jobs, scratch);
+    buildIslands(scratch);
+    const uint32_t islandCount = m_stats.islands;
+    parallelFor(jobs, islandCount, ISLANDS_PER_JOB, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t island = begin; island < end; ++island)
+        {
+            solveIsland(island, seconds);
+        }
+    });
+
+    parallelFor(jobs, batchCount, INTEGRATION_JOB_BATCHES, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        g_integratePositions(bodies, begin * BATCH_SIZE, end * BATCH_SIZE, seconds);
+    });
+    // Only awake bodies moved, the rest keep their cells
+    for (uint32_t body = 0; body < m_count; ++body)
+    {
+        if (m_motion[body] != 0.0f)
+        {
+            const float radius = m_radius[body];
+            m_broadphase.Set(body, m_positionX[body], m_positionY[body], m_positionZ[body], radius, radius, radius);
+        }
+    }
+
+    // Only bodies resting on something can stay still, the rest falls
+    for (uint32_t island = 0; island < islandCount; ++island)
+    {
+        if (sleepIsland(island))
+        {
+            m_stats.sleptBodies += m_islandBodyStarts[island + 1] - m_islandBodyStarts[island];
+        }
+    }
+    for (uint32_t index = 0; index < m_touchedBodyCount; ++index)
+    {
+        const uint32_t body = m_touchedBodies[index];
+        m_parents[body] = body;
+        m_islandOfBody[body] = NO_ISLAND;
+    }
+}
+
+// Only awake bodies look for contacts, so pairs of sleeping or static
+// bodies never cost anything. The broadphase hands out the pairs sorted,
+// which keeps the contact order, and the step, independent of the workers.
+void PhysicsWorld::findContacts(JobSystem* jobs, Arena* scratch)
+{
+    // The broadphase gives scratch back before the contacts take it
+    m_broadphase.FindPairs(jobs, scratch, [this](uint32_t body) { return m_motion[body] != 0.0f; }, &m_pairs);
+    uint32_t groundContactCount = 0;
+    for (uint32_t body = 0; body < m_count; ++body)
+    {
+        groundContactCount += m_motion[body] != 0.0f && m_positionY[body] < m_radius[body] ? 1 : 0;
+    }
+    m_contacts = AllocateScratch(scratch, &m_contactsFallback, groundContactCount + m_pairs.size());
+    m_contactCount = 0;
+    for (uint32_t body = 0; body < m_count; ++body)
+    {
+        const float radius = m_radius[body];
+        if (m_motion[body] != 0.0f && m_positionY[body] < radius)
+        {
+            m_contacts[m_contactCount++] = { body, NO_BODY, { 0.0f, 1.0f, 0.0f }, radius - m_positionY[body], {}, 0.0f, 0.0f, 0.0f, 0.0f };
+        }
+    }
+
+    for (const BroadphasePair& pair : m_pairs)
+    {
+        const uint32_t a = pair.a;
+        const uint32_t b = pair.b;
+        const float dx = m_positionX[a] - m_positionX[b];
+        const float dy = m_positionY[a] - m_positionY[b];
+        const float dz = m_positionZ[a] - m_positionZ[b];
+        const float distanceSquared = dx * dx + dy * dy + dz * dz;
+        const float radii = m_radius[a] + m_radius[b];
+        if (distanceSquared >= radii * radii)
+        {
+            continue;
+        }
+        const float distance = sqrtf(distanceSquared);
+        // A static body may touch several islands at once
+        Contact contact = { a, m_inverseMass[b] > 0.0f ? b : NO_BODY, { 0.0f, 1.0f, 0.0f }, radii - distance, {}, 0.0f, 0.0f, 0.0f, 0.0f };
+        if (distance > 1e-6f)
+        {
+            contact.normal[0] = dx / distance;
+            contact.normal[1] = dy / distance;
+            contact.normal[2] = dz / distance;
+        }
+        m_contacts[m_contactCount++] = contact;
+    }
+    m_stats.contacts = m_contactCount;
+}
+
+// Islands are the connected groups of dynamic bodies in contact, numbered
+// in contact order. Static bodies and the ground join no island, so a
+// floor does not merge everything standing on it into one.
+void PhysicsWorld::buildIslands(Arena* scratch)
+{
+    // Every contact touches at most two bodies
+    m_touchedBodies = AllocateScratch(scratch, &m_touchedBodiesFallback, std::min<size_t>(2 * static_cast<size_t>(m_contactCount), m_count));
+    m_touchedBodyCount = 0;
+    for (uint32_t index = 0; index < m_contactCount; ++index)
+    {
+        const Contact& contact = m_contacts[index];
+        for (uint32_t body : { contact.a, contact.b })
+        {
+            if (body != NO_BODY && m_islandOfBody[body] == NO_ISLAND)
+            {
+                m_islandOfBody[body] = PENDING_ISLAND;
+                m_touchedBodies[m_touchedBodyCount++] = body;
+            }
+        }
+        if (contact.b != NO_BODY)
+        {
+            const uint32_t rootA = findRoot(contact.a);
+            const uint32_t rootB = findRoot(contact.b);
+            // The lower index stays root, the same for any order of union
+            m_parents[std::max(rootA, rootB)] = std::min(rootA, rootB);
+        }
+    }
+
+    uint32_t islandCount = 0;
+    for (uint32_t index = 0; index < m_touchedBodyCount; ++index)
+    {
+        const uint32_t body = m_touchedBodies[index];
+        const uint32_t root = findRoot(body);
+        if (m_islandOfBody[root] == PENDING_ISLAND)
+        {
+            m_islandOfBody[root] = islandCount++;
+        }
+        m_islandOfBody[body] = m_islandOfBody[root];
+        // Something awake touches it, the whole island wakes up
+        if (m_motion[body] == 0.0f)
+        {
+            m_motion[body] = 1.0f;
+            m_stillSeconds[body] = 0.0f;
+        }
+    }
+    m_stats.islands = islandCount;
+
+    // Counting sorts of the contacts and the bodies by island, keeping
+    // their order
+    m_islandContactStarts = AllocateScratch(scratch, &m_islandContactStartsFallback, islandCount + 1);
+    m_islandBodyStarts = AllocateScratch(scratch, &m_islandBodyStartsFallback, islandCount + 1);
+    m_islandContacts = AllocateScratch(scratch, &m_islandContactsFallback, m_contactCount);
+    m_islandBodies = AllocateScratch(scratch, &m_islandBodiesFallback, m_touchedBodyCount);
+    std::fill(m_islandContactStarts, m_islandContactStarts + islandCount + 1, 0);
+    std::fill(m_islandBodyStarts, m_islandBodyStarts + islandCount + 1, 0);
+    for (uint32_t contact = 0; contact < m_contactCount; ++contact)
+    {
+        ++m_islandContactStarts[m_islandOfBody[m_contacts[contact].a] + 1];
+    }
+    for (uint32_t index = 0; index < m_touchedBodyCount; ++index)
+    {
+        ++m_islandBodyStarts[m_islandOfBody[m_touchedBodies[index]] + 1];
+    }
+    for (uint32_t island = 0; island < islandCount; ++island)
+    {
+        m_islandContactStarts[island + 1] += m_islandContactStarts[island];
+        m_islandBodyStarts[island + 1] += m_islandBodyStarts[island];
+    }
+    for (uint32_t contact = 0; contact < m_contactCount; ++contact)
+    {
+        m_islandContacts[m_islandContactStarts[m_islandOfBody[m_contacts[contact].a]]++] = contact;
+    }
+    for (uint32_t index = 0; index < m_touchedBodyCount; ++index)
+    {
+        const uint32_t body = m_touchedBodies[index];
+        m_islandBodies[m_islandBodyStarts[m_islandOfBody[body]]++] = body;
+    }
+    for (uint32_t island = islandCount; island > 0; --island)
+    {
+        m_islandContactStarts[island] = m_islandContactStarts[island - 1];
+        m_islandBodyStarts[island] = m_islandBodyStarts[island - 1];
+    }
+    m_islandContactStarts[0] = 0;
+    m_islandBodyStarts[0] = 0;
+}
+
+uint32_t PhysicsWorld::findRoot(uint32_t body)
+{
+    while (m_parents[body] != body)
+    {
+        // Path halving
+        m_parents[body] = m_parents[m_parents[body]];
+        body = m_parents[body];
+    }
+    return body;
+}
+
+// Sequential impulses without warm starting, contacts are not kept between
+// steps. Only touches the island's own bodies, contacts with static bodies
+// leave them out like the ground, so islands run in parallel.
+void PhysicsWorld::solveIsland(uint32_t island, float seconds)
+{
+    const uint32_t* contacts = m_islandContacts + m_islandContactStarts[island];
+    const uint32_t contactCount = m_islandContactStarts[island + 1] - m_islandContactStarts[island];
+    float* velocityX = m_velocityX.data();
+    float* velocityY = m_velocityY.data();
+    float* velocityZ = m_velocityZ.data();
+    const auto relativeVelocity = [&](const Contact& contact, float velocity[3])
+    {
+        velocity[0] = velocityX[contact.a];
+        velocity[1] = velocityY[contact.a];
+        velocity[2] = velocityZ[contact.a];
+        if (contact.b != NO_BODY)
+        {
+            velocity[0] -= velocityX[contact.b];
+            velocity[1] -= velocityY[contact.b];
+            velocity[2] -= velocityZ[contact.b];
+        }
+    };
+    const auto applyImpulse = [&](const Contact& contact, const float direction[3], float impulse)
+    {
+        const float impulseA = impulse * m_inverseMass[contact.a];
+        velocityX[contact.a] += direction[0] * impulseA;
+        velocityY[contact.a] += direction[1] * impulseA;
+        velocityZ[contact.a] += direction[2] * impulseA;
+        if (contact.b != NO_BODY)
+        {
+            const float impulseB = impulse * m_inverseMass[contact.b];
+            velocityX[contact.b] -= direction[0] * impulseB;
+            velocityY[contact.b] -= direction[1] * impulseB;
+            velocityZ[contact.b] -= direction[2] * impulseB;
+        }
+    };
+
+    for (uint32_t index = 0; index < contactCount; ++index)
+    {
+        Contact& contact = m_contacts[contacts[index]];
+        const float inverseMassB = contact.b != NO_BODY ? m_inverseMass[contact.b] : 0.0f;
+        // No rotation, the normal and the tangent share the effective mass
+        contact.mass = 1.0f / (m_inverseMass[contact.a] + inverseMassB);
+        contact.bias = BAUMGARTE / seconds * std::max(contact.depth - PENETRATION_SLOP, 0.0f);
+        contact.normalImpulse = 0.0f;
+        contact.tangentImpulse = 0.0f;
+
+        float velocity[3];
+        relativeVelocity(contact, velocity);
+        const float normalSpeed = velocity[0] * contact.normal[0] + velocity[1] * contact.normal[1] + velocity[2] * contact.normal[2];
+        float tangent[3] = {
+            velocity[0] - contact.normal[0] * normalSpeed,
+            velocity[1] - contact.normal[1] * normalSpeed,
+            velocity[2] - contact.normal[2] * normalSpeed
+        };
+        const float tangentLength = sqrtf(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+        const float inverseLength = tangentLength > 1e-6f ? 1.0f / tangentLength : 0.0f;
+        contact.tangent[0] = tangent[0] * inverseLength;
+        contact.tangent[1] = tangent[1] * inverseLength;
+        contact.tangent[2] = tangent[2] * inverseLength;
+    }
+
+    for (uint32_t iteration = 0; iteration < SOLVER_ITERATIONS; ++iteration)
+    {
+        for (uint32_t index = 0; index < contactCount; ++index)
+        {
+            Contact& contact = m_contacts[contacts[index]];
+            float velocity[3];
+            relativeVelocity(contact, velocity);
+            const float normalSpeed = velocity[0] * contact.normal[0] + velocity[1] * contact.normal[1] + velocity[2] * contact.normal[2];
+            const float normalImpulse = std::max(contact.normalImpulse + (contact.bias - normalSpeed) * contact.mass, 0.0f);
+            applyImpulse(contact, contact.normal, normalImpulse - contact.normalImpulse);
+            contact.normalImpulse = normalImpulse;
+
+            relativeVelocity(contact, velocity);
+            const float tangentSpeed = velocity[0] * contact.tangent[0] + velocity[1] * contact.tangent[1] + velocity[2] * contact.tangent[2];
+            const float maxFriction = FRICTION * contact.normalImpulse;
+            const float tangentImpulse = std::min(std::max(contact.tangentImpulse - tangentSpeed * contact.mass, -maxFriction), maxFriction);
+            applyImpulse(contact, contact.tangent, tangentImpulse - contact.tangentImpulse);
+            contact.tangentImpulse = tangentImpulse;
+        }
+    }
+}
+
+// True when the whole island stayed slow long enough and went to sleep
+bool PhysicsWorld::sleepIsland(uint32_t island)
+{
+    const uint32_t begin = m_islandBodyStarts[island];
+    const uint32_t end = m_islandBodyStarts[island + 1];
+    for (uint32_t index = begin; index < end; ++index)
+    {
+        if (m_stillSeconds[m_islandBodies[index]] < SLEEP_SECONDS)
+        {
+            return false;
+        }
+    }
+    for (uint32_t index = begin; index < end; ++index)
+    {
+        const uint32_t body = m_islandBodies[index];
+        m_motion[body] = 0.0f;
+        m_velocityX[body] = 0.0f;
+        m_velocityY[body] = 0.0f;
+        m_velocityZ[body] = 0.0f;
+    }
+    return true;
+}
+
+#pragma endregion
+
+#pragma region Kernels
+
+void SelectPhysicsKernels(SimdLevel level)
+{
+    using namespace Physics_internal;
+    // Integration is bound by memory, AVX-512 gains nothing over AVX
+    if (level == SimdLevel::AVX2 || level == SimdLevel::AVX512)
+    {
+        g_integrateVelocities = integrateVelocitiesAVX;
+        g_integratePositions = integratePositionsAVX;
+    } else {
+        g_integrateVelocities = integrateVelocitiesSSE;
+        g_integratePositions = integratePositionsSSE;
+    }
+}
+
+void Physics_internal::integrateVelocitiesSSE(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds)
+{
+    const __m128 gravity = _mm_set1_ps(PhysicsWorld::GRAVITY * seconds);
+    for (uint32_t i = begin; i < end; i += 4)
+    {
+        const __m128 motion = _mm_loadu_ps(bodies.motion + i);
+        _mm_storeu_ps(bodies.velocityY + i, _mm_add_ps(_mm_loadu_ps(bodies.velocityY + i), _mm_mul_ps(gravity, motion)));
+    }
+}
+
+PHYSICS_TARGET("avx")
+void Physics_internal::integrateVelocitiesAVX(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds)
+{
+    const __m256 gravity = _mm256_set1_ps(PhysicsWorld::GRAVITY * seconds);
+    for (uint32_t i = begin; i < end; i += 8)
+    {
+        const __m256 motion = _mm256_loadu_ps(bodies.motion + i);
+        _mm256_storeu_ps(bodies.velocityY + i, _mm256_add_ps(_mm256_loadu_ps(bodies.velocityY + i), _mm256_mul_ps(gravity, motion)));
+    }
+}
+
+void Physics_internal::integratePositionsSSE(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds)
+{
+    const __m128 step = _mm_set1_ps(seconds);
+    const __m128 sleepSpeedSquared = _mm_set1_ps(PhysicsWorld::SLEEP_SPEED * PhysicsWorld::SLEEP_SPEED);
+    for (uint32_t i = begin; i < end; i += 4)
+    {
+        const __m128 scaledStep = _mm_mul_ps(step, _mm_loadu_ps(bodies.motion + i));
+        const __m128 velocityX = _mm_loadu_ps(bodies.velocityX + i);
+        const __m128 velocityY = _mm_loadu_ps(bodies.velocityY + i);
+        const __m128 velocityZ = _mm_loadu_ps(bodies.velocityZ + i);
+        _mm_storeu_ps(bodies.positionX + i, _mm_add_ps(_mm_loadu_ps(bodies.positionX + i), _mm_mul_ps(velocityX, scaledStep)));
+        _mm_storeu_ps(bodies.positionY + i, _mm_add_ps(_mm_loadu_ps(bodies.positionY + i), _mm_mul_ps(velocityY, scaledStep)));
+        _mm_storeu_ps(bodies.positionZ + i, _mm_add_ps(_mm_loadu_ps(bodies.positionZ + i), _mm_mul_ps(velocityZ, scaledStep)));
+
+        const __m128 speedSquared = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(velocityX, velocityX), _mm_mul_ps(velocityY, velocityY)),
+            _mm_mul_ps(velocityZ, velocityZ)
+        );
+        const __m128 isSlow = _mm_cmplt_ps(speedSquared, sleepSpeedSquared);
+        const __m128 stillSeconds = _mm_add_ps(_mm_loadu_ps(bodies.stillSeconds + i), step);
+        _mm_storeu_ps(bodies.stillSeconds + i, _mm_and_ps(isSlow, stillSeconds));
+    }
+}
+
+PHYSICS_TARGET("avx")
+void Physics_internal::integratePositionsAVX(const BodyArrays& bodies, uint32_t begin, uint32_t end, float seconds)
+{
+    const __m256 step = _mm256_set1_ps(seconds);
+    const __m256 sleepSpeedSquared = _mm256_set1_ps(PhysicsWorld::SLEEP_SPEED * PhysicsWorld::SLEEP_SPEED);
+    for (uint32_t i = begin; i < end; i += 8)
+    {
+        const __m256 scaledStep = _mm256_mul_ps(step, _mm256_loadu_ps(bodies.motion + i));
+        const __m256 velocityX = _mm256_loadu_ps(bodies.velocityX + i);
+        const __m256 velocityY = _mm256_loadu_ps(bodies.velocityY + i);
+        const __m256 velocityZ = _mm256_loadu_ps(bodies.velocityZ + i);
+        _mm256_storeu_ps(bodies.positionX + i, _mm256_add_ps(_mm256_loadu_ps(bodies.positionX + i), _mm256_mul_ps(velocityX, scaledStep)));
+        _mm256_storeu_ps(bodies.positionY + i, _mm256_add_ps(_mm256_loadu_ps(bodies.positionY + i), _mm256_mul_ps(velocityY, scaledStep)));
+        _mm256_storeu_ps(bodies.positionZ + i, _mm256_add_ps(_mm256_loadu_ps(bodies.positionZ + i), _mm256_mul_ps(velocityZ, scaledStep)));
+
+        const __m256 speedSquared = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(velocityX, velocityX), _mm256_mul_ps(velocityY, velocityY)),
+            _mm256_mul_ps(velocityZ, velocityZ)
+        );
+        const __m256 isSlow = _mm256_cmp_ps(speedSquared, sleepSpeedSquared, _CMP_LT_OQ);
+        const __m256 stillSeconds = _mm256_add_ps(_mm256_loadu_ps(bodies.stillSeconds + i), step);
+        _mm256_storeu_ps(bodies.stillSeconds + i, _mm256_and_ps(isSlow, stillSeconds));
+    }
+}
+
+#pragma endregion
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Hash.h"
+
+// On-disk store of compiled pipelines. The file holds a small index of
+// pipeline keys followed by an opaque payload produced by the backend
+// (a serialized ID3D12PipelineLibrary on Windows):
+//
+//     Header                    magic, version, device hash, sizes, payload hash
+//     uint64_t keys[keyCount]   sorted
+//     uint8_t  payload[payloadSize]
+//
+// A file written for another device or driver, an older format, sizes that
+// do not add up to the file size or a damaged payload is rejected as a
+// whole and the cache starts empty. Saving writes a temporary file next to
+// the cache and renames it over the old one, so an interrupted save leaves
+// the previous cache behind.
+class PipelineCache final
+{
+public:
+    static constexpr uint32_t MAGIC = 0x43505350; // "PSPC"
+    static constexpr uint32_t VERSION = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t deviceHash;
+        uint32_t keyCount;
+        uint32_t reserved;
+        uint64_t payloadSize;
+        uint64_t payloadHash;
+    };
+
+    // Returns false when the file is missing or rejected
+    bool Load(const char* path, uint64_t deviceHash);
+    bool Save(const char* path, const void* payload, size_t payloadSize);
+    void Clear();
+
+    bool Contains(uint64_t key) const { return std::binary_search(m_keys.begin(), m_keys.end(), key); }
+    void Insert(uint64_t key);
+    bool IsDirty() const { return m_isDirty; }
+    uint32_t KeyCount() const { return static_cast<uint32_t>(m_keys.size()); }
+
+    // Must stay alive as long as the backend library created from it
+    const std::vector<uint8_t>& Payload() const { return m_payload; }
+
+private:
+    uint64_t              m_deviceHash = 0;
+    std::vector<uint64_t> m_keys;
+    std::vector<uint8_t>  m_payload;
+    bool                  m_isDirty = false;
+};
+
+bool PipelineCache::Load(const char* path, uint64_t deviceHash)
+{
+    m_deviceHash = deviceHash;
+    Clear();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    Header header = {};
+    if (!file.seekg(0) ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != MAGIC ||
+        header.version != VERSION ||
+        header.deviceHash != deviceHash)
+    {
+        return false;
+    }
+    // Checked before anything is allocated from the sizes on disk
+    const uint64_t keysSize = static_cast<uint64_t>(header.keyCount) * sizeof(uint64_t);
+    if (fileSize < sizeof(header) + keysSize ||
+        header.payloadSize != fileSize - sizeof(header) - keysSize)
+    {
+        return false;
+    }
+    std::vector<uint64_t> keys(header.keyCount);
+    std::vector<uint8_t> payload(static_cast<size_t>(header.payloadSize));
+    if (!file.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(uint64_t)) ||
+        !file.read(reinterpret_cast<char*>(payload.data()), payload.size()) ||
+        HashBytes(payload.data(), payload.size()) != header.payloadHash ||
+        !std::is_sorted(keys.begin(), keys.end()))
+    {
+        return false;
+    }
+    m_keys.swap(keys);
+    m_payload.swap(payload);
+    return true;
+}
+
+bool PipelineCache::Save(const char* path, const void* payload, size_t payloadSize)
+{
+    Header header = {};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.deviceHash = m_deviceHash;
+    header.keyCount = KeyCount();
+    header.payloadSize = payloadSize;
+    header.payloadHash = HashBytes(payload, payloadSize);
+
+    const std::filesystem::path cachePath(path);
+    std::filesystem::path temporaryPath = cachePath;
+    temporaryPath += ".tmp";
+    bool isWritten;
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_keys.data()), m_keys.size() * sizeof(uint64_t));
+        file.write(static_cast<const char*>(payload), payloadSize);
+        file.close();
+        isWritten = static_cast<bool>(file);
+    }
+    std::error_code error;
+    if (isWritten)
+    {
+        std::filesystem::rename(temporaryPath, cachePath, error);
+    }
+    if (!isWritten || error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    m_isDirty = false;
+    return true;
+}
+
+void PipelineCache::Clear()
+{
+    m_keys.clear();
+    m_payload.clear();
+    m_isDirty = false;
+}
+
+void PipelineCache::Insert(uint64_t key)
+{
+    const auto position = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    if (position == m_keys.end() || *position != key)
+    {
+        m_keys.insert(position, key);
+        m_isDirty = true;
+    }
+}
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "ResourceStateTracker.h"
+
+// Frame graph. Passes declare which textures they read and write, Compile()
+// drops passes whose output is never consumed, assigns every transient
+// texture an offset in one shared heap so textures with disjoint lifetimes
+// overlap, and computes the barriers issued before each pass.
+//
+// A Write alone means the previous content is discarded, a pass that loads
+// or blends into a texture declares a Read of it as well. Transient textures
+// start every frame in the state of their first use and are returned to it
+// at the end of the frame, so a compiled graph can be executed repeatedly.
+// Aliased memory holds garbage, the first pass writing a transient texture
+// must clear or fully overwrite it.
+//
+// The graph knows nothing about the GPU API: the backend creates placed
+// resources at HeapOffset() and translates the barriers.
+class RenderGraph final
+{
+public:
+    typedef uint32_t Resource;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct TextureDesc
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint64_t sizeInBytes;
+        uint64_t alignment;
+    };
+
+    enum class BarrierType : uint8_t
+    {
+        Transition,
+        Aliasing,
+        UnorderedAccess,
+    };
+
+    struct Barrier
+    {
+        BarrierType   type;
+        Resource      resource;
+        // Aliasing only, NONE when several textures shared the memory
+        Resource      previousResource;
+        ResourceState before;
+        ResourceState after;
+    };
+
+    void Reset();
+
+    Resource CreateTexture(const char* name, const TextureDesc& desc);
+    // External texture, e.g. the back buffer. Never culled or aliased.
+    Resource ImportTexture(const char* name, ResourceState initialState, ResourceState finalState);
+
+    // Passes execute in the order they were added. Passes with side effects
+    // outside of the graph are never culled.
+    uint32_t AddPass(const char* name, std::function<void()> execute, bool hasSideEffects = false);
+    void Read(uint32_t pass, Resource resource, ResourceState state);
+    void Write(uint32_t pass, Resource resource, ResourceState state);
+
+    void Compile();
+    // issueBarriers(const Barrier* barriers, uint32_t count) is called
+    // before every pass that needs barriers and once more at the end.
+    template<typename IssueBarriers>
+    void Execute(const IssueBarriers& issueBarriers) const;
+
+    uint32_t ResourceCount() const { return static_cast<uint32_t>(m_resources.size()); }
+    uint32_t PassCount() const { return static_cast<uint32_t>(m_passes.size()); }
+    const char* ResourceName(Resource resource) const { return m_resources[resource].name; }
+    const char* PassName(uint32_t pass) const { return m_passes[pass].name; }
+    const TextureDesc& Desc(Resource resource) const { return m_resources[resource].desc; }
+    bool IsImported(Resource resource) const { return m_resources[resource].isImported; }
+
+    // Results of Compile()
+    bool IsPassCulled(uint32_t pass) const { return m_passes[pass].isCulled; }
+    // Transient textures of culled passes get no memory
+    bool IsAllocated(Resource resource) const { return m_resources[resource].heapOffset != NONE_OFFSET; }
+    uint64_t HeapOffset(Resource resource) const { return m_resources[resource].heapOffset; }
+    ResourceState InitialState(Resource resource) const { return m_resources[resource].initialState; }
+    // Union of all states the texture is used in, decides the resource flags
+    ResourceState UsageStates(Resource resource) const { return m_resources[resource].usageStates; }
+    uint64_t TransientHeapSize() const { return m_transientHeapSize; }
+    uint32_t BarrierCount() const { return static_cast<uint32_t>(m_barriers.size()); }
+
+private:
+    static constexpr uint64_t NONE_OFFSET = UINT64_MAX;
+
+    struct Access
+    {
+        Resource      resource;
+        ResourceState state;
+        bool          isWrite;
+    };
+
+    struct PassNode
+    {
+        const char*           name;
+        std::function<void()> execute;
+        std::vector<Access>   accesses;
+        bool                  hasSideEffects;
+        bool                  isCulled;
+    };
+
+    struct ResourceNode
+    {
+        const char*   name;
+        TextureDesc   desc;
+        bool          isImported;
+        ResourceState initialState;
+        ResourceState finalState;
+        ResourceState usageStates;
+        uint32_t      firstStep;
+        uint32_t      lastStep;
+        uint64_t      heapOffset;
+        Resource      aliasedResource;
+        bool          isAliased;
+    };
+
+    // One use of a resource by a live pass, in execution order
+    struct Use
+    {
+        uint32_t      step;
+        ResourceState state;
+        bool          isWrite;
+    };
+
+    struct Step
+    {
+        uint32_t pass;
+        uint32_t barrierBegin;
+        uint32_t barrierEnd;
+    };
+
+    std::vector<PassNode>     m_passes;
+    std::vector<ResourceNode> m_resources;
+    std::vector<Step>         m_steps;
+    std::vector<Barrier>      m_barriers;
+    uint64_t                  m_transientHeapSize = 0;
+
+    void cullPasses();
+    void collectUses(std::vector<std::vector<Use>>* uses);
+    void placeTransientResources();
+    void computeBarriers(const std::vector<std::vector<Use>>& uses);
+};
+
+#pragma region Building
+
+void RenderGraph::Reset()
+{
+    m_passes.clear();
+    m_resources.clear();
+    m_steps.clear();
+    m_barriers.clear();
+    m_transientHeapSize = 0;
+}
+
+RenderGraph::Resource RenderGraph::CreateTexture(const char* name, const TextureDesc& desc)
+{
+    ResourceNode resource = {};
+    resource.name = name;
+    resource.desc = desc;
+    resource.isImported = false;
+    resource.heapOffset = NONE_OFFSET;
+    m_resources.push_back(resource);
+    return ResourceCount() - 1;
+}
+
+RenderGraph::Resource RenderGraph::ImportTexture(const char* name, ResourceState initialState, ResourceState finalState)
+{
+    ResourceNode resource = {};
+    resource.name = name;
+    resource.isImported = true;
+    resource.initialState = initialState;
+    resource.finalState = finalState;
+    resource.heapOffset = NONE_OFFSET;
+    m_resources.push_back(resource);
+    return ResourceCount() - 1;
+}
+
+uint32_t RenderGraph::AddPass(const char* name, std::function<void()> execute, bool hasSideEffects)
+{
+    PassNode pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.hasSideEffects = hasSideEffects;
+    pass.isCulled = false;
+    m_passes.push_back(std::move(pass));
+    return PassCount() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, Resource resource, ResourceState state)
+{
+    m_passes[pass].accesses.push_back({ resource, state, false });
+}
+
+void RenderGraph::Write(uint32_t pass, Resource resource, ResourceState state)
+{
+    m_passes[pass].accesses.push_back({ resource, state, true });
+}
+
+#pragma endregion
+
+#pragma region Compilation
+
+void RenderGraph::Compile()
+{
+    m_steps.clear();
+    m_barriers.clear();
+    m_transientHeapSize = 0;
+
+    cullPasses();
+    std::vector<std::vector<Use>> uses;
+    collectUses(&uses);
+    placeTransientResources();
+    computeBarriers(uses);
+}
+
+void RenderGraph::cullPasses()
+{
+    // Walking backwards, a resource is needed while some later live pass
+    // reads its current content. Imported resources are read by the outside.
+    std::vector<uint8_t> isNeeded(m_resources.size(), 0);
+    for (Resource resource = 0; resource < ResourceCount(); ++resource)
+    {
+        isNeeded[resource] = m_resources[resource].isImported;
+    }
+    for (uint32_t pass = PassCount(); pass-- > 0;)
+    {
+        PassNode& node = m_passes[pass];
+        bool isAlive = node.hasSideEffects;
+        for (const Access& access : node.accesses)
+        {
+            isAlive = isAlive || (access.isWrite && isNeeded[access.resource]);
+        }
+        node.isCulled = !isAlive;
+        if (node.isCulled)
+        {
+            continue;
+        }
+        for (const Access& access : node.accesses)
+        {
+            if (access.isWrite)
+            {
+                isNeeded[access.resource] = 0;
+            }
+        }
+        for (const Access& access : node.accesses)
+        {
+            if (!access.isWrite)
+            {
+                isNeeded[access.resource] = 1;
+            }
+        }
+    }
+}
+
+void RenderGraph::collectUses(std::vector<std::vector<Use>>* uses)
+{
+    uses->assign(m_resources.size(), std::vector<Use>());
+    for (ResourceNode& resource : m_resources)
+    {
+        resource.usageStates = ResourceState::Common;
+        resource.firstStep = NONE;
+        resource.lastStep = NONE;
+        resource.heapOffset = NONE_OFFSET;
+        resource.aliasedResource = NONE;
+        resource.isAliased = false;
+    }
+    for (uint32_t pass = 0; pass < PassCount(); ++pass)
+    {
+        if (m_passes[pass].isCulled)
+        {
+            continue;
+        }
+        const uint32_t step = static_cast<uint32_t>(m_steps.size());
+        m_steps.push_back({ pass, 0, 0 });
+        for (const Access& access : m_passes[pass].accesses)
+        {
+            std::vector<Use>& resourceUses = (*uses)[access.resource];
+            if (resourceUses.empty() || resourceUses.back().step != step)
+            {
+                resourceUses.push_back({ step, access.state, access.isWrite });
+            } else if (access.isWrite) {
+                // Reading and writing in one pass, the write state wins
+                resourceUses.back().state = access.state;
+                resourceUses.back().isWrite = true;
+            } else if (!resourceUses.back().isWrite) {
+                resourceUses.back().state = resourceUses.back().state | access.state;
+            }
+        }
+    }
+    for (Resource resource = 0; resource < ResourceCount(); ++resource)
+    {
+        ResourceNode& node = m_resources[resource];
+        for (const Use& use : (*uses)[resource])
+        {
+            node.usageStates = node.usageStates | use.state;
+        }
+        if (!(*uses)[resource].empty())
+        {
+            node.firstStep = (*uses)[resource].front().step;
+            node.lastStep = (*uses)[resource].back().step;
+        }
+    }
+}
+
+void RenderGraph::placeTransientResources()
+{
+    std::vector<Resource> order;
+    for (Resource resource = 0; resource < ResourceCount(); ++resource)
+    {
+        if (!m_resources[resource].isImported && m_resources[resource].firstStep != NONE)
+        {
+            order.push_back(resource);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](Resource left, Resource right)
+    {
+        const ResourceNode& a = m_resources[left];
+        const ResourceNode& b = m_resources[right];
+        if (a.firstStep != b.firstStep)
+        {
+            return a.firstStep < b.firstStep;
+        }
+        return a.desc.sizeInBytes > b.desc.sizeInBytes;
+    });
+
+    // First fit: skip over the memory of placed resources alive at the same
+    // time. Resources come in order of their first step, so those are the
+    // placed ones still alive at this first step.
+    std::vector<Resource> alive;
+    for (const Resource resource : order)
+    {
+        ResourceNode& node = m_resources[resource];
+        const uint64_t alignment = std::max<uint64_t>(node.desc.alignment, 1);
+        alive.erase(
+            std::remove_if(alive.begin(), alive.end(), [this, &node](Resource other)
+            {
+                return m_resources[other].lastStep < node.firstStep;
+            }),
+            alive.end()
+        );
+        uint64_t offset = 0;
+        for (const Resource other : alive)
+        {
+            const ResourceNode& otherNode = m_resources[other];
+            if (offset + node.desc.sizeInBytes <= otherNode.heapOffset)
+            {
+                break;
+            }
+            const uint64_t otherEnd = otherNode.heapOffset + otherNode.desc.sizeInBytes;
+            offset = std::max(offset, (otherEnd + alignment - 1) / alignment * alignment);
+        }
+        node.heapOffset = offset;
+        m_transientHeapSize = std::max(m_transientHeapSize, offset + node.desc.sizeInBytes);
+        alive.insert(
+            std::upper_bound(alive.begin(), alive.end(), resource, [this](Resource left, Resource right)
+            {
+                return m_resources[left].heapOffset < m_resources[right].heapOffset;
+            }),
+            resource
+        );
+    }
+
+    // Every frame the memory of an aliased texture was last used by some
+    // other texture, possibly in the previous frame
+    std::sort(order.begin(), order.end(), [this](Resource left, Resource right)
+    {
+        return m_resources[left].heapOffset < m_resources[right].heapOffset;
+    });
+    for (size_t index = 0; index < order.size(); ++index)
+    {
+        ResourceNode& node = m_resources[order[index]];
+        const uint64_t end = node.heapOffset + node.desc.sizeInBytes;
+        for (size_t otherIndex = index + 1; otherIndex < order.size(); ++otherIndex)
+        {
+            ResourceNode& otherNode = m_resources[order[otherIndex]];
+            if (otherNode.heapOffset >= end)
+            {
+                break;
+            }
+            // Several previous owners are reported as NONE
+            node.aliasedResource = node.isAliased ? NONE : order[otherIndex];
+            otherNode.aliasedResource = otherNode.isAliased ? NONE : order[index];
+            node.isAliased = true;
+            otherNode.isAliased = true;
+        }
+    }
+}
+
+void RenderGraph::computeBarriers(const std::vector<std::vector<Use>>& uses)
+{
+    // Barriers are generated per resource, then grouped by step. The extra
+    // step at the end holds the barriers restoring the frame start states.
+    const uint32_t endStep = static_cast<uint32_t>(m_steps.size());
+    std::vector<std::pair<uint32_t, Barrier>> pending;
+    for (Resource resource = 0; resource < ResourceCount(); ++resource)
+    {
+        ResourceNode& node = m_resources[resource];
+        const std::vector<Use>& resourceUses = uses[resource];
+        if (resourceUses.empty() && !node.isImported)
+        {
+            continue;
+        }
+        // Consecutive reads share one combined read state
+        auto readRunState = [&resourceUses](size_t first)
+        {
+            ResourceState state = resourceUses[first].state;
+            for (size_t use = first + 1; use < resourceUses.size() && !resourceUses[use].isWrite; ++use)
+            {
+                if (!IsReadOnlyState(state | resourceUses[use].state))
+                {
+                    break;
+                }
+                state = state | resourceUses[use].state;
+            }
+            return state;
+        };
+        if (!node.isImported)
+        {
+            node.initialState = resourceUses.front().isWrite || !IsReadOnlyState(resourceUses.front().state)
+                ? resourceUses.front().state
+                : readRunState(0);
+        }
+        ResourceState current = node.initialState;
+        for (size_t use = 0; use < resourceUses.size(); ++use)
+        {
+            const Use& resourceUse = resourceUses[use];
+            if (use == 0 && node.isAliased)
+            {
+                pending.push_back({ resourceUse.step, { BarrierType::Aliasing, resource, node.aliasedResource, current, current } });
+            }
+            if (!resourceUse.isWrite && IsReadOnlyState(current) && (current & resourceUse.state) == resourceUse.state)
+            {
+                continue;
+            }
+            if (resourceUse.state == ResourceState::UnorderedAccess && current == ResourceState::UnorderedAccess)
+            {
+                // The end of frame transition already orders the previous frame
+                if (use == 0)
+                {
+                    continue;
+                }
+                pending.push_back({ resourceUse.step, { BarrierType::UnorderedAccess, resource, NONE, current, current } });
+                continue;
+            }
+            const ResourceState target = !resourceUse.isWrite && IsReadOnlyState(resourceUse.state)
+                ? readRunState(use)
+                : resourceUse.state;
+            if (target != current)
+            {
+                pending.push_back({ resourceUse.step, { BarrierType::Transition, resource, NONE, current, target } });
+                current = target;
+            }
+        }
+        const ResourceState endState = node.isImported ? node.finalState : node.initialState;
+        if (current != endState)
+        {
+            pending.push_back({ endStep, { BarrierType::Transition, resource, NONE, current, endState } });
+        }
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](const std::pair<uint32_t, Barrier>& left, const std::pair<uint32_t, Barrier>& right)
+    {
+        return left.first < right.first;
+    });
+    m_steps.push_back({ NONE, 0, 0 });
+    m_barriers.reserve(pending.size());
+    size_t next = 0;
+    for (uint32_t step = 0; step < m_steps.size(); ++step)
+    {
+        m_steps[step].barrierBegin = static_cast<uint32_t>(m_barriers.size());
+        for (; next < pending.size() && pending[next].first == step; ++next)
+        {
+            m_barriers.push_back(pending[next].second);
+        }
+        m_steps[step].barrierEnd = static_cast<uint32_t>(m_barriers.size());
+    }
+}
+
+#pragma endregion
+
+#pragma region Execution
+
+template<typename IssueBarriers>
+void RenderGraph::Execute(const IssueBarriers& issueBarriers) const
+{
+    for (const Step& step : m_steps)
+    {
+        if (step.barrierEnd != step.barrierBegin)
+        {
+            issueBarriers(m_barriers.data() + step.barrierBegin, step.barrierEnd - step.barrierBegin);
+        }
+        if (step.pass != NONE)
+        {
+            m_passes[step.pass].execute();
+        }
+    }
+}
+
+#pragma endregion
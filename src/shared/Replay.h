@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Input.h"
+
+// Log of everything that decides what the simulation does: its seed, how
+// many ticks each ProcessTicks call ran and the input every one of those
+// ticks applied, with a hash of the simulation state after each call.
+// Replaying a log makes the same calls without looking at a clock, so it
+// runs as fast as the simulation allows and has to reproduce the hashes.
+// Input times are not kept, a replayed event is stamped just before the
+// deadline of the tick that applied it.
+//
+// Little endian: a Header, then per call a Call followed by eventCount
+// Events.
+namespace ReplayLog
+{
+    constexpr uint32_t MAGIC = 0x594C5052; // "RPLY"
+    constexpr uint32_t VERSION = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t seed;
+        uint64_t tickNanoseconds;
+    };
+
+    struct Call
+    {
+        uint32_t numberOfTicks;
+        uint32_t eventCount;
+        uint64_t stateHash;
+    };
+
+    struct Event
+    {
+        // Of the call's ticks
+        uint32_t tick;
+        uint32_t code;
+        int32_t  x;
+        int32_t  y;
+        uint8_t  type;
+        uint8_t  reserved[3];
+    };
+}
+
+class ReplayWriter final
+{
+public:
+    ReplayWriter() = default;
+    ReplayWriter(const ReplayWriter&) = delete;
+    ReplayWriter& operator=(const ReplayWriter&) = delete;
+    ~ReplayWriter() { Close(); }
+
+    bool Open(const std::filesystem::path& path, uint64_t seed, uint64_t tickNanoseconds);
+    // False when anything failed to write
+    bool Close();
+    bool IsOpen() const { return m_file.is_open(); }
+
+    // Events first, then the call they belong to
+    void RecordInput(uint32_t tick, const InputEvent& event);
+    void RecordCall(uint32_t numberOfTicks, uint64_t stateHash);
+
+private:
+    std::ofstream                 m_file;
+    std::vector<ReplayLog::Event> m_events;
+};
+
+class ReplayReader final
+{
+public:
+    bool Open(const std::filesystem::path& path);
+    void Close() { m_file.close(); }
+
+    uint64_t Seed() const { return m_header.seed; }
+    uint64_t TickNanoseconds() const { return m_header.tickNanoseconds; }
+
+    // The next call and its input, false at the end of the log. IsTruncated
+    // tells an incomplete log apart.
+    bool Next(ReplayLog::Call* call, std::vector<ReplayLog::Event>* events);
+    bool IsTruncated() const { return m_isTruncated; }
+
+    // Stamped so that ApplyInput gives it to the same tick
+    static InputEvent ToInputEvent(const ReplayLog::Event& event, uint64_t firstTickTime, uint64_t tickNanoseconds);
+
+private:
+    std::ifstream     m_file;
+    uint64_t          m_fileSize = 0;
+    ReplayLog::Header m_header = {};
+    bool              m_isTruncated = false;
+};
+
+#pragma region ReplayWriter
+
+bool ReplayWriter::Open(const std::filesystem::path& path, uint64_t seed, uint64_t tickNanoseconds)
+{
+    Close();
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+    {
+        return false;
+    }
+    ReplayLog::Header header = {};
+    header.magic = ReplayLog::MAGIC;
+    header.version = ReplayLog::VERSION;
+    header.seed = seed;
+    header.tickNanoseconds = tickNanoseconds;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(m_file);
+}
+
+bool ReplayWriter::Close()
+{
+    if (!m_file.is_open())
+    {
+        return true;
+    }
+    m_file.close();
+    const bool isWritten = !m_file.fail();
+    m_file.clear();
+    m_events.clear();
+    return isWritten;
+}
+
+void ReplayWriter::RecordInput(uint32_t tick, const InputEvent& event)
+{
+    ReplayLog::Event logged = {};
+    logged.tick = tick;
+    logged.code = event.code;
+    logged.x = event.x;
+    logged.y = event.y;
+    logged.type = static_cast<uint8_t>(event.type);
+    m_events.push_back(logged);
+}
+
+void ReplayWriter::RecordCall(uint32_t numberOfTicks, uint64_t stateHash)
+{
+    const ReplayLog::Call call = { numberOfTicks, static_cast<uint32_t>(m_events.size()), stateHash };
+    m_file.write(reinterpret_cast<const char*>(&call), sizeof(call));
+    m_file.write(reinterpret_cast<const char*>(m_events.data()), m_events.size() * sizeof(ReplayLog::Event));
+    m_events.clear();
+}
+
+#pragma endregion
+
+#pragma region ReplayReader
+
+bool ReplayReader::Open(const std::filesystem::path& path)
+{
+    m_file.close();
+    m_file.clear();
+    m_isTruncated = false;
+    m_file.open(path, std::ios::binary | std::ios::ate);
+    if (!m_file)
+    {
+        return false;
+    }
+    m_fileSize = static_cast<uint64_t>(m_file.tellg());
+    m_file.seekg(0);
+    return m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header)) &&
+        m_header.magic == ReplayLog::MAGIC &&
+        m_header.version == ReplayLog::VERSION &&
+        m_header.tickNanoseconds;
+}
+
+bool ReplayReader::Next(ReplayLog::Call* call, std::vector<ReplayLog::Event>* events)
+{
+    if (!m_file.read(reinterpret_cast<char*>(call), sizeof(*call)))
+    {
+        m_isTruncated = m_file.gcount() != 0;
+        return false;
+    }
+    // A damaged count must not allocate more events than the file holds
+    const uint64_t position = static_cast<uint64_t>(m_file.tellg());
+    if (call->eventCount > (m_fileSize - position) / sizeof(ReplayLog::Event))
+    {
+        m_isTruncated = true;
+        return false;
+    }
+    events->resize(call->eventCount);
+    if (!m_file.read(reinterpret_cast<char*>(events->data()), events->size() * sizeof(ReplayLog::Event)))
+    {
+        m_isTruncated = true;
+        return false;
+    }
+    return true;
+}
+
+InputEvent ReplayReader::ToInputEvent(const ReplayLog::Event& event, uint64_t firstTickTime, uint64_t tickNanoseconds)
+{
+    return {
+        firstTickTime + event.tick * tickNanoseconds - 1,
+        static_cast<InputEventType>(event.type),
+        event.code,
+        event.x,
+        event.y
+    };
+}
+
+#pragma endregion
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Resource states, a subset of D3D12_RESOURCE_STATES. Read only states may
+// be combined, write states are exclusive.
+enum class ResourceState : uint32_t
+{
+    Common                 = 0,
+    RenderTarget           = 1 << 0,
+    DepthWrite             = 1 << 1,
+    DepthRead              = 1 << 2,
+    PixelShaderResource    = 1 << 3,
+    NonPixelShaderResource = 1 << 4,
+    UnorderedAccess        = 1 << 5,
+    CopySource             = 1 << 6,
+    CopyDest               = 1 << 7,
+    Present                = 1 << 8,
+};
+
+constexpr ResourceState operator|(ResourceState left, ResourceState right)
+{
+    return static_cast<ResourceState>(static_cast<uint32_t>(left) | static_cast<uint32_t>(right));
+}
+
+constexpr ResourceState operator&(ResourceState left, ResourceState right)
+{
+    return static_cast<ResourceState>(static_cast<uint32_t>(left) & static_cast<uint32_t>(right));
+}
+
+constexpr bool IsReadOnlyState(ResourceState state)
+{
+    return state != ResourceState::Common && (state & (
+        ResourceState::DepthRead |
+        ResourceState::PixelShaderResource |
+        ResourceState::NonPixelShaderResource |
+        ResourceState::CopySource
+    )) == state;
+}
+
+// Remembers the current state of every subresource of the registered
+// resources and turns "resource is about to be used in state X" into the
+// transitions needed to get there. Requests are queued and Flush() hands
+// them to the backend as one batch, so it must be called before recording
+// commands that use the resources.
+//
+// While queued, transitions of the same subresource are merged, ones that
+// return to the original state disappear, and a read request on a resource
+// already readable in that state is dropped. Resources are opaque pointers
+// (ID3D12Resource* on Windows) and states are tracked as seen by a single
+// queue recording one command list at a time.
+class ResourceStateTracker final
+{
+public:
+    static constexpr uint32_t ALL_SUBRESOURCES = UINT32_MAX;
+
+    enum class BarrierType : uint8_t
+    {
+        Transition,
+        Aliasing,
+        UnorderedAccess,
+    };
+
+    struct Barrier
+    {
+        BarrierType   type;
+        void*         resource;
+        // Aliasing only, may be nullptr
+        void*         previousResource;
+        uint32_t      subresource;
+        ResourceState before;
+        ResourceState after;
+    };
+
+    void Register(void* resource, uint32_t subresourceCount, ResourceState state);
+    void Unregister(void* resource);
+    ResourceState State(void* resource, uint32_t subresource = 0) const;
+
+    // Unregistered resources are assumed to have one subresource in Common
+    void Transition(void* resource, ResourceState state, uint32_t subresource = ALL_SUBRESOURCES);
+    void Aliasing(void* previousResource, void* resource);
+    void UnorderedAccess(void* resource);
+
+    // submit(const Barrier* barriers, uint32_t count) is called once if
+    // anything is queued
+    template<typename Submit>
+    void Flush(const Submit& submit);
+
+    uint32_t PendingCount() const { return static_cast<uint32_t>(m_pending.size()); }
+
+private:
+    struct Entry
+    {
+        // A single state while all subresources agree
+        std::vector<ResourceState> states;
+        uint32_t                   subresourceCount;
+    };
+
+    std::unordered_map<void*, Entry> m_entries;
+    std::vector<Barrier>             m_pending;
+
+    Entry& entry(void* resource);
+    void transitionSubresource(void* resource, uint32_t subresource, ResourceState* current, ResourceState requested);
+};
+
+#pragma region Registration
+
+void ResourceStateTracker::Register(void* resource, uint32_t subresourceCount, ResourceState state)
+{
+    Entry& registered = m_entries[resource];
+    registered.states.assign(1, state);
+    registered.subresourceCount = subresourceCount;
+}
+
+void ResourceStateTracker::Unregister(void* resource)
+{
+    m_entries.erase(resource);
+}
+
+ResourceState ResourceStateTracker::State(void* resource, uint32_t subresource) const
+{
+    const auto found = m_entries.find(resource);
+    if (found == m_entries.end())
+    {
+        return ResourceState::Common;
+    }
+    const Entry& registered = found->second;
+    return registered.states.size() == 1 ? registered.states[0] : registered.states[subresource];
+}
+
+ResourceStateTracker::Entry& ResourceStateTracker::entry(void* resource)
+{
+    auto found = m_entries.find(resource);
+    if (found == m_entries.end())
+    {
+        found = m_entries.emplace(resource, Entry{ { ResourceState::Common }, 1 }).first;
+    }
+    return found->second;
+}
+
+#pragma endregion
+
+#pragma region Barriers
+
+void ResourceStateTracker::Transition(void* resource, ResourceState state, uint32_t subresource)
+{
+    Entry& tracked = entry(resource);
+    std::vector<ResourceState>& states = tracked.states;
+    if (subresource == ALL_SUBRESOURCES)
+    {
+        if (states.size() == 1)
+        {
+            transitionSubresource(resource, ALL_SUBRESOURCES, &states[0], state);
+            return;
+        }
+        for (uint32_t index = 0; index < tracked.subresourceCount; ++index)
+        {
+            transitionSubresource(resource, index, &states[index], state);
+        }
+    } else {
+        if (states.size() == 1 && tracked.subresourceCount > 1)
+        {
+            states.assign(tracked.subresourceCount, states[0]);
+        }
+        transitionSubresource(resource, states.size() == 1 ? ALL_SUBRESOURCES : subresource, &states[states.size() == 1 ? 0 : subresource], state);
+    }
+    // Collapse back once the subresources agree again
+    for (size_t index = 1; index < states.size(); ++index)
+    {
+        if (states[index] != states[0])
+        {
+            return;
+        }
+    }
+    states.resize(1);
+}
+
+void ResourceStateTracker::transitionSubresource(void* resource, uint32_t subresource, ResourceState* current, ResourceState requested)
+{
+    if (requested == *current)
+    {
+        return;
+    }
+    const bool isRead = IsReadOnlyState(requested);
+    if (isRead && IsReadOnlyState(*current) && (*current & requested) == requested)
+    {
+        return;
+    }
+    // Queued barriers all execute at the same point of the command list, so
+    // a queued transition of this subresource can be retargeted. Anything
+    // else queued for the resource in between keeps the order.
+    for (size_t index = m_pending.size(); index-- > 0;)
+    {
+        Barrier& pending = m_pending[index];
+        if (pending.resource != resource && pending.previousResource != resource)
+        {
+            continue;
+        }
+        if (pending.type != BarrierType::Transition || pending.subresource != subresource)
+        {
+            break;
+        }
+        pending.after = isRead && IsReadOnlyState(pending.after) ? pending.after | requested : requested;
+        *current = pending.after;
+        if (pending.before == pending.after)
+        {
+            m_pending.erase(m_pending.begin() + index);
+        }
+        return;
+    }
+    // Readers that follow each other share one combined state
+    const ResourceState target = isRead && IsReadOnlyState(*current) ? *current | requested : requested;
+    m_pending.push_back({ BarrierType::Transition, resource, nullptr, subresource, *current, target });
+    *current = target;
+}
+
+void ResourceStateTracker::Aliasing(void* previousResource, void* resource)
+{
+    m_pending.push_back({ BarrierType::Aliasing, resource, previousResource, ALL_SUBRESOURCES, ResourceState::Common, ResourceState::Common });
+}
+
+void ResourceStateTracker::UnorderedAccess(void* resource)
+{
+    m_pending.push_back({ BarrierType::UnorderedAccess, resource, nullptr, ALL_SUBRESOURCES, ResourceState::UnorderedAccess, ResourceState::UnorderedAccess });
+}
+
+template<typename Submit>
+void ResourceStateTracker::Flush(const Submit& submit)
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+    submit(m_pending.data(), static_cast<uint32_t>(m_pending.size()));
+    m_pending.clear();
+}
+
+#pragma endregion
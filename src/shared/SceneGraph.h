@@ -0,0 +1,349 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include "MatrixBatch.h"
+#include "Snapshot.h"
+
+// Transform hierarchy stored as flat arrays in depth first order. Every
+// parent precedes its children and every subtree occupies a contiguous
+// range of slots, so a dirty node is recomputed together with its
+// descendants by a single linear pass over that range.
+//
+// Nodes are referred to by stable ids. A new child is inserted at the end
+// of its parent's subtree, moving the slots after it up by one, so only
+// the new node needs updating. Once the insertions since the last update
+// moved MOVED_SLOTS_PER_NODE times as many slots as there are nodes,
+// further nodes are appended and the depth first order is rebuilt once on
+// the next update instead, which keeps building large hierarchies linear. Slots move only after
+// structural changes; WorldMatrices() is indexed by slot and SlotOf()
+// translates an id.
+class SceneGraph final
+{
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+    // Moving a slot is a few memmoved bytes, a rebuild reorders everything
+    static constexpr uint64_t MOVED_SLOTS_PER_NODE = 8;
+
+    uint32_t AddNode(
+        uint32_t parent,
+        const DirectX::XMFLOAT3& position,
+        const DirectX::XMFLOAT4& rotation,
+        const DirectX::XMFLOAT3& scale
+    );
+    void SetLocalTransform(
+        uint32_t node,
+        const DirectX::XMFLOAT3& position,
+        const DirectX::XMFLOAT4& rotation,
+        const DirectX::XMFLOAT3& scale
+    );
+    // Recomputes world matrices of dirty nodes and their descendants only
+    void UpdateWorldMatrices();
+
+    uint32_t NodeCount() const { return static_cast<uint32_t>(m_parentSlots.size()); }
+    uint32_t SlotOf(uint32_t node) const { return m_slotOfNode[node]; }
+    const DirectX::XMFLOAT4X4* WorldMatrices() const { return m_worldMatrices.data(); }
+    uint32_t LastUpdatedNodeCount() const { return m_lastUpdatedNodeCount; }
+
+    // One memcpy per array, restoring a graph of the same size does not
+    // allocate. False on a snapshot of another layout.
+    void Save(Snapshot* snapshot) const;
+    bool Restore(SnapshotReader* reader);
+
+private:
+    std::vector<uint32_t>             m_parentSlots;
+    std::vector<uint32_t>             m_subtreeSizes;
+    std::vector<uint32_t>             m_nodeOfSlot;
+    std::vector<uint32_t>             m_slotOfNode;
+    std::vector<DirectX::XMFLOAT3>    m_positions;
+    std::vector<DirectX::XMFLOAT4>    m_rotations;
+    std::vector<DirectX::XMFLOAT3>    m_scales;
+    std::vector<DirectX::XMFLOAT4X4>  m_worldMatrices;
+    std::vector<uint8_t>              m_isDirty;
+    std::vector<uint32_t>             m_dirtySlots;
+    bool                              m_isLayoutStale = false;
+    // By insertions since the last update
+    uint64_t                          m_movedSlotCount = 0;
+    uint32_t                          m_lastUpdatedNodeCount = 0;
+
+    void markDirty(uint32_t slot);
+    void restoreDepthFirstOrder();
+    void updateRange(uint32_t begin, uint32_t end);
+};
+
+uint32_t SceneGraph::AddNode(
+    uint32_t parent,
+    const DirectX::XMFLOAT3& position,
+    const DirectX::XMFLOAT4& rotation,
+    const DirectX::XMFLOAT3& scale)
+{
+    const uint32_t node = NodeCount();
+    const uint32_t parentSlot = parent == NO_PARENT ? NO_PARENT : m_slotOfNode[parent];
+    // Roots are appended, which keeps parents before children and subtrees contiguous
+    uint32_t slot = NodeCount();
+    if (parentSlot != NO_PARENT && !m_isLayoutStale)
+    {
+        const uint32_t subtreeEnd = parentSlot + m_subtreeSizes[parentSlot];
+        const uint32_t movedSlotCount = NodeCount() - subtreeEnd;
+        if (m_movedSlotCount + movedSlotCount <= MOVED_SLOTS_PER_NODE * NodeCount())
+        {
+            m_movedSlotCount += movedSlotCount;
+            slot = subtreeEnd;
+            for (uint32_t ancestor = parentSlot; ancestor != NO_PARENT; ancestor = m_parentSlots[ancestor])
+            {
+                ++m_subtreeSizes[ancestor];
+            }
+        } else {
+            m_isLayoutStale = true;
+        }
+    }
+    m_parentSlots.insert(m_parentSlots.begin() + slot, parentSlot);
+    m_subtreeSizes.insert(m_subtreeSizes.begin() + slot, 1);
+    m_nodeOfSlot.insert(m_nodeOfSlot.begin() + slot, node);
+    m_slotOfNode.push_back(slot);
+    m_positions.insert(m_positions.begin() + slot, position);
+    m_rotations.insert(m_rotations.begin() + slot, rotation);
+    m_scales.insert(m_scales.begin() + slot, scale);
+    m_worldMatrices.insert(m_worldMatrices.begin() + slot, DirectX::XMFLOAT4X4());
+    m_isDirty.insert(m_isDirty.begin() + slot, 0);
+    if (slot + 1 < NodeCount())
+    {
+        // Parents precede their children, only slots after the new one refer to moved parents
+        for (uint32_t movedSlot = slot + 1; movedSlot < NodeCount(); ++movedSlot)
+        {
+            m_slotOfNode[m_nodeOfSlot[movedSlot]] = movedSlot;
+            if (m_parentSlots[movedSlot] != NO_PARENT && m_parentSlots[movedSlot] >= slot)
+            {
+                ++m_parentSlots[movedSlot];
+            }
+        }
+        for (uint32_t& dirtySlot : m_dirtySlots)
+        {
+            dirtySlot += dirtySlot >= slot ? 1 : 0;
+        }
+    }
+    markDirty(slot);
+    return node;
+}
+
+void SceneGraph::SetLocalTransform(
+    uint32_t node,
+    const DirectX::XMFLOAT3& position,
+    const DirectX::XMFLOAT4& rotation,
+    const DirectX::XMFLOAT3& scale)
+{
+    const uint32_t slot = m_slotOfNode[node];
+    m_positions[slot] = position;
+    m_rotations[slot] = rotation;
+    m_scales[slot] = scale;
+    markDirty(slot);
+}
+
+void SceneGraph::Save(Snapshot* snapshot) const
+{
+    snapshot->WriteArray(m_parentSlots);
+    snapshot->WriteArray(m_subtreeSizes);
+    snapshot->WriteArray(m_nodeOfSlot);
+    snapshot->WriteArray(m_slotOfNode);
+    snapshot->WriteArray(m_positions);
+    snapshot->WriteArray(m_rotations);
+    snapshot->WriteArray(m_scales);
+    snapshot->WriteArray(m_worldMatrices);
+    snapshot->WriteArray(m_isDirty);
+    snapshot->WriteArray(m_dirtySlots);
+    snapshot->Write(m_isLayoutStale);
+    snapshot->Write(m_movedSlotCount);
+    snapshot->Write(m_lastUpdatedNodeCount);
+}
+
+bool SceneGraph::Restore(SnapshotReader* reader)
+{
+    const bool isRead =
+        reader->ReadArray(&m_parentSlots) &&
+        reader->ReadArray(&m_subtreeSizes) &&
+        reader->ReadArray(&m_nodeOfSlot) &&
+        reader->ReadArray(&m_slotOfNode) &&
+        reader->ReadArray(&m_positions) &&
+        reader->ReadArray(&m_rotations) &&
+        reader->ReadArray(&m_scales) &&
+        reader->ReadArray(&m_worldMatrices) &&
+        reader->ReadArray(&m_isDirty) &&
+        reader->ReadArray(&m_dirtySlots) &&
+        reader->Read(&m_isLayoutStale) &&
+        reader->Read(&m_movedSlotCount) &&
+        reader->Read(&m_lastUpdatedNodeCount);
+    const size_t nodeCount = m_parentSlots.size();
+    return isRead &&
+        m_subtreeSizes.size() == nodeCount &&
+        m_nodeOfSlot.size() == nodeCount &&
+        m_slotOfNode.size() == nodeCount &&
+        m_positions.size() == nodeCount &&
+        m_rotations.size() == nodeCount &&
+        m_scales.size() == nodeCount &&
+        m_worldMatrices.size() == nodeCount &&
+        m_isDirty.size() == nodeCount;
+}
+
+void SceneGraph::markDirty(uint32_t slot)
+{
+    if (!m_isDirty[slot])
+    {
+        m_isDirty[slot] = 1;
+        m_dirtySlots.push_back(slot);
+    }
+}
+
+void SceneGraph::UpdateWorldMatrices()
+{
+    m_lastUpdatedNodeCount = 0;
+    m_movedSlotCount = 0;
+    if (m_dirtySlots.empty())
+    {
+        return;
+    }
+    if (m_isLayoutStale)
+    {
+        restoreDepthFirstOrder();
+        for (const uint32_t dirtySlot : m_dirtySlots)
+        {
+            m_isDirty[dirtySlot] = 0;
+        }
+        m_dirtySlots.clear();
+        updateRange(0, NodeCount());
+        return;
+    }
+    // Ascending order visits an ancestor before any of its dirty descendants,
+    // which are then already covered by the ancestor's range.
+    std::sort(m_dirtySlots.begin(), m_dirtySlots.end());
+
+    uint32_t coveredEnd = 0;
+    for (const uint32_t dirtySlot : m_dirtySlots)
+    {
+        m_isDirty[dirtySlot] = 0;
+        if (dirtySlot < coveredEnd)
+        {
+            continue;
+        }
+        coveredEnd = dirtySlot + m_subtreeSizes[dirtySlot];
+        updateRange(dirtySlot, coveredEnd);
+    }
+    m_dirtySlots.clear();
+}
+
+void SceneGraph::updateRange(uint32_t begin, uint32_t end)
+{
+    using namespace DirectX;
+
+    // Consecutive slots with the same parent, the leaves under it, take its
+    // world matrix in one batch once the run ends. A parent precedes its
+    // children, so its own run is done before any of theirs starts.
+    const XMVECTOR origin = XMVectorZero();
+    uint32_t runBegin = begin;
+    for (uint32_t slot = begin; slot < end; ++slot)
+    {
+        XMStoreFloat4x4(&m_worldMatrices[slot], XMMatrixAffineTransformation(
+            XMLoadFloat3(&m_scales[slot]),
+            origin,
+            XMLoadFloat4(&m_rotations[slot]),
+            XMLoadFloat3(&m_positions[slot])
+        ));
+        const uint32_t parentSlot = m_parentSlots[slot];
+        if (slot + 1 == end || m_parentSlots[slot + 1] != parentSlot)
+        {
+            if (parentSlot != NO_PARENT)
+            {
+                MultiplyMatrices(&m_worldMatrices[runBegin], slot + 1 - runBegin, m_worldMatrices[parentSlot], &m_worldMatrices[runBegin]);
+            }
+            runBegin = slot + 1;
+        }
+    }
+    m_lastUpdatedNodeCount += end - begin;
+}
+
+void SceneGraph::restoreDepthFirstOrder()
+{
+    const uint32_t nodeCount = NodeCount();
+
+    // Children of every slot as ranges of one array, in slot order
+    std::vector<uint32_t> childrenBegin(nodeCount + 1, 0);
+    for (uint32_t slot = 0; slot < nodeCount; ++slot)
+    {
+        if (m_parentSlots[slot] != NO_PARENT)
+        {
+            ++childrenBegin[m_parentSlots[slot] + 1];
+        }
+    }
+    for (uint32_t slot = 0; slot < nodeCount; ++slot)
+    {
+        childrenBegin[slot + 1] += childrenBegin[slot];
+    }
+    std::vector<uint32_t> children(nodeCount);
+    std::vector<uint32_t> childrenEnd(childrenBegin.begin(), childrenBegin.end() - 1);
+    for (uint32_t slot = 0; slot < nodeCount; ++slot)
+    {
+        if (m_parentSlots[slot] != NO_PARENT)
+        {
+            children[childrenEnd[m_parentSlots[slot]]++] = slot;
+        }
+    }
+
+    // Pre-order walk, pushing children in reverse to visit them in slot order
+    std::vector<uint32_t> newSlotOfOldSlot(nodeCount);
+    std::vector<uint32_t> oldSlotOfNewSlot;
+    oldSlotOfNewSlot.reserve(nodeCount);
+    std::vector<uint32_t> stack;
+    for (uint32_t root = nodeCount; root-- > 0;)
+    {
+        if (m_parentSlots[root] == NO_PARENT)
+        {
+            stack.push_back(root);
+        }
+    }
+    while (!stack.empty())
+    {
+        const uint32_t oldSlot = stack.back();
+        stack.pop_back();
+        newSlotOfOldSlot[oldSlot] = static_cast<uint32_t>(oldSlotOfNewSlot.size());
+        oldSlotOfNewSlot.push_back(oldSlot);
+        for (uint32_t child = childrenEnd[oldSlot]; child-- > childrenBegin[oldSlot];)
+        {
+            stack.push_back(children[child]);
+        }
+    }
+
+    std::vector<uint32_t> parentSlots(nodeCount);
+    std::vector<uint32_t> nodeOfSlot(nodeCount);
+    std::vector<DirectX::XMFLOAT3> positions(nodeCount);
+    std::vector<DirectX::XMFLOAT4> rotations(nodeCount);
+    std::vector<DirectX::XMFLOAT3> scales(nodeCount);
+    for (uint32_t slot = 0; slot < nodeCount; ++slot)
+    {
+        const uint32_t oldSlot = oldSlotOfNewSlot[slot];
+        const uint32_t oldParent = m_parentSlots[oldSlot];
+        parentSlots[slot] = oldParent == NO_PARENT ? NO_PARENT : newSlotOfOldSlot[oldParent];
+        nodeOfSlot[slot] = m_nodeOfSlot[oldSlot];
+        positions[slot] = m_positions[oldSlot];
+        rotations[slot] = m_rotations[oldSlot];
+        scales[slot] = m_scales[oldSlot];
+        m_slotOfNode[nodeOfSlot[slot]] = slot;
+    }
+    m_parentSlots.swap(parentSlots);
+    m_nodeOfSlot.swap(nodeOfSlot);
+    m_positions.swap(positions);
+    m_rotations.swap(rotations);
+    m_scales.swap(scales);
+
+    std::fill(m_subtreeSizes.begin(), m_subtreeSizes.end(), 1);
+    for (uint32_t slot = nodeCount; slot-- > 0;)
+    {
+        if (m_parentSlots[slot] != NO_PARENT)
+        {
+            m_subtreeSizes[m_parentSlots[slot]] += m_subtreeSizes[slot];
+        }
+    }
+    m_isLayoutStale = false;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "Hash.h"
+#include "ShaderPermutations.h"
+
+// All compiled shader permutations packed into one file:
+//
+//     Header
+//     Entry entries[entryCount]    sorted by key
+//     bytecode, every blob 16 byte aligned
+//
+// Keys hash the program name and feature bits, so a library stays usable
+// when programs are added or reordered. Load() resolves every permutation
+// declared in ShaderPermutations.h once, afterwards Get() is a table lookup.
+// The library does not copy the file, bytecode points into the caller's
+// memory, usually an entry mapped from the asset Archive. Every blob is
+// hashed once by Load() for the pipeline keys.
+struct ShaderBytecode
+{
+    const void* data;
+    size_t      size;
+    uint64_t    hash;
+};
+
+class ShaderLibrary final
+{
+public:
+    static constexpr uint32_t MAGIC = 0x424C4853; // "SHLB"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t ALIGNMENT = 16;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+    };
+
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static uint64_t Key(const char* programName, uint32_t features);
+
+    // Fails when the data is damaged or misses a declared permutation.
+    // data has to outlive the library.
+    bool Load(const void* data, size_t size);
+    ShaderBytecode Get(uint32_t permutationIndex) const { return m_permutations[permutationIndex]; }
+
+private:
+    ShaderBytecode m_permutations[SHADER_PERMUTATION_COUNT] = {};
+};
+
+uint64_t ShaderLibrary::Key(const char* programName, uint32_t features)
+{
+    return Hasher().AddString(programName).AddU64(features).Finish();
+}
+
+bool ShaderLibrary::Load(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (size < sizeof(Header))
+    {
+        return false;
+    }
+    const Header* header = reinterpret_cast<const Header*>(bytes);
+    if (header->magic != MAGIC || header->version != VERSION ||
+        (size - sizeof(Header)) / sizeof(Entry) < header->entryCount)
+    {
+        return false;
+    }
+    const Entry* entries = reinterpret_cast<const Entry*>(bytes + sizeof(Header));
+    const Entry* entriesEnd = entries + header->entryCount;
+    for (uint32_t index = 0; index < SHADER_PERMUTATION_COUNT; ++index)
+    {
+        const ShaderPermutation permutation = ShaderPermutationAt(index);
+        const uint64_t key = Key(SHADER_PROGRAMS[static_cast<uint32_t>(permutation.program)].name, permutation.features);
+        const Entry* entry = std::lower_bound(entries, entriesEnd, key, [](const Entry& left, uint64_t right)
+        {
+            return left.key < right;
+        });
+        if (entry == entriesEnd || entry->key != key || entry->offset > size || entry->size > size - entry->offset)
+        {
+            return false;
+        }
+        m_permutations[index] = {
+            bytes + entry->offset,
+            static_cast<size_t>(entry->size),
+            HashBytes(bytes + entry->offset, static_cast<size_t>(entry->size))
+        };
+    }
+    return true;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+
+// Single declaration of shader programs and the feature bits they are
+// specialized on, shared by the game and the shader library build tool.
+// Every feature is passed to the compiler as a 0/1 define, and every
+// combination of a program's features is compiled ahead of time.
+//
+// Permutations are addressed by a dense index computed at compile time:
+//
+//     ShaderPermutationIndex<ShaderProgram::Vertex, SHADER_FEATURE_INSTANCING>()
+enum ShaderFeature : uint32_t
+{
+    // Vertices carry only a position, the color is derived from it
+    SHADER_FEATURE_VERTEX_POSITION_ONLY = 1 << 0,
+    // Per-instance world matrix in input slot 1
+    SHADER_FEATURE_INSTANCING           = 1 << 1,
+    // Tints everything to spot what a pipeline draws
+    SHADER_FEATURE_DEBUG_COLOR          = 1 << 2,
+};
+
+constexpr const char* SHADER_FEATURE_DEFINES[] = {
+    "VERTEX_POSITION_ONLY",
+    "INSTANCING",
+    "DEBUG_COLOR",
+};
+
+enum class ShaderProgram : uint32_t
+{
+    Vertex,
+    Pixel,
+    ParticleVertex,
+};
+
+struct ShaderProgramDesc
+{
+    const char* name;
+    const char* source;
+    const char* entryPoint;
+    const char* profile;
+    uint32_t    featureMask;
+};
+
+// Indexed by ShaderProgram, profiles match SHADER_MODEL in Dx12Game.h
+constexpr ShaderProgramDesc SHADER_PROGRAMS[] = {
+    { "VertexShader",         "VertexShader.hlsl",         "main", "vs_6_0", SHADER_FEATURE_VERTEX_POSITION_ONLY | SHADER_FEATURE_INSTANCING },
+    { "PixelShader",          "PixelShader.hlsl",          "main", "ps_6_0", SHADER_FEATURE_DEBUG_COLOR },
+    { "ParticleVertexShader", "ParticleVertexShader.hlsl", "main", "vs_6_0", 0 },
+};
+
+constexpr uint32_t SHADER_PROGRAM_COUNT = sizeof(SHADER_PROGRAMS) / sizeof(SHADER_PROGRAMS[0]);
+constexpr uint32_t SHADER_FEATURE_COUNT = sizeof(SHADER_FEATURE_DEFINES) / sizeof(SHADER_FEATURE_DEFINES[0]);
+
+namespace ShaderPermutations_internal
+{
+    constexpr uint32_t bitCount(uint32_t bits)
+    {
+        uint32_t count = 0;
+        for (; bits; bits &= bits - 1)
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    // Packs the bits of value selected by mask next to each other
+    constexpr uint32_t compactBits(uint32_t value, uint32_t mask)
+    {
+        uint32_t result = 0;
+        uint32_t outputBit = 1;
+        for (uint32_t bit = 1; bit && bit <= mask; bit <<= 1)
+        {
+            if (mask & bit)
+            {
+                result |= (value & bit) ? outputBit : 0;
+                outputBit <<= 1;
+            }
+        }
+        return result;
+    }
+
+    constexpr uint32_t expandBits(uint32_t value, uint32_t mask)
+    {
+        uint32_t result = 0;
+        uint32_t inputBit = 1;
+        for (uint32_t bit = 1; bit && bit <= mask; bit <<= 1)
+        {
+            if (mask & bit)
+            {
+                result |= (value & inputBit) ? bit : 0;
+                inputBit <<= 1;
+            }
+        }
+        return result;
+    }
+}
+
+constexpr uint32_t ShaderPermutationCount(ShaderProgram program)
+{
+    return 1u << ShaderPermutations_internal::bitCount(SHADER_PROGRAMS[static_cast<uint32_t>(program)].featureMask);
+}
+
+constexpr uint32_t ShaderFirstPermutation(ShaderProgram program)
+{
+    uint32_t first = 0;
+    for (uint32_t index = 0; index < static_cast<uint32_t>(program); ++index)
+    {
+        first += ShaderPermutationCount(static_cast<ShaderProgram>(index));
+    }
+    return first;
+}
+
+constexpr uint32_t SHADER_PERMUTATION_COUNT = ShaderFirstPermutation(static_cast<ShaderProgram>(SHADER_PROGRAM_COUNT));
+
+template<ShaderProgram Program, uint32_t Features>
+constexpr uint32_t ShaderPermutationIndex()
+{
+    static_assert((Features & ~SHADER_PROGRAMS[static_cast<uint32_t>(Program)].featureMask) == 0, "Feature not supported by the program");
+    return ShaderFirstPermutation(Program) +
+        ShaderPermutations_internal::compactBits(Features, SHADER_PROGRAMS[static_cast<uint32_t>(Program)].featureMask);
+}
+
+// Inverse of ShaderPermutationIndex for tools enumerating all permutations
+struct ShaderPermutation
+{
+    ShaderProgram program;
+    uint32_t      features;
+};
+
+constexpr ShaderPermutation ShaderPermutationAt(uint32_t index)
+{
+    uint32_t program = 0;
+    while (index >= ShaderPermutationCount(static_cast<ShaderProgram>(program)))
+    {
+        index -= ShaderPermutationCount(static_cast<ShaderProgram>(program));
+        ++program;
+    }
+    return {
+        static_cast<ShaderProgram>(program),
+        ShaderPermutations_internal::expandBits(index, SHADER_PROGRAMS[program].featureMask)
+    };
+}
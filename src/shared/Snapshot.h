@@ -0,0 +1,276 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+// Byte image of simulation state. The state lives in flat arrays of
+// pointer free values, so saving it is one memcpy per array into a buffer
+// that keeps its capacity from snapshot to snapshot, and restoring is one
+// memcpy per array back. Values are read in the order they were written and
+// nothing describes the layout, a snapshot only restores into the build
+// that saved it.
+class Snapshot final
+{
+public:
+    void Clear() { m_bytes.clear(); }
+
+    template<typename T>
+    void Write(const T& value);
+    // Length first, then the elements
+    template<typename T>
+    void WriteArray(const std::vector<T>& values);
+
+    const uint8_t* Data() const { return m_bytes.data(); }
+    size_t Size() const { return m_bytes.size(); }
+    bool IsEqual(const Snapshot& other) const;
+
+private:
+    std::vector<uint8_t> m_bytes;
+
+    void append(const void* data, size_t size);
+
+    friend class SnapshotReader;
+    friend bool DecodeSnapshotDelta(const Snapshot& base, const uint8_t* delta, size_t size, Snapshot* next);
+};
+
+class SnapshotReader final
+{
+public:
+    explicit SnapshotReader(const Snapshot& snapshot) : m_snapshot(snapshot) {}
+
+    // False when the snapshot ends first
+    template<typename T>
+    bool Read(T* value);
+    template<typename T>
+    bool ReadArray(std::vector<T>* values);
+    bool IsAtEnd() const { return m_offset == m_snapshot.Size(); }
+
+private:
+    const Snapshot& m_snapshot;
+    size_t          m_offset = 0;
+};
+
+// Consecutive snapshots differ in few bytes. A delta holds the byte wise
+// xor of a snapshot with the one before in 8 byte words, runs of zero
+// words are skipped:
+//
+//     u64 size, then records of varint zero words, varint literal words
+//     and the literal words
+//
+// Encoding is one compare pass over both snapshots, decoding one copy of
+// the base plus the changed words.
+
+// Appends the delta of next against base to delta
+void EncodeSnapshotDelta(const Snapshot& base, const Snapshot& next, std::vector<uint8_t>* delta);
+// Rebuilds next from base, false on a malformed delta. next must not be
+// base.
+bool DecodeSnapshotDelta(const Snapshot& base, const uint8_t* delta, size_t size, Snapshot* next);
+
+namespace Snapshot_internal
+{
+    constexpr size_t WORD_SIZE = sizeof(uint64_t);
+
+    // Zero past the end, snapshots of different sizes compare as if padded
+    uint64_t readWord(const uint8_t* bytes, size_t size, size_t word)
+    {
+        const size_t offset = word * WORD_SIZE;
+        uint64_t value = 0;
+        if (offset + WORD_SIZE <= size)
+        {
+            memcpy(&value, bytes + offset, WORD_SIZE);
+        } else if (offset < size) {
+            memcpy(&value, bytes + offset, size - offset);
+        }
+        return value;
+    }
+
+    void writeVarint(std::vector<uint8_t>* output, uint64_t value)
+    {
+        for (; value >= 0x80; value >>= 7)
+        {
+            output->push_back(static_cast<uint8_t>(value | 0x80));
+        }
+        output->push_back(static_cast<uint8_t>(value));
+    }
+
+    bool readVarint(const uint8_t** input, const uint8_t* inputEnd, uint64_t* value)
+    {
+        *value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7)
+        {
+            if (*input == inputEnd)
+            {
+                return false;
+            }
+            const uint8_t byte = *(*input)++;
+            *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#pragma region Snapshot
+
+void Snapshot::append(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+}
+
+template<typename T>
+void Snapshot::Write(const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold plain bytes");
+    append(&value, sizeof(value));
+}
+
+template<typename T>
+void Snapshot::WriteArray(const std::vector<T>& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold plain bytes");
+    Write<uint64_t>(values.size());
+    append(values.data(), values.size() * sizeof(T));
+}
+
+bool Snapshot::IsEqual(const Snapshot& other) const
+{
+    return Size() == other.Size() && (!Size() || !memcmp(Data(), other.Data(), Size()));
+}
+
+#pragma endregion
+
+#pragma region SnapshotReader
+
+template<typename T>
+bool SnapshotReader::Read(T* value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold plain bytes");
+    if (m_snapshot.Size() - m_offset < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(value, m_snapshot.Data() + m_offset, sizeof(T));
+    m_offset += sizeof(T);
+    return true;
+}
+
+template<typename T>
+bool SnapshotReader::ReadArray(std::vector<T>* values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold plain bytes");
+    uint64_t count;
+    if (!Read(&count) || (m_snapshot.Size() - m_offset) / sizeof(T) < count)
+    {
+        return false;
+    }
+    // Keeps the capacity, restoring a state of the same size does not allocate
+    values->resize(static_cast<size_t>(count));
+    if (count)
+    {
+        memcpy(values->data(), m_snapshot.Data() + m_offset, values->size() * sizeof(T));
+    }
+    m_offset += values->size() * sizeof(T);
+    return true;
+}
+
+#pragma endregion
+
+#pragma region SnapshotDelta
+
+void EncodeSnapshotDelta(const Snapshot& base, const Snapshot& next, std::vector<uint8_t>* delta)
+{
+    using namespace Snapshot_internal;
+
+    const uint64_t size = next.Size();
+    const uint8_t* sizeBytes = reinterpret_cast<const uint8_t*>(&size);
+    delta->insert(delta->end(), sizeBytes, sizeBytes + sizeof(size));
+
+    const size_t wordCount = (next.Size() + WORD_SIZE - 1) / WORD_SIZE;
+    const auto difference = [&](size_t word)
+    {
+        return readWord(base.Data(), base.Size(), word) ^ readWord(next.Data(), next.Size(), word);
+    };
+    size_t word = 0;
+    while (word < wordCount)
+    {
+        const size_t zeroBegin = word;
+        while (word < wordCount && !difference(word))
+        {
+            ++word;
+        }
+        const size_t literalBegin = word;
+        while (word < wordCount && difference(word))
+        {
+            ++word;
+        }
+        if (literalBegin == word)
+        {
+            break;
+        }
+        writeVarint(delta, literalBegin - zeroBegin);
+        writeVarint(delta, word - literalBegin);
+        for (size_t literal = literalBegin; literal < word; ++literal)
+        {
+            const uint64_t value = difference(literal);
+            const uint8_t* valueBytes = reinterpret_cast<const uint8_t*>(&value);
+            delta->insert(delta->end(), valueBytes, valueBytes + WORD_SIZE);
+        }
+    }
+}
+
+bool DecodeSnapshotDelta(const Snapshot& base, const uint8_t* delta, size_t size, Snapshot* next)
+{
+    using namespace Snapshot_internal;
+
+    uint64_t storedSize;
+    if (size < sizeof(storedSize))
+    {
+        return false;
+    }
+    memcpy(&storedSize, delta, sizeof(storedSize));
+    const uint8_t* input = delta + sizeof(storedSize);
+    const uint8_t* const inputEnd = delta + size;
+
+    // Keeps the capacity, the bytes past the base start out as zeros
+    std::vector<uint8_t>& bytes = next->m_bytes;
+    const size_t nextSize = static_cast<size_t>(storedSize);
+    bytes.assign(base.Data(), base.Data() + (base.Size() < nextSize ? base.Size() : nextSize));
+    bytes.resize(nextSize);
+
+    const size_t wordCount = (nextSize + WORD_SIZE - 1) / WORD_SIZE;
+    size_t word = 0;
+    while (input < inputEnd)
+    {
+        uint64_t zeroWords;
+        uint64_t literalWords;
+        if (!readVarint(&input, inputEnd, &zeroWords) ||
+            !readVarint(&input, inputEnd, &literalWords) ||
+            zeroWords > wordCount - word ||
+            literalWords > wordCount - word - zeroWords ||
+            literalWords > static_cast<size_t>(inputEnd - input) / WORD_SIZE)
+        {
+            next->Clear();
+            return false;
+        }
+        word += static_cast<size_t>(zeroWords);
+        for (uint64_t literal = 0; literal < literalWords; ++literal, ++word, input += WORD_SIZE)
+        {
+            const size_t offset = word * WORD_SIZE;
+            const size_t length = nextSize - offset < WORD_SIZE ? nextSize - offset : WORD_SIZE;
+            for (size_t index = 0; index < length; ++index)
+            {
+                bytes[offset + index] ^= input[index];
+            }
+        }
+    }
+    return true;
+}
+
+#pragma endregion
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+// Bounded ring passing items from one producer thread to one consumer
+// thread without locks or allocations. Each side owns one index and
+// keeps a copy of the other's, the shared cache line is only read again
+// when the ring looks full to the producer or empty to the consumer.
+template<typename T, uint32_t CAPACITY>
+class SpscQueue final
+{
+    static_assert(CAPACITY && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity has to be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "Items are copied in and out");
+
+public:
+    // Producer, false when full and the item was not queued
+    bool Push(const T& item);
+
+    // Consumer, the oldest item or null when empty. Valid until Pop.
+    const T* Peek();
+    void Pop();
+
+    // Approximate unless called from the consumer with the producer idle
+    uint32_t Size() const;
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    // Indices run freely and wrap, tail - head is the item count
+    alignas(CACHE_LINE) std::atomic<uint32_t> m_head{0};
+    uint32_t                                  m_cachedTail = 0;
+    alignas(CACHE_LINE) std::atomic<uint32_t> m_tail{0};
+    uint32_t                                  m_cachedHead = 0;
+    alignas(CACHE_LINE) T                     m_items[CAPACITY];
+};
+
+template<typename T, uint32_t CAPACITY>
+bool SpscQueue<T, CAPACITY>::Push(const T& item)
+{
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cachedHead == CAPACITY)
+    {
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        if (tail - m_cachedHead == CAPACITY)
+        {
+            return false;
+        }
+    }
+    m_items[tail & MASK] = item;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T, uint32_t CAPACITY>
+const T* SpscQueue<T, CAPACITY>::Peek()
+{
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cachedTail)
+    {
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        if (head == m_cachedTail)
+        {
+            return nullptr;
+        }
+    }
+    return &m_items[head & MASK];
+}
+
+template<typename T, uint32_t CAPACITY>
+void SpscQueue<T, CAPACITY>::Pop()
+{
+    m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T, uint32_t CAPACITY>
+uint32_t SpscQueue<T, CAPACITY>::Size() const
+{
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
@@ -0,0 +1,559 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Archive.h"
+#include "AsyncFile.h"
+
+// Background loading of Archive entries. An I/O thread keeps up to
+// queueDepth chunk reads in flight on an AsyncFile, decompression threads
+// expand LZ4 entries, and the owner collects finished entries with Poll(),
+// usually to copy them into upload memory.
+//
+// Requests with a higher priority are issued first, equal priorities in
+// request order. Buffers of issued and not yet polled requests count
+// against memoryBudget, a request that does not fit waits until polled
+// results free enough memory. A request larger than the whole budget is
+// issued alone.
+class StreamingLoader final
+{
+public:
+    typedef uint32_t RequestId;
+    static constexpr RequestId INVALID_REQUEST = 0;
+    // Large entries are split into chunks read in parallel
+    static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+    struct Config
+    {
+        size_t   memoryBudget = 64 * 1024 * 1024;
+        uint32_t queueDepth = 32;
+        // 0 picks one per hardware thread, leaving one for the game
+        uint32_t decompressionThreads = 0;
+    };
+
+    // Valid only during the Poll() callback
+    struct Result
+    {
+        RequestId   id;
+        uint32_t    entry;
+        const void* data;
+        size_t      size;
+        bool        failed;
+    };
+
+    struct Stats
+    {
+        uint64_t bytesRead;
+        uint64_t readCount;
+        // Reads in flight, sampled every time the I/O thread submits
+        double   averageQueueDepth;
+        uint32_t maxQueueDepth;
+        size_t   peakMemory;
+    };
+
+    // archive has to be open on the same file and outlive the loader
+    bool Initialize(const char* archivePath, const Archive* archive, const Config& config);
+    void Shutdown();
+    ~StreamingLoader() { Shutdown(); }
+
+    RequestId Request(uint32_t entry, int32_t priority = 0);
+    // Pending requests are dropped, issued ones are discarded when they
+    // finish. Results already waiting for Poll() stay.
+    void Cancel(RequestId id);
+
+    // Calls function(const Result&) for every finished request and frees
+    // its memory afterwards. Returns how many results were handed out.
+    template<typename Function>
+    uint32_t Poll(const Function& function);
+    // Blocks until a result is ready or nothing is outstanding
+    void Wait();
+    // Requests neither cancelled nor polled yet
+    uint32_t Outstanding() const;
+    Stats GetStats() const;
+
+private:
+    struct Job
+    {
+        RequestId id;
+        uint32_t  entry;
+        int32_t   priority;
+        uint64_t  sequence;
+        size_t    reservedMemory;
+        uint8_t*  stored;
+        uint8_t*  output;
+        uint32_t  chunkCount;
+        uint32_t  chunksIssued;
+        uint32_t  chunksLeft;
+        bool      failed;
+        bool      cancelled;
+    };
+
+    const Archive*                       m_archive = nullptr;
+    Config                               m_config;
+    AsyncFile                            m_file;
+    std::thread                          m_ioThread;
+    std::vector<std::thread>             m_decompressionThreads;
+
+    mutable std::mutex                   m_mutex;
+    std::condition_variable              m_ioWake;
+    std::condition_variable              m_decompressionWake;
+    std::condition_variable              m_resultReady;
+    bool                                 m_quit = false;
+    RequestId                            m_nextId = 1;
+    uint64_t                             m_nextSequence = 0;
+    std::unordered_map<RequestId, Job*>  m_jobs;
+    // Heap ordered by priority, then sequence
+    std::vector<Job*>                    m_pending;
+    // Issued jobs that still have chunks to read, touched by the I/O thread only
+    std::deque<Job*>                     m_reading;
+    std::deque<Job*>                     m_decompressing;
+    std::deque<Job*>                     m_finished;
+    uint32_t                             m_outstanding = 0;
+    size_t                               m_memoryUsed = 0;
+
+    Stats                                m_stats = {};
+    uint64_t                             m_queueDepthSum = 0;
+    uint64_t                             m_queueDepthSamples = 0;
+
+    static bool isLowerPriority(const Job* left, const Job* right);
+    size_t requiredMemory(const Job& job) const;
+    bool canStart() const;
+    void ioMain();
+    void decompressionMain();
+    // Called with m_mutex held
+    void finish(Job* job);
+    void drop(Job* job);
+    void release(Job* job);
+};
+
+namespace Streaming_internal
+{
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Unbuffered reads need block aligned destinations
+    uint8_t* allocateBlocks(size_t size)
+    {
+        const size_t alignedSize = std::max(alignUp(size, AsyncFile::READ_ALIGNMENT), AsyncFile::READ_ALIGNMENT);
+#ifdef _WIN32
+        return static_cast<uint8_t*>(_aligned_malloc(alignedSize, AsyncFile::READ_ALIGNMENT));
+#else
+        return static_cast<uint8_t*>(aligned_alloc(AsyncFile::READ_ALIGNMENT, alignedSize));
+#endif
+    }
+
+    void freeBlocks(uint8_t* blocks)
+    {
+#ifdef _WIN32
+        _aligned_free(blocks);
+#else
+        free(blocks);
+#endif
+    }
+}
+
+#pragma region Public
+
+bool StreamingLoader::Initialize(const char* archivePath, const Archive* archive, const Config& config)
+{
+    Shutdown();
+    m_config = config;
+    m_config.queueDepth = std::max(m_config.queueDepth, 1u);
+    if (!m_file.Open(archivePath, m_config.queueDepth))
+    {
+        return false;
+    }
+    m_archive = archive;
+    m_quit = false;
+    m_stats = {};
+    m_queueDepthSum = 0;
+    m_queueDepthSamples = 0;
+
+    uint32_t decompressionThreads = m_config.decompressionThreads;
+    if (!decompressionThreads)
+    {
+        decompressionThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+    for (uint32_t i = 0; i < decompressionThreads; ++i)
+    {
+        m_decompressionThreads.emplace_back(&StreamingLoader::decompressionMain, this);
+    }
+    m_ioThread = std::thread(&StreamingLoader::ioMain, this);
+    return true;
+}
+
+void StreamingLoader::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_ioWake.notify_all();
+    m_decompressionWake.notify_all();
+    if (m_ioThread.joinable())
+    {
+        m_ioThread.join();
+    }
+    for (std::thread& thread : m_decompressionThreads)
+    {
+        thread.join();
+    }
+    m_decompressionThreads.clear();
+    // Waits for reads still in flight before their buffers go away
+    m_file.Close();
+
+    for (auto& job : m_jobs)
+    {
+        release(job.second);
+    }
+    m_jobs.clear();
+    m_pending.clear();
+    m_reading.clear();
+    m_decompressing.clear();
+    m_finished.clear();
+    m_outstanding = 0;
+    m_memoryUsed = 0;
+    m_archive = nullptr;
+}
+
+StreamingLoader::RequestId StreamingLoader::Request(uint32_t entry, int32_t priority)
+{
+    Job* job = new Job();
+    job->entry = entry;
+    job->priority = priority;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job->id = m_nextId++;
+        if (m_nextId == INVALID_REQUEST)
+        {
+            m_nextId = 1;
+        }
+        job->sequence = m_nextSequence++;
+        m_jobs[job->id] = job;
+        m_pending.push_back(job);
+        std::push_heap(m_pending.begin(), m_pending.end(), isLowerPriority);
+        ++m_outstanding;
+    }
+    m_ioWake.notify_one();
+    return job->id;
+}
+
+void StreamingLoader::Cancel(RequestId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto found = m_jobs.find(id);
+    if (found == m_jobs.end() || found->second->cancelled)
+    {
+        return;
+    }
+    Job* job = found->second;
+    if (std::find(m_finished.begin(), m_finished.end(), job) != m_finished.end())
+    {
+        return;
+    }
+    job->cancelled = true;
+    --m_outstanding;
+    const auto pending = std::find(m_pending.begin(), m_pending.end(), job);
+    if (pending != m_pending.end())
+    {
+        m_pending.erase(pending);
+        std::make_heap(m_pending.begin(), m_pending.end(), isLowerPriority);
+        m_jobs.erase(found);
+        release(job);
+    }
+    m_resultReady.notify_all();
+}
+
+template<typename Function>
+uint32_t StreamingLoader::Poll(const Function& function)
+{
+    std::deque<Job*> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished.swap(m_finished);
+    }
+    for (Job* job : finished)
+    {
+        Result result;
+        result.id = job->id;
+        result.entry = job->entry;
+        result.data = job->output;
+        result.size = job->failed ? 0 : m_archive->Size(job->entry);
+        result.failed = job->failed;
+        function(static_cast<const Result&>(result));
+    }
+    if (!finished.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (Job* job : finished)
+            {
+                // Cancel() may have raced with handing the result out
+                if (!job->cancelled)
+                {
+                    --m_outstanding;
+                }
+                m_jobs.erase(job->id);
+                m_memoryUsed -= job->reservedMemory;
+                release(job);
+            }
+        }
+        m_ioWake.notify_one();
+    }
+    return static_cast<uint32_t>(finished.size());
+}
+
+void StreamingLoader::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_resultReady.wait(lock, [this] { return !m_finished.empty() || m_outstanding == 0; });
+}
+
+uint32_t StreamingLoader::Outstanding() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_outstanding;
+}
+
+StreamingLoader::Stats StreamingLoader::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.averageQueueDepth = m_queueDepthSamples ? static_cast<double>(m_queueDepthSum) / m_queueDepthSamples : 0.0;
+    return stats;
+}
+
+#pragma endregion
+
+#pragma region Private
+
+bool StreamingLoader::isLowerPriority(const Job* left, const Job* right)
+{
+    if (left->priority != right->priority)
+    {
+        return left->priority < right->priority;
+    }
+    return left->sequence > right->sequence;
+}
+
+size_t StreamingLoader::requiredMemory(const Job& job) const
+{
+    const size_t stored = Streaming_internal::alignUp(m_archive->Span(job.entry).size, AsyncFile::READ_ALIGNMENT);
+    return m_archive->IsCompressed(job.entry) ? stored + m_archive->Size(job.entry) : stored;
+}
+
+bool StreamingLoader::canStart() const
+{
+    return !m_pending.empty() &&
+        (!m_memoryUsed || m_memoryUsed + requiredMemory(*m_pending.front()) <= m_config.memoryBudget);
+}
+
+void StreamingLoader::ioMain()
+{
+    struct ChunkRead
+    {
+        uint64_t offset;
+        uint8_t* destination;
+        uint32_t size;
+        uint64_t userData;
+    };
+    std::vector<ChunkRead> reads;
+    std::vector<std::pair<uint64_t, int64_t>> completions;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        if (!m_file.InFlight() && m_reading.empty())
+        {
+            m_ioWake.wait(lock, [this] { return m_quit || canStart(); });
+        }
+        if (m_quit)
+        {
+            return;
+        }
+
+        // Strictly in priority order, a large job is not starved by
+        // smaller ones behind it
+        while (canStart())
+        {
+            Job* job = m_pending.front();
+            std::pop_heap(m_pending.begin(), m_pending.end(), isLowerPriority);
+            m_pending.pop_back();
+            const size_t stored = m_archive->Span(job->entry).size;
+            job->reservedMemory = requiredMemory(*job);
+            job->stored = Streaming_internal::allocateBlocks(stored);
+            job->output = m_archive->IsCompressed(job->entry) ? nullptr : job->stored;
+            job->chunkCount = static_cast<uint32_t>((stored + CHUNK_SIZE - 1) / CHUNK_SIZE);
+            job->chunksLeft = job->chunkCount;
+            m_memoryUsed += job->reservedMemory;
+            m_stats.peakMemory = std::max(m_stats.peakMemory, m_memoryUsed);
+            if (job->chunkCount)
+            {
+                m_reading.push_back(job);
+            } else {
+                finish(job);
+            }
+        }
+
+        reads.clear();
+        while (!m_reading.empty() && m_file.InFlight() + reads.size() < m_config.queueDepth)
+        {
+            Job* job = m_reading.front();
+            if (job->cancelled)
+            {
+                // Chunks already in flight finish the job
+                m_reading.pop_front();
+                job->chunksLeft -= job->chunkCount - job->chunksIssued;
+                if (!job->chunksLeft)
+                {
+                    finish(job);
+                }
+                continue;
+            }
+            const size_t stored = m_archive->Span(job->entry).size;
+            const size_t chunkOffset = static_cast<size_t>(job->chunksIssued) * CHUNK_SIZE;
+            const size_t chunkSize = std::min(CHUNK_SIZE, stored - chunkOffset);
+            ChunkRead read;
+            read.offset = m_archive->Offset(job->entry) + chunkOffset;
+            read.destination = job->stored + chunkOffset;
+            // The tail of the last block belongs to the next entry or is
+            // past the end of the file, either way it is never looked at
+            read.size = static_cast<uint32_t>(Streaming_internal::alignUp(chunkSize, AsyncFile::READ_ALIGNMENT));
+            read.userData = (static_cast<uint64_t>(job->id) << 32) | job->chunksIssued;
+            reads.push_back(read);
+            if (++job->chunksIssued == job->chunkCount)
+            {
+                m_reading.pop_front();
+            }
+        }
+        if (!m_file.InFlight() && reads.empty())
+        {
+            continue;
+        }
+        m_queueDepthSum += m_file.InFlight() + reads.size();
+        ++m_queueDepthSamples;
+        m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, static_cast<uint32_t>(m_file.InFlight() + reads.size()));
+
+        lock.unlock();
+        for (const ChunkRead& read : reads)
+        {
+            m_file.Read(read.offset, read.destination, read.size, read.userData);
+        }
+        completions.clear();
+        m_file.Wait([&](uint64_t userData, int64_t result)
+        {
+            completions.emplace_back(userData, result);
+        });
+        lock.lock();
+
+        for (const auto& completion : completions)
+        {
+            Job* job = m_jobs[static_cast<RequestId>(completion.first >> 32)];
+            const uint32_t chunk = static_cast<uint32_t>(completion.first);
+            const size_t stored = m_archive->Span(job->entry).size;
+            const size_t expected = std::min(CHUNK_SIZE, stored - static_cast<size_t>(chunk) * CHUNK_SIZE);
+            if (completion.second < static_cast<int64_t>(expected))
+            {
+                job->failed = true;
+            }
+            if (completion.second > 0)
+            {
+                m_stats.bytesRead += static_cast<uint64_t>(completion.second);
+            }
+            ++m_stats.readCount;
+            if (!--job->chunksLeft)
+            {
+                finish(job);
+            }
+        }
+    }
+}
+
+void StreamingLoader::decompressionMain()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_decompressionWake.wait(lock, [this] { return m_quit || !m_decompressing.empty(); });
+        if (m_quit)
+        {
+            return;
+        }
+        Job* job = m_decompressing.front();
+        m_decompressing.pop_front();
+        if (job->cancelled)
+        {
+            drop(job);
+            continue;
+        }
+        lock.unlock();
+
+        const size_t size = m_archive->Size(job->entry);
+        const size_t stored = m_archive->Span(job->entry).size;
+        uint8_t* output = Streaming_internal::allocateBlocks(size);
+        const bool succeeded = Lz4Decompress(job->stored, stored, output, size);
+        Streaming_internal::freeBlocks(job->stored);
+
+        lock.lock();
+        job->stored = nullptr;
+        job->output = output;
+        job->failed = !succeeded;
+        // The compressed copy is gone, let the I/O thread use its memory
+        const size_t storedMemory = Streaming_internal::alignUp(stored, AsyncFile::READ_ALIGNMENT);
+        job->reservedMemory -= storedMemory;
+        m_memoryUsed -= storedMemory;
+        m_ioWake.notify_one();
+        if (job->cancelled)
+        {
+            drop(job);
+            continue;
+        }
+        m_finished.push_back(job);
+        m_resultReady.notify_all();
+    }
+}
+
+void StreamingLoader::finish(Job* job)
+{
+    if (job->cancelled)
+    {
+        drop(job);
+    } else if (m_archive->IsCompressed(job->entry) && !job->failed) {
+        m_decompressing.push_back(job);
+        m_decompressionWake.notify_one();
+    } else {
+        m_finished.push_back(job);
+        m_resultReady.notify_all();
+    }
+}
+
+void StreamingLoader::drop(Job* job)
+{
+    m_memoryUsed -= job->reservedMemory;
+    m_jobs.erase(job->id);
+    release(job);
+    m_ioWake.notify_one();
+}
+
+void StreamingLoader::release(Job* job)
+{
+    if (job->stored != job->output)
+    {
+        Streaming_internal::freeBlocks(job->stored);
+    }
+    Streaming_internal::freeBlocks(job->output);
+    delete job;
+}
+
+#pragma endregion
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <limits>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "MatrixBatch.h"
+
+#ifdef _MSC_VER
+#define VISIBILITY_TARGET(features)
+#else
+#define VISIBILITY_TARGET(features) __attribute__((target(features)))
+#endif
+
+// Frustum planes in SoA layout so one plane can be broadcast against
+// a batch of bounds. Planes point inwards: a point is inside when
+// a*x + b*y + c*z + d >= 0 for every plane.
+struct FrustumPlanes
+{
+    static constexpr uint32_t PLANE_COUNT = 6;
+
+    float a[PLANE_COUNT];
+    float b[PLANE_COUNT];
+    float c[PLANE_COUNT];
+    float d[PLANE_COUNT];
+
+    // viewProjection is row-major and uses the DirectXMath row vector
+    // convention (clip = [x y z 1] * viewProjection) with D3D depth in [0, 1].
+    void ExtractFrom(const float viewProjection[4][4]);
+};
+
+// Bounding spheres and boxes (center + half extents) of all objects.
+// Arrays are padded to a multiple of BATCH_SIZE with NaN centers so the
+// kernels never need a scalar tail and padding is never reported visible.
+struct BoundsStore
+{
+    static constexpr uint32_t BATCH_SIZE = 8;
+
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    std::vector<float> extentX;
+    std::vector<float> extentY;
+    std::vector<float> extentZ;
+
+    uint32_t Add(float x, float y, float z, float halfX, float halfY, float halfZ);
+    void Set(uint32_t index, float x, float y, float z, float halfX, float halfY, float halfZ);
+    void Clear();
+    uint32_t Count() const { return m_count; }
+    uint32_t PaddedCount() const { return static_cast<uint32_t>(centerX.size()); }
+
+private:
+    uint32_t m_count = 0;
+};
+
+// Compact list of indices into a BoundsStore.
+struct VisibleSet
+{
+    std::vector<uint32_t> indices;
+    uint32_t count = 0;
+};
+
+void CullSpheres(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+void CullBoxes(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+void SelectVisibilityKernels(SimdLevel level);
+
+namespace Visibility_internal
+{
+    typedef void (*CullKernel)(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+
+    void cullSpheresSSE(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+    void cullSpheresAVX2(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+    void cullBoxesSSE(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+    void cullBoxesAVX2(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible);
+
+    static CullKernel g_cullSpheres = cullSpheresSSE;
+    static CullKernel g_cullBoxes = cullBoxesSSE;
+
+    void setPlane(FrustumPlanes* planes, uint32_t plane, float a, float b, float c, float d);
+    uint32_t* prepareOutput(const BoundsStore& bounds, VisibleSet* visible);
+    void appendMask(uint32_t* out, uint32_t* count, uint32_t baseIndex, int mask, uint32_t width);
+    VISIBILITY_TARGET("avx2,popcnt") void appendMask8(uint32_t* out, uint32_t* count, uint32_t baseIndex, int mask);
+}
+
+#pragma region FrustumPlanes
+
+void FrustumPlanes::ExtractFrom(const float m[4][4])
+{
+    using Visibility_internal::setPlane;
+    // Column k of the matrix produces clip coordinate k.
+    setPlane(this, 0, m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0]); // left
+    setPlane(this, 1, m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0]); // right
+    setPlane(this, 2, m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1]); // bottom
+    setPlane(this, 3, m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1]); // top
+    setPlane(this, 4, m[0][2],           m[1][2],           m[2][2],           m[3][2]);           // near
+    setPlane(this, 5, m[0][3] - m[0][2], m[1][3] - m[1][2], m[2][3] - m[2][2], m[3][3] - m[3][2]); // far
+}
+
+void Visibility_internal::setPlane(FrustumPlanes* planes, uint32_t plane, float a, float b, float c, float d)
+{
+    // Normalized so the distance can be compared directly with a radius
+    const float length = sqrtf(a * a + b * b + c * c);
+    const float inverseLength = length > 0.0f ? 1.0f / length : 0.0f;
+    planes->a[plane] = a * inverseLength;
+    planes->b[plane] = b * inverseLength;
+    planes->c[plane] = c * inverseLength;
+    planes->d[plane] = d * inverseLength;
+}
+
+#pragma endregion
+
+#pragma region BoundsStore
+
+uint32_t BoundsStore::Add(float x, float y, float z, float halfX, float halfY, float halfZ)
+{
+    if (m_count == PaddedCount())
+    {
+        const size_t paddedCount = PaddedCount() + BATCH_SIZE;
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        centerX.resize(paddedCount, nan);
+        centerY.resize(paddedCount, nan);
+        centerZ.resize(paddedCount, nan);
+        radius.resize(paddedCount, 0.0f);
+        extentX.resize(paddedCount, 0.0f);
+        extentY.resize(paddedCount, 0.0f);
+        extentZ.resize(paddedCount, 0.0f);
+    }
+    const uint32_t index = m_count++;
+    Set(index, x, y, z, halfX, halfY, halfZ);
+    return index;
+}
+
+void BoundsStore::Set(uint32_t index, float x, float y, float z, float halfX, float halfY, float halfZ)
+{
+    centerX[index] = x;
+    centerY[index] = y;
+    centerZ[index] = z;
+    radius[index] = sqrtf(halfX * halfX + halfY * halfY + halfZ * halfZ);
+    extentX[index] = halfX;
+    extentY[index] = halfY;
+    extentZ[index] = halfZ;
+}
+
+void BoundsStore::Clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+    m_count = 0;
+}
+
+#pragma endregion
+
+#pragma region Culling
+
+void CullSpheres(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    Visibility_internal::g_cullSpheres(planes, bounds, visible);
+}
+
+void CullBoxes(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    Visibility_internal::g_cullBoxes(planes, bounds, visible);
+}
+
+void SelectVisibilityKernels(SimdLevel level)
+{
+    using namespace Visibility_internal;
+    // Culling is bound by the loads, AVX-512 gains nothing over AVX2
+    if (level == SimdLevel::AVX2 || level == SimdLevel::AVX512)
+    {
+        g_cullSpheres = cullSpheresAVX2;
+        g_cullBoxes = cullBoxesAVX2;
+    } else {
+        g_cullSpheres = cullSpheresSSE;
+        g_cullBoxes = cullBoxesSSE;
+    }
+}
+
+uint32_t* Visibility_internal::prepareOutput(const BoundsStore& bounds, VisibleSet* visible)
+{
+    // Only grows, so steady state culling does not touch the heap
+    if (visible->indices.size() < bounds.PaddedCount())
+    {
+        visible->indices.resize(bounds.PaddedCount());
+    }
+    visible->count = 0;
+    return visible->indices.data();
+}
+
+void Visibility_internal::appendMask(uint32_t* out, uint32_t* count, uint32_t baseIndex, int mask, uint32_t width)
+{
+    // Branchless compaction: every lane is written, only visible ones advance
+    uint32_t n = *count;
+    for (uint32_t lane = 0; lane < width; ++lane)
+    {
+        out[n] = baseIndex + lane;
+        n += (mask >> lane) & 1;
+    }
+    *count = n;
+}
+
+namespace Visibility_internal
+{
+    // For every 8 bit visibility mask, the lane numbers of set bits packed
+    // into bytes, so a batch is compacted with a single permute and store.
+    struct CompactionTable
+    {
+        uint64_t lanes[256];
+
+        constexpr CompactionTable() : lanes()
+        {
+            for (uint32_t mask = 0; mask < 256; ++mask)
+            {
+                uint64_t packed = 0;
+                uint32_t count = 0;
+                for (uint32_t lane = 0; lane < 8; ++lane)
+                {
+                    if (mask & (1u << lane))
+                    {
+                        packed |= static_cast<uint64_t>(lane) << (8 * count++);
+                    }
+                }
+                lanes[mask] = packed;
+            }
+        }
+    };
+    static constexpr CompactionTable g_compactionTable;
+}
+
+VISIBILITY_TARGET("avx2,popcnt")
+void Visibility_internal::appendMask8(uint32_t* out, uint32_t* count, uint32_t baseIndex, int mask)
+{
+    const __m256i lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(static_cast<long long>(g_compactionTable.lanes[mask])));
+    const __m256i indices = _mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(baseIndex)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + *count), indices);
+    *count += static_cast<uint32_t>(_mm_popcnt_u32(static_cast<unsigned int>(mask)));
+}
+
+void Visibility_internal::cullSpheresSSE(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    uint32_t* out = Visibility_internal::prepareOutput(bounds, visible);
+    const __m128 zero = _mm_setzero_ps();
+    for (uint32_t i = 0; i < bounds.PaddedCount(); i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+        const __m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+        const __m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+        const __m128 r = _mm_loadu_ps(&bounds.radius[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (uint32_t p = 0; p < FrustumPlanes::PLANE_COUNT; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes.a[p])), _mm_set1_ps(planes.d[p]));
+            distance = _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(planes.b[p])), distance);
+            distance = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes.c[p])), distance);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+        }
+        Visibility_internal::appendMask(out, &visible->count, i, _mm_movemask_ps(inside), 4);
+    }
+}
+
+void Visibility_internal::cullBoxesSSE(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    uint32_t* out = Visibility_internal::prepareOutput(bounds, visible);
+    const __m128 zero = _mm_setzero_ps();
+    for (uint32_t i = 0; i < bounds.PaddedCount(); i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+        const __m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+        const __m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+        const __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        const __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        const __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (uint32_t p = 0; p < FrustumPlanes::PLANE_COUNT; ++p)
+        {
+            const float a = planes.a[p];
+            const float b = planes.b[p];
+            const float c = planes.c[p];
+            __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(a)), _mm_set1_ps(planes.d[p]));
+            distance = _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(b)), distance);
+            distance = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(c)), distance);
+            // Projected half extent of the box onto the plane normal
+            distance = _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(a))), distance);
+            distance = _mm_add_ps(_mm_mul_ps(ey, _mm_set1_ps(fabsf(b))), distance);
+            distance = _mm_add_ps(_mm_mul_ps(ez, _mm_set1_ps(fabsf(c))), distance);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+        }
+        Visibility_internal::appendMask(out, &visible->count, i, _mm_movemask_ps(inside), 4);
+    }
+}
+
+VISIBILITY_TARGET("avx2,fma,popcnt")
+void Visibility_internal::cullSpheresAVX2(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    uint32_t* out = Visibility_internal::prepareOutput(bounds, visible);
+    const __m256 zero = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < bounds.PaddedCount(); i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&bounds.centerX[i]);
+        const __m256 y = _mm256_loadu_ps(&bounds.centerY[i]);
+        const __m256 z = _mm256_loadu_ps(&bounds.centerZ[i]);
+        const __m256 r = _mm256_loadu_ps(&bounds.radius[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t p = 0; p < FrustumPlanes::PLANE_COUNT; ++p)
+        {
+            __m256 distance = _mm256_fmadd_ps(x, _mm256_set1_ps(planes.a[p]), _mm256_set1_ps(planes.d[p]));
+            distance = _mm256_fmadd_ps(y, _mm256_set1_ps(planes.b[p]), distance);
+            distance = _mm256_fmadd_ps(z, _mm256_set1_ps(planes.c[p]), distance);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), zero, _CMP_GE_OQ));
+        }
+        Visibility_internal::appendMask8(out, &visible->count, i, _mm256_movemask_ps(inside));
+    }
+}
+
+VISIBILITY_TARGET("avx2,fma,popcnt")
+void Visibility_internal::cullBoxesAVX2(const FrustumPlanes& planes, const BoundsStore& bounds, VisibleSet* visible)
+{
+    uint32_t* out = Visibility_internal::prepareOutput(bounds, visible);
+    const __m256 zero = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < bounds.PaddedCount(); i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&bounds.centerX[i]);
+        const __m256 y = _mm256_loadu_ps(&bounds.centerY[i]);
+        const __m256 z = _mm256_loadu_ps(&bounds.centerZ[i]);
+        const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+        const __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+        const __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t p = 0; p < FrustumPlanes::PLANE_COUNT; ++p)
+        {
+            const float a = planes.a[p];
+            const float b = planes.b[p];
+            const float c = planes.c[p];
+            __m256 distance = _mm256_fmadd_ps(x, _mm256_set1_ps(a), _mm256_set1_ps(planes.d[p]));
+            distance = _mm256_fmadd_ps(y, _mm256_set1_ps(b), distance);
+            distance = _mm256_fmadd_ps(z, _mm256_set1_ps(c), distance);
+            // Projected half extent of the box onto the plane normal
+            distance = _mm256_fmadd_ps(ex, _mm256_set1_ps(fabsf(a)), distance);
+            distance = _mm256_fmadd_ps(ey, _mm256_set1_ps(fabsf(b)), distance);
+            distance = _mm256_fmadd_ps(ez, _mm256_set1_ps(fabsf(c)), distance);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        }
+        Visibility_internal::appendMask8(out, &visible->count, i, _mm256_movemask_ps(inside));
+    }
+}
+
+#pragma endregion
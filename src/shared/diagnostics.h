@@ -6,6 +6,8 @@
 #include <windows.h>
 #include <stdio.h>
 
+#include "MemoryTracker.h"
+
 #ifdef DEBUG
 #define LOG(format, ...) LOG_PATH( __FILE__, __LINE__, format, ##__VA_ARGS__)
 #define CanLog() true
@@ -25,34 +27,44 @@ void SetupDiagnostics()
 {
 }
 
-wchar_t* _convertToUtf16(const char * utf8)
-{
-    int sizeNeeded = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, NULL, 0);
-    wchar_t* utf16 = (wchar_t*) malloc(sizeNeeded * sizeof(wchar_t));
-    MultiByteToWideChar(CP_UTF8, 0, utf8, -1, utf16, sizeNeeded);
-    return utf16;
-}
+// Lines up to this long are formatted on the stack, only longer ones
+// touch the heap, charged to MemoryTag::Logger
+#define LOG_BUFFER_SIZE 1024
 
 void _logFile(const char * file, unsigned int line)
 {
-    const char* format = "%s:%lu ";
-    int sizeNeeded = _scprintf(format, file, line) + 1;
-    char* buffer = (char*) malloc(sizeNeeded * sizeof(char));
-    _snprintf_s(buffer, sizeNeeded, sizeNeeded - 1, format, file, line);
+    char buffer[LOG_BUFFER_SIZE];
+    _snprintf_s(buffer, LOG_BUFFER_SIZE, _TRUNCATE, "%s:%lu ", file, line);
     OutputDebugStringA(buffer);
-    free(buffer);
+}
+
+void _logUtf8(const char * utf8)
+{
+    MEMORY_TAG(Logger);
+    wchar_t stackBuffer[LOG_BUFFER_SIZE];
+    int sizeNeeded = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, NULL, 0);
+    wchar_t* utf16 = sizeNeeded <= LOG_BUFFER_SIZE ? stackBuffer : new wchar_t[sizeNeeded];
+    MultiByteToWideChar(CP_UTF8, 0, utf8, -1, utf16, sizeNeeded);
+    OutputDebugStringW(utf16);
+    if (utf16 != stackBuffer)
+    {
+        delete[] utf16;
+    }
 }
 
 #define LOG_PATH(file, line, format, ...) \
     { \
         _logFile(file, line); \
+        char _logStackBuffer[LOG_BUFFER_SIZE]; \
         int sizeNeeded = _scprintf(format, ##__VA_ARGS__) + 1; \
-        char* buffer = (char*) malloc(sizeNeeded * sizeof(char)); \
+        MemoryTagScope _logMemoryTag(MemoryTag::Logger); \
+        char* buffer = sizeNeeded <= LOG_BUFFER_SIZE ? _logStackBuffer : new char[sizeNeeded]; \
         _snprintf_s(buffer, sizeNeeded, sizeNeeded - 1, format, ##__VA_ARGS__); \
-        wchar_t* output = _convertToUtf16(buffer); \
-        OutputDebugStringW(output); \
-        free(buffer); \
-        free(output); \
+        _logUtf8(buffer); \
+        if (buffer != _logStackBuffer) \
+        { \
+            delete[] buffer; \
+        } \
     }
 
 #endif
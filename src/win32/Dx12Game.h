@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <fstream>
+#include <unordered_map>
 
 #include <Windows.h>
 #include <d3d12.h>
@@ -14,24 +16,112 @@
 #include <dxgidebug.h>
 #endif
 
+#include "Archive.h"
+#include "Arena.h"
+#include "EventLoop.h"
 #include "Game.h"
+#include "HandlePool.h"
+#include "HeapCheck.h"
+#ifdef DEBUG
+#include "HotReload.h"
+#endif
+#include "MatrixBatch.h"
+#include "MemoryTracker.h"
+#include "Meshes.h"
+#include "Occlusion.h"
+#include "Particles.h"
+#include "PipelineCache.h"
+#include "PipelineStateStream.h"
+#include "RenderGraph.h"
+#include "SceneGraph.h"
+#include "ShaderLibrary.h"
+#include "Visibility.h"
 using Microsoft::WRL::ComPtr;
 
 #define AssertDx12(result) Dx12Game::_assertDx12(result, __FILE__, __LINE__)
 
+// GPU objects live in the renderer's HandlePools, everything else refers
+// to them by handle
+struct GpuBuffer
+{
+    ComPtr<ID3D12Resource>   resource;
+    // Charged to MemoryTag::Renderer until destroyed
+    uint64_t                 gpuBytes;
+};
+
+struct Mesh
+{
+    Handle<GpuBuffer>        vertexBuffer;
+    Handle<GpuBuffer>        indexBuffer;
+    D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW  indexBufferView;
+    UINT                     indexCount;
+};
+
+struct Pipeline
+{
+    ComPtr<ID3D12PipelineState> state;
+    // Of state in Dx12Game::m_pipelineStates and the pipeline library
+    uint64_t                    key;
+};
+
 class Dx12Game final
 {
 public:
     void Initialize(HWND windowHandle, UINT width, UINT height, Game* game);
     void Resize(UINT width, UINT height);
+    // Blocks until the GPU is done with the previous use of the back buffer
+    // unless IsFrameReady(), FrameReadyEvent() is set once it is
     void RenderAndWaitForVSync();
-    void ProcessTicks(uint64_t numberOfTicks);
+    void ProcessTicks(uint64_t numberOfTicks, uint64_t firstTickTime);
+    // Window procedure side of the game's input queue, false when dropped
+    bool QueueInput(const InputEvent& event);
+    bool IsFrameReady() const;
+    HANDLE FrameReadyEvent() const { return m_frameReadyEvent.Get(); }
+    // Minimized or covered, nothing needs to be rendered
+    bool IsOccluded();
 
 private:
     static constexpr UINT SWAP_BUFFER_COUNT = 2;
     // shader model defined in shaders/compile.bat
     static constexpr D3D_SHADER_MODEL SHADER_MODEL = D3D_SHADER_MODEL_6_0;
     static constexpr D3D_FEATURE_LEVEL FEATURE_LEVEL = D3D_FEATURE_LEVEL_11_0;
+    static constexpr const char* PIPELINE_CACHE_PATH = "pipelines.cache";
+    static constexpr const char* ASSET_ARCHIVE_PATH = "assets.pak";
+    static constexpr size_t FRAME_ARENA_CAPACITY = 1 << 20;
+    static constexpr uint32_t PARTICLE_CAPACITY = 1 << 20;
+    // Longest particle step, time lost while not rendering is not caught up
+    static constexpr float MAX_PARTICLE_SECONDS = 0.25f;
+    // Cubes on a grid around the camera, PROP_SPACING apart
+    static constexpr uint32_t PROP_GRID_SIDE = 24;
+    static constexpr float PROP_SPACING = 3.0f;
+#ifdef CULL_STATS
+    // How often the culling counters are logged, in EventLoop::Now() time
+    static constexpr uint64_t CULL_REPORT_NANOSECONDS = 1000000000ull;
+#endif
+#ifdef DEBUG
+    // Relative to the build directory the game runs in. The reloaded
+    // library is read from the tool's output, assets.pak is left alone.
+    static constexpr const char* SHADER_SOURCE_DIR = "..\\src\\shaders";
+    static constexpr const char* SHADER_BUILD_COMMAND = "..\\scripts\\bin\\shader_library.exe ..\\src\\shaders shaders debug";
+    static constexpr const char* RELOADED_SHADER_LIBRARY_PATH = "shaders\\shaders.lib";
+
+    struct ReloadedPipelines
+    {
+        ComPtr<ID3D12PipelineState> pipelineState;
+        ComPtr<ID3D12PipelineState> particlePipelineState;
+        uint64_t                    pipelineKey;
+        uint64_t                    particlePipelineKey;
+        double                      buildMilliseconds;
+        double                      pipelineMilliseconds;
+    };
+    struct RetiredPipelineState
+    {
+        ComPtr<ID3D12PipelineState> pipelineState;
+        // Released once the direct fence reaches it
+        UINT64                      fenceValue;
+    };
+#endif
 
     HWND                              m_outputWindowHandle;
     UINT                              m_outputWindowWidth;
@@ -46,48 +136,146 @@ private:
     ComPtr<ID3D12Fence>               m_directFence;
     UINT64                            m_directFenceValues[SWAP_BUFFER_COUNT];
     Microsoft::WRL::Wrappers::Event   m_directFenceEvent;
+    Microsoft::WRL::Wrappers::Event   m_frameReadyEvent;
+    // Reached when the back buffer can be recorded to again
+    UINT64                            m_frameReadyFenceValue = 0;
+    bool                              m_isOccluded = false;
     ComPtr<IDXGISwapChain3>           m_swapChain;
     ComPtr<ID3D12DescriptorHeap>      m_rtvDescriptorHeap;
     UINT                              m_rtvDescriptorSize;
     ComPtr<ID3D12Resource>            m_renderTargets[SWAP_BUFFER_COUNT];
     ComPtr<ID3D12DescriptorHeap>      m_dsvDescriptorHeap;
-    ComPtr<ID3D12Resource>            m_depthStencil;
     UINT                              m_backBufferIndex;
+    // Per back buffer, reset once the GPU is done with its previous frame
+    FrameArenas<SWAP_BUFFER_COUNT>    m_frameArenas{FRAME_ARENA_CAPACITY, MemoryTag::Renderer};
+    // GPU memory charged to MemoryTag::Renderer, given back when resized
+    uint64_t                          m_swapChainBytes = 0;
+    uint64_t                          m_transientHeapBytes = 0;
+
+    RenderGraph                       m_renderGraph;
+    RenderGraph::Resource             m_backBufferTexture;
+    RenderGraph::Resource             m_depthStencilTexture;
+    ComPtr<ID3D12Heap>                m_transientHeap;
+    // Indexed by RenderGraph::Resource, empty for imported textures
+    std::vector<ComPtr<ID3D12Resource>> m_transientTextures;
+    ResourceStateTracker              m_stateTracker;
+    std::vector<D3D12_RESOURCE_BARRIER> m_barrierBatch;
 
     ComPtr<ID3D12CommandQueue>        m_copyCommandQueue;
     ComPtr<ID3D12GraphicsCommandList> m_copyCommandList;
     ComPtr<ID3D12CommandAllocator>    m_copyCommandAllocator;
     ComPtr<ID3D12Fence>               m_copyFence;
     UINT64                            m_copyFenceValue;
+    // Upload buffers of copyToGPU, tracked until the copy queue is done
+    uint64_t                          m_pendingUploadBytes = 0;
+    uint32_t                          m_pendingUploadCount = 0;
     Microsoft::WRL::Wrappers::Event   m_copyFenceEvent;
 
-    ComPtr<ID3D12Resource>            m_vertexBuffer;
-    D3D12_VERTEX_BUFFER_VIEW          m_vertexBufferView;
-    ComPtr<ID3D12Resource>            m_indexBuffer;
-    D3D12_INDEX_BUFFER_VIEW           m_indexBufferView;
+    // Nothing is destroyed while frames using it may be in flight
+    HandlePool<GpuBuffer>             m_buffers;
+    HandlePool<Mesh>                  m_meshes;
+    HandlePool<Pipeline>              m_pipelines;
+    Handle<Mesh>                      m_cubeMesh;
+    Archive                           m_assets;
+    ShaderLibrary                     m_shaderLibrary;
     ComPtr<ID3D12RootSignature>       m_rootSignature;
-    ComPtr<ID3D12PipelineState>       m_pipelineState;
+    uint64_t                          m_rootSignatureHash;
+    // Keep their handles when the shaders are reloaded
+    Handle<Pipeline>                  m_mainPipeline;
+    Handle<Pipeline>                  m_particlePipeline;
+    PipelineCache                     m_pipelineCache;
+    ComPtr<ID3D12PipelineLibrary1>    m_pipelineLibrary;
+    std::unordered_map<uint64_t, ComPtr<ID3D12PipelineState>> m_pipelineStates;
+    UINT                              m_cachedPipelineCount = 0;
+    UINT                              m_compiledPipelineCount = 0;
+#ifdef DEBUG
+    // Bytecode the current pipelines use, only touched by the reload thread once it runs
+    uint64_t                          m_pipelineShaderHash;
+    std::vector<RetiredPipelineState> m_retiredPipelineStates;
+    HotReload<ReloadedPipelines>::Clock::time_point m_reloadChangedAt;
+    ReloadedPipelines                 m_reloadTimings;
+    // First frame drawn with reloaded pipelines, 0 when none is in flight
+    UINT64                            m_reloadFenceValue = 0;
+#endif
 
     D3D12_VIEWPORT                    m_viewport;
     D3D12_RECT                        m_scissorRect;
     float                             m_FoV;
-    DirectX::XMMATRIX                 m_modelMatrix;
     DirectX::XMMATRIX                 m_viewMatrix;
     DirectX::XMMATRIX                 m_projectionMatrix;
 
-    Game*                             m_game;
+    // Frustum and occlusion culled every frame, only the visible ones are
+    // drawn. The first _countof(g_walls) props are the walls, which are
+    // also the occluders. Placed by their own scene graph, children of one
+    // root, not by the game's: they are not simulated and recorded replays
+    // do not know about them.
+    SceneGraph                        m_propGraph;
+    uint32_t                          m_firstPropNode = 0;
+    BoundsStore                       m_propBounds;
+    VisibleSet                        m_visibleProps;
+    OcclusionCuller                   m_occlusionCuller;
+#ifdef CULL_STATS
+    uint64_t                          m_nextCullReport = 0;
+#endif
+    // In the frame arena, read by the main pass
+    const DirectX::XMFLOAT4X4*        m_visiblePropMVPs = nullptr;
+    UINT                              m_visiblePropCount = 0;
+
+    // Cosmetic, stepped once per frame by the tick time since the last
+    // frame, straight into the instance buffer of the back buffer
+    ParticleSystem                    m_particles;
+    float                             m_particleSeconds = 0.0f;
+    // Per back buffer, upload heap, mapped for as long as they live
+    Handle<GpuBuffer>                 m_particleInstanceBuffers[SWAP_BUFFER_COUNT];
+    ParticleInstance*                 m_particleInstances[SWAP_BUFFER_COUNT] = {};
+    UINT                              m_particleCount = 0;
+
+    Game*                             m_game = nullptr;
+
+#ifdef DEBUG
+    // Last, the reload thread stops before anything it uses goes away
+    HotReload<ReloadedPipelines>      m_shaderReload;
+#endif
 
     void createDeviceAndResolutionIndependentResources();
     void createOrResizeResolutionDependentResources();
+    void buildRenderGraph(DXGI_FORMAT depthBufferFormat);
+    void createTransientTextures(const D3D12_RESOURCE_DESC* descs, const D3D12_CLEAR_VALUE* clearValues);
+    ID3D12Resource* graphTexture(RenderGraph::Resource resource) const;
+    void issueGraphBarriers(const RenderGraph::Barrier* barriers, uint32_t count);
+    void flushBarriers();
+    void openPipelineLibrary(uint64_t deviceHash);
+    void savePipelineLibrary();
+    // Equal streams, by key, share one pipeline state object
+    ComPtr<ID3D12PipelineState> createPipelineState(uint64_t key, const D3D12_PIPELINE_STATE_STREAM_DESC& desc);
+    void storePipelineState(uint64_t key, ID3D12PipelineState* pipelineState);
+    // Pipelines of the main pass, key is set either way. Uncached ones do
+    // not touch the pipeline library, so they may be created on any thread.
+    ComPtr<ID3D12PipelineState> createMainPipelineState(const ShaderLibrary& shaders, bool isCached, uint64_t* key);
+    ComPtr<ID3D12PipelineState> createParticlePipelineState(const ShaderLibrary& shaders, bool isCached, uint64_t* key);
+#ifdef DEBUG
+    void startShaderReload();
+    bool rebuildShaders(ReloadedPipelines* reloaded);
+    void swapReloadedPipelines();
+    void replacePipelineState(Pipeline* pipeline, ComPtr<ID3D12PipelineState> pipelineState, uint64_t key, UINT64 lastSubmittedFenceValue);
+#endif
     
+    // Returns the upload buffer, which has to live until the copy is done
     ComPtr<ID3D12Resource>  copyToGPU(
-        ID3D12Resource** pDestinationResource,
+        GpuBuffer* destination,
         size_t size,
         const void* data
     );
+    void destroyBuffer(Handle<GpuBuffer> buffer);
+    void createParticleInstanceBuffers();
+    void createProps();
+    void cullProps(Arena* frameArena);
+    void occludeProps(const float viewProjection[4][4]);
+    const DirectX::XMFLOAT4X4& propWorld(uint32_t prop) const;
     void onDeviceLost();
 
     void moveToNextFrame();
+    void waitForFrame();
     void waitForAllGPUOperations();
     
 
@@ -95,33 +283,89 @@ private:
     static void _assertDx12(HRESULT result, const char *file, int line);
 };
 
+namespace Dx12Game_internal
+{
+    D3D12_RESOURCE_STATES resourceStates(ResourceState state)
+    {
+        // PRESENT and COMMON are both 0
+        D3D12_RESOURCE_STATES result = D3D12_RESOURCE_STATE_COMMON;
+        const struct { ResourceState state; D3D12_RESOURCE_STATES d3dState; } mapping[] = {
+            { ResourceState::RenderTarget,           D3D12_RESOURCE_STATE_RENDER_TARGET },
+            { ResourceState::DepthWrite,             D3D12_RESOURCE_STATE_DEPTH_WRITE },
+            { ResourceState::DepthRead,              D3D12_RESOURCE_STATE_DEPTH_READ },
+            { ResourceState::PixelShaderResource,    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE },
+            { ResourceState::NonPixelShaderResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE },
+            { ResourceState::UnorderedAccess,        D3D12_RESOURCE_STATE_UNORDERED_ACCESS },
+            { ResourceState::CopySource,             D3D12_RESOURCE_STATE_COPY_SOURCE },
+            { ResourceState::CopyDest,               D3D12_RESOURCE_STATE_COPY_DEST },
+        };
+        for (const auto& entry : mapping)
+        {
+            if ((state & entry.state) == entry.state)
+            {
+                result |= entry.d3dState;
+            }
+        }
+        return result;
+    }
+
+    // Bytecode the main pass pipelines are built from
+    uint64_t mainShaderHash(const ShaderLibrary& shaders)
+    {
+        const ShaderBytecode vertexShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::Vertex, 0>());
+        const ShaderBytecode pixelShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::Pixel, 0>());
+        const ShaderBytecode particleVertexShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::ParticleVertex, 0>());
+        return Hasher()
+            .AddU64(vertexShader.hash)
+            .AddU64(pixelShader.hash)
+            .AddU64(particleVertexShader.hash)
+            .Finish();
+    }
+
+    // Of a pipeline in the pipeline library
+    struct PipelineName
+    {
+        wchar_t text[17];
+
+        explicit PipelineName(uint64_t key)
+        {
+            swprintf_s(text, L"%016llx", static_cast<unsigned long long>(key));
+        }
+    };
+}
+
 #pragma region FakeData
 
-struct VertexShaderInput
-{
-    DirectX::XMFLOAT3 Position;
-    DirectX::XMFLOAT3 Color;
+// Layout of MeshVertex, matches the vertex shader input
+static constexpr D3D12_INPUT_ELEMENT_DESC g_meshInputLayout[] = {
+    { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "COLOR",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 };
-
-static VertexShaderInput g_cubeVertices[8] = {
-    { DirectX::XMFLOAT3(-1.0f, -1.0f, -1.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f) }, // 0
-    { DirectX::XMFLOAT3(-1.0f,  1.0f, -1.0f), DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f) }, // 1
-    { DirectX::XMFLOAT3(1.0f,  1.0f, -1.0f),  DirectX::XMFLOAT3(1.0f, 1.0f, 0.0f) }, // 2
-    { DirectX::XMFLOAT3(1.0f, -1.0f, -1.0f),  DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f) }, // 3
-    { DirectX::XMFLOAT3(-1.0f, -1.0f,  1.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f) }, // 4
-    { DirectX::XMFLOAT3(-1.0f,  1.0f,  1.0f), DirectX::XMFLOAT3(0.0f, 1.0f, 1.0f) }, // 5
-    { DirectX::XMFLOAT3(1.0f,  1.0f,  1.0f),  DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f) }, // 6
-    { DirectX::XMFLOAT3(1.0f, -1.0f,  1.0f),  DirectX::XMFLOAT3(1.0f, 0.0f, 1.0f) }  // 7
+// ParticleInstance, one per instance from slot 0
+static constexpr D3D12_INPUT_ELEMENT_DESC g_particleInputLayout[] = {
+    { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+    { "SIZE",     0, DXGI_FORMAT_R32_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+    { "COLOR",    0, DXGI_FORMAT_R8G8B8A8_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+};
+// Hashed once at startup for the pipeline keys
+static const uint64_t g_meshInputLayoutHash = HashInputLayout({ g_meshInputLayout, _countof(g_meshInputLayout) });
+static const uint64_t g_particleInputLayoutHash = HashInputLayout({ g_particleInputLayout, _countof(g_particleInputLayout) });
+
+// Baked at compile time, layout matches the vertex shader input
+static constexpr auto g_cube = MakeBox<1>(1.0f);
+
+// Props hiding the pillars behind them from the default camera
+static constexpr struct { float center[3]; float halfExtent[3]; } g_walls[] = {
+    { {  0.0f, 2.5f, -9.0f }, { 4.0f, 2.5f, 0.25f } },
+    { { -9.0f, 3.0f,  0.0f }, { 3.0f, 3.0f, 0.25f } },
+    { {  9.0f, 4.0f,  9.0f }, { 5.0f, 4.0f, 0.25f } },
 };
 
-static UINT16 g_cubeIndicies[36] =
-{
-    0, 1, 2, 0, 2, 3,
-    4, 6, 5, 4, 7, 6,
-    4, 5, 1, 4, 1, 0,
-    3, 2, 6, 3, 6, 7,
-    1, 5, 6, 1, 6, 2,
-    4, 0, 3, 4, 3, 7
+// Enough to keep about PARTICLE_CAPACITY particles alive
+static constexpr ParticleEmitter g_fountains[] = {
+    { { -4.0f, 0.0f, 0.0f }, { 0.0f, 9.0f, 0.0f }, 2.0f, 110000.0f, 3.0f, 0.05f, 0xFF40A0FFu },
+    { {  0.0f, 0.0f, 0.0f }, { 0.0f, 9.0f, 0.0f }, 2.0f, 110000.0f, 3.0f, 0.05f, 0xFFFF8040u },
+    { {  4.0f, 0.0f, 0.0f }, { 0.0f, 9.0f, 0.0f }, 2.0f, 110000.0f, 3.0f, 0.05f, 0xFF40FF80u },
 };
 
 #pragma endregion
@@ -134,13 +378,24 @@ void Dx12Game::Initialize(HWND windowHandle, UINT width, UINT height, Game* game
     m_outputWindowWidth = std::max(width, 1u);
     m_outputWindowHeight = std::max(height, 1u);
     m_game = game;
+    MEMORY_TAG(Renderer);
+    m_FoV = 45.0f;
+    m_viewMatrix = DirectX::XMMatrixLookAtLH(
+        DirectX::XMVectorSet(0.0f, 6.0f, -18.0f, 1.0f),
+        DirectX::XMVectorSet(0.0f, 4.0f, 0.0f, 1.0f),
+        DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)
+    );
 
     createDeviceAndResolutionIndependentResources();
     createOrResizeResolutionDependentResources();
+    #ifdef DEBUG
+    startShaderReload();
+    #endif
 }
 
 void Dx12Game::Resize(UINT width, UINT height)
 {
+    MEMORY_TAG(Renderer);
     waitForAllGPUOperations();
     m_outputWindowWidth = std::max(width, 1u);
     m_outputWindowHeight = std::max(height, 1u);
@@ -157,46 +412,39 @@ void Dx12Game::Resize(UINT width, UINT height)
     m_scissorRect.right = static_cast<LONG>(width);
     m_scissorRect.bottom = static_cast<LONG>(height);
 
+    m_projectionMatrix = DirectX::XMMatrixPerspectiveFovLH(
+        DirectX::XMConvertToRadians(m_FoV),
+        m_viewport.Width / m_viewport.Height,
+        0.1f,
+        100.0f
+    );
+
     createOrResizeResolutionDependentResources();
 }
 
 void Dx12Game::RenderAndWaitForVSync()
 {
+    #ifdef DEBUG
+    swapReloadedPipelines();
+    #endif
+    waitForFrame();
+    NO_HEAP_ALLOCATIONS("Dx12Game::RenderAndWaitForVSync");
+    MEMORY_TAG(Renderer);
     const UINT bufferIndex = this->m_backBufferIndex;
-    { // CLEAR
-        AssertDx12(m_directCommandAllocators[bufferIndex]->Reset());
-        AssertDx12(m_directCommandList->Reset(m_directCommandAllocators[bufferIndex].Get(), nullptr));
-        D3D12_RESOURCE_BARRIER barrier = {};
-        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        barrier.Transition.pResource = m_renderTargets[bufferIndex].Get();
-        barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        m_directCommandList->ResourceBarrier(1, &barrier);
-
-        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        rtvHandle.ptr += bufferIndex * m_rtvDescriptorSize;
-        D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        m_directCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
-        m_directCommandList->ClearRenderTargetView(rtvHandle, DirectX::Colors::MediumSeaGreen, 0, nullptr);
-        m_directCommandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
-
-        m_directCommandList->RSSetViewports(1, &m_viewport);
-        m_directCommandList->RSSetScissorRects(1, &m_scissorRect);
-    }
-    // TODO: LOGIC HERE!
+    Arena& frameArena = m_frameArenas.BeginFrame(bufferIndex);
+    cullProps(&frameArena);
+    // The GPU is done with the back buffer's instances as well
+    m_particleCount = m_particles.Update(m_game->jobs, std::min(m_particleSeconds, MAX_PARTICLE_SECONDS), m_particleInstances[bufferIndex]);
+    m_particleSeconds = 0.0f;
+    AssertDx12(m_directCommandAllocators[bufferIndex]->Reset());
+    AssertDx12(m_directCommandList->Reset(m_directCommandAllocators[bufferIndex].Get(), nullptr));
+
+    m_renderGraph.Execute([this](const RenderGraph::Barrier* barriers, uint32_t count)
+    {
+        issueGraphBarriers(barriers, count);
+    });
 
     { // PRESENT
-        D3D12_RESOURCE_BARRIER barrier = {};
-        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        barrier.Transition.pResource = m_renderTargets[bufferIndex].Get();
-        barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        m_directCommandList->ResourceBarrier(1, &barrier);
-
         AssertDx12(m_directCommandList->Close());
         m_directCommandQueue->ExecuteCommandLists(1, reinterpret_cast<ID3D12CommandList* const *>(m_directCommandList.GetAddressOf()));
         HRESULT result = m_swapChain->Present(1, 0);
@@ -205,14 +453,37 @@ void Dx12Game::RenderAndWaitForVSync()
             onDeviceLost();
         } else {
             AssertDx12(result);
+            m_isOccluded = result == DXGI_STATUS_OCCLUDED;
             moveToNextFrame();
         }
     }
 }
 
-void Dx12Game::ProcessTicks(uint64_t numberOfTicks)
+void Dx12Game::ProcessTicks(uint64_t numberOfTicks, uint64_t firstTickTime)
+{
+    m_game->ProcessTicks(numberOfTicks, firstTickTime);
+    m_particleSeconds += static_cast<float>(numberOfTicks) * Game::TICK_SECONDS;
+}
+
+bool Dx12Game::QueueInput(const InputEvent& event)
+{
+    // Messages arrive while the window is created, before Initialize
+    return m_game && m_game->input.Push(event);
+}
+
+bool Dx12Game::IsFrameReady() const
+{
+    return m_directFence->GetCompletedValue() >= m_frameReadyFenceValue;
+}
+
+bool Dx12Game::IsOccluded()
 {
-    m_game->ProcessTicks(numberOfTicks);
+    if (m_isOccluded)
+    {
+        // Asks without presenting anything
+        m_isOccluded = m_swapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED;
+    }
+    return m_isOccluded;
 }
 
 #pragma endregion
@@ -221,6 +492,13 @@ void Dx12Game::ProcessTicks(uint64_t numberOfTicks)
 
 void Dx12Game::createDeviceAndResolutionIndependentResources()
 {
+    { // Assets
+        if (!m_assets.Open(ASSET_ARCHIVE_PATH))
+        {
+            LOG("Unable to open %s\n", ASSET_ARCHIVE_PATH);
+            exit(1);
+        }
+    }
     { // Factory
         DWORD createFactoryFlags = 0;
         #ifdef GPU_DEBUG
@@ -286,6 +564,18 @@ void Dx12Game::createDeviceAndResolutionIndependentResources()
         }
         #endif
         AssertDx12(device.As(&m_device));
+
+        // Compiled pipelines are only valid for the same adapter and driver
+        LARGE_INTEGER driverVersion = {};
+        adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+        openPipelineLibrary(Hasher()
+            .AddU64(adapterDesc.VendorId)
+            .AddU64(adapterDesc.DeviceId)
+            .AddU64(adapterDesc.SubSysId)
+            .AddU64(adapterDesc.Revision)
+            .AddU64(static_cast<uint64_t>(driverVersion.QuadPart))
+            .Finish()
+        );
     }
     { // Direct Command Queue, Allocators, List & Fences
         D3D12_COMMAND_QUEUE_DESC directCommandQueueDesc = {};
@@ -334,6 +624,13 @@ void Dx12Game::createDeviceAndResolutionIndependentResources()
             LOG("Unable to create direct fence event\n");
             exit(1);
         }
+        // Separate, waitForAllGPUOperations must not be woken up by it
+        m_frameReadyEvent.Attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
+        if (!m_frameReadyEvent.IsValid())
+        {
+            LOG("Unable to create frame ready event\n");
+            exit(1);
+        }
     }
     { // RTV Descriptor Heap & Allocators
         D3D12_DESCRIPTOR_HEAP_DESC rtvDescriptorHeapDesc = {};
@@ -408,52 +705,59 @@ void Dx12Game::createDeviceAndResolutionIndependentResources()
             LOG("No support for directX math!\n");
             exit(1);
         }
+        const SimdLevel simdLevel = DetectSimdLevel();
+        SelectMatrixBatchKernels(simdLevel);
+        SelectPhysicsKernels(simdLevel);
+        SelectParticleKernels(simdLevel);
+        SelectVisibilityKernels(simdLevel);
+        LOG("Using %s matrix kernels\n", SimdLevelName(simdLevel));
     }
     // Load static content
     { // Load cube vertices
-        constexpr size_t cubeVerticesBufferSize = sizeof(g_cubeVertices);
+        Mesh cube = {};
+        GpuBuffer vertexBuffer = {};
+        constexpr size_t cubeVerticesBufferSize = sizeof(g_cube.vertices);
         ComPtr<ID3D12Resource> cubeVerticesIntermediateBuffer = copyToGPU(
-            m_vertexBuffer.ReleaseAndGetAddressOf(),
+            &vertexBuffer,
             cubeVerticesBufferSize,
-            g_cubeVertices
+            g_cube.vertices.data()
         );
-        m_vertexBufferView.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
-        m_vertexBufferView.SizeInBytes = cubeVerticesBufferSize;
-        m_vertexBufferView.StrideInBytes = sizeof(VertexShaderInput);
+        cube.vertexBufferView.BufferLocation = vertexBuffer.resource->GetGPUVirtualAddress();
+        cube.vertexBufferView.SizeInBytes = cubeVerticesBufferSize;
+        cube.vertexBufferView.StrideInBytes = sizeof(MeshVertex);
+        cube.vertexBuffer = m_buffers.Create(std::move(vertexBuffer));
         
-        constexpr size_t cubeIndiciesBufferSize = sizeof(g_cubeIndicies);
+        GpuBuffer indexBuffer = {};
+        constexpr size_t cubeIndiciesBufferSize = sizeof(g_cube.indices);
         ComPtr<ID3D12Resource> cubeIndiciesIntermediateBuffer = copyToGPU(
-            m_indexBuffer.ReleaseAndGetAddressOf(),
+            &indexBuffer,
             cubeIndiciesBufferSize,
-            g_cubeIndicies
+            g_cube.indices.data()
         );
-        m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
-        m_indexBufferView.SizeInBytes = cubeIndiciesBufferSize;
-        m_indexBufferView.Format = DXGI_FORMAT_R16_UINT;
-
-        ComPtr<ID3DBlob> vertexShaderBlob;
-        AssertDx12(D3DReadFileToBlob(L"shaders\\VertexShader.cso", vertexShaderBlob.ReleaseAndGetAddressOf()));
-
-        ComPtr<ID3DBlob> pixelShaderBlob;
-        AssertDx12(D3DReadFileToBlob(L"shaders\\PixelShader.cso", pixelShaderBlob.ReleaseAndGetAddressOf()));
-
-        D3D12_INPUT_ELEMENT_DESC inputLayout[2];
-        inputLayout[0].SemanticName = "POSITION";
-        inputLayout[0].SemanticIndex = 0;
-        inputLayout[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-        inputLayout[0].InputSlot = 0;
-        inputLayout[0].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
-        inputLayout[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-        inputLayout[0].InstanceDataStepRate = 0;
-
-        inputLayout[1].SemanticName = "COLOR";
-        inputLayout[1].SemanticIndex = 0;
-        inputLayout[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-        inputLayout[1].InputSlot = 0;
-        inputLayout[1].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
-        inputLayout[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-        inputLayout[1].InstanceDataStepRate = 0;
-
+        cube.indexBufferView.BufferLocation = indexBuffer.resource->GetGPUVirtualAddress();
+        cube.indexBufferView.SizeInBytes = cubeIndiciesBufferSize;
+        cube.indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+        cube.indexBuffer = m_buffers.Create(std::move(indexBuffer));
+        cube.indexCount = static_cast<UINT>(g_cube.indices.size());
+        m_cubeMesh = m_meshes.Create(cube);
+
+        LARGE_INTEGER pipelinesStart;
+        QueryPerformanceCounter(&pipelinesStart);
+
+        // Shaders are used in place from the mapped archive
+        const uint32_t shaderLibraryEntry = m_assets.Find("shaders.lib");
+        if (shaderLibraryEntry == Archive::NOT_FOUND || m_assets.IsCompressed(shaderLibraryEntry))
+        {
+            LOG("Missing uncompressed shaders.lib in %s\n", ASSET_ARCHIVE_PATH);
+            exit(1);
+        }
+        m_assets.Prefetch(shaderLibraryEntry);
+        const ArchiveSpan shaderLibrary = m_assets.Span(shaderLibraryEntry);
+        if (!m_shaderLibrary.Load(shaderLibrary.data, shaderLibrary.size))
+        {
+            LOG("Unable to load shaders.lib from %s\n", ASSET_ARCHIVE_PATH);
+            exit(1);
+        }
         D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
             D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
             D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
@@ -518,75 +822,203 @@ void Dx12Game::createDeviceAndResolutionIndependentResources()
             IID_PPV_ARGS(m_rootSignature.ReleaseAndGetAddressOf())
         ));
         
-        struct alignas(void*) PipelineStateStream
+        m_rootSignatureHash = HashBytes(rootSignatureBlob->GetBufferPointer(), rootSignatureBlob->GetBufferSize());
+        uint64_t pipelineKey;
+        ComPtr<ID3D12PipelineState> pipelineState = createMainPipelineState(m_shaderLibrary, true, &pipelineKey);
+        m_mainPipeline = m_pipelines.Create(std::move(pipelineState), pipelineKey);
+        pipelineState = createParticlePipelineState(m_shaderLibrary, true, &pipelineKey);
+        m_particlePipeline = m_pipelines.Create(std::move(pipelineState), pipelineKey);
+        #ifdef DEBUG
+        m_pipelineShaderHash = Dx12Game_internal::mainShaderHash(m_shaderLibrary);
+        #endif
+        savePipelineLibrary();
         {
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE pRootSignatureType; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE
-            ID3D12RootSignature* pRootSignature;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE InputLayoutType; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_INPUT_LAYOUT
-            D3D12_INPUT_LAYOUT_DESC InputLayout;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE PrimitiveTopologyTypeType; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY
-            D3D12_PRIMITIVE_TOPOLOGY_TYPE PrimitiveTopologyType;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE VS_Type; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VS
-            D3D12_SHADER_BYTECODE VS;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE PS_Type; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS
-            D3D12_SHADER_BYTECODE PS;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE DSVFormat_Type; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT
-            DXGI_FORMAT DSVFormat;
-
-            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE RTVFormats_Type; // D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS
-            D3D12_RT_FORMAT_ARRAY RTVFormats;
-        } pipelineStateStream;
-
-        pipelineStateStream.pRootSignatureType = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE;
-        pipelineStateStream.pRootSignature = m_rootSignature.Get();
+            LARGE_INTEGER pipelinesEnd;
+            LARGE_INTEGER frequency;
+            QueryPerformanceCounter(&pipelinesEnd);
+            QueryPerformanceFrequency(&frequency);
+            LOG("Pipelines ready in %.2f ms, %u from cache, %u compiled\n",
+                1000.0 * static_cast<double>(pipelinesEnd.QuadPart - pipelinesStart.QuadPart) / static_cast<double>(frequency.QuadPart),
+                m_cachedPipelineCount,
+                m_compiledPipelineCount
+            );
+        }
+        m_copyFenceValue++;
+        m_copyCommandQueue->Signal(m_copyFence.Get(), m_copyFenceValue);
 
-        pipelineStateStream.InputLayoutType = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_INPUT_LAYOUT;
-        pipelineStateStream.InputLayout.pInputElementDescs = inputLayout;
-        pipelineStateStream.InputLayout.NumElements = _countof(inputLayout);
+        if (m_copyFence->GetCompletedValue() < m_copyFenceValue) 
+        {
+            m_copyFence->SetEventOnCompletion(m_copyFenceValue, m_copyFenceEvent.Get());
+            ::WaitForSingleObject(m_copyFenceEvent.Get(), INFINITE);
+        }
+        // The upload buffers go with this scope
+        TrackFree(MemoryTag::Renderer, MemorySource::Gpu, m_pendingUploadBytes, m_pendingUploadCount);
+        m_pendingUploadBytes = 0;
+        m_pendingUploadCount = 0;
+    }
+    { // Props
+        createProps();
+    }
+    { // Particles
+        createParticleInstanceBuffers();
+        m_particles.Reset(PARTICLE_CAPACITY, 0);
+        for (const ParticleEmitter& fountain : g_fountains)
+        {
+            m_particles.AddEmitter(fountain);
+        }
+    }
+}
 
-        pipelineStateStream.PrimitiveTopologyTypeType = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY;
-        pipelineStateStream.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+void Dx12Game::createParticleInstanceBuffers()
+{
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
 
-        pipelineStateStream.VS_Type = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VS;
-        pipelineStateStream.VS.pShaderBytecode = vertexShaderBlob->GetBufferPointer();
-        pipelineStateStream.VS.BytecodeLength = vertexShaderBlob->GetBufferSize();
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = static_cast<UINT64>(PARTICLE_CAPACITY) * sizeof(ParticleInstance);
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    const UINT64 allocationSize = m_device->GetResourceAllocationInfo(0, 1, &resourceDesc).SizeInBytes;
 
-        pipelineStateStream.PS_Type = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS;
-        pipelineStateStream.PS.pShaderBytecode = pixelShaderBlob->GetBufferPointer();
-        pipelineStateStream.PS.BytecodeLength = pixelShaderBlob->GetBufferSize();
+    for (UINT i = 0; i < SWAP_BUFFER_COUNT; ++i)
+    {
+        GpuBuffer instanceBuffer = {};
+        AssertDx12(m_device->CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &resourceDesc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(instanceBuffer.resource.ReleaseAndGetAddressOf())
+        ));
+        // Never read on the CPU, the memory is write combined
+        const D3D12_RANGE noRead = { 0, 0 };
+        AssertDx12(instanceBuffer.resource->Map(0, &noRead, reinterpret_cast<void**>(&m_particleInstances[i])));
+        instanceBuffer.gpuBytes = allocationSize;
+        TrackAllocation(MemoryTag::Renderer, MemorySource::Gpu, allocationSize);
+        m_particleInstanceBuffers[i] = m_buffers.Create(std::move(instanceBuffer));
+    }
+}
 
-        pipelineStateStream.DSVFormat_Type = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT;
-        pipelineStateStream.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+void Dx12Game::createProps()
+{
+    const DirectX::XMFLOAT4 noRotation(0.0f, 0.0f, 0.0f, 1.0f);
+    m_propGraph = SceneGraph();
+    m_propBounds.Clear();
+    const uint32_t root = m_propGraph.AddNode(SceneGraph::NO_PARENT, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), noRotation, DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f));
+    m_firstPropNode = root + 1;
+    for (const auto& wall : g_walls)
+    {
+        m_propGraph.AddNode(
+            root,
+            DirectX::XMFLOAT3(wall.center[0], wall.center[1], wall.center[2]),
+            noRotation,
+            DirectX::XMFLOAT3(wall.halfExtent[0], wall.halfExtent[1], wall.halfExtent[2])
+        );
+        m_propBounds.Add(wall.center[0], wall.center[1], wall.center[2], wall.halfExtent[0], wall.halfExtent[1], wall.halfExtent[2]);
+    }
+    const float gridOffset = 0.5f * PROP_SPACING * static_cast<float>(PROP_GRID_SIDE - 1);
+    for (uint32_t row = 0; row < PROP_GRID_SIDE; ++row)
+    {
+        for (uint32_t column = 0; column < PROP_GRID_SIDE; ++column)
+        {
+            // g_cube has half extent 1, scaled into a pillar standing on y = 0
+            const float halfWidth = 0.5f;
+            const float halfHeight = 0.5f + 0.5f * static_cast<float>((row * 7 + column * 3) % 4);
+            const float x = static_cast<float>(column) * PROP_SPACING - gridOffset;
+            const float z = static_cast<float>(row) * PROP_SPACING - gridOffset;
+            m_propGraph.AddNode(root, DirectX::XMFLOAT3(x, halfHeight, z), noRotation, DirectX::XMFLOAT3(halfWidth, halfHeight, halfWidth));
+            m_propBounds.Add(x, halfHeight, z, halfWidth, halfHeight, halfWidth);
+        }
+    }
+    m_propGraph.UpdateWorldMatrices();
+    // Culling grows its buffers once here, not in the first frames
+    m_visibleProps.indices.resize(m_propBounds.PaddedCount());
+    m_occlusionCuller.Reserve(
+        _countof(g_walls) * static_cast<uint32_t>(g_cube.indices.size() / 3),
+        m_propBounds.Count()
+    );
+}
 
-        pipelineStateStream.RTVFormats_Type = D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS;
-        D3D12_RT_FORMAT_ARRAY rtvFormats = {};
-        rtvFormats.NumRenderTargets = 1;
-        rtvFormats.RTFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-        pipelineStateStream.RTVFormats = rtvFormats;
+void Dx12Game::occludeProps(const float viewProjection[4][4])
+{
+    m_occlusionCuller.BeginFrame(viewProjection);
+    for (uint32_t wall = 0; wall < _countof(g_walls); ++wall)
+    {
+        m_occlusionCuller.AddOccluder(g_cube.vertices.data(), sizeof(MeshVertex), g_cube.indices.data(), static_cast<uint32_t>(g_cube.indices.size()), propWorld(wall).m);
+    }
+    m_occlusionCuller.Cull(m_game->jobs, m_propBounds, &m_visibleProps);
+}
 
-        D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {};
-        pipelineStateStreamDesc.SizeInBytes = sizeof(PipelineStateStream);
-        pipelineStateStreamDesc.pPipelineStateSubobjectStream = &pipelineStateStream;
+const DirectX::XMFLOAT4X4& Dx12Game::propWorld(uint32_t prop) const
+{
+    return m_propGraph.WorldMatrices()[m_propGraph.SlotOf(m_firstPropNode + prop)];
+}
 
-        AssertDx12(m_device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(m_pipelineState.ReleaseAndGetAddressOf())));
-        m_copyFenceValue++;
-        m_copyCommandQueue->Signal(m_copyFence.Get(), m_copyFenceValue);
+void Dx12Game::cullProps(Arena* frameArena)
+{
+    // Only recomputes props moved since the last frame, none so far
+    m_propGraph.UpdateWorldMatrices();
+    DirectX::XMFLOAT4X4 view;
+    DirectX::XMFLOAT4X4 projection;
+    DirectX::XMFLOAT4X4 viewProjection;
+    DirectX::XMStoreFloat4x4(&view, m_viewMatrix);
+    DirectX::XMStoreFloat4x4(&projection, m_projectionMatrix);
+    DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(m_viewMatrix, m_projectionMatrix));
+    FrustumPlanes planes;
+    planes.ExtractFrom(viewProjection.m);
+    CullBoxes(planes, m_propBounds, &m_visibleProps);
+
+    occludeProps(viewProjection.m);
+#ifdef CULL_STATS
+    const uint64_t now = EventLoop::Now();
+    if (now >= m_nextCullReport)
+    {
+        m_nextCullReport = now + CULL_REPORT_NANOSECONDS;
+        const OcclusionStats& stats = m_occlusionCuller.Stats();
+        LOG("Props: %u of %u in the frustum, %u occluded by %u triangles (%u crossing the near plane)\n",
+            stats.testedObjects,
+            m_propBounds.Count(),
+            stats.culledObjects,
+            stats.occluderTriangles,
+            stats.rejectedTriangles
+        );
+    }
+#endif
 
-        if (m_copyFence->GetCompletedValue() < m_copyFenceValue) 
-        {
-            m_copyFence->SetEventOnCompletion(m_copyFenceValue, m_copyFenceEvent.Get());
-            ::WaitForSingleObject(m_copyFenceEvent.Get(), INFINITE);
-        }
+    // Gathered so the batch only multiplies what is drawn
+    const uint32_t count = m_visibleProps.count;
+    DirectX::XMFLOAT4X4* worlds = frameArena->AllocateArray<DirectX::XMFLOAT4X4>(count);
+    DirectX::XMFLOAT4X4* modelViewProjections = frameArena->AllocateArray<DirectX::XMFLOAT4X4>(count);
+    m_visiblePropMVPs = modelViewProjections;
+    m_visiblePropCount = 0;
+    if (!worlds || !modelViewProjections)
+    {
+        LOG("Frame arena is full, %u props are not drawn\n", count);
+        return;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        worlds[i] = propWorld(m_visibleProps.indices[i]);
     }
+    ComputeModelViewProjections(worlds, count, view, projection, modelViewProjections);
+    m_visiblePropCount = count;
 }
 
 ComPtr<ID3D12Resource>  Dx12Game::copyToGPU(
-    ID3D12Resource** pDestinationBuffer,
+    GpuBuffer* destination,
     size_t bufferSize,
     const void* data)
 {
@@ -616,7 +1048,7 @@ ComPtr<ID3D12Resource>  Dx12Game::copyToGPU(
         &resourceDesc,
         D3D12_RESOURCE_STATE_COMMON,
         nullptr,
-        IID_PPV_ARGS(pDestinationBuffer)
+        IID_PPV_ARGS(destination->resource.ReleaseAndGetAddressOf())
     ));
 
 
@@ -631,6 +1063,12 @@ ComPtr<ID3D12Resource>  Dx12Game::copyToGPU(
         nullptr,
         IID_PPV_ARGS(intermidiateBuffer.ReleaseAndGetAddressOf())
     ));
+    // Destination and upload buffer, the same size
+    const UINT64 allocationSize = m_device->GetResourceAllocationInfo(0, 1, &resourceDesc).SizeInBytes;
+    TrackAllocation(MemoryTag::Renderer, MemorySource::Gpu, 2 * allocationSize, 2);
+    destination->gpuBytes = allocationSize;
+    m_pendingUploadBytes += allocationSize;
+    ++m_pendingUploadCount;
     D3D12_SUBRESOURCE_DATA subresourceData = {};
     subresourceData.pData = data;
     subresourceData.RowPitch = bufferSize;
@@ -667,20 +1105,33 @@ ComPtr<ID3D12Resource>  Dx12Game::copyToGPU(
     }
     intermidiateBuffer->Unmap(0, NULL);
     m_copyCommandList->CopyBufferRegion(
-        *pDestinationBuffer, 0, 
+        destination->resource.Get(), 0, 
         intermidiateBuffer.Get(), resourceLayout.Offset, 
         resourceLayout.Footprint.Width
     );
     return intermidiateBuffer;
 }
 
+void Dx12Game::destroyBuffer(Handle<GpuBuffer> buffer)
+{
+    const GpuBuffer* destroyed = m_buffers.Get(buffer);
+    if (destroyed)
+    {
+        TrackFree(MemoryTag::Renderer, MemorySource::Gpu, destroyed->gpuBytes);
+        m_buffers.Destroy(buffer);
+    }
+}
+
 void Dx12Game::createOrResizeResolutionDependentResources()
 {
     for (UINT i = 0; i < SWAP_BUFFER_COUNT; ++i)
     {
+        m_stateTracker.Unregister(m_renderTargets[i].Get());
         m_renderTargets[i].Reset();
         m_directFenceValues[i] = m_directFenceValues[m_backBufferIndex];
     }
+    TrackFree(MemoryTag::Renderer, MemorySource::Gpu, m_swapChainBytes, m_swapChainBytes ? SWAP_BUFFER_COUNT : 0);
+    m_swapChainBytes = 0;
 
     // TODO: make sure that rtv has format DXGI_FORMAT_R8G8B8A8_UNORM
     constexpr DXGI_FORMAT backBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -739,19 +1190,32 @@ void Dx12Game::createOrResizeResolutionDependentResources()
             m_renderTargets[i]->SetName(name);
             #endif
             m_device->CreateRenderTargetView(m_renderTargets[i].Get(), nullptr, cpuHandle);
+            m_stateTracker.Register(m_renderTargets[i].Get(), 1, ResourceState::Present);
             cpuHandle.ptr += m_rtvDescriptorSize;
         }
         m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
     }
+    { // Memory of the back buffers, all alike
+        const D3D12_RESOURCE_DESC backBufferDesc = m_renderTargets[0]->GetDesc();
+        m_swapChainBytes = m_device->GetResourceAllocationInfo(0, 1, &backBufferDesc).SizeInBytes * SWAP_BUFFER_COUNT;
+        TrackAllocation(MemoryTag::Renderer, MemorySource::Gpu, m_swapChainBytes, SWAP_BUFFER_COUNT);
+    }
 
-    { // DSV
-        D3D12_HEAP_PROPERTIES depthHeapProperties = {};
-        depthHeapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
-        depthHeapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-        depthHeapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-        depthHeapProperties.CreationNodeMask = 1;
-        depthHeapProperties.VisibleNodeMask = 1;
+    buildRenderGraph(depthBufferFormat);
+}
+
+void Dx12Game::buildRenderGraph(DXGI_FORMAT depthBufferFormat)
+{
+    m_renderGraph.Reset();
+    // Creation parameters of graph textures, indexed by RenderGraph::Resource
+    std::vector<D3D12_RESOURCE_DESC> textureDescs;
+    std::vector<D3D12_CLEAR_VALUE> clearValues;
 
+    m_backBufferTexture = m_renderGraph.ImportTexture("Back buffer", ResourceState::Present, ResourceState::Present);
+    textureDescs.push_back({});
+    clearValues.push_back({});
+
+    { // Depth stencil
         D3D12_RESOURCE_DESC depthStencilDesc = {};
         depthStencilDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
         depthStencilDesc.Alignment = 0;
@@ -770,17 +1234,80 @@ void Dx12Game::createOrResizeResolutionDependentResources()
         depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
         depthOptimizedClearValue.DepthStencil.Stencil = 0u;
 
-        AssertDx12(m_device->CreateCommittedResource(
-            &depthHeapProperties,
-            D3D12_HEAP_FLAG_NONE,
-            &depthStencilDesc,
-            D3D12_RESOURCE_STATE_DEPTH_WRITE,
-            &depthOptimizedClearValue,
-            IID_PPV_ARGS(m_depthStencil.ReleaseAndGetAddressOf())
-        ));
-        #ifdef GPU_DEBUG
-        m_depthStencil->SetName(L"Depth stencil");
-        #endif
+        const D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = m_device->GetResourceAllocationInfo(0, 1, &depthStencilDesc);
+        m_depthStencilTexture = m_renderGraph.CreateTexture("Depth stencil", {
+            m_outputWindowWidth,
+            m_outputWindowHeight,
+            static_cast<uint32_t>(depthBufferFormat),
+            allocationInfo.SizeInBytes,
+            allocationInfo.Alignment
+        });
+        textureDescs.push_back(depthStencilDesc);
+        clearValues.push_back(depthOptimizedClearValue);
+    }
+
+    { // Main pass
+        const uint32_t mainPass = m_renderGraph.AddPass("Main", [this]
+        {
+            D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+            rtvHandle.ptr += m_backBufferIndex * m_rtvDescriptorSize;
+            D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+            m_directCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
+            m_directCommandList->ClearRenderTargetView(rtvHandle, DirectX::Colors::MediumSeaGreen, 0, nullptr);
+            m_directCommandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+            m_directCommandList->RSSetViewports(1, &m_viewport);
+            m_directCommandList->RSSetScissorRects(1, &m_scissorRect);
+
+            // TODO: LOGIC HERE!
+
+            if (m_visiblePropCount)
+            {
+                const Mesh* cube = m_meshes.Get(m_cubeMesh);
+                m_directCommandList->SetGraphicsRootSignature(m_rootSignature.Get());
+                m_directCommandList->SetPipelineState(m_pipelines.Get(m_mainPipeline)->state.Get());
+                m_directCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                m_directCommandList->IASetVertexBuffers(0, 1, &cube->vertexBufferView);
+                m_directCommandList->IASetIndexBuffer(&cube->indexBufferView);
+                for (UINT prop = 0; prop < m_visiblePropCount; ++prop)
+                {
+                    m_directCommandList->SetGraphicsRoot32BitConstants(0, sizeof(DirectX::XMFLOAT4X4) / 4, &m_visiblePropMVPs[prop], 0);
+                    m_directCommandList->DrawIndexedInstanced(cube->indexCount, 1, 0, 0, 0);
+                }
+            }
+
+            if (m_particleCount)
+            {
+                const DirectX::XMMATRIX viewProjection = DirectX::XMMatrixMultiply(m_viewMatrix, m_projectionMatrix);
+                D3D12_VERTEX_BUFFER_VIEW instanceBufferView;
+                instanceBufferView.BufferLocation = m_buffers.Get(m_particleInstanceBuffers[m_backBufferIndex])->resource->GetGPUVirtualAddress();
+                instanceBufferView.SizeInBytes = m_particleCount * sizeof(ParticleInstance);
+                instanceBufferView.StrideInBytes = sizeof(ParticleInstance);
+                m_directCommandList->SetGraphicsRootSignature(m_rootSignature.Get());
+                m_directCommandList->SetPipelineState(m_pipelines.Get(m_particlePipeline)->state.Get());
+                m_directCommandList->SetGraphicsRoot32BitConstants(0, sizeof(DirectX::XMMATRIX) / 4, &viewProjection, 0);
+                m_directCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+                m_directCommandList->IASetVertexBuffers(0, 1, &instanceBufferView);
+                // A camera facing quad per particle
+                m_directCommandList->DrawInstanced(4, m_particleCount, 0, 0);
+            }
+        });
+        m_renderGraph.Write(mainPass, m_backBufferTexture, ResourceState::RenderTarget);
+        m_renderGraph.Write(mainPass, m_depthStencilTexture, ResourceState::DepthWrite);
+    }
+
+    m_renderGraph.Compile();
+    createTransientTextures(textureDescs.data(), clearValues.data());
+    // flushBarriers runs where nothing may allocate. A transition of a
+    // texture whose subresources disagree takes one barrier for each.
+    uint32_t maxSubresourceCount = 1;
+    for (const D3D12_RESOURCE_DESC& desc : textureDescs)
+    {
+        maxSubresourceCount = std::max<uint32_t>(maxSubresourceCount, desc.MipLevels * desc.DepthOrArraySize);
+    }
+    m_barrierBatch.reserve(m_renderGraph.BarrierCount() * maxSubresourceCount);
+
+    { // DSV
         D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
         dsvDesc.Format = depthBufferFormat;
         dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
@@ -788,7 +1315,68 @@ void Dx12Game::createOrResizeResolutionDependentResources()
         dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
 
         D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        m_device->CreateDepthStencilView(m_depthStencil.Get(), &dsvDesc, cpuHandle);
+        m_device->CreateDepthStencilView(graphTexture(m_depthStencilTexture), &dsvDesc, cpuHandle);
+    }
+}
+
+void Dx12Game::createTransientTextures(const D3D12_RESOURCE_DESC* descs, const D3D12_CLEAR_VALUE* clearValues)
+{
+    for (const ComPtr<ID3D12Resource>& texture : m_transientTextures)
+    {
+        m_stateTracker.Unregister(texture.Get());
+    }
+    m_transientTextures.clear();
+    m_transientTextures.resize(m_renderGraph.ResourceCount());
+    m_transientHeap.Reset();
+    TrackFree(MemoryTag::Renderer, MemorySource::Gpu, m_transientHeapBytes, m_transientHeapBytes ? 1 : 0);
+    m_transientHeapBytes = 0;
+    if (!m_renderGraph.TransientHeapSize())
+    {
+        return;
+    }
+
+    // Resource heap tier 1 keeps render targets and depth stencils apart
+    // from everything else, which are the only transient textures for now
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes = m_renderGraph.TransientHeapSize();
+    heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapDesc.Properties.CreationNodeMask = 1;
+    heapDesc.Properties.VisibleNodeMask = 1;
+    heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+    AssertDx12(m_device->CreateHeap(&heapDesc, IID_PPV_ARGS(m_transientHeap.GetAddressOf())));
+    m_transientHeapBytes = heapDesc.SizeInBytes;
+    TrackAllocation(MemoryTag::Renderer, MemorySource::Gpu, m_transientHeapBytes);
+    #ifdef GPU_DEBUG
+    m_transientHeap->SetName(L"Transient textures");
+    #endif
+
+    for (RenderGraph::Resource resource = 0; resource < m_renderGraph.ResourceCount(); ++resource)
+    {
+        if (m_renderGraph.IsImported(resource) || !m_renderGraph.IsAllocated(resource))
+        {
+            continue;
+        }
+        AssertDx12(m_device->CreatePlacedResource(
+            m_transientHeap.Get(),
+            m_renderGraph.HeapOffset(resource),
+            &descs[resource],
+            Dx12Game_internal::resourceStates(m_renderGraph.InitialState(resource)),
+            clearValues[resource].Format != DXGI_FORMAT_UNKNOWN ? &clearValues[resource] : nullptr,
+            IID_PPV_ARGS(m_transientTextures[resource].GetAddressOf())
+        ));
+        m_stateTracker.Register(
+            m_transientTextures[resource].Get(),
+            descs[resource].MipLevels * descs[resource].DepthOrArraySize,
+            m_renderGraph.InitialState(resource)
+        );
+        #ifdef GPU_DEBUG
+        wchar_t name[64] = {};
+        swprintf_s(name, L"%hs", m_renderGraph.ResourceName(resource));
+        m_transientTextures[resource]->SetName(name);
+        #endif
     }
 }
 
@@ -800,6 +1388,352 @@ void Dx12Game::onDeviceLost()
 
 #pragma endregion
 
+#pragma region Render graph
+
+ID3D12Resource* Dx12Game::graphTexture(RenderGraph::Resource resource) const
+{
+    if (resource == m_backBufferTexture)
+    {
+        return m_renderTargets[m_backBufferIndex].Get();
+    }
+    return m_transientTextures[resource].Get();
+}
+
+void Dx12Game::issueGraphBarriers(const RenderGraph::Barrier* barriers, uint32_t count)
+{
+    // The tracker knows the actual states, the graph only says where to go
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const RenderGraph::Barrier& barrier = barriers[i];
+        switch (barrier.type)
+        {
+        case RenderGraph::BarrierType::Transition:
+            m_stateTracker.Transition(graphTexture(barrier.resource), barrier.after);
+            break;
+        case RenderGraph::BarrierType::Aliasing:
+            m_stateTracker.Aliasing(
+                barrier.previousResource == RenderGraph::NONE ? nullptr : graphTexture(barrier.previousResource),
+                graphTexture(barrier.resource)
+            );
+            break;
+        case RenderGraph::BarrierType::UnorderedAccess:
+            m_stateTracker.UnorderedAccess(graphTexture(barrier.resource));
+            break;
+        }
+    }
+    flushBarriers();
+}
+
+void Dx12Game::flushBarriers()
+{
+    m_stateTracker.Flush([this](const ResourceStateTracker::Barrier* barriers, uint32_t count)
+    {
+        // Reserved with the render graph, never grows here
+        m_barrierBatch.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const ResourceStateTracker::Barrier& barrier = barriers[i];
+            D3D12_RESOURCE_BARRIER& d3dBarrier = m_barrierBatch[i];
+            d3dBarrier = {};
+            d3dBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            switch (barrier.type)
+            {
+            case ResourceStateTracker::BarrierType::Transition:
+                d3dBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+                d3dBarrier.Transition.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+                d3dBarrier.Transition.StateBefore = Dx12Game_internal::resourceStates(barrier.before);
+                d3dBarrier.Transition.StateAfter = Dx12Game_internal::resourceStates(barrier.after);
+                d3dBarrier.Transition.Subresource = barrier.subresource == ResourceStateTracker::ALL_SUBRESOURCES
+                    ? D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+                    : barrier.subresource;
+                break;
+            case ResourceStateTracker::BarrierType::Aliasing:
+                d3dBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+                d3dBarrier.Aliasing.pResourceBefore = static_cast<ID3D12Resource*>(barrier.previousResource);
+                d3dBarrier.Aliasing.pResourceAfter = static_cast<ID3D12Resource*>(barrier.resource);
+                break;
+            case ResourceStateTracker::BarrierType::UnorderedAccess:
+                d3dBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+                d3dBarrier.UAV.pResource = static_cast<ID3D12Resource*>(barrier.resource);
+                break;
+            }
+        }
+        m_directCommandList->ResourceBarrier(count, m_barrierBatch.data());
+    });
+}
+
+#pragma endregion
+
+#pragma region Pipeline cache
+
+void Dx12Game::openPipelineLibrary(uint64_t deviceHash)
+{
+    m_pipelineLibrary.Reset();
+    m_pipelineCache.Load(PIPELINE_CACHE_PATH, deviceHash);
+    const std::vector<uint8_t>& payload = m_pipelineCache.Payload();
+    HRESULT result = m_device->CreatePipelineLibrary(
+        payload.empty() ? nullptr : payload.data(),
+        payload.size(),
+        IID_PPV_ARGS(m_pipelineLibrary.ReleaseAndGetAddressOf())
+    );
+    if (FAILED(result) && !payload.empty())
+    {
+        // Driver rejected the blob (e.g. D3D12_ERROR_DRIVER_VERSION_MISMATCH), start over
+        LOG("Discarding pipeline cache\n");
+        m_pipelineCache.Clear();
+        result = m_device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(m_pipelineLibrary.ReleaseAndGetAddressOf()));
+    }
+    if (FAILED(result))
+    {
+        LOG("Pipeline library unavailable, pipelines will not be cached\n");
+        m_pipelineLibrary.Reset();
+    }
+}
+
+void Dx12Game::savePipelineLibrary()
+{
+    if (!m_pipelineLibrary || !m_pipelineCache.IsDirty())
+    {
+        return;
+    }
+    std::vector<uint8_t> payload(m_pipelineLibrary->GetSerializedSize());
+    AssertDx12(m_pipelineLibrary->Serialize(payload.data(), payload.size()));
+    if (!m_pipelineCache.Save(PIPELINE_CACHE_PATH, payload.data(), payload.size()))
+    {
+        LOG("Unable to write %s\n", PIPELINE_CACHE_PATH);
+    }
+}
+
+ComPtr<ID3D12PipelineState> Dx12Game::createPipelineState(uint64_t key, const D3D12_PIPELINE_STATE_STREAM_DESC& desc)
+{
+    const auto found = m_pipelineStates.find(key);
+    if (found != m_pipelineStates.end())
+    {
+        return found->second;
+    }
+
+    ComPtr<ID3D12PipelineState> pipelineState;
+    if (m_pipelineLibrary && m_pipelineCache.Contains(key) &&
+        SUCCEEDED(m_pipelineLibrary->LoadPipeline(Dx12Game_internal::PipelineName(key).text, &desc, IID_PPV_ARGS(pipelineState.GetAddressOf()))))
+    {
+        ++m_cachedPipelineCount;
+    } else {
+        AssertDx12(m_device->CreatePipelineState(&desc, IID_PPV_ARGS(pipelineState.ReleaseAndGetAddressOf())));
+        ++m_compiledPipelineCount;
+        storePipelineState(key, pipelineState.Get());
+    }
+    m_pipelineStates.emplace(key, pipelineState);
+    return pipelineState;
+}
+
+// The library refuses a name twice, a key already cached is left alone
+void Dx12Game::storePipelineState(uint64_t key, ID3D12PipelineState* pipelineState)
+{
+    if (m_pipelineLibrary && !m_pipelineCache.Contains(key) &&
+        SUCCEEDED(m_pipelineLibrary->StorePipeline(Dx12Game_internal::PipelineName(key).text, pipelineState)))
+    {
+        m_pipelineCache.Insert(key);
+    }
+}
+
+ComPtr<ID3D12PipelineState> Dx12Game::createMainPipelineState(const ShaderLibrary& shaders, bool isCached, uint64_t* key)
+{
+    const ShaderBytecode vertexShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::Vertex, 0>());
+    const ShaderBytecode pixelShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::Pixel, 0>());
+
+    D3D12_RT_FORMAT_ARRAY rtvFormats = {};
+    rtvFormats.NumRenderTargets = 1;
+    rtvFormats.RTFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    auto pipelineStateStream = MakePipelineStateStream(
+        PipelineRootSignature(m_rootSignature.Get()),
+        PipelineInputLayout({ g_meshInputLayout, _countof(g_meshInputLayout) }),
+        PipelinePrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE),
+        PipelineVS({ vertexShader.data, vertexShader.size }),
+        PipelinePS({ pixelShader.data, pixelShader.size }),
+        PipelineDepthStencilFormat(DXGI_FORMAT_D32_FLOAT),
+        PipelineRenderTargetFormats(rtvFormats)
+    );
+    PipelineStateHashes hashes;
+    hashes.rootSignature = m_rootSignatureHash;
+    hashes.vertexShader = vertexShader.hash;
+    hashes.pixelShader = pixelShader.hash;
+    hashes.inputLayout = g_meshInputLayoutHash;
+    *key = pipelineStateStream.Hash(hashes);
+    if (isCached)
+    {
+        return createPipelineState(*key, pipelineStateStream.Desc());
+    }
+    const D3D12_PIPELINE_STATE_STREAM_DESC desc = pipelineStateStream.Desc();
+    ComPtr<ID3D12PipelineState> pipelineState;
+    if (FAILED(m_device->CreatePipelineState(&desc, IID_PPV_ARGS(pipelineState.GetAddressOf()))))
+    {
+        return nullptr;
+    }
+    return pipelineState;
+}
+
+ComPtr<ID3D12PipelineState> Dx12Game::createParticlePipelineState(const ShaderLibrary& shaders, bool isCached, uint64_t* key)
+{
+    const ShaderBytecode vertexShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::ParticleVertex, 0>());
+    const ShaderBytecode pixelShader = shaders.Get(ShaderPermutationIndex<ShaderProgram::Pixel, 0>());
+
+    D3D12_RT_FORMAT_ARRAY rtvFormats = {};
+    rtvFormats.NumRenderTargets = 1;
+    rtvFormats.RTFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    auto pipelineStateStream = MakePipelineStateStream(
+        PipelineRootSignature(m_rootSignature.Get()),
+        PipelineInputLayout({ g_particleInputLayout, _countof(g_particleInputLayout) }),
+        PipelinePrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE),
+        PipelineVS({ vertexShader.data, vertexShader.size }),
+        PipelinePS({ pixelShader.data, pixelShader.size }),
+        PipelineDepthStencilFormat(DXGI_FORMAT_D32_FLOAT),
+        PipelineRenderTargetFormats(rtvFormats)
+    );
+    PipelineStateHashes hashes;
+    hashes.rootSignature = m_rootSignatureHash;
+    hashes.vertexShader = vertexShader.hash;
+    hashes.pixelShader = pixelShader.hash;
+    hashes.inputLayout = g_particleInputLayoutHash;
+    *key = pipelineStateStream.Hash(hashes);
+    if (isCached)
+    {
+        return createPipelineState(*key, pipelineStateStream.Desc());
+    }
+    const D3D12_PIPELINE_STATE_STREAM_DESC desc = pipelineStateStream.Desc();
+    ComPtr<ID3D12PipelineState> pipelineState;
+    if (FAILED(m_device->CreatePipelineState(&desc, IID_PPV_ARGS(pipelineState.GetAddressOf()))))
+    {
+        return nullptr;
+    }
+    return pipelineState;
+}
+
+#pragma endregion
+
+#ifdef DEBUG
+#pragma region Hot reload
+
+void Dx12Game::startShaderReload()
+{
+    const bool isStarted = m_shaderReload.Start(SHADER_SOURCE_DIR, { ".hlsl", ".hlsli" }, [this](ReloadedPipelines* reloaded)
+    {
+        return rebuildShaders(reloaded);
+    });
+    if (!isStarted)
+    {
+        LOG("Unable to watch %s, shaders will not be reloaded\n", SHADER_SOURCE_DIR);
+    }
+}
+
+// Reload thread, the device is free threaded and the root signature does
+// not change after creation
+bool Dx12Game::rebuildShaders(ReloadedPipelines* reloaded)
+{
+    MEMORY_TAG(Renderer);
+    typedef HotReload<ReloadedPipelines>::Clock Clock;
+    const Clock::time_point buildStart = Clock::now();
+    if (system(SHADER_BUILD_COMMAND))
+    {
+        LOG("Shader build failed, keeping the current pipelines\n");
+        return false;
+    }
+    // Read, not mapped, a mapping would keep the next build from replacing the file
+    std::ifstream file(RELOADED_SHADER_LIBRARY_PATH, std::ios::binary | std::ios::ate);
+    std::vector<char> data(file ? static_cast<size_t>(file.tellg()) : 0);
+    file.seekg(0);
+    ShaderLibrary shaders;
+    if (!file.read(data.data(), data.size()) || !shaders.Load(data.data(), data.size()))
+    {
+        LOG("Unable to load %s\n", RELOADED_SHADER_LIBRARY_PATH);
+        return false;
+    }
+    const uint64_t shaderHash = Dx12Game_internal::mainShaderHash(shaders);
+    if (shaderHash == m_pipelineShaderHash)
+    {
+        LOG("Shaders rebuilt, no pipeline uses the changed ones\n");
+        return false;
+    }
+
+    const Clock::time_point pipelineStart = Clock::now();
+    reloaded->pipelineState = createMainPipelineState(shaders, false, &reloaded->pipelineKey);
+    reloaded->particlePipelineState = createParticlePipelineState(shaders, false, &reloaded->particlePipelineKey);
+    if (!reloaded->pipelineState || !reloaded->particlePipelineState)
+    {
+        LOG("Unable to create pipelines from the reloaded shaders\n");
+        return false;
+    }
+    m_pipelineShaderHash = shaderHash;
+    reloaded->buildMilliseconds = std::chrono::duration<double, std::milli>(pipelineStart - buildStart).count();
+    reloaded->pipelineMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - pipelineStart).count();
+    return true;
+}
+
+// Frame boundary, nothing is recorded with the current pipelines yet
+void Dx12Game::swapReloadedPipelines()
+{
+    const UINT64 completedFenceValue = m_directFence->GetCompletedValue();
+    m_retiredPipelineStates.erase(
+        std::remove_if(m_retiredPipelineStates.begin(), m_retiredPipelineStates.end(), [completedFenceValue](const RetiredPipelineState& retired)
+        {
+            return retired.fenceValue <= completedFenceValue;
+        }),
+        m_retiredPipelineStates.end()
+    );
+    if (m_reloadFenceValue && completedFenceValue >= m_reloadFenceValue)
+    {
+        // Seen one frame late at most
+        LOG("Shader change on screen after %.1f ms, build %.1f ms, pipelines %.1f ms\n",
+            std::chrono::duration<double, std::milli>(HotReload<ReloadedPipelines>::Clock::now() - m_reloadChangedAt).count(),
+            m_reloadTimings.buildMilliseconds,
+            m_reloadTimings.pipelineMilliseconds
+        );
+        m_reloadFenceValue = 0;
+    }
+
+    ReloadedPipelines reloaded;
+    if (!m_shaderReload.Take(&reloaded, &m_reloadChangedAt))
+    {
+        return;
+    }
+    // Frames already submitted may still use the old pipelines, the last
+    // of them signals the current value
+    const UINT64 lastSubmittedFenceValue = m_directFenceValues[m_backBufferIndex];
+    replacePipelineState(m_pipelines.Get(m_mainPipeline), std::move(reloaded.pipelineState), reloaded.pipelineKey, lastSubmittedFenceValue);
+    replacePipelineState(m_pipelines.Get(m_particlePipeline), std::move(reloaded.particlePipelineState), reloaded.particlePipelineKey, lastSubmittedFenceValue);
+    // The next start loads the reloaded pipelines instead of compiling them
+    savePipelineLibrary();
+    m_reloadTimings = reloaded;
+    m_reloadFenceValue = lastSubmittedFenceValue + 1;
+}
+
+// Only the main thread touches m_pipelineStates and the pipeline library
+void Dx12Game::replacePipelineState(Pipeline* pipeline, ComPtr<ID3D12PipelineState> pipelineState, uint64_t key, UINT64 lastSubmittedFenceValue)
+{
+    if (key == pipeline->key)
+    {
+        // Its shaders did not change
+        return;
+    }
+    // Dropped from the map too, or the old state would live as long as the game
+    m_pipelineStates.erase(pipeline->key);
+    m_retiredPipelineStates.push_back({ std::move(pipeline->state), lastSubmittedFenceValue });
+    const auto found = m_pipelineStates.find(key);
+    if (found != m_pipelineStates.end())
+    {
+        pipelineState = found->second;
+    } else {
+        storePipelineState(key, pipelineState.Get());
+        m_pipelineStates.emplace(key, pipelineState);
+    }
+    pipeline->state = std::move(pipelineState);
+    pipeline->key = key;
+}
+
+#pragma endregion
+#endif
+
 #pragma region Synchronization
 
 void Dx12Game::moveToNextFrame()
@@ -807,12 +1741,20 @@ void Dx12Game::moveToNextFrame()
     const UINT64 currentFenceValue = ++m_directFenceValues[m_backBufferIndex];
     AssertDx12(m_directCommandQueue->Signal(m_directFence.Get(), currentFenceValue));
     m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
-    if (m_directFence->GetCompletedValue() < m_directFenceValues[m_backBufferIndex])
+    // Not waited for here, the main loop sleeps on m_frameReadyEvent and
+    // the next frame waits if it starts early
+    m_frameReadyFenceValue = m_directFenceValues[m_backBufferIndex];
+    AssertDx12(m_directFence->SetEventOnCompletion(m_frameReadyFenceValue, m_frameReadyEvent.Get()));
+    m_directFenceValues[m_backBufferIndex] = currentFenceValue;
+}
+
+void Dx12Game::waitForFrame()
+{
+    if (m_directFence->GetCompletedValue() < m_frameReadyFenceValue)
     {
-        AssertDx12(m_directFence->SetEventOnCompletion(m_directFenceValues[m_backBufferIndex], m_directFenceEvent.Get()));
+        AssertDx12(m_directFence->SetEventOnCompletion(m_frameReadyFenceValue, m_directFenceEvent.Get()));
         ::WaitForSingleObject(m_directFenceEvent.Get(), INFINITE);
     }
-    m_directFenceValues[m_backBufferIndex] = currentFenceValue;
 }
 
 void Dx12Game::waitForAllGPUOperations()
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+
+#include <d3d12.h>
+
+#include "Hash.h"
+
+// Pipeline state streams composed at compile time:
+//
+//     auto stream = MakePipelineStateStream(
+//         PipelineRootSignature(rootSignature),
+//         PipelineVS(vertexShader),
+//         ...
+//     );
+//     const D3D12_PIPELINE_STATE_STREAM_DESC desc = stream.Desc();
+//     device->CreatePipelineState(&desc, ...);
+//
+// Every subobject is a pointer aligned type tag followed by its value, the
+// same layout the runtime parses, so the stream is just the subobjects laid
+// out one after another. Repeated subobject types are rejected at compile
+// time. Hash() takes what the pointers inside the stream refer to as
+// hashes the caller computed once, so equal pipelines built at different
+// call sites get equal hashes without rehashing bytecode every time.
+template<typename Value, D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type>
+struct alignas(void*) PipelineSubobject
+{
+    static constexpr D3D12_PIPELINE_STATE_SUBOBJECT_TYPE TYPE = Type;
+    typedef Value ValueType;
+
+    D3D12_PIPELINE_STATE_SUBOBJECT_TYPE type = Type;
+    Value value;
+
+    PipelineSubobject() : value() {}
+    PipelineSubobject(const Value& initialValue) : value(initialValue) {}
+};
+
+typedef PipelineSubobject<ID3D12RootSignature*,               D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE>        PipelineRootSignature;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VS>                    PipelineVS;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS>                    PipelinePS;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DS>                    PipelineDS;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_HS>                    PipelineHS;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_GS>                    PipelineGS;
+typedef PipelineSubobject<D3D12_SHADER_BYTECODE,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_CS>                    PipelineCS;
+typedef PipelineSubobject<D3D12_BLEND_DESC,                   D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND>                 PipelineBlend;
+typedef PipelineSubobject<UINT,                               D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK>           PipelineSampleMask;
+typedef PipelineSubobject<D3D12_RASTERIZER_DESC,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER>            PipelineRasterizer;
+typedef PipelineSubobject<D3D12_DEPTH_STENCIL_DESC,           D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL>         PipelineDepthStencil;
+typedef PipelineSubobject<D3D12_INPUT_LAYOUT_DESC,            D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_INPUT_LAYOUT>          PipelineInputLayout;
+typedef PipelineSubobject<D3D12_INDEX_BUFFER_STRIP_CUT_VALUE, D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_IB_STRIP_CUT_VALUE>    PipelineStripCutValue;
+typedef PipelineSubobject<D3D12_PRIMITIVE_TOPOLOGY_TYPE,      D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY>    PipelinePrimitiveTopology;
+typedef PipelineSubobject<D3D12_RT_FORMAT_ARRAY,              D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS> PipelineRenderTargetFormats;
+typedef PipelineSubobject<DXGI_FORMAT,                        D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT>  PipelineDepthStencilFormat;
+typedef PipelineSubobject<DXGI_SAMPLE_DESC,                   D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC>           PipelineSampleDesc;
+typedef PipelineSubobject<UINT,                               D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_NODE_MASK>             PipelineNodeMask;
+typedef PipelineSubobject<D3D12_PIPELINE_STATE_FLAGS,         D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_FLAGS>                 PipelineFlags;
+
+// Of the data the subobjects point to: the serialized root signature, the
+// bytecode of every shader stage, e.g. ShaderBytecode::hash, and the input
+// layout from HashInputLayout(). Stages the stream lacks are ignored.
+struct PipelineStateHashes
+{
+    uint64_t rootSignature = 0;
+    uint64_t vertexShader = 0;
+    uint64_t pixelShader = 0;
+    uint64_t domainShader = 0;
+    uint64_t hullShader = 0;
+    uint64_t geometryShader = 0;
+    uint64_t computeShader = 0;
+    uint64_t inputLayout = 0;
+};
+
+uint64_t HashInputLayout(const D3D12_INPUT_LAYOUT_DESC& inputLayout);
+
+namespace PipelineStateStream_internal
+{
+    // Subobjects one after another. The last one ends the struct, an empty
+    // terminator would add padding the runtime would try to parse.
+    template<typename... Subobjects>
+    struct Storage;
+
+    template<typename Last>
+    struct Storage<Last>
+    {
+        Last first;
+    };
+
+    template<typename First, typename Second, typename... Rest>
+    struct Storage<First, Second, Rest...>
+    {
+        First first;
+        Storage<Second, Rest...> rest;
+    };
+
+    template<typename... Subobjects>
+    constexpr bool hasUniqueTypes()
+    {
+        constexpr D3D12_PIPELINE_STATE_SUBOBJECT_TYPE types[] = { Subobjects::TYPE... };
+        for (size_t i = 0; i < sizeof...(Subobjects); ++i)
+        {
+            for (size_t j = i + 1; j < sizeof...(Subobjects); ++j)
+            {
+                if (types[i] == types[j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Hashes the bytes of the value, only for types without padding, whose
+    // bytes would be whatever the caller's initialization left there.
+    // D3D12_BLEND_DESC and D3D12_DEPTH_STENCIL_DESC have padding after their
+    // UINT8 masks and are hashed field by field below.
+    template<typename T>
+    void hashValue(Hasher* hasher, const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "Value needs its own hashValue");
+        hasher->AddValue(value);
+    }
+
+    void hashValue(Hasher* hasher, const D3D12_BLEND_DESC& blend)
+    {
+        hasher->AddU64(blend.AlphaToCoverageEnable).AddU64(blend.IndependentBlendEnable);
+        for (const D3D12_RENDER_TARGET_BLEND_DESC& target : blend.RenderTarget)
+        {
+            hasher->AddU64(target.BlendEnable)
+                .AddU64(target.LogicOpEnable)
+                .AddU64(target.SrcBlend)
+                .AddU64(target.DestBlend)
+                .AddU64(target.BlendOp)
+                .AddU64(target.SrcBlendAlpha)
+                .AddU64(target.DestBlendAlpha)
+                .AddU64(target.BlendOpAlpha)
+                .AddU64(target.LogicOp)
+                .AddU64(target.RenderTargetWriteMask);
+        }
+    }
+
+    void hashValue(Hasher* hasher, const D3D12_DEPTH_STENCIL_DESC& depthStencil)
+    {
+        hasher->AddU64(depthStencil.DepthEnable)
+            .AddU64(depthStencil.DepthWriteMask)
+            .AddU64(depthStencil.DepthFunc)
+            .AddU64(depthStencil.StencilEnable)
+            .AddU64(depthStencil.StencilReadMask)
+            .AddU64(depthStencil.StencilWriteMask);
+        const D3D12_DEPTH_STENCILOP_DESC faces[] = { depthStencil.FrontFace, depthStencil.BackFace };
+        for (const D3D12_DEPTH_STENCILOP_DESC& face : faces)
+        {
+            hasher->AddU64(face.StencilFailOp)
+                .AddU64(face.StencilDepthFailOp)
+                .AddU64(face.StencilPassOp)
+                .AddU64(face.StencilFunc);
+        }
+    }
+
+    template<typename Subobject>
+    void hashSubobject(Hasher* hasher, const Subobject& subobject, const PipelineStateHashes&)
+    {
+        hashValue(hasher, subobject.value);
+    }
+
+    // Pointers, the caller hashed what they point to
+    void hashSubobject(Hasher* hasher, const PipelineRootSignature&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.rootSignature); }
+    void hashSubobject(Hasher* hasher, const PipelineVS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.vertexShader); }
+    void hashSubobject(Hasher* hasher, const PipelinePS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.pixelShader); }
+    void hashSubobject(Hasher* hasher, const PipelineDS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.domainShader); }
+    void hashSubobject(Hasher* hasher, const PipelineHS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.hullShader); }
+    void hashSubobject(Hasher* hasher, const PipelineGS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.geometryShader); }
+    void hashSubobject(Hasher* hasher, const PipelineCS&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.computeShader); }
+    void hashSubobject(Hasher* hasher, const PipelineInputLayout&, const PipelineStateHashes& hashes) { hasher->AddU64(hashes.inputLayout); }
+
+    template<typename Last>
+    void hashStorage(const Storage<Last>& storage, Hasher* hasher, const PipelineStateHashes& hashes)
+    {
+        hasher->AddU64(Last::TYPE);
+        hashSubobject(hasher, storage.first, hashes);
+    }
+
+    template<typename First, typename Second, typename... Rest>
+    void hashStorage(const Storage<First, Second, Rest...>& storage, Hasher* hasher, const PipelineStateHashes& hashes)
+    {
+        hasher->AddU64(First::TYPE);
+        hashSubobject(hasher, storage.first, hashes);
+        hashStorage(storage.rest, hasher, hashes);
+    }
+
+    template<typename Subobject, typename First, typename... Rest>
+    Subobject& find(Storage<First, Rest...>& storage)
+    {
+        if constexpr (std::is_same<Subobject, First>::value)
+        {
+            return storage.first;
+        } else {
+            static_assert(sizeof...(Rest) > 0, "Subobject is not part of the stream");
+            return find<Subobject>(storage.rest);
+        }
+    }
+}
+
+template<typename... Subobjects>
+class PipelineStateStream final
+{
+public:
+    static_assert(sizeof...(Subobjects) > 0, "Empty pipeline state stream");
+    static_assert(PipelineStateStream_internal::hasUniqueTypes<Subobjects...>(), "Subobject type used twice");
+
+    explicit PipelineStateStream(const Subobjects&... subobjects) : m_storage{ subobjects... } {}
+
+    template<typename Subobject>
+    typename Subobject::ValueType& Get() { return PipelineStateStream_internal::find<Subobject>(m_storage).value; }
+
+    D3D12_PIPELINE_STATE_STREAM_DESC Desc() { return { sizeof(m_storage), &m_storage }; }
+    uint64_t Hash(const PipelineStateHashes& hashes) const;
+
+private:
+    PipelineStateStream_internal::Storage<Subobjects...> m_storage;
+};
+
+template<typename... Subobjects>
+uint64_t PipelineStateStream<Subobjects...>::Hash(const PipelineStateHashes& hashes) const
+{
+    Hasher hasher;
+    PipelineStateStream_internal::hashStorage(m_storage, &hasher, hashes);
+    return hasher.Finish();
+}
+
+template<typename... Subobjects>
+PipelineStateStream<Subobjects...> MakePipelineStateStream(const Subobjects&... subobjects)
+{
+    return PipelineStateStream<Subobjects...>(subobjects...);
+}
+
+uint64_t HashInputLayout(const D3D12_INPUT_LAYOUT_DESC& inputLayout)
+{
+    Hasher hasher;
+    hasher.AddU64(inputLayout.NumElements);
+    for (UINT i = 0; i < inputLayout.NumElements; ++i)
+    {
+        const D3D12_INPUT_ELEMENT_DESC& element = inputLayout.pInputElementDescs[i];
+        hasher.AddString(element.SemanticName)
+            .AddU64(element.SemanticIndex)
+            .AddU64(element.Format)
+            .AddU64(element.InputSlot)
+            .AddU64(element.AlignedByteOffset)
+            .AddU64(element.InputSlotClass)
+            .AddU64(element.InstanceDataStepRate);
+    }
+    return hasher.Finish();
+}
@@ -9,26 +9,36 @@ set "exe_name=%~2"
 set "configuration=%~3"
 
 set "build_dir=%root_dir%build\"
-set "last_build=%build_dir%%exe_name%_last_build.txt"
-set "tmp_file=%build_dir%tmp.txt"
-set "modification_date_exe=%root_dir%scripts\bin\modification_date.exe"
+set "dependencies=%build_dir%%exe_name%.deps"
+set "dependency_cache_exe=%root_dir%scripts\bin\dependency_cache.exe"
 
-if not exist %build_dir% (
-    mkdir %build_dir%
-    goto BUILD
+set "main_file=%~dp0main.cpp"
+set "shared_sources=%root_dir%src\shared"
+set "out_exe=%build_dir%%exe_name%.exe"
+set "out_obj=%build_dir%%exe_name%.obj"
+set "libraties=user32.lib Shell32.lib D3D12.lib DXGI.lib D3DCompiler.lib"
+
+set "flags=/W4 /std:c++17 /D _UNICODE /D UNICODE /D NOMINMAX /D WIN_32_BUILD /I%shared_sources%"
+if "%configuration%"=="terminal" (
+    set "flags=%flags% /D TERMINAL_RUN /D DEBUG /D _DEBUG /D GPU_DEBUG /D HEAP_ALLOCATION_CHECKS /D MEMORY_TRACKING /D CULL_STATS"
+    set "libraties=%libraties% dxguid.lib"
+) else if "%configuration%"=="debug" (
+    set "flags=%flags% /Zi /D DEBUG /D _DEBUG /D GPU_DEBUG /D HEAP_ALLOCATION_CHECKS /D MEMORY_TRACKING"
+    set "libraties=%libraties% dxguid.lib"
+) else if not "%configuration%"=="release" (
+    echo Unknown configuration "%configuration%". Possible: "terminal", "debug", "release"
+    exit /b 1
 )
 
-if not exist %last_build% (
-    goto BUILD
+if not exist %build_dir% (
+    mkdir %build_dir%
 )
 
-%modification_date_exe% %root_dir%src\ > %tmp_file%
-if errorlevel 1 (
-    echo Unable to check date of the changes
+%dependency_cache_exe% check "%dependencies%" "%flags% %libraties%" -o "%out_exe%" -I "%shared_sources%" "%main_file%"
+if errorlevel 2 (
+    echo Unable to check dependencies
     exit /b 1
-)
-fc %tmp_file%  %last_build%  >nul
-if errorlevel 1 (
+) else if errorlevel 1 (
     goto BUILD
 ) else (
     goto END
@@ -38,38 +48,16 @@ if errorlevel 1 (
 
 echo Compiling sources
 
-set "main_file=%~dp0main.cpp"
-set "shared_sources=%root_dir%src\shared"
-set "out_exe=%build_dir%%exe_name%.exe"
-set "out_obj=%build_dir%%exe_name%.obj"
-set "libraties=user32.lib D3D12.lib DXGI.lib D3DCompiler.lib"
-
 if exist %out_exe% (
     del %out_exe%
 )
 
-
-set "flags=/W4 /D _UNICODE /D UNICODE /D NOMINMAX /D WIN_32_BUILD /I%shared_sources%"
-if "%configuration%"=="terminal" (
-    set "flags=%flags% /D TERMINAL_RUN /D DEBUG /D _DEBUG /D GPU_DEBUG"
-    set "libraties=%libraties% dxguid.lib"
-) else if "%configuration%"=="debug" (
-    set "flags=%flags% /Zi /D DEBUG /D _DEBUG /D GPU_DEBUG"
-    set "libraties=%libraties% dxguid.lib"
-) else if not "%configuration%"=="release" (
-    echo Unknown configuration "%configuration%". Possible: "terminal", "debug", "release"
-    exit /b 1
-)
-
 cl %main_file% %flags% /Fo"%out_obj%" /Fe"%out_exe%" %libraties%
 if errorlevel 1 (
     exit /b 1
 )
-%modification_date_exe% %~dp0 > %last_build%
+%dependency_cache_exe% update "%dependencies%" "%flags% %libraties%" -o "%out_exe%" -I "%shared_sources%" "%main_file%"
 
 :END
-if exist %tmp_file% (
-    del %tmp_file%
-)
 exit /b 0
 
@@ -5,21 +5,91 @@
 
 
 #include <Windows.h>
+#include <windowsx.h>
+#include <shellapi.h>
 
 #include <DirectXMath.h>
 
 #include "diagnostics.h"
 #include "Dx12Game.h"
+#include "EventLoop.h"
+#include "Jobs.h"
+#include "MemoryTracker.h"
+#include "Replay.h"
 
+#include <filesystem>
 #include <tuple>
 
+// Ticks run at most about this late, the part of a wait before it sleeps
+static constexpr uint64_t TICK_JITTER_NANOSECONDS = 1000000;
 
+// Over every source, the renderer's includes GPU memory
+static constexpr uint64_t SIMULATION_MEMORY_BUDGET = 64ull << 20;
+static constexpr uint64_t RENDERER_MEMORY_BUDGET = 512ull << 20;
+static constexpr uint64_t LOGGER_MEMORY_BUDGET = 1ull << 20;
+
+
+void queueInput(HWND windowHandle, InputEventType type, uint32_t code, int32_t x, int32_t y)
+{
+    Dx12Game* renderer = reinterpret_cast<Dx12Game*>(GetWindowLongPtr(windowHandle, GWLP_USERDATA));
+    if (renderer)
+    {
+        renderer->QueueInput({ EventLoop::Now(), type, code, x, y });
+    }
+}
 
 LRESULT CALLBACK WindowProc(HWND windowHandle, UINT message, WPARAM wParam, LPARAM lParam)
 {
     static bool sInSizeMove = false;   
     switch (message)
     {
+    case WM_KEYDOWN:
+    case WM_SYSKEYDOWN:
+    {
+        // Bit 30 is set for auto repeats of a held key
+        if (!(lParam & (1 << 30)))
+        {
+            queueInput(windowHandle, InputEventType::KeyDown, static_cast<uint32_t>(wParam), 0, 0);
+        }
+        break;
+    }
+    case WM_KEYUP:
+    case WM_SYSKEYUP:
+    {
+        queueInput(windowHandle, InputEventType::KeyUp, static_cast<uint32_t>(wParam), 0, 0);
+        break;
+    }
+    case WM_MOUSEMOVE:
+    {
+        queueInput(windowHandle, InputEventType::MouseMove, 0, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+        break;
+    }
+    case WM_LBUTTONDOWN:
+    case WM_RBUTTONDOWN:
+    case WM_MBUTTONDOWN:
+    case WM_LBUTTONUP:
+    case WM_RBUTTONUP:
+    case WM_MBUTTONUP:
+    {
+        const bool isDown = message == WM_LBUTTONDOWN || message == WM_RBUTTONDOWN || message == WM_MBUTTONDOWN;
+        const uint32_t button =
+            message == WM_LBUTTONDOWN || message == WM_LBUTTONUP ? MOUSE_BUTTON_LEFT :
+            message == WM_RBUTTONDOWN || message == WM_RBUTTONUP ? MOUSE_BUTTON_RIGHT :
+            MOUSE_BUTTON_MIDDLE;
+        queueInput(
+            windowHandle,
+            isDown ? InputEventType::MouseButtonDown : InputEventType::MouseButtonUp,
+            button,
+            GET_X_LPARAM(lParam),
+            GET_Y_LPARAM(lParam)
+        );
+        break;
+    }
+    case WM_MOUSEWHEEL:
+    {
+        queueInput(windowHandle, InputEventType::MouseWheel, 0, 0, GET_WHEEL_DELTA_WPARAM(wParam));
+        break;
+    }
     case WM_CREATE:
     {
         if (lParam)
@@ -112,6 +182,28 @@ void setWorkingDirectory()
     SetCurrentDirectoryW(buffer);
 }
 
+// The path after -record, absolute as the working directory changes, or
+// empty
+std::filesystem::path recordPathArgument()
+{
+    int argumentCount = 0;
+    LPWSTR* arguments = CommandLineToArgvW(GetCommandLineW(), &argumentCount);
+    if (!arguments)
+    {
+        return {};
+    }
+    std::filesystem::path path;
+    for (int argument = 1; argument + 1 < argumentCount; ++argument)
+    {
+        if (!wcscmp(arguments[argument], L"-record"))
+        {
+            path = std::filesystem::absolute(arguments[argument + 1]);
+        }
+    }
+    LocalFree(arguments);
+    return path;
+}
+
 #ifdef TERMINAL_RUN
 int main(int argc, char* argv[])
 {
@@ -126,11 +218,18 @@ int CALLBACK wWinMain(HINSTANCE appInstance, HINSTANCE hPrevInstance, PWSTR lpCm
     UNREFERENCED_PARAMETER(lpCmdLine);
 #endif
     SetupDiagnostics();
+    SetMemoryBudget(MemoryTag::Simulation, SIMULATION_MEMORY_BUDGET);
+    SetMemoryBudget(MemoryTag::Renderer, RENDERER_MEMORY_BUDGET);
+    SetMemoryBudget(MemoryTag::Logger, LOGGER_MEMORY_BUDGET);
+    const std::filesystem::path recordPath = recordPathArgument();
     setWorkingDirectory();
     SetThreadDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
 
     Dx12Game dx12Game;
     Game game;
+    JobSystem jobs;
+    jobs.Initialize();
+    game.jobs = &jobs;
 
     {
         int width = 800; int height = 600;
@@ -188,30 +287,65 @@ int CALLBACK wWinMain(HINSTANCE appInstance, HINSTANCE hPrevInstance, PWSTR lpCm
         ShowWindow(windowHandle, cmdShow);
     }
     
-    MSG msg = {};
+    EventLoop eventLoop;
+    {
+        EventLoop::Config eventLoopConfig;
+        eventLoopConfig.spinNanoseconds = TICK_JITTER_NANOSECONDS;
+        if (!eventLoop.Initialize(eventLoopConfig))
+        {
+            LOG("Unable to create event loop\n");
+            return 1;
+        }
+        eventLoop.AddSource(dx12Game.FrameReadyEvent());
+    }
 
-    LARGE_INTEGER previousTimestamp, currentTimestamp;
-    LARGE_INTEGER frequency;
-    QueryPerformanceFrequency(&frequency);
+    // Replayed by scripts/src/replay_game.cpp
+    ReplayWriter recorder;
+    game.seed = EventLoop::Now();
+    if (!recordPath.empty())
+    {
+        if (!recorder.Open(recordPath, game.seed, Game::TICK_NANOSECONDS))
+        {
+            LOG("Unable to record to %ls\n", recordPath.c_str());
+            return 1;
+        }
+        game.recorder = &recorder;
+    }
 
-    QueryPerformanceCounter(&previousTimestamp);
+    MSG msg = {};
+    uint64_t nextTick = EventLoop::Now() + Game::TICK_NANOSECONDS;
     while (WM_QUIT != msg.message)
     {
         if (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE))
         {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
-        } else {
-            QueryPerformanceCounter(&currentTimestamp);
-            LONGLONG numberOfTicks = (currentTimestamp.QuadPart - previousTimestamp.QuadPart) * 60 / (frequency.QuadPart);
-            if (numberOfTicks)
-            {
-                std::swap(previousTimestamp, currentTimestamp);
-            }
-            dx12Game.ProcessTicks(static_cast<uint64_t>(numberOfTicks));
+            continue;
+        }
+        const uint64_t now = EventLoop::Now();
+        #ifdef MEMORY_TRACKING
+        ReportMemory(now, [](const char* line) { LOG("%s", line); });
+        #endif
+        if (now >= nextTick)
+        {
+            const uint64_t numberOfTicks = 1 + (now - nextTick) / Game::TICK_NANOSECONDS;
+            dx12Game.ProcessTicks(numberOfTicks, nextTick);
+            nextTick += numberOfTicks * Game::TICK_NANOSECONDS;
+        }
+        if (dx12Game.IsFrameReady() && !dx12Game.IsOccluded())
+        {
             dx12Game.RenderAndWaitForVSync();
+        } else {
+            // Until a message, the GPU freeing the back buffer or the next tick
+            eventLoop.Wait(nextTick);
         }
     }
+
+    if (!recorder.Close())
+    {
+        LOG("Unable to write the recording %ls\n", recordPath.c_str());
+    }
+    game.recorder = nullptr;
     
     return static_cast<int>(msg.wParam);
 }
\ No newline at end of file